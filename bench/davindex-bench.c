@@ -0,0 +1,149 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* What the .dav sidecar index saves a seek in a local recording.
+ *
+ * A generated .dav is written to a temporary directory, then timed:
+ * building its index by walking every frame, which a seek without a
+ * sidecar costs, against mapping the saved sidecar and looking a position
+ * up in it, which is what a seek costs with one. The walk is the same one
+ * dmssdemux does over a pulled file, here over a mapping of a file that
+ * was just written, so the page cache is warm and it is a lower bound.
+ *
+ *   b2 davindex-bench && davindex-bench --frames=90000 --frame-size=16384
+ */
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include "gstdmssdavindex.h"
+#include "gstdmssdhavgen.h"
+
+#include <errno.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+static gint n_frames = 45000;
+static gint frame_size = 16 * 1024;
+static gint gop = 50;
+static gint rounds = 20;
+
+static GOptionEntry entries[] = {
+  {"frames", 0, 0, G_OPTION_ARG_INT, &n_frames, "Frames in the file", "N"},
+  {"frame-size", 0, 0, G_OPTION_ARG_INT, &frame_size, "Bytes per frame",
+      "N"},
+  {"gop", 0, 0, G_OPTION_ARG_INT, &gop, "Frames per keyframe", "N"},
+  {"rounds", 0, 0, G_OPTION_ARG_INT, &rounds, "Times each step is run",
+      "N"},
+  {NULL}
+};
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GstDmssDavIndex *index;
+  GstDmssDavKeyframe keyframe;
+  GByteArray *stream;
+  GStatBuf stat_buf;
+  GError *err = NULL;
+  gchar *dir, *path, *sidecar;
+  gint64 start, build = 0, load = 0, lookup = 0;
+  guint n_keyframes = 0;
+  gint i;
+
+  context = g_option_context_new ("- time the .dav sidecar index");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  n_frames = MAX (n_frames, 1);
+  frame_size = CLAMP (frame_size, 64, 8 * 1024 * 1024);
+  rounds = MAX (rounds, 1);
+
+  if (!(dir = g_dir_make_tmp ("davindex-bench-XXXXXX", &err))) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  path = g_build_filename (dir, "bench.dav", NULL);
+  sidecar = gst_dmss_dav_index_sidecar_path (path);
+
+  stream = gst_dmss_dhav_gen_stream (n_frames, frame_size, gop);
+  if (!g_file_set_contents (path, (const gchar *) stream->data, stream->len,
+          &err) || g_stat (path, &stat_buf) < 0) {
+    g_printerr ("Failed to write %s: %s\n", path,
+        err ? err->message : g_strerror (errno));
+    return 1;
+  }
+  g_byte_array_unref (stream);
+
+  for (i = 0; i != rounds; ++i) {
+    start = g_get_monotonic_time ();
+    if (!(index = gst_dmss_dav_index_build (path, &err))) {
+      g_printerr ("Failed to index %s: %s\n", path, err->message);
+      return 1;
+    }
+    build += g_get_monotonic_time () - start;
+    n_keyframes = gst_dmss_dav_index_get_n_keyframes (index);
+    if (!i && !gst_dmss_dav_index_save (index, sidecar, &err)) {
+      g_printerr ("Failed to save %s: %s\n", sidecar, err->message);
+      return 1;
+    }
+    gst_dmss_dav_index_free (index);
+  }
+
+  for (i = 0; i != rounds; ++i) {
+    start = g_get_monotonic_time ();
+    if (!(index = gst_dmss_dav_index_load (sidecar, stat_buf.st_size,
+                stat_buf.st_mtime, &err))) {
+      g_printerr ("Failed to load %s: %s\n", sidecar, err->message);
+      return 1;
+    }
+    load += g_get_monotonic_time () - start;
+
+    // a seek to the middle, the lookup a sidecar turns it into
+    start = g_get_monotonic_time ();
+    gst_dmss_dav_index_lookup (index,
+        gst_dmss_dav_index_get_duration (index) / 2, &keyframe);
+    lookup += g_get_monotonic_time () - start;
+    gst_dmss_dav_index_free (index);
+  }
+
+  g_print ("%" G_GINT64_FORMAT " bytes, %d frames of %d, %u keyframes\n",
+      (gint64) stat_buf.st_size, n_frames, frame_size, n_keyframes);
+  g_print ("  build  %10.3f ms %10.1f MB/s\n", build / 1000.0 / rounds,
+      (gdouble) stat_buf.st_size * rounds / MAX (build, 1));
+  g_print ("  load   %10.3f ms\n", load / 1000.0 / rounds);
+  g_print ("  lookup %10.3f ms\n", lookup / 1000.0 / rounds);
+
+  g_unlink (sidecar);
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (sidecar);
+  g_free (path);
+  g_free (dir);
+
+  return 0;
+}
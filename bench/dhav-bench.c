@@ -0,0 +1,285 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Frames per second through dmssdemux, fed the way dmsssrc feeds it.
+ *
+ * A synthetic stream is pushed into the demux in push mode as one 0xbc
+ * packet per buffer, at the body sizes devices are seen to use, and once
+ * more with a frame mangled every so often to measure the resync path.
+ * Each run goes over the stream again until it took min-time.
+ *
+ * The demux is only reached through its factory and the properties it
+ * has, so the same bench measures any build of the plugin. Run it with
+ * --plugin on the library of the parent commit for the "before" numbers:
+ *
+ *   b2 stage dhav-bench && dhav-bench --plugin=stage/libgstdmss.so
+ */
+
+#include <gst/gst.h>
+#include "gstdmssdhavgen.h"
+
+#include <string.h>
+
+static gint n_frames = 10000;
+static gint frame_size = 16 * 1024;
+static gint gop = 50;
+static gint corrupt_every = 16;
+static gdouble min_time = 2.0;
+static gchar *plugin_path = NULL;
+
+static GOptionEntry entries[] = {
+  {"frames", 0, 0, G_OPTION_ARG_INT, &n_frames, "Frames per run", "N"},
+  {"frame-size", 0, 0, G_OPTION_ARG_INT, &frame_size,
+      "Bytes per DHAV frame", "N"},
+  {"gop", 0, 0, G_OPTION_ARG_INT, &gop, "Frames per keyframe", "N"},
+  {"corrupt-every", 0, 0, G_OPTION_ARG_INT, &corrupt_every,
+      "Mangle one frame in N in the resync run", "N"},
+  {"min-time", 0, 0, G_OPTION_ARG_DOUBLE, &min_time,
+      "Seconds each run takes at least, the demux rates the copies per "
+        "second once one is over", "S"},
+  {"plugin", 0, 0, G_OPTION_ARG_FILENAME, &plugin_path,
+      "Plugin library to measure instead of the one in the registry", "PATH"},
+  {NULL}
+};
+
+typedef struct
+{
+  guint64 frames;
+  guint64 bytes;
+} DhavBenchCount;
+
+static GstFlowReturn
+count_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  DhavBenchCount *count = gst_pad_get_element_private (pad);
+
+  count->frames++;
+  count->bytes += gst_buffer_get_size (buffer);
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+count_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  gst_event_unref (event);
+  return TRUE;
+}
+
+/* A file or a download, never live, so the demux times by DHAV alone */
+static gboolean
+feed_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY)
+    return FALSE;
+
+  gst_query_set_latency (query, FALSE, 0, GST_CLOCK_TIME_NONE);
+  return TRUE;
+}
+
+/* Pushes every packet of packets, one per buffer */
+static GstFlowReturn
+push_packets (GstPad * pad, GByteArray * packets)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize offset, length;
+
+  for (offset = 0; ret == GST_FLOW_OK && offset < packets->len;
+      offset += length) {
+    length = MIN (32 + GST_READ_UINT32_LE (packets->data + offset + 4),
+        packets->len - offset);
+    ret = gst_pad_push (pad, gst_buffer_new_wrapped_full
+        (GST_MEMORY_FLAG_READONLY, packets->data + offset, length, 0, length,
+            NULL, NULL));
+  }
+
+  return ret;
+}
+
+static gboolean
+run (const gchar * name, GByteArray * packets)
+{
+  GstElement *demux;
+  GObjectClass *klass;
+  GstPad *feed, *count_pad, *sinkpad = NULL, *videopad = NULL;
+  GstStructure *stats = NULL;
+  DhavBenchCount count = { 0, };
+  GstSegment segment;
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint64 memcpy_rate = 0, skipped = 0, pushed = 0;
+  gint64 start, elapsed;
+  gboolean has_memcpy_rate, has_stats;
+
+  if (!(demux = gst_element_factory_make ("dmssdemux", NULL))) {
+    g_printerr ("%s: no dmssdemux, see --plugin\n", name);
+    return FALSE;
+  }
+  gst_object_ref_sink (demux);
+  // older builds don't have these
+  klass = G_OBJECT_GET_CLASS (demux);
+  has_memcpy_rate = g_object_class_find_property (klass, "memcpy-rate")
+      != NULL;
+  has_stats = g_object_class_find_property (klass, "stats") != NULL;
+
+  feed = gst_pad_new ("feed", GST_PAD_SRC);
+  gst_pad_set_query_function (feed, feed_query);
+  count_pad = gst_pad_new ("count", GST_PAD_SINK);
+  gst_pad_set_element_private (count_pad, &count);
+  gst_pad_set_chain_function (count_pad, count_chain);
+  gst_pad_set_event_function (count_pad, count_event);
+
+  sinkpad = gst_element_get_static_pad (demux, "sink");
+  videopad = gst_element_get_static_pad (demux, "video");
+  if (gst_pad_link (feed, sinkpad) != GST_PAD_LINK_OK
+      || gst_pad_link (videopad, count_pad) != GST_PAD_LINK_OK) {
+    g_printerr ("%s: could not link the demux\n", name);
+    ret = GST_FLOW_NOT_LINKED;
+    goto done;
+  }
+  gst_pad_set_active (count_pad, TRUE);
+  gst_pad_set_active (feed, TRUE);
+  gst_element_set_state (demux, GST_STATE_PLAYING);
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (feed, gst_event_new_stream_start ("dhav-bench"));
+  gst_pad_push_event (feed, gst_event_new_caps (gst_caps_from_string
+          ("application/x-dmss")));
+  gst_pad_push_event (feed, gst_event_new_segment (&segment));
+
+  start = g_get_monotonic_time ();
+  do {
+    ret = push_packets (feed, packets);
+    pushed += packets->len;
+    elapsed = g_get_monotonic_time () - start;
+  } while (ret == GST_FLOW_OK && elapsed < min_time * G_USEC_PER_SEC);
+  gst_pad_push_event (feed, gst_event_new_eos ());
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  if (has_memcpy_rate)
+    g_object_get (demux, "memcpy-rate", &memcpy_rate, NULL);
+  if (has_stats)
+    g_object_get (demux, "stats", &stats, NULL);
+  if (stats) {
+    gst_structure_get_uint64 (stats, "bytes-skipped", &skipped);
+    gst_structure_free (stats);
+  }
+
+  gst_element_set_state (demux, GST_STATE_NULL);
+  gst_pad_set_active (feed, FALSE);
+  gst_pad_set_active (count_pad, FALSE);
+
+  if (ret != GST_FLOW_OK && ret != GST_FLOW_EOS)
+    g_printerr ("%s: %s\n", name, gst_flow_get_name (ret));
+  g_print ("%-14s %10.0f frames/s %8.1f MB/s %8" G_GUINT64_FORMAT " frames",
+      name, count.frames * 1e6 / elapsed, pushed / (gdouble) elapsed,
+      count.frames);
+  if (has_stats)
+    g_print (" %10" G_GUINT64_FORMAT " bytes skipped", skipped);
+  // the rate covers the last whole second, a shorter run has none yet
+  if (has_memcpy_rate && elapsed > G_USEC_PER_SEC)
+    g_print (" %8.1f MB/s copied", memcpy_rate / 1e6);
+  g_print ("\n");
+
+done:
+  if (videopad)
+    gst_object_unref (videopad);
+  if (sinkpad)
+    gst_object_unref (sinkpad);
+  gst_object_unref (count_pad);
+  gst_object_unref (feed);
+  gst_object_unref (demux);
+
+  return ret == GST_FLOW_OK || ret == GST_FLOW_EOS;
+}
+
+static gboolean
+run_packets (const gchar * name, GByteArray * stream, gsize body_size)
+{
+  GByteArray *packets;
+  gboolean ok;
+
+  packets = gst_dmss_dhav_gen_packets (stream->data, stream->len, body_size);
+  ok = run (name, packets);
+  g_byte_array_unref (packets);
+
+  return ok;
+}
+
+/* Spoils the magic of one frame in every, so the demux has to resync */
+static GByteArray *
+corrupt_stream (GByteArray * stream, guint every)
+{
+  GByteArray *copy = g_byte_array_sized_new (stream->len);
+  gsize offset;
+  guint i;
+
+  g_byte_array_append (copy, stream->data, stream->len);
+  for (offset = 0, i = 0; offset < copy->len; ++i) {
+    if (every > 1 && i % every == every - 1)
+      copy->data[offset] = 'X';
+    offset += GST_READ_UINT32_LE (copy->data + offset + 12);
+  }
+
+  return copy;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GByteArray *stream, *corrupt;
+  GstPlugin *plugin;
+  GError *err = NULL;
+  gboolean ok;
+
+  context = g_option_context_new ("- measure DHAV parsing in dmssdemux");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (plugin_path) {
+    if (!(plugin = gst_plugin_load_file (plugin_path, &err))) {
+      g_printerr ("%s\n", err->message);
+      return 1;
+    }
+    gst_object_unref (plugin);
+  }
+
+  stream = gst_dmss_dhav_gen_stream (MAX (n_frames, 1), CLAMP (frame_size,
+          64, 8 * 1024 * 1024), gop);
+  corrupt = corrupt_stream (stream, MAX (corrupt_every, 0));
+
+  g_print ("%d frames of %d bytes, a keyframe every %d\n", n_frames,
+      frame_size, gop);
+  ok = run_packets ("packets 1400", stream, 1400)
+      && run_packets ("packets 8K", stream, 8 * 1024)
+      && run_packets ("packets 64K", stream, G_MAXUINT16)
+      && run_packets ("resync 8K", corrupt, 8 * 1024);
+
+  g_byte_array_unref (corrupt);
+  g_byte_array_unref (stream);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Throughput of the DHAV sync word scanner, each variant the build has
+ * against memmem and a byte at a time loop.
+ *
+ * Two buffers without a match are scanned end to end, the worst case of a
+ * resync: uniform random bytes, which is what compressed video looks like,
+ * and bytes dense in "DHA" prefixes, which defeats the memchr in the
+ * scalar loop.
+ *
+ *   b2 dhavscan-bench && dhavscan-bench --size=1048576 --rounds=2000
+ */
+
+/* for memmem */
+#define _GNU_SOURCE
+
+/* included, like tests/dhavscan.c, to reach the static variants */
+#include "gstdmssdhavscan.c"
+
+static gint size = 1024 * 1024;
+static gint rounds = 1000;
+
+static GOptionEntry entries[] = {
+  {"size", 0, 0, G_OPTION_ARG_INT, &size, "Bytes per buffer", "N"},
+  {"rounds", 0, 0, G_OPTION_ARG_INT, &rounds, "Scans per variant", "N"},
+  {NULL}
+};
+
+typedef gsize (*DhavScanFunc) (const guint8 * data, gsize size);
+
+static gsize
+naive_scan (const guint8 * data, gsize size)
+{
+  gsize i;
+
+  for (i = 0; i + 4 <= size; ++i)
+    if (data[i] == 'D' && data[i + 1] == 'H' && data[i + 2] == 'A'
+        && data[i + 3] == 'V')
+      return i;
+
+  return size;
+}
+
+static gsize
+memmem_scan (const guint8 * data, gsize size)
+{
+  const guint8 *found = memmem (data, size, "DHAV", 4);
+
+  return found ? (gsize) (found - data) : size;
+}
+
+static gsize
+scalar_scan (const guint8 * data, gsize size)
+{
+  return gst_dmss_dhav_scan_scalar (data, size, 0);
+}
+
+static void
+run (const gchar * name, DhavScanFunc scan, const guint8 * data)
+{
+  volatile gsize found = 0;
+  gint64 start, elapsed;
+  gint i;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i != rounds; ++i)
+    found += scan (data, size);
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  g_assert (found == (gsize) size * rounds);
+  g_print ("  %-10s %10.1f MB/s\n", name,
+      (gdouble) size * rounds / elapsed);
+}
+
+static void
+run_all (const gchar * name, const guint8 * data)
+{
+  g_print ("%s\n", name);
+  run ("dispatch", gst_dmss_dhav_scan, data);
+#ifdef DMSS_DHAV_SCAN_AVX2
+  if (__builtin_cpu_supports ("avx2"))
+    run ("avx2", gst_dmss_dhav_scan_avx2, data);
+#endif
+#ifdef DMSS_DHAV_SCAN_SSE2
+  run ("sse2", gst_dmss_dhav_scan_sse2, data);
+#endif
+#ifdef DMSS_DHAV_SCAN_NEON
+  run ("neon", gst_dmss_dhav_scan_neon, data);
+#endif
+  run ("scalar", scalar_scan, data);
+  run ("memmem", memmem_scan, data);
+  run ("naive", naive_scan, data);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GError *err = NULL;
+  guint8 *random, *dense;
+  GRand *rand;
+  gint i;
+
+  context = g_option_context_new ("- measure the DHAV sync word scanner");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (context);
+  size = MAX (size, 4);
+  rounds = MAX (rounds, 1);
+
+  random = g_malloc (size);
+  dense = g_malloc (size);
+  rand = g_rand_new_with_seed (0x44484156);
+  for (i = 0; i != size; ++i) {
+    random[i] = g_rand_int (rand);
+    // a "DHA" every four bytes, never followed by the 'V'
+    dense[i] = "DHAx"[i % 4];
+  }
+  for (i = 0; i + 4 <= size; ++i)
+    if (!memcmp (random + i, "DHAV", 4))
+      random[i] = 'x';
+  g_rand_free (rand);
+
+  run_all ("random bytes", random);
+  run_all ("dense prefixes", dense);
+
+  g_free (dense);
+  g_free (random);
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Runs the mock device on its own, so dmsssrc or another client can be
+ * pointed at it:
+ *
+ *   dmss-mock-server --port=37778 &
+ *   uring-bench, or any reader of the port
+ */
+
+#include <gio/gio.h>
+#include "gstdmssmock.h"
+
+static gint port = 37778;
+static gint frame_size = 64 * 1024;
+static gint body_size = 8 * 1024;
+static gint64 total = 256 * 1024 * 1024;
+
+static GOptionEntry entries[] = {
+  {"port", 0, 0, G_OPTION_ARG_INT, &port, "Port to listen on", "N"},
+  {"frame-size", 0, 0, G_OPTION_ARG_INT, &frame_size,
+      "Bytes per DHAV frame", "N"},
+  {"body-size", 0, 0, G_OPTION_ARG_INT, &body_size,
+      "Bytes per packet body, at most 65535", "N"},
+  {"bytes", 0, 0, G_OPTION_ARG_INT64, &total,
+      "Bytes sent to each connection", "N"},
+  {NULL}
+};
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GstDmssMock *mock;
+  GMainLoop *loop;
+  GError *err = NULL;
+
+  context = g_option_context_new ("- serve DHAV packets like a device");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (!(mock = gst_dmss_mock_new (CLAMP (port, 0, G_MAXUINT16), frame_size,
+              CLAMP (body_size, 1, G_MAXUINT16), total, &err))) {
+    g_printerr ("Failed to start the mock device: %s\n", err->message);
+    return 1;
+  }
+  g_print ("Listening on 127.0.0.1:%u\n", gst_dmss_mock_get_port (mock));
+
+  loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (loop);
+
+  g_main_loop_unref (loop);
+  gst_dmss_mock_free (mock);
+
+  return 0;
+}
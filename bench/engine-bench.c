@@ -0,0 +1,249 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Compares the shared epoll engine of receive-mode=shared with a blocking
+ * socket per stream, the way receive-mode=pool reads, against the mock
+ * device on the loopback.
+ *
+ * Many cameras at once is what the engine is for, so --streams
+ * connections are read at the same time, each popped by a thread of its
+ * own like the streaming thread of one dmsssrc. Reported are the total
+ * rate and the receive syscalls per packet.
+ *
+ *   b2 engine-bench && engine-bench --streams=64 --bytes=67108864
+ */
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include "gstdmssioengine.h"
+#include "gstdmssmock.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+static gint n_streams = 16;
+static gint frame_size = 64 * 1024;
+static gint body_size = 8 * 1024;
+static gint64 total = 64 * 1024 * 1024;
+
+static GOptionEntry entries[] = {
+  {"streams", 0, 0, G_OPTION_ARG_INT, &n_streams,
+      "Connections read at once", "N"},
+  {"frame-size", 0, 0, G_OPTION_ARG_INT, &frame_size,
+      "Bytes per DHAV frame", "N"},
+  {"body-size", 0, 0, G_OPTION_ARG_INT, &body_size,
+      "Bytes per packet body, at most 65535", "N"},
+  {"bytes", 0, 0, G_OPTION_ARG_INT64, &total, "Bytes per stream", "N"},
+  {NULL}
+};
+
+typedef struct
+{
+  GSocketConnection *connection;
+  GstDmssIoStream *io_stream;
+  GThread *thread;
+  guint64 packets;
+  guint64 bytes;
+  guint64 syscalls;
+  GError *error;
+} BenchStream;
+
+static gboolean
+receive_exact (GSocket * socket, gchar * data, gsize size,
+    BenchStream * stream, GError ** err)
+{
+  gssize received;
+
+  while (size) {
+    stream->syscalls++;
+    if ((received = g_socket_receive (socket, data, size, NULL, err)) <= 0) {
+      if (!received)
+        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+            "Connection closed by remote peer");
+      return FALSE;
+    }
+    data += received;
+    size -= received;
+  }
+
+  return TRUE;
+}
+
+/* header and body read apart, like gst_dmss_src_receive_pooled */
+static GstFlowReturn
+receive_gsocket (GSocket * socket, GstBuffer ** outbuf, BenchStream * stream,
+    GError ** err)
+{
+  gchar header[32];
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize size;
+
+  if (!receive_exact (socket, header, sizeof (header), stream, err))
+    return GST_FLOW_ERROR;
+
+  size = GST_READ_UINT16_LE (&header[4]);
+  buffer = gst_buffer_new_allocate (NULL, sizeof (header) + size, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  memcpy (map.data, header, sizeof (header));
+  if (!receive_exact (socket, (gchar *) & map.data[sizeof (header)], size,
+          stream, err)) {
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  *outbuf = buffer;
+  return GST_FLOW_OK;
+}
+
+/* Reads one stream to the end */
+static gpointer
+stream_func (gpointer user_data)
+{
+  BenchStream *stream = user_data;
+  GSocket *socket = g_socket_connection_get_socket (stream->connection);
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+
+  while (TRUE) {
+    if (stream->io_stream) {
+      ret = gst_dmss_io_stream_pop (stream->io_stream, &buffer,
+          &stream->error);
+      stream->syscalls += gst_dmss_io_stream_take_syscalls (stream->io_stream);
+    } else {
+      ret = receive_gsocket (socket, &buffer, stream, &stream->error);
+    }
+    if (ret != GST_FLOW_OK)
+      break;
+
+    stream->packets++;
+    stream->bytes += gst_buffer_get_size (buffer);
+    gst_buffer_unref (buffer);
+  }
+
+  return NULL;
+}
+
+static gboolean
+run (const gchar * name, guint16 port, gboolean shared)
+{
+  GSocketClient *client;
+  BenchStream *streams;
+  BenchStream sum = { 0, };
+  GError *err = NULL;
+  gint64 start, elapsed;
+  gboolean ok = TRUE;
+  gint i, n = 0;
+
+  streams = g_new0 (BenchStream, n_streams);
+  client = g_socket_client_new ();
+  for (; n != n_streams; ++n) {
+    if (!(streams[n].connection = g_socket_client_connect_to_host (client,
+                "127.0.0.1", port, NULL, &err)))
+      break;
+    if (shared && !(streams[n].io_stream = gst_dmss_io_engine_add_stream
+            (g_socket_connection_get_socket (streams[n].connection), &err))) {
+      g_object_unref (streams[n].connection);
+      break;
+    }
+  }
+  g_object_unref (client);
+  if (err) {
+    g_printerr ("%s: %s\n", name, err->message);
+    g_error_free (err);
+    ok = FALSE;
+    goto done;
+  }
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i != n; ++i)
+    streams[i].thread = g_thread_new ("engine-bench", stream_func,
+        &streams[i]);
+  for (i = 0; i != n; ++i)
+    g_thread_join (streams[i].thread);
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  for (i = 0; i != n; ++i) {
+    if (!g_error_matches (streams[i].error, G_IO_ERROR,
+            G_IO_ERROR_CONNECTION_CLOSED)) {
+      g_printerr ("%s: %s\n", name, streams[i].error ?
+          streams[i].error->message : "stopped");
+      ok = FALSE;
+    }
+    sum.packets += streams[i].packets;
+    sum.bytes += streams[i].bytes;
+    sum.syscalls += streams[i].syscalls;
+  }
+
+  g_print ("%-10s %8.1f MB/s %10" G_GUINT64_FORMAT " packets %6.2f "
+      "syscalls/packet\n", name, sum.bytes / (gdouble) elapsed, sum.packets,
+      sum.packets ? sum.syscalls / (gdouble) sum.packets : 0.0);
+
+done:
+  for (i = 0; i != n; ++i) {
+    if (streams[i].io_stream)
+      gst_dmss_io_engine_remove_stream (streams[i].io_stream);
+    g_object_unref (streams[i].connection);
+    g_clear_error (&streams[i].error);
+  }
+  g_free (streams);
+
+  return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GstDmssMock *mock;
+  GError *err = NULL;
+  gboolean ok;
+
+  context = g_option_context_new ("- compare the shared I/O engine with a "
+      "socket per stream");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  if (!(mock = gst_dmss_mock_new (0, frame_size, CLAMP (body_size, 1,
+                  G_MAXUINT16), total, &err))) {
+    g_printerr ("Failed to start the mock device: %s\n", err->message);
+    return 1;
+  }
+
+  g_print ("%d streams of %" G_GINT64_FORMAT " bytes in frames of %d, "
+      "bodies of %d\n", MAX (n_streams, 1), total, frame_size, body_size);
+  n_streams = MAX (n_streams, 1);
+  ok = run ("pool", gst_dmss_mock_get_port (mock), FALSE)
+      && run ("shared", gst_dmss_mock_get_port (mock), TRUE);
+
+  gst_dmss_mock_free (mock);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Synthetic DHAV streams for the benchmarks and tests.
+ *
+ * Frames carry a video info tag in their extended header, a payload of
+ * pseudo random bytes and the "dhav" trailer, stamped 40 ms apart from a
+ * fixed wall clock, so they go through the same paths as a camera's.
+ */
+
+#include <gst/gst.h>
+#include "gstdmssdhavgen.h"
+
+#include <string.h>
+
+/* 2018-09-22 11:29:00, packed like the devices do */
+#define DHAV_GEN_TIME \
+  ((18u << 26) | (9u << 22) | (22u << 17) | (11u << 12) | (29u << 6))
+#define DHAV_GEN_HEADER_SIZE    24
+#define DHAV_GEN_EXTENDED_SIZE  8
+#define DHAV_GEN_TRAILER_SIZE   8
+
+/* Appends one frame of frame_size bytes, header and trailer included */
+void
+gst_dmss_dhav_gen_frame (GByteArray * array, guint8 type, gsize frame_size,
+    guint16 frame_ts)
+{
+  guint8 header[DHAV_GEN_HEADER_SIZE + DHAV_GEN_EXTENDED_SIZE] = { 0, };
+  guint8 trailer[DHAV_GEN_TRAILER_SIZE] = { 'd', 'h', 'a', 'v', };
+  gsize payload, offset;
+  guint32 seed = frame_ts * 2654435761u;
+
+  g_assert (frame_size >= sizeof (header) + sizeof (trailer));
+
+  memcpy (header, "DHAV", 4);
+  header[4] = type;
+  GST_WRITE_UINT32_LE (&header[12], frame_size);
+  GST_WRITE_UINT32_LE (&header[16], DHAV_GEN_TIME + frame_ts / 1000);
+  GST_WRITE_UINT16_LE (&header[20], frame_ts);
+  header[22] = DHAV_GEN_EXTENDED_SIZE;
+  // H.264 at 25 fps
+  header[24] = 0x81;
+  header[26] = 2;
+  header[27] = 25;
+  GST_WRITE_UINT32_LE (&trailer[4], frame_size);
+
+  g_byte_array_append (array, header, sizeof (header));
+  payload = frame_size - sizeof (header) - sizeof (trailer);
+  offset = array->len;
+  g_byte_array_set_size (array, offset + payload);
+  for (; payload; --payload) {
+    seed = seed * 1103515245u + 12345u;
+    // never spells "DHAV" by accident, the scanner would stop there
+    array->data[offset++] = (seed >> 16) & 0x3f;
+  }
+  g_byte_array_append (array, trailer, sizeof (trailer));
+}
+
+/* n_frames frames of frame_size bytes, a keyframe every gop */
+GByteArray *
+gst_dmss_dhav_gen_stream (guint n_frames, gsize frame_size, guint gop)
+{
+  GByteArray *array = g_byte_array_sized_new (n_frames * frame_size);
+  guint i;
+
+  for (i = 0; i != n_frames; ++i)
+    gst_dmss_dhav_gen_frame (array, i % MAX (gop, 1) ?
+        GST_DMSS_DHAV_GEN_DELTA : GST_DMSS_DHAV_GEN_KEYFRAME, frame_size,
+        (guint16) (i * 40));
+
+  return array;
+}
+
+/* Cuts data into 0xbc stream packets of body_size bytes at most, the way
+ * a device sends it */
+GByteArray *
+gst_dmss_dhav_gen_packets (const guint8 * data, gsize size, gsize body_size)
+{
+  guint8 header[32];
+  GByteArray *array;
+  gsize length;
+
+  g_assert (body_size && body_size <= G_MAXUINT16);
+
+  array = g_byte_array_sized_new (size + (size / body_size + 1) *
+      sizeof (header));
+  while (size) {
+    length = MIN (size, body_size);
+    memset (header, 0, sizeof (header));
+    header[0] = 0xbc;
+    GST_WRITE_UINT32_LE (&header[4], length);
+    g_byte_array_append (array, header, sizeof (header));
+    g_byte_array_append (array, data, length);
+    data += length;
+    size -= length;
+  }
+
+  return array;
+}
@@ -0,0 +1,39 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_DHAV_GEN_H__
+#define __GST_DMSS_DHAV_GEN_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+#define GST_DMSS_DHAV_GEN_KEYFRAME 0xfc
+#define GST_DMSS_DHAV_GEN_DELTA    0xfd
+
+void gst_dmss_dhav_gen_frame (GByteArray * array, guint8 type,
+    gsize frame_size, guint16 frame_ts);
+GByteArray *gst_dmss_dhav_gen_stream (guint n_frames, gsize frame_size,
+    guint gop);
+GByteArray *gst_dmss_dhav_gen_packets (const guint8 * data, gsize size,
+    gsize body_size);
+
+G_END_DECLS
+#endif /* __GST_DMSS_DHAV_GEN_H__ */
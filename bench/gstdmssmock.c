@@ -0,0 +1,216 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* A stand-in for the stream socket of a device.
+ *
+ * Every connection accepted on the loopback port gets 0xbc packets of
+ * body_size bytes carrying DHAV frames of frame_size bytes, as fast as the
+ * client reads them, and is closed once total bytes of packets were sent,
+ * or earlier, mid-packet, to play a device dropping its client.
+ * There is no login or control socket: receive paths are benchmarked
+ * against it without a camera.
+ */
+
+#include "gstdmssmock.h"
+#include "gstdmssdhavgen.h"
+
+/* frames in the block sent over and over, a GOP of 25 */
+#define DMSS_MOCK_FRAMES        50
+
+struct _GstDmssMock
+{
+  GSocket *listener;
+  guint16 port;
+  GThread *accept_thread;
+  GCancellable *cancellable;
+
+  /* packets of DMSS_MOCK_FRAMES frames, sent until total is reached */
+  GByteArray *packets;
+  guint64 total;
+  /* bytes after which connections are dropped, 0 to send them all */
+  guint64 drop;
+
+  GMutex lock;
+  GSList *clients;
+};
+
+typedef struct
+{
+  GstDmssMock *mock;
+  GSocket *socket;
+  GThread *thread;
+} GstDmssMockClient;
+
+static gpointer
+gst_dmss_mock_client_func (gpointer user_data)
+{
+  GstDmssMockClient *client = user_data;
+  GstDmssMock *mock = client->mock;
+  GError *err = NULL;
+  guint64 left;
+  gsize offset = 0, length;
+  gssize sent;
+
+  g_mutex_lock (&mock->lock);
+  left = mock->drop ? MIN (mock->drop, mock->total) : mock->total;
+  g_mutex_unlock (&mock->lock);
+
+  while (left) {
+    length = MIN (mock->packets->len - offset, left);
+    if ((sent = g_socket_send (client->socket,
+                (const gchar *) &mock->packets->data[offset], length,
+                mock->cancellable, &err)) < 0) {
+      if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        g_printerr ("mock: send failed: %s\n", err->message);
+      g_clear_error (&err);
+      break;
+    }
+    left -= sent;
+    offset = (offset + sent) % mock->packets->len;
+  }
+
+  // the client sees the end of the recording
+  g_socket_close (client->socket, NULL);
+
+  return NULL;
+}
+
+static gpointer
+gst_dmss_mock_accept_func (gpointer user_data)
+{
+  GstDmssMock *mock = user_data;
+  GstDmssMockClient *client;
+  GSocket *socket;
+  GError *err = NULL;
+
+  while ((socket = g_socket_accept (mock->listener, mock->cancellable,
+              &err))) {
+    client = g_slice_new0 (GstDmssMockClient);
+    client->mock = mock;
+    client->socket = socket;
+    client->thread = g_thread_new ("dmss-mock-client",
+        gst_dmss_mock_client_func, client);
+
+    g_mutex_lock (&mock->lock);
+    mock->clients = g_slist_prepend (mock->clients, client);
+    g_mutex_unlock (&mock->lock);
+  }
+
+  if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_printerr ("mock: accept failed: %s\n", err->message);
+  g_error_free (err);
+
+  return NULL;
+}
+
+/* Listens on port of the loopback interface, 0 picks a free one */
+GstDmssMock *
+gst_dmss_mock_new (guint16 port, gsize frame_size, gsize body_size,
+    guint64 total, GError ** err)
+{
+  GstDmssMock *mock;
+  GInetAddress *loopback;
+  GSocketAddress *address;
+  GByteArray *frames;
+  gboolean bound;
+
+  mock = g_slice_new0 (GstDmssMock);
+  g_mutex_init (&mock->lock);
+
+  if (!(mock->listener = g_socket_new (G_SOCKET_FAMILY_IPV4,
+              G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, err)))
+    goto error;
+
+  loopback = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  address = g_inet_socket_address_new (loopback, port);
+  bound = g_socket_bind (mock->listener, address, TRUE, err);
+  g_object_unref (address);
+  g_object_unref (loopback);
+  if (!bound || !g_socket_listen (mock->listener, err))
+    goto error;
+
+  address = g_socket_get_local_address (mock->listener, err);
+  if (!address)
+    goto error;
+  mock->port =
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (address));
+  g_object_unref (address);
+
+  frames = gst_dmss_dhav_gen_stream (DMSS_MOCK_FRAMES, frame_size, 25);
+  mock->packets = gst_dmss_dhav_gen_packets (frames->data, frames->len,
+      body_size);
+  g_byte_array_unref (frames);
+  // whole blocks only, the last packet isn't cut short
+  mock->total = (total + mock->packets->len - 1) / mock->packets->len *
+      mock->packets->len;
+
+  mock->cancellable = g_cancellable_new ();
+  mock->accept_thread = g_thread_new ("dmss-mock",
+      gst_dmss_mock_accept_func, mock);
+
+  return mock;
+error:
+  if (mock->listener)
+    g_object_unref (mock->listener);
+  g_mutex_clear (&mock->lock);
+  g_slice_free (GstDmssMock, mock);
+  return NULL;
+}
+
+/* Hangs up connections accepted from now on after bytes, wherever that
+ * falls, 0 sends the whole total again */
+void
+gst_dmss_mock_set_drop (GstDmssMock * mock, guint64 bytes)
+{
+  g_mutex_lock (&mock->lock);
+  mock->drop = bytes;
+  g_mutex_unlock (&mock->lock);
+}
+
+guint16
+gst_dmss_mock_get_port (GstDmssMock * mock)
+{
+  return mock->port;
+}
+
+void
+gst_dmss_mock_free (GstDmssMock * mock)
+{
+  GstDmssMockClient *client;
+  GSList *walk;
+
+  g_cancellable_cancel (mock->cancellable);
+  g_thread_join (mock->accept_thread);
+
+  for (walk = mock->clients; walk; walk = walk->next) {
+    client = walk->data;
+    g_thread_join (client->thread);
+    g_object_unref (client->socket);
+    g_slice_free (GstDmssMockClient, client);
+  }
+  g_slist_free (mock->clients);
+
+  g_byte_array_unref (mock->packets);
+  g_object_unref (mock->cancellable);
+  g_socket_close (mock->listener, NULL);
+  g_object_unref (mock->listener);
+  g_mutex_clear (&mock->lock);
+  g_slice_free (GstDmssMock, mock);
+}
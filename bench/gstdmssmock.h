@@ -0,0 +1,37 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_MOCK_H__
+#define __GST_DMSS_MOCK_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstDmssMock GstDmssMock;
+
+GstDmssMock *gst_dmss_mock_new (guint16 port, gsize frame_size,
+    gsize body_size, guint64 total, GError ** err);
+void gst_dmss_mock_set_drop (GstDmssMock * mock, guint64 bytes);
+guint16 gst_dmss_mock_get_port (GstDmssMock * mock);
+void gst_dmss_mock_free (GstDmssMock * mock);
+
+G_END_DECLS
+#endif /* __GST_DMSS_MOCK_H__ */
@@ -0,0 +1,228 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Compares the io_uring receive backend with the GSocket one dmsssrc uses
+ * in receive-mode=pool, against the mock device on the loopback.
+ *
+ * Both read the same stream of 0xbc packets to the end, once dropping
+ * every packet right away and once keeping --hold packets alive before
+ * dropping the oldest, standing in for a downstream that holds on to
+ * buffers. With more held than the ring has slots, io_uring only keeps
+ * going because it copies bodies out below its low watermark, so the two
+ * runs show what wrapping bodies in place gains and what copying them out
+ * costs.
+ *
+ *   b2 io-uring=on uring-bench && uring-bench --bytes=1073741824 --hold=256
+ */
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include "gstdmssuring.h"
+#include "gstdmssmock.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+static gint frame_size = 64 * 1024;
+static gint body_size = 8 * 1024;
+static gint64 total = 256 * 1024 * 1024;
+static gint hold = 128;
+
+static GOptionEntry entries[] = {
+  {"frame-size", 0, 0, G_OPTION_ARG_INT, &frame_size,
+      "Bytes per DHAV frame", "N"},
+  {"body-size", 0, 0, G_OPTION_ARG_INT, &body_size,
+      "Bytes per packet body, at most 65535", "N"},
+  {"bytes", 0, 0, G_OPTION_ARG_INT64, &total, "Bytes to receive", "N"},
+  {"hold", 0, 0, G_OPTION_ARG_INT, &hold,
+      "Packets kept alive like a slow downstream would", "N"},
+  {NULL}
+};
+
+typedef struct
+{
+  guint64 packets;
+  guint64 bytes;
+  guint64 syscalls;
+} BenchResult;
+
+static gboolean
+receive_exact (GSocket * socket, gchar * data, gsize size,
+    BenchResult * result, GError ** err)
+{
+  gssize received;
+
+  while (size) {
+    result->syscalls++;
+    if ((received = g_socket_receive (socket, data, size, NULL, err)) <= 0) {
+      if (!received)
+        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+            "Connection closed by remote peer");
+      return FALSE;
+    }
+    data += received;
+    size -= received;
+  }
+
+  return TRUE;
+}
+
+/* header and body read apart, like gst_dmss_src_receive_pooled */
+static GstFlowReturn
+receive_gsocket (GSocket * socket, GstBuffer ** outbuf, BenchResult * result,
+    GError ** err)
+{
+  gchar header[32];
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize size;
+
+  if (!receive_exact (socket, header, sizeof (header), result, err))
+    return GST_FLOW_ERROR;
+
+  size = GST_READ_UINT16_LE (&header[4]);
+  buffer = gst_buffer_new_allocate (NULL, sizeof (header) + size, NULL);
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  memcpy (map.data, header, sizeof (header));
+  if (!receive_exact (socket, (gchar *) & map.data[sizeof (header)], size,
+          result, err)) {
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  *outbuf = buffer;
+  return GST_FLOW_OK;
+}
+
+static gboolean
+run (const gchar * name, guint16 port, gboolean use_uring, guint hold)
+{
+  GSocketClient *client;
+  GSocketConnection *connection;
+  GSocket *socket;
+  GCancellable *cancellable;
+  GstDmssUring *uring = NULL;
+  GQueue held = G_QUEUE_INIT;
+  BenchResult result = { 0, };
+  GstBuffer *buffer;
+  GstFlowReturn ret;
+  GError *err = NULL;
+  gint64 start, elapsed;
+
+  client = g_socket_client_new ();
+  connection = g_socket_client_connect_to_host (client, "127.0.0.1", port,
+      NULL, &err);
+  g_object_unref (client);
+  if (!connection) {
+    g_printerr ("%s: %s\n", name, err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+  socket = g_socket_connection_get_socket (connection);
+  cancellable = g_cancellable_new ();
+
+  if (use_uring
+      && !(uring = gst_dmss_uring_new (socket, cancellable, &err))) {
+    g_print ("%-10s %3u held unavailable: %s\n", name, hold,
+        err->message);
+    g_error_free (err);
+    g_object_unref (cancellable);
+    g_object_unref (connection);
+    return TRUE;
+  }
+
+  start = g_get_monotonic_time ();
+  while (TRUE) {
+    if (uring) {
+      ret = gst_dmss_uring_receive_packet (uring, &buffer, &err);
+      result.syscalls += gst_dmss_uring_take_syscalls (uring);
+    } else {
+      ret = receive_gsocket (socket, &buffer, &result, &err);
+    }
+    if (ret != GST_FLOW_OK)
+      break;
+
+    result.packets++;
+    result.bytes += gst_buffer_get_size (buffer);
+    g_queue_push_tail (&held, buffer);
+    if (held.length > hold)
+      gst_buffer_unref (g_queue_pop_head (&held));
+  }
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+  if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED))
+    g_printerr ("%s: %s\n", name, err ? err->message : "stopped");
+  g_clear_error (&err);
+
+  g_queue_foreach (&held, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (&held);
+  if (uring)
+    gst_dmss_uring_free (uring);
+  g_object_unref (cancellable);
+  g_object_unref (connection);
+
+  g_print ("%-10s %3u held %8.1f MB/s %10" G_GUINT64_FORMAT " packets %6.2f "
+      "syscalls/packet\n", name, hold, result.bytes / (gdouble) elapsed,
+      result.packets, result.packets ? result.syscalls /
+      (gdouble) result.packets : 0.0);
+
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionContext *context;
+  GstDmssMock *mock;
+  GError *err = NULL;
+  guint16 port;
+  gboolean ok;
+
+  context = g_option_context_new ("- compare the stream receive backends");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  if (!(mock = gst_dmss_mock_new (0, frame_size, CLAMP (body_size, 1,
+                  G_MAXUINT16), total, &err))) {
+    g_printerr ("Failed to start the mock device: %s\n", err->message);
+    return 1;
+  }
+
+  g_print ("%" G_GINT64_FORMAT " bytes in frames of %d, bodies of %d\n",
+      total, frame_size, body_size);
+  port = gst_dmss_mock_get_port (mock);
+  ok = run ("gsocket", port, FALSE, 0) && run ("io_uring", port, TRUE, 0)
+      && run ("gsocket", port, FALSE, MAX (hold, 0))
+      && run ("io_uring", port, TRUE, MAX (hold, 0));
+
+  gst_dmss_mock_free (mock);
+
+  return ok ? 0 : 1;
+}
@@ -31,8 +31,6 @@
 #define DMSS_DEFAULT_CHANNEL     0
 #define DMSS_DEFAULT_SUBCHANNEL     0
 #define DMSS_DEFAULT_LATENCY     200
-#define DMSS_EXTENDED_HEADER_AUDIOINFO_PREFIX ((guint8)0x83)
-#define DMSS_EXTENDED_HEADER_VIDEOINFO_PREFIX ((guint8)0x81)
 #define DMSS_MAXIMUM_SAMPLES_AVERAGE 100
 
 #endif /* __GST_DMSS_H__ */
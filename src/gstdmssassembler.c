@@ -0,0 +1,315 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Reassembles DHAV frames out of the buffers dmssdemux receives.
+ *
+ * Buffers are mapped once when pushed and kept in a ring of chunks until
+ * every byte of them is consumed. The parser peeks at the front: as long as
+ * what it asks for lies in the first chunk it gets a pointer straight into
+ * it, only a header wrapping over to the next chunk is copied into a
+ * contiguous scratch area. Unlike GstAdapter nothing is unmapped and mapped
+ * again between frames, and the byte count is kept up to date instead of
+ * being recomputed.
+ *
+ * Payloads are never copied: they come out as sub-buffers of the chunks
+ * they were received in, one memory per chunk.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include "gstdmssassembler.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+#define DMSS_ASSEMBLER_INITIAL_CHUNKS   16
+
+typedef struct
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  /* consumed bytes at the start */
+  gsize offset;
+} GstDmssAssemblerChunk;
+
+struct _GstDmssAssembler
+{
+  /* ring of n_chunks starting at first, capacity is a power of two */
+  GstDmssAssemblerChunk *chunks;
+  guint capacity;
+  guint first;
+  guint n_chunks;
+  gsize available;
+
+  /* frames wrapping over chunks are copied here */
+  guint8 *scratch;
+  gsize scratch_size;
+
+  /* bytes memcpy'd since gst_dmss_assembler_take_copied */
+  guint64 copied;
+};
+
+#define CHUNK(assembler, i) \
+  (&(assembler)->chunks[((assembler)->first + (i)) & ((assembler)->capacity - 1)])
+
+GstDmssAssembler *
+gst_dmss_assembler_new (void)
+{
+  GstDmssAssembler *assembler = g_slice_new0 (GstDmssAssembler);
+
+  assembler->capacity = DMSS_ASSEMBLER_INITIAL_CHUNKS;
+  assembler->chunks = g_new0 (GstDmssAssemblerChunk, assembler->capacity);
+
+  return assembler;
+}
+
+void
+gst_dmss_assembler_free (GstDmssAssembler * assembler)
+{
+  gst_dmss_assembler_clear (assembler);
+  g_free (assembler->chunks);
+  g_free (assembler->scratch);
+  g_slice_free (GstDmssAssembler, assembler);
+}
+
+static void
+gst_dmss_assembler_release_first (GstDmssAssembler * assembler)
+{
+  GstDmssAssemblerChunk *chunk = CHUNK (assembler, 0);
+
+  gst_buffer_unmap (chunk->buffer, &chunk->map);
+  gst_buffer_unref (chunk->buffer);
+  chunk->buffer = NULL;
+  assembler->first = (assembler->first + 1) & (assembler->capacity - 1);
+  --assembler->n_chunks;
+}
+
+static void
+gst_dmss_assembler_grow (GstDmssAssembler * assembler)
+{
+  GstDmssAssemblerChunk *chunks;
+  guint i;
+
+  chunks = g_new0 (GstDmssAssemblerChunk, assembler->capacity * 2);
+  for (i = 0; i < assembler->n_chunks; ++i)
+    chunks[i] = *CHUNK (assembler, i);
+
+  g_free (assembler->chunks);
+  assembler->chunks = chunks;
+  assembler->capacity *= 2;
+  assembler->first = 0;
+}
+
+/* Takes ownership of buffer */
+void
+gst_dmss_assembler_push (GstDmssAssembler * assembler, GstBuffer * buffer)
+{
+  GstDmssAssemblerChunk *chunk;
+
+  if (!gst_buffer_get_size (buffer)) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+
+  if (assembler->n_chunks == assembler->capacity)
+    gst_dmss_assembler_grow (assembler);
+
+  chunk = CHUNK (assembler, assembler->n_chunks);
+  if (!gst_buffer_map (buffer, &chunk->map, GST_MAP_READ)) {
+    GST_WARNING ("Can't map a buffer of %" G_GSIZE_FORMAT " bytes",
+        gst_buffer_get_size (buffer));
+    gst_buffer_unref (buffer);
+    return;
+  }
+  chunk->buffer = buffer;
+  chunk->offset = 0;
+  ++assembler->n_chunks;
+  assembler->available += chunk->map.size;
+}
+
+void
+gst_dmss_assembler_clear (GstDmssAssembler * assembler)
+{
+  while (assembler->n_chunks)
+    gst_dmss_assembler_release_first (assembler);
+  assembler->first = 0;
+  assembler->available = 0;
+}
+
+gsize
+gst_dmss_assembler_available (GstDmssAssembler * assembler)
+{
+  return assembler->available;
+}
+
+/* Copies size bytes from the front into dest without consuming them */
+static void
+gst_dmss_assembler_copy (GstDmssAssembler * assembler, guint8 * dest,
+    gsize size)
+{
+  GstDmssAssemblerChunk *chunk;
+  gsize copied = 0, length;
+  guint i;
+
+  for (i = 0; copied < size; ++i) {
+    chunk = CHUNK (assembler, i);
+    length = MIN (size - copied, chunk->map.size - chunk->offset);
+    memcpy (dest + copied, chunk->map.data + chunk->offset, length);
+    copied += length;
+  }
+  assembler->copied += size;
+}
+
+/* Copies size bytes at offset from the front into dest, without consuming
+ * anything
+ */
+void
+gst_dmss_assembler_read (GstDmssAssembler * assembler, gsize offset,
+    guint8 * dest, gsize size)
+{
+  GstDmssAssemblerChunk *chunk;
+  gsize length;
+  guint i;
+
+  g_return_if_fail (offset + size <= assembler->available);
+
+  assembler->copied += size;
+  for (i = 0; size; ++i) {
+    chunk = CHUNK (assembler, i);
+    length = chunk->map.size - chunk->offset;
+    if (offset >= length) {
+      offset -= length;
+      continue;
+    }
+    length = MIN (size, length - offset);
+    memcpy (dest, chunk->map.data + chunk->offset + offset, length);
+    dest += length;
+    size -= length;
+    offset = 0;
+  }
+}
+
+/* A contiguous view of the next size bytes, valid until the next call.
+ * NULL when fewer are available.
+ */
+const guint8 *
+gst_dmss_assembler_peek (GstDmssAssembler * assembler, gsize size)
+{
+  GstDmssAssemblerChunk *chunk;
+
+  if (size > assembler->available || !size)
+    return NULL;
+
+  chunk = CHUNK (assembler, 0);
+  if (chunk->map.size - chunk->offset >= size)
+    return chunk->map.data + chunk->offset;
+
+  if (assembler->scratch_size < size) {
+    assembler->scratch_size = MAX (size, assembler->scratch_size * 2);
+    g_free (assembler->scratch);
+    assembler->scratch = g_malloc (assembler->scratch_size);
+  }
+  gst_dmss_assembler_copy (assembler, assembler->scratch, size);
+
+  return assembler->scratch;
+}
+
+/* The bytes at the front that can be read without a copy */
+const guint8 *
+gst_dmss_assembler_peek_contiguous (GstDmssAssembler * assembler,
+    gsize * size)
+{
+  GstDmssAssemblerChunk *chunk;
+
+  if (!assembler->n_chunks) {
+    *size = 0;
+    return NULL;
+  }
+
+  chunk = CHUNK (assembler, 0);
+  *size = chunk->map.size - chunk->offset;
+  return chunk->map.data + chunk->offset;
+}
+
+void
+gst_dmss_assembler_flush (GstDmssAssembler * assembler, gsize size)
+{
+  GstDmssAssemblerChunk *chunk;
+  gsize length;
+
+  g_return_if_fail (size <= assembler->available);
+
+  assembler->available -= size;
+  while (size) {
+    chunk = CHUNK (assembler, 0);
+    length = MIN (size, chunk->map.size - chunk->offset);
+    chunk->offset += length;
+    size -= length;
+    if (chunk->offset == chunk->map.size)
+      gst_dmss_assembler_release_first (assembler);
+  }
+}
+
+/* The next size bytes as a buffer sharing the memory of the buffers they
+ * were pushed in. GstBuffer merges memories past its limit per buffer, so
+ * only a frame spread over that many chunks is copied.
+ */
+GstBuffer *
+gst_dmss_assembler_take_buffer (GstDmssAssembler * assembler, gsize size)
+{
+  GstDmssAssemblerChunk *chunk;
+  GstBuffer *buffer;
+  gsize length;
+
+  g_return_val_if_fail (size <= assembler->available, NULL);
+
+  buffer = gst_buffer_new ();
+  assembler->available -= size;
+  while (size) {
+    chunk = CHUNK (assembler, 0);
+    length = MIN (size, chunk->map.size - chunk->offset);
+    // a full buffer merges what it holds before taking one more
+    if (gst_buffer_n_memory (buffer) == gst_buffer_get_max_memory ())
+      assembler->copied += gst_buffer_get_size (buffer);
+    gst_buffer_copy_into (buffer, chunk->buffer, GST_BUFFER_COPY_MEMORY,
+        chunk->offset, length);
+    chunk->offset += length;
+    size -= length;
+    if (chunk->offset == chunk->map.size)
+      gst_dmss_assembler_release_first (assembler);
+  }
+
+  return buffer;
+}
+
+/* Bytes copied since the last call */
+guint64
+gst_dmss_assembler_take_copied (GstDmssAssembler * assembler)
+{
+  guint64 copied = assembler->copied;
+
+  assembler->copied = 0;
+  return copied;
+}
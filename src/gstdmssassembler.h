@@ -0,0 +1,50 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_ASSEMBLER_H__
+#define __GST_DMSS_ASSEMBLER_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstDmssAssembler GstDmssAssembler;
+
+GstDmssAssembler *gst_dmss_assembler_new (void);
+void gst_dmss_assembler_free (GstDmssAssembler * assembler);
+
+void gst_dmss_assembler_push (GstDmssAssembler * assembler,
+    GstBuffer * buffer);
+void gst_dmss_assembler_clear (GstDmssAssembler * assembler);
+gsize gst_dmss_assembler_available (GstDmssAssembler * assembler);
+
+const guint8 *gst_dmss_assembler_peek (GstDmssAssembler * assembler,
+    gsize size);
+const guint8 *gst_dmss_assembler_peek_contiguous (GstDmssAssembler *
+    assembler, gsize * size);
+void gst_dmss_assembler_read (GstDmssAssembler * assembler, gsize offset,
+    guint8 * dest, gsize size);
+void gst_dmss_assembler_flush (GstDmssAssembler * assembler, gsize size);
+GstBuffer *gst_dmss_assembler_take_buffer (GstDmssAssembler * assembler,
+    gsize size);
+guint64 gst_dmss_assembler_take_copied (GstDmssAssembler * assembler);
+
+G_END_DECLS
+#endif /* __GST_DMSS_ASSEMBLER_H__ */
@@ -0,0 +1,452 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Keyframe index of a .dav file, saved next to it as a sidecar.
+ *
+ * The index lives in memory with the same layout as the sidecar, so a
+ * loaded sidecar is only mapped and a fresh index is written as is. All
+ * fields are little endian:
+ *
+ *   header  "DMSSIDX\0", version u32, keyframes u32, file size u64,
+ *           file mtime i64, duration in ms u64, first frame ts u16,
+ *           reserved u16 u32
+ *   entry   offset u64, pts in ms u32, frame ts u16, reserved u16
+ *
+ * The size and mtime of the .dav tell a stale sidecar apart, and a
+ * version other than this one's is rebuilt rather than read.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include "gstdmssdavindex.h"
+#include "gstdmssdhavscan.h"
+#include "gstdmssprotocol.h"
+
+#include <errno.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+#define DAV_INDEX_MAGIC         "DMSSIDX"
+#define DAV_INDEX_VERSION       2
+#define DAV_INDEX_HEADER_SIZE   48
+#define DAV_INDEX_ENTRY_SIZE    16
+#define DAV_INDEX_SUFFIX        ".idx"
+
+#define DHAV_FRAME_HEADER_SIZE  24
+#define DHAV_FRAME_MIN_SIZE     32
+#define DHAV_FRAME_TRAILER_SIZE 8
+
+struct _GstDmssDavIndex
+{
+  /* loaded from a sidecar, else data holds the index being built */
+  GMappedFile *mapped;
+  GByteArray *data;
+  const guint8 *entries;
+  guint n_entries;
+  GstClockTime duration;
+  guint16 first_frame_ts;
+
+  /* building */
+  gboolean have_frame;
+  guint16 last_ts;
+  guint64 pts_ms;
+};
+
+GstDmssDavIndex *
+gst_dmss_dav_index_new (guint64 file_size, gint64 mtime)
+{
+  GstDmssDavIndex *index = g_slice_new0 (GstDmssDavIndex);
+
+  index->data = g_byte_array_new ();
+  g_byte_array_set_size (index->data, DAV_INDEX_HEADER_SIZE);
+  memset (index->data->data, 0, DAV_INDEX_HEADER_SIZE);
+  memcpy (index->data->data, DAV_INDEX_MAGIC, sizeof (DAV_INDEX_MAGIC));
+  GST_WRITE_UINT32_LE (&index->data->data[8], DAV_INDEX_VERSION);
+  GST_WRITE_UINT64_LE (&index->data->data[16], file_size);
+  GST_WRITE_UINT64_LE (&index->data->data[24], mtime);
+  index->duration = GST_CLOCK_TIME_NONE;
+
+  return index;
+}
+
+/* Feeds the frames of the file in order. PTS follow the millisecond
+ * counter the same way dmssdemux stamps frames, steps over a second are
+ * taken for a counter glitch and don't advance.
+ */
+void
+gst_dmss_dav_index_add_frame (GstDmssDavIndex * index, guint64 offset,
+    guint8 type, guint16 frame_ts)
+{
+  guint8 entry[DAV_INDEX_ENTRY_SIZE];
+  guint16 diff;
+
+  if (type != 0xfc && type != 0xfd)
+    return;
+
+  if (!index->have_frame) {
+    index->first_frame_ts = index->last_ts = frame_ts;
+    index->have_frame = TRUE;
+  }
+
+  diff = frame_ts - index->last_ts;
+  if (diff <= 1000) {
+    index->pts_ms += diff;
+    index->last_ts = frame_ts;
+  }
+
+  if (type != 0xfc)
+    return;
+
+  GST_WRITE_UINT64_LE (&entry[0], offset);
+  GST_WRITE_UINT32_LE (&entry[8], index->pts_ms);
+  GST_WRITE_UINT16_LE (&entry[12], frame_ts);
+  GST_WRITE_UINT16_LE (&entry[14], 0);
+  g_byte_array_append (index->data, entry, sizeof (entry));
+}
+
+void
+gst_dmss_dav_index_finish (GstDmssDavIndex * index)
+{
+  guint8 *header = index->data->data;
+
+  index->n_entries = (index->data->len - DAV_INDEX_HEADER_SIZE) /
+      DAV_INDEX_ENTRY_SIZE;
+  index->entries = &header[DAV_INDEX_HEADER_SIZE];
+  index->duration = index->pts_ms * GST_MSECOND;
+
+  GST_WRITE_UINT32_LE (&header[12], index->n_entries);
+  GST_WRITE_UINT64_LE (&header[32], index->pts_ms);
+  GST_WRITE_UINT16_LE (&header[40], index->first_frame_ts);
+}
+
+void
+gst_dmss_dav_index_free (GstDmssDavIndex * index)
+{
+  if (index->mapped)
+    g_mapped_file_unref (index->mapped);
+  if (index->data)
+    g_byte_array_unref (index->data);
+  g_slice_free (GstDmssDavIndex, index);
+}
+
+gchar *
+gst_dmss_dav_index_sidecar_path (const gchar * path)
+{
+  return g_strconcat (path, DAV_INDEX_SUFFIX, NULL);
+}
+
+/* Maps the sidecar at path if it was made for a .dav of this size and
+ * mtime by this version.
+ */
+GstDmssDavIndex *
+gst_dmss_dav_index_load (const gchar * path, guint64 file_size, gint64 mtime,
+    GError ** err)
+{
+  GstDmssDavIndex *index;
+  GMappedFile *mapped;
+  const guint8 *header;
+  gsize size;
+  guint n_entries;
+
+  if (!(mapped = g_mapped_file_new (path, FALSE, err)))
+    return NULL;
+
+  header = (const guint8 *) g_mapped_file_get_contents (mapped);
+  size = g_mapped_file_get_length (mapped);
+
+  if (size < DAV_INDEX_HEADER_SIZE
+      || memcmp (header, DAV_INDEX_MAGIC, sizeof (DAV_INDEX_MAGIC))
+      || GST_READ_UINT32_LE (&header[8]) != DAV_INDEX_VERSION)
+    goto invalid;
+
+  n_entries = GST_READ_UINT32_LE (&header[12]);
+  if (size != DAV_INDEX_HEADER_SIZE + (gsize) n_entries * DAV_INDEX_ENTRY_SIZE)
+    goto invalid;
+
+  if (GST_READ_UINT64_LE (&header[16]) != file_size
+      || (gint64) GST_READ_UINT64_LE (&header[24]) != mtime) {
+    g_mapped_file_unref (mapped);
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+        "Index %s is out of date", path);
+    return NULL;
+  }
+
+  index = g_slice_new0 (GstDmssDavIndex);
+  index->mapped = mapped;
+  index->entries = &header[DAV_INDEX_HEADER_SIZE];
+  index->n_entries = n_entries;
+  index->duration = GST_READ_UINT64_LE (&header[32]) * GST_MSECOND;
+  index->first_frame_ts = GST_READ_UINT16_LE (&header[40]);
+
+  GST_DEBUG ("Mapped index %s of %u keyframes", path, n_entries);
+
+  return index;
+invalid:
+  g_mapped_file_unref (mapped);
+  g_set_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+      "%s is not a valid index", path);
+  return NULL;
+}
+
+/* Writes a built index to path, through a temporary file so readers never
+ * map half of it.
+ */
+gboolean
+gst_dmss_dav_index_save (GstDmssDavIndex * index, const gchar * path,
+    GError ** err)
+{
+  g_return_val_if_fail (index->data != NULL, FALSE);
+
+  return g_file_set_contents (path, (const gchar *) index->data->data,
+      index->data->len, err);
+}
+
+/* Offset of the next "DHAV" after offset, FALSE when there is none */
+static gboolean
+gst_dmss_dav_index_resync (GstDmssDavReadFunc read, gpointer user_data,
+    guint64 * offset)
+{
+  const guint8 *data;
+  gsize size, found;
+
+  ++*offset;
+  while (TRUE) {
+    size = 4;
+    if (!(data = read (*offset, &size, user_data)))
+      return FALSE;
+    if ((found = gst_dmss_dhav_scan (data, size)) != size) {
+      *offset += found;
+      return TRUE;
+    }
+    // the magic may start in the last three bytes
+    *offset += size - 3;
+  }
+}
+
+/* Adds every frame of a .dav to index and finishes it. A frame counts
+ * when its size is within bounds and its trailer repeats it, anything else
+ * is skipped up to the next "DHAV". A frame cut short by the end of the
+ * file is left out. Both the sidecar builder and dmssdemux index through
+ * here, so a file gets the same keyframes whoever indexed it.
+ */
+void
+gst_dmss_dav_index_walk (GstDmssDavIndex * index, GstDmssDavReadFunc read,
+    gpointer user_data)
+{
+  const guint8 *header, *trailer;
+  guint64 offset = 0;
+  guint32 frame_size;
+  guint16 frame_ts;
+  guint8 type;
+  gsize size;
+
+  while (TRUE) {
+    size = DHAV_FRAME_HEADER_SIZE;
+    if (!(header = read (offset, &size, user_data)))
+      break;
+    type = header[4];
+    frame_size = GST_READ_UINT32_LE (&header[12]);
+    frame_ts = GST_READ_UINT16_LE (&header[20]);
+
+    if (!memcmp (header, "DHAV", 4) && frame_size >= DHAV_FRAME_MIN_SIZE
+        && frame_size <= GST_DMSS_DHAV_MAX_FRAME_SIZE) {
+      size = DHAV_FRAME_TRAILER_SIZE;
+      if (!(trailer = read (offset + frame_size - DHAV_FRAME_TRAILER_SIZE,
+                  &size, user_data)))
+        break;
+      if (!memcmp (trailer, "dhav", 4)
+          && GST_READ_UINT32_LE (&trailer[4]) == frame_size) {
+        gst_dmss_dav_index_add_frame (index, offset, type, frame_ts);
+        offset += frame_size;
+        continue;
+      }
+    }
+
+    GST_LOG ("No frame at %" G_GUINT64_FORMAT, offset);
+    if (!gst_dmss_dav_index_resync (read, user_data, &offset))
+      break;
+  }
+
+  gst_dmss_dav_index_finish (index);
+}
+
+typedef struct
+{
+  const guint8 *data;
+  gsize size;
+} GstDmssDavIndexMapping;
+
+static const guint8 *
+gst_dmss_dav_index_read_mapping (guint64 offset, gsize * size,
+    gpointer user_data)
+{
+  GstDmssDavIndexMapping *mapping = user_data;
+
+  if (offset > mapping->size || mapping->size - offset < *size)
+    return NULL;
+
+  *size = mapping->size - offset;
+  return mapping->data + offset;
+}
+
+/* Indexes the .dav at path, walking its frames over a mapping */
+GstDmssDavIndex *
+gst_dmss_dav_index_build (const gchar * path, GError ** err)
+{
+  GstDmssDavIndexMapping mapping;
+  GstDmssDavIndex *index;
+  GMappedFile *mapped;
+  GStatBuf stat_buf;
+
+  if (g_stat (path, &stat_buf) < 0) {
+    g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Can't stat %s", path);
+    return NULL;
+  }
+  if (!(mapped = g_mapped_file_new (path, FALSE, err)))
+    return NULL;
+
+  mapping.data = (const guint8 *) g_mapped_file_get_contents (mapped);
+  mapping.size = g_mapped_file_get_length (mapped);
+  index = gst_dmss_dav_index_new (mapping.size, stat_buf.st_mtime);
+  gst_dmss_dav_index_walk (index, gst_dmss_dav_index_read_mapping, &mapping);
+  g_mapped_file_unref (mapped);
+
+  GST_DEBUG ("Indexed %u keyframes of %s", index->n_entries, path);
+
+  return index;
+}
+
+/* Builds the sidecar of a .dav file unless it is up to date. TRUE when
+ * one was written.
+ */
+gboolean
+gst_dmss_dav_index_build_file (const gchar * path)
+{
+  GstDmssDavIndex *index;
+  GStatBuf stat_buf;
+  GError *err = NULL;
+  gchar *sidecar;
+  gboolean built = FALSE;
+
+  sidecar = gst_dmss_dav_index_sidecar_path (path);
+
+  // already up to date
+  if (!g_stat (path, &stat_buf)
+      && (index = gst_dmss_dav_index_load (sidecar, stat_buf.st_size,
+              stat_buf.st_mtime, NULL))) {
+    gst_dmss_dav_index_free (index);
+    g_free (sidecar);
+    return FALSE;
+  }
+
+  if (!(index = gst_dmss_dav_index_build (path, &err))
+      || !gst_dmss_dav_index_save (index, sidecar, &err)) {
+    GST_WARNING ("Failed to index %s: %s", path, err->message);
+    g_error_free (err);
+  } else {
+    built = TRUE;
+  }
+
+  if (index)
+    gst_dmss_dav_index_free (index);
+  g_free (sidecar);
+
+  return built;
+}
+
+static void
+gst_dmss_dav_index_build_func (gpointer data, gpointer user_data)
+{
+  gint *built = user_data;
+
+  if (gst_dmss_dav_index_build_file (data))
+    g_atomic_int_inc (built);
+}
+
+/* Builds the missing or stale sidecars of a list of .dav files, a file
+ * per thread. Returns how many were written.
+ */
+guint
+gst_dmss_dav_index_build_files (const gchar * const *paths, guint n_threads)
+{
+  GThreadPool *pool;
+  gint built = 0;
+
+  pool = g_thread_pool_new (gst_dmss_dav_index_build_func, &built,
+      MAX (n_threads, 1), FALSE, NULL);
+  for (; *paths; ++paths)
+    g_thread_pool_push (pool, (gpointer) * paths, NULL);
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  return built;
+}
+
+guint
+gst_dmss_dav_index_get_n_keyframes (GstDmssDavIndex * index)
+{
+  return index->n_entries;
+}
+
+GstClockTime
+gst_dmss_dav_index_get_duration (GstDmssDavIndex * index)
+{
+  return index->duration;
+}
+
+guint16
+gst_dmss_dav_index_get_first_frame_ts (GstDmssDavIndex * index)
+{
+  return index->first_frame_ts;
+}
+
+/* The last keyframe at or before pts */
+gboolean
+gst_dmss_dav_index_lookup (GstDmssDavIndex * index, GstClockTime pts,
+    GstDmssDavKeyframe * keyframe)
+{
+  const guint8 *entry;
+  guint low = 0, high = index->n_entries, middle;
+
+  while (low < high) {
+    middle = low + (high - low) / 2;
+    entry = &index->entries[middle * DAV_INDEX_ENTRY_SIZE];
+    if (GST_READ_UINT32_LE (&entry[8]) * GST_MSECOND <= pts)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  if (!low)
+    return FALSE;
+
+  entry = &index->entries[(low - 1) * DAV_INDEX_ENTRY_SIZE];
+  keyframe->offset = GST_READ_UINT64_LE (&entry[0]);
+  keyframe->pts = GST_READ_UINT32_LE (&entry[8]) * GST_MSECOND;
+  keyframe->frame_ts = GST_READ_UINT16_LE (&entry[12]);
+
+  return TRUE;
+}
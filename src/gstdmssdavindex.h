@@ -0,0 +1,71 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_DAV_INDEX_H__
+#define __GST_DMSS_DAV_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* A keyframe of a .dav file. frame_ts is the millisecond counter of the
+ * frame, playback continues stamping from it.
+ */
+typedef struct
+{
+  guint64 offset;
+  GstClockTime pts;
+  guint16 frame_ts;
+} GstDmssDavKeyframe;
+
+typedef struct _GstDmssDavIndex GstDmssDavIndex;
+
+/* Returns the bytes of a .dav from offset on, at least *size of them, and
+ * sets *size to how many there are. NULL past the end or on an error.
+ */
+typedef const guint8 *(*GstDmssDavReadFunc) (guint64 offset, gsize * size,
+    gpointer user_data);
+
+GstDmssDavIndex *gst_dmss_dav_index_new (guint64 file_size, gint64 mtime);
+void gst_dmss_dav_index_add_frame (GstDmssDavIndex * index, guint64 offset,
+    guint8 type, guint16 frame_ts);
+void gst_dmss_dav_index_finish (GstDmssDavIndex * index);
+void gst_dmss_dav_index_free (GstDmssDavIndex * index);
+
+gchar *gst_dmss_dav_index_sidecar_path (const gchar * path);
+GstDmssDavIndex *gst_dmss_dav_index_load (const gchar * path,
+    guint64 file_size, gint64 mtime, GError ** err);
+gboolean gst_dmss_dav_index_save (GstDmssDavIndex * index,
+    const gchar * path, GError ** err);
+void gst_dmss_dav_index_walk (GstDmssDavIndex * index, GstDmssDavReadFunc read,
+    gpointer user_data);
+GstDmssDavIndex *gst_dmss_dav_index_build (const gchar * path, GError ** err);
+gboolean gst_dmss_dav_index_build_file (const gchar * path);
+guint gst_dmss_dav_index_build_files (const gchar * const *paths,
+    guint n_threads);
+
+guint gst_dmss_dav_index_get_n_keyframes (GstDmssDavIndex * index);
+GstClockTime gst_dmss_dav_index_get_duration (GstDmssDavIndex * index);
+guint16 gst_dmss_dav_index_get_first_frame_ts (GstDmssDavIndex * index);
+gboolean gst_dmss_dav_index_lookup (GstDmssDavIndex * index, GstClockTime pts,
+    GstDmssDavKeyframe * keyframe);
+
+G_END_DECLS
+#endif /* __GST_DMSS_DAV_INDEX_H__ */
@@ -0,0 +1,388 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:element-dmssdavsrc
+ * @title: dmssdavsrc
+ * @see_also: #dmssdemux
+ *
+ * Reads a .dav file recorded from a DMSS device by mapping it in memory.
+ * Buffers wrap read-only ranges of the mapping instead of being read into,
+ * so dmssdemux pulling from it parses the page cache directly. The kernel
+ * is told reads are sequential, and a jump to another offset, a keyframe
+ * seek, asks it to fault in the frames there ahead of time.
+ *
+ * ## Example launch line:
+ * |[
+ * gst-launch-1.0 dmssdavsrc location=recording.dav ! dmssdemux ! \
+ *   h264parse ! avdec_h264 ! videoconvert ! autovideosink
+ * ]|
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gstversion.h>
+#if GST_VERSION_MINOR <= 15
+#include <gst/gst-i18n-plugin.h>
+#endif
+#include "gstdmssdavsrc.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+GST_DEBUG_CATEGORY_STATIC (dmssdavsrc_debug);
+#define GST_CAT_DEFAULT dmssdavsrc_debug
+
+#define DMSS_DAV_DEFAULT_BLOCKSIZE      (64 * 1024)
+/* faulted in past a seek, about a GOP of a high bitrate stream */
+#define DMSS_DAV_SEEK_READAHEAD         (1024 * 1024)
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-dhav"));
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION
+};
+
+static void gst_dmss_dav_src_uri_handler_init (gpointer g_iface,
+    gpointer iface_data);
+
+#define gst_dmss_dav_src_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstDmssDavSrc, gst_dmss_dav_src, GST_TYPE_BASE_SRC,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_URI_HANDLER,
+        gst_dmss_dav_src_uri_handler_init));
+
+static void gst_dmss_dav_src_finalize (GObject * gobject);
+static void gst_dmss_dav_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_dmss_dav_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static gboolean gst_dmss_dav_src_start (GstBaseSrc * bsrc);
+static gboolean gst_dmss_dav_src_stop (GstBaseSrc * bsrc);
+static gboolean gst_dmss_dav_src_is_seekable (GstBaseSrc * bsrc);
+static gboolean gst_dmss_dav_src_get_size (GstBaseSrc * bsrc, guint64 * size);
+static GstFlowReturn gst_dmss_dav_src_create (GstBaseSrc * bsrc,
+    guint64 offset, guint length, GstBuffer ** outbuf);
+
+static void
+gst_dmss_dav_src_class_init (GstDmssDavSrcClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+  GstBaseSrcClass *gstbasesrc_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+  gstbasesrc_class = (GstBaseSrcClass *) klass;
+
+  gobject_class->set_property = gst_dmss_dav_src_set_property;
+  gobject_class->get_property = gst_dmss_dav_src_get_property;
+  gobject_class->finalize = gst_dmss_dav_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File Location",
+          "Location of the .dav file to read", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  gst_element_class_add_static_pad_template (gstelement_class,
+      &src_template);
+
+  gst_element_class_set_metadata (gstelement_class,
+      "DMSS .dav file source",
+      "Source/File",
+      "Read a .dav recording through a memory mapping",
+      "Felipe Magno de Almeida <felipe@expertisesolutions.com.br>");
+
+  gstbasesrc_class->start = GST_DEBUG_FUNCPTR (gst_dmss_dav_src_start);
+  gstbasesrc_class->stop = GST_DEBUG_FUNCPTR (gst_dmss_dav_src_stop);
+  gstbasesrc_class->is_seekable =
+      GST_DEBUG_FUNCPTR (gst_dmss_dav_src_is_seekable);
+  gstbasesrc_class->get_size = GST_DEBUG_FUNCPTR (gst_dmss_dav_src_get_size);
+  gstbasesrc_class->create = GST_DEBUG_FUNCPTR (gst_dmss_dav_src_create);
+
+  GST_DEBUG_CATEGORY_INIT (dmssdavsrc_debug, "dmssdavsrc", 0,
+      "DMSS .dav File Source");
+}
+
+static void
+gst_dmss_dav_src_init (GstDmssDavSrc * src)
+{
+  src->location = NULL;
+  src->mapped = NULL;
+  src->data = NULL;
+  src->size = 0;
+  src->next_offset = 0;
+
+  gst_base_src_set_blocksize (GST_BASE_SRC (src), DMSS_DAV_DEFAULT_BLOCKSIZE);
+}
+
+static void
+gst_dmss_dav_src_finalize (GObject * gobject)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (gobject);
+
+  g_assert (src->mapped == NULL);
+  g_free (src->location);
+
+  G_OBJECT_CLASS (parent_class)->finalize (gobject);
+}
+
+static gboolean
+gst_dmss_dav_src_set_location (GstDmssDavSrc * src, const gchar * location,
+    GError ** err)
+{
+  GstState state;
+
+  GST_OBJECT_LOCK (src);
+  state = GST_STATE (src);
+  if (state != GST_STATE_READY && state != GST_STATE_NULL) {
+    GST_OBJECT_UNLOCK (src);
+    g_set_error (err, GST_URI_ERROR, GST_URI_ERROR_BAD_STATE,
+        "Changing the location of dmssdavsrc while open is not supported");
+    return FALSE;
+  }
+  g_free (src->location);
+  src->location = g_strdup (location);
+  GST_OBJECT_UNLOCK (src);
+
+  return TRUE;
+}
+
+static void
+gst_dmss_dav_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (object);
+  GError *err = NULL;
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      if (!gst_dmss_dav_src_set_location (src, g_value_get_string (value),
+              &err)) {
+        g_warning ("%s", err->message);
+        g_error_free (err);
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_dmss_dav_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (object);
+
+  switch (prop_id) {
+    case PROP_LOCATION:
+      GST_OBJECT_LOCK (src);
+      g_value_set_string (value, src->location);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Hints the kernel about how a range of the mapping is about to be read */
+static void
+gst_dmss_dav_src_advise (GstDmssDavSrc * src, guint64 offset, guint64 size,
+    int advice)
+{
+  guint64 page_size = sysconf (_SC_PAGESIZE);
+  guint64 start = offset & ~(page_size - 1);
+
+  if (offset >= src->size)
+    return;
+  size = MIN (size, src->size - offset) + (offset - start);
+
+  if (madvise ((void *) (src->data + start), size, advice) < 0)
+    GST_DEBUG_OBJECT (src, "madvise %d failed: %s", advice,
+        g_strerror (errno));
+}
+
+static gboolean
+gst_dmss_dav_src_start (GstBaseSrc * bsrc)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (bsrc);
+  GError *err = NULL;
+
+  if (!src->location) {
+    GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND,
+        ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+
+  if (!(src->mapped = g_mapped_file_new (src->location, FALSE, &err))) {
+    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ,
+        ("Could not open file \"%s\" for reading.", src->location),
+        ("%s", err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+
+  src->data = (const guint8 *) g_mapped_file_get_contents (src->mapped);
+  src->size = g_mapped_file_get_length (src->mapped);
+  src->next_offset = 0;
+
+  if (src->size)
+    gst_dmss_dav_src_advise (src, 0, src->size, MADV_SEQUENTIAL);
+
+  GST_DEBUG_OBJECT (src, "Mapped %s, %" G_GUINT64_FORMAT " bytes",
+      src->location, src->size);
+
+  return TRUE;
+}
+
+static gboolean
+gst_dmss_dav_src_stop (GstBaseSrc * bsrc)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (bsrc);
+
+  // buffers still downstream hold the mapping until they are freed
+  if (src->mapped) {
+    g_mapped_file_unref (src->mapped);
+    src->mapped = NULL;
+  }
+  src->data = NULL;
+  src->size = 0;
+
+  return TRUE;
+}
+
+static gboolean
+gst_dmss_dav_src_is_seekable (GstBaseSrc * bsrc)
+{
+  return TRUE;
+}
+
+static gboolean
+gst_dmss_dav_src_get_size (GstBaseSrc * bsrc, guint64 * size)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (bsrc);
+
+  if (!src->mapped)
+    return FALSE;
+
+  *size = src->size;
+  return TRUE;
+}
+
+static GstFlowReturn
+gst_dmss_dav_src_create (GstBaseSrc * bsrc, guint64 offset, guint length,
+    GstBuffer ** outbuf)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (bsrc);
+  GstBuffer *buffer;
+  GstMemory *memory;
+
+  if (offset >= src->size)
+    return GST_FLOW_EOS;
+  length = MIN (length, src->size - offset);
+
+  if (offset != src->next_offset) {
+    GST_LOG_OBJECT (src, "Jump to %" G_GUINT64_FORMAT, offset);
+    gst_dmss_dav_src_advise (src, offset,
+        MAX (length, DMSS_DAV_SEEK_READAHEAD), MADV_WILLNEED);
+  }
+  src->next_offset = offset + length;
+
+  // every memory spans the whole mapping, so adjacent ones can be merged
+  // without a copy
+  memory = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+      (gpointer) src->data, src->size, offset, length,
+      g_mapped_file_ref (src->mapped), (GDestroyNotify) g_mapped_file_unref);
+
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer, memory);
+  GST_BUFFER_OFFSET (buffer) = offset;
+  GST_BUFFER_OFFSET_END (buffer) = offset + length;
+
+  *outbuf = buffer;
+  return GST_FLOW_OK;
+}
+
+static GstURIType
+gst_dmss_dav_src_uri_get_type (GType type)
+{
+  return GST_URI_SRC;
+}
+
+static const gchar *const *
+gst_dmss_dav_src_uri_get_protocols (GType type)
+{
+  static const gchar *protocols[] = { "file", NULL };
+
+  return protocols;
+}
+
+static gchar *
+gst_dmss_dav_src_uri_get_uri (GstURIHandler * handler)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (handler);
+  gchar *uri = NULL;
+
+  GST_OBJECT_LOCK (src);
+  if (src->location)
+    uri = gst_filename_to_uri (src->location, NULL);
+  GST_OBJECT_UNLOCK (src);
+
+  return uri;
+}
+
+static gboolean
+gst_dmss_dav_src_uri_set_uri (GstURIHandler * handler, const gchar * uri,
+    GError ** err)
+{
+  GstDmssDavSrc *src = GST_DMSS_DAV_SRC (handler);
+  gchar *location;
+  gboolean ret;
+
+  if (!(location = g_filename_from_uri (uri, NULL, err)))
+    return FALSE;
+
+  ret = gst_dmss_dav_src_set_location (src, location, err);
+  g_free (location);
+
+  return ret;
+}
+
+static void
+gst_dmss_dav_src_uri_handler_init (gpointer g_iface, gpointer iface_data)
+{
+  GstURIHandlerInterface *iface = (GstURIHandlerInterface *) g_iface;
+
+  iface->get_type = gst_dmss_dav_src_uri_get_type;
+  iface->get_protocols = gst_dmss_dav_src_uri_get_protocols;
+  iface->get_uri = gst_dmss_dav_src_uri_get_uri;
+  iface->set_uri = gst_dmss_dav_src_uri_set_uri;
+}
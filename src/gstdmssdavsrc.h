@@ -0,0 +1,65 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_DAV_SRC_H__
+#define __GST_DMSS_DAV_SRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DMSS_DAV_SRC                   \
+  (gst_dmss_dav_src_get_type())
+#define GST_DMSS_DAV_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DMSS_DAV_SRC,GstDmssDavSrc))
+#define GST_DMSS_DAV_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_DMSS_DAV_SRC,GstDmssDavSrcClass))
+#define GST_IS_DMSS_DAV_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DMSS_DAV_SRC))
+#define GST_IS_DMSS_DAV_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DMSS_DAV_SRC))
+typedef struct _GstDmssDavSrc GstDmssDavSrc;
+typedef struct _GstDmssDavSrcClass GstDmssDavSrcClass;
+
+struct _GstDmssDavSrc
+{
+  GstBaseSrc element;
+
+  /*< private > */
+  gchar *location;
+
+  /* mapped from READY to PAUSED, buffers keep their own reference */
+  GMappedFile *mapped;
+  const guint8 *data;
+  guint64 size;
+  /* where the last read ended, anything else is a seek */
+  guint64 next_offset;
+};
+
+struct _GstDmssDavSrcClass
+{
+  GstBaseSrcClass parent_class;
+};
+
+GType gst_dmss_dav_src_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_DMSS_DAV_SRC_H__ */
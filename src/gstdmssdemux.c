@@ -28,7 +28,12 @@
 #endif
 #include <gst/gst.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include "gstdmssdemux.h"
+#include "gstdmssassembler.h"
+#include "gstdmssdavindex.h"
+#include "gstdmssdhavscan.h"
+#include "gstdmssprotocol.h"
 #include "gstdmss.h"
 
 #include <stdio.h>
@@ -41,6 +46,14 @@ GST_DEBUG_CATEGORY_STATIC (dmssdemux_debug);
 static const char DHAV_prefix[4] = {'D', 'H', 'A', 'V'};
 static const char DHAV_suffix[4] = {'d', 'h', 'a', 'v'};
 
+/* pull mode */
+#define DMSS_PULL_CHUNK_SIZE (64 * 1024)
+#define DMSS_SCAN_CHUNK_SIZE (1024 * 1024)
+#define DHAV_FRAME_HEADER_SIZE 24
+#define DHAV_FRAME_MIN_SIZE 32
+#define DMSS_DEFAULT_SIDECAR_INDEX TRUE
+#define DMSS_DEFAULT_INDEX_SIBLINGS FALSE
+
 #define VIDEO_CAPS \
   GST_STATIC_CAPS (\
     "video/x-h264, stream-format=(string)byte-stream;" \
@@ -66,7 +79,7 @@ static const char DHAV_suffix[4] = {'d', 'h', 'a', 'v'};
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS ("application/x-dmss"));
+    GST_STATIC_CAPS ("application/x-dmss; video/x-dhav"));
 
 static GstStaticPadTemplate video_template = GST_STATIC_PAD_TEMPLATE ("video",
     GST_PAD_SRC,
@@ -81,12 +94,17 @@ static GstStaticPadTemplate audio_template = GST_STATIC_PAD_TEMPLATE ("audio",
 enum
 {
   PROP_0,
-  PROP_LATENCY
+  PROP_LATENCY,
+  PROP_SIDECAR_INDEX,
+  PROP_INDEX_SIBLINGS,
+  PROP_MEMCPY_RATE,
+  PROP_STATS
 };
 
 #define gst_dmss_demux_parent_class parent_class
 G_DEFINE_TYPE (GstDmssDemux, gst_dmss_demux, GST_TYPE_ELEMENT);
 
+static void gst_dmss_demux_dispose (GObject * object);
 static void gst_dmss_demux_finalize (GObject * object);
 
 static GstPad *gst_dmss_demux_add_audio_pad (GstDmssDemux * demux,
@@ -115,10 +133,15 @@ static GstFlowReturn gst_dmss_demux_chain (GstPad * pad, GstObject * parent,
 
 static gboolean gst_dmss_demux_sink_activate (GstPad * sinkpad,
     GstObject * parent);
+static gboolean gst_dmss_demux_sink_activate_mode (GstPad * sinkpad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+static void gst_dmss_demux_loop (GstPad * pad);
 static GstStateChangeReturn gst_dmss_demux_change_state (GstElement * element,
     GstStateChange transition);
 static GstClockTime gst_dmss_demux_calculate_pts (GstDmssDemux *demux,
     guint16 frame_epoch, guint16 frame_ts, gboolean is_audio);
+static GstClockTime gst_dmss_demux_calculate_trick_pts (GstDmssDemux *demux,
+    guint32 frame_time, guint16 frame_ts);
 
 static void gst_dmss_demux_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
@@ -139,12 +162,32 @@ gst_dmss_demux_class_init (GstDmssDemuxClass * klass)
 
   gobject_class->set_property = gst_dmss_demux_set_property;
   gobject_class->get_property = gst_dmss_demux_get_property;
+  gobject_class->dispose = gst_dmss_demux_dispose;
   gobject_class->finalize = gst_dmss_demux_finalize;
 
   g_object_class_install_property (gobject_class, PROP_LATENCY,
       g_param_spec_uint ("latency", "Latency",
           "Set latency in ms", 0, G_MAXUINT, DMSS_DEFAULT_LATENCY,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SIDECAR_INDEX,
+      g_param_spec_boolean ("sidecar-index", "Sidecar index",
+          "Keep the keyframe index of .dav files read in pull mode in a "
+          "<file>.idx next to them", DMSS_DEFAULT_SIDECAR_INDEX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_INDEX_SIBLINGS,
+      g_param_spec_boolean ("index-siblings", "Index siblings",
+          "Build the missing sidecar indexes of the other .dav files in the "
+          "directory in the background", DMSS_DEFAULT_INDEX_SIBLINGS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MEMCPY_RATE,
+      g_param_spec_uint64 ("memcpy-rate", "memcpy rate",
+          "Bytes per second copied while parsing DHAV frames over the last "
+          "second", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Recovery from corrupted data: bytes-skipped and frames-salvaged",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
   
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_dmss_demux_change_state);
@@ -226,6 +269,7 @@ gst_dmss_demux_segment_init (GstDmssDemux * demux, GstClockTime timestamp)
   gst_segment_init (&demux->time_segment, GST_FORMAT_TIME);
 
   demux->time_segment.start = demux->time_segment.position = timestamp;
+  demux->time_segment.applied_rate = demux->rate;
 
   event = gst_event_new_segment (&demux->time_segment);
   if (demux->segment_seqnum)
@@ -234,51 +278,18 @@ gst_dmss_demux_segment_init (GstDmssDemux * demux, GstClockTime timestamp)
   demux->need_segment = FALSE;
 }
 
-static guint64
-gst_dmss_demux_find_extended_header_value (guint8 prefix,
-    guint64 extended_header[32])
-{
-  int i;
-  gint64 v = -1;
-
-  for (i = 0; i != 32; ++i) {
-    if (prefix != 0x88 || prefix != 0x82) {
-      guint8 pv = (extended_header[i] & 0xFF000000) >> 24;
-      if (pv == prefix) {
-        v = extended_header[i] & 0xFFFFFF;
-        break;
-      } else if (!pv)
-        break;
-    } else {
-      guint8 pv = (extended_header[i] & 0xFF00000000000000) >> 56;
-      if (pv == prefix) {
-        v = extended_header[i] & 0xFFFFFFFFFFFFFF;
-        break;
-      } else if (!pv)
-        break;
-    }
-  }
-
-  return v;
-}
-
 static void
 gst_dmss_demux_audio_prepare_buffer (GstDmssDemux * demux, GstBuffer * buffer,
-                                     guint64 extended_header[32], GstClockTime frame_ts)
+                                     const GstDmssDhavInfo * info, GstClockTime frame_ts)
 {
   GstDmssAudioFormat format;
   GstDmssAudioRate rate;
-  guint64 value;
   GstCaps *caps;
   int rate_num;
 
-  value =
-      gst_dmss_demux_find_extended_header_value
-      (DMSS_EXTENDED_HEADER_AUDIOINFO_PREFIX, extended_header);
-
-  if (value != -1) {
-    format = (value & 0xFF00) >> 8;
-    rate = value & 0xFF;
+  if (info->flags & GST_DMSS_DHAV_INFO_AUDIO) {
+    format = info->audio_format;
+    rate = info->audio_rate;
     if (!demux->audiosrcpad && (format != demux->audio_format
             || rate != demux->audio_rate)) {
       switch (rate) {
@@ -348,18 +359,13 @@ gst_dmss_demux_audio_prepare_buffer (GstDmssDemux * demux, GstBuffer * buffer,
 
 static void
 gst_dmss_demux_video_prepare_buffer (GstDmssDemux * demux, GstBuffer * buffer,
-                                     guint64 extended_header[32], GstClockTime frame_ts)
+                                     const GstDmssDhavInfo * info, GstClockTime frame_ts)
 {
   GstDmssVideoFormat format;
-  guint32 value;
   GstCaps *caps;
 
-  value =
-      gst_dmss_demux_find_extended_header_value
-      (DMSS_EXTENDED_HEADER_VIDEOINFO_PREFIX, extended_header);
-
-  if (value != -1) {
-    format = (value & 0xFF00) >> 8;
+  if (info->flags & GST_DMSS_DHAV_INFO_VIDEO) {
+    format = info->video_format;
     if (format != demux->video_format) {
       switch (format) {
       default:
@@ -391,130 +397,170 @@ gst_dmss_demux_video_prepare_buffer (GstDmssDemux * demux, GstBuffer * buffer,
   }
 }
 
-static void
-gst_dmss_demux_parse_extended_header (GstDmssDemux * demux, gchar * header,
-    int size, guint64 extended_header[32])
+/* Pushes the segment of a pull mode seek once the pads are set up */
+static gboolean
+gst_dmss_demux_push_pending_segment (GstDmssDemux * demux)
 {
-  gchar *p = header, *end = header + size;
-  int i = 0;
-  guint32 copy32;               // because of alignment
+  GstEvent *event;
 
-  while (p != end && i != 32) {
-    GST_DEBUG ("reading extended header of %.02x", (unsigned int) (guint8) * p);
+  if (!demux->segment_pending)
+    return TRUE;
 
-    if (end - p >= sizeof (guint32)) {
-      memcpy (&copy32, p, sizeof (copy32));
-      extended_header[i] = GUINT32_FROM_BE (copy32);
-      p += sizeof (guint32);
-    } else {
-      GST_ELEMENT_WARNING (demux, RESOURCE, READ, (NULL),
-          ("Couldn't parse extended header correctly"));
+  event = gst_event_new_segment (&demux->time_segment);
+  if (demux->segment_seqnum)
+    gst_event_set_seqnum (event, demux->segment_seqnum);
+  demux->segment_pending = FALSE;
+
+  return gst_dmss_demux_push_event (demux, event);
+}
+
+/* Whether a "DHAV" at offset of the pending bytes starts a frame: its
+ * size must fit its headers without going over the largest frame and,
+ * once all of it is here, it must end with the "dhav" trailer repeating
+ * that size. A frame still incomplete is given the benefit of the doubt.
+ */
+static gboolean
+gst_dmss_demux_check_frame (GstDmssDemux * demux, gsize offset)
+{
+  gsize available = gst_dmss_assembler_available (demux->assembler);
+  guint8 header[DHAV_FRAME_HEADER_SIZE], trailer[8];
+  guint32 frame_size;
+
+  if (offset + DHAV_FRAME_HEADER_SIZE > available)
+    return TRUE;
+
+  gst_dmss_assembler_read (demux->assembler, offset, header, sizeof (header));
+  frame_size = GST_READ_UINT32_LE (&header[12]);
+  if (frame_size < DHAV_FRAME_MIN_SIZE + header[22]
+      || frame_size > GST_DMSS_DHAV_MAX_FRAME_SIZE)
+    return FALSE;
+  if (offset + frame_size > available)
+    return TRUE;
+
+  gst_dmss_assembler_read (demux->assembler, offset + frame_size - 8, trailer,
+      sizeof (trailer));
+  return !memcmp (trailer, DHAV_suffix, 4)
+      && GST_READ_UINT32_LE (&trailer[4]) == frame_size;
+}
+
+/* Drops the bytes before the next valid frame, looking only at what can be
+ * read in place. Returns how many were dropped. The frames already queued
+ * behind them count as salvaged as they come out, the next ones are marked
+ * DISCONT.
+ */
+static gsize
+gst_dmss_demux_skip_to_frame (GstDmssDemux * demux)
+{
+  const guint8 *data;
+  gsize size, skip = 1;
+
+  data = gst_dmss_assembler_peek_contiguous (demux->assembler, &size);
+  if (size < DHAV_FRAME_MIN_SIZE) {
+    data = gst_dmss_assembler_peek (demux->assembler, DHAV_FRAME_MIN_SIZE);
+    size = DHAV_FRAME_MIN_SIZE;
+  }
+
+  while (TRUE) {
+    skip += gst_dmss_dhav_scan (data + skip, size - skip);
+    // a prefix may still start in the last bytes
+    if (skip + 4 > size) {
+      skip = size - 3;
       break;
     }
-    GST_DEBUG ("Value read for header %" G_GUINT64_FORMAT, extended_header[i]);
-    ++i;
+    if (gst_dmss_demux_check_frame (demux, skip))
+      break;
+    GST_LOG_OBJECT (demux, "False DHAV prefix at %" G_GSIZE_FORMAT, skip);
+    ++skip;
   }
+
+  gst_dmss_assembler_flush (demux->assembler, skip);
+
+  GST_OBJECT_LOCK (demux);
+  demux->bytes_skipped += skip;
+  GST_OBJECT_UNLOCK (demux);
+  demux->salvage_remaining = gst_dmss_assembler_available (demux->assembler);
+  demux->video_discont = demux->audio_discont = TRUE;
+
+  return skip;
 }
 
 static void
+gst_dmss_demux_update_memcpy_rate (GstDmssDemux * demux)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  demux->memcpy_bytes += gst_dmss_assembler_take_copied (demux->assembler);
+  if (!GST_CLOCK_TIME_IS_VALID (demux->last_rate_time)) {
+    demux->last_rate_time = now;
+  } else if (now - demux->last_rate_time > GST_SECOND) {
+    GST_OBJECT_LOCK (demux);
+    demux->memcpy_rate = gst_util_uint64_scale (demux->memcpy_bytes,
+        GST_SECOND, now - demux->last_rate_time);
+    GST_OBJECT_UNLOCK (demux);
+    GST_DEBUG_OBJECT (demux, "Copied %" G_GUINT64_FORMAT " Bps",
+        demux->memcpy_rate);
+    demux->memcpy_bytes = 0;
+    demux->last_rate_time = now;
+  }
+}
+
+static GstFlowReturn
 gst_dmss_demux_flush (GstDmssDemux * demux)
 {
+  GstFlowReturn ret = GST_FLOW_OK;
   //int const prologue_size = 32;
   int const dhav_fixed_header_size = 24;
   int const dhav_epilogue_size = 8;
-  int const minimum_prefix_search = 32*1024;
-  guint64 extended_header[32];
-  gsize size;
+  GstDmssDhavInfo info;
+  gsize size, skipped;
   GstBuffer *buffer = NULL;
-  GstMapInfo map;
+  guint8 trailer[8];
   guint8 dhav_packet_type;
   guint32 dhav_packet_size;
   guint32 dhav_head_size;
   guint32 dhav_body_size;
-  gchar const *prologue;
+  guint8 const *prologue;
   guint32 minimum_dhav_size = dhav_fixed_header_size + dhav_epilogue_size;
   guint16 frame_epoch;
+  guint32 frame_time;
   guint16 frame_ts/*, ring_diff_ts*//*, reverse_ring_diff_ts*/;
   //int diff_ts;
   //GstClockTime absolute_timestamp;
   gboolean is_audio;
   gchar const *error_msg;
-  int start_offset, mapped_size;
 
-  size = gst_adapter_available (demux->adapter);
+  size = gst_dmss_assembler_available (demux->assembler);
 
+  // one pass over every complete frame, the header is read in place unless
+  // it wraps over two of the buffers received
   while (size >= /*prologue_size +*/ minimum_dhav_size) {
     GST_INFO_OBJECT (demux, "loop size %d", (int)size);
-    prologue =
-      gst_adapter_map (demux->adapter, /*prologue_size +*/ minimum_dhav_size);
-    if (!prologue)
-      goto adapter_map_error;
+    prologue = gst_dmss_assembler_peek (demux->assembler, minimum_dhav_size);
 
-    start_offset = 0;
-
-    if ((prologue[/*prologue_size +*/ 0] != DHAV_prefix[0] ||
-         prologue[/*prologue_size +*/ 1] != DHAV_prefix[1] ||
-         prologue[/*prologue_size +*/ 2] != DHAV_prefix[2] ||
-         prologue[/*prologue_size +*/ 3] != DHAV_prefix[3])) {
+    dhav_packet_size = GST_READ_UINT32_LE (&prologue[12]);
+    if (memcmp (prologue, DHAV_prefix, 4)
+        || dhav_packet_size < minimum_dhav_size + prologue[22]
+        || dhav_packet_size > GST_DMSS_DHAV_MAX_FRAME_SIZE) {
       GST_WARNING_OBJECT (demux, "Out of sync on data received");
-      while (size - start_offset > /*prologue_size +*/ minimum_dhav_size &&
-             (prologue[/*prologue_size +*/ start_offset + 0] != DHAV_prefix[0] ||
-              prologue[/*prologue_size +*/ start_offset + 1] != DHAV_prefix[1] ||
-              prologue[/*prologue_size +*/ start_offset + 2] != DHAV_prefix[2] ||
-              prologue[/*prologue_size +*/ start_offset + 3] != DHAV_prefix[3])) {
-        GST_LOG_OBJECT (demux, "searching for prologue DHAV prefix (not found immediatelly)");
-        mapped_size = start_offset + minimum_prefix_search < size ? start_offset + minimum_prefix_search : size;
-        assert (mapped_size <= size);
-        assert (mapped_size >= /*prologue_size +*/ minimum_dhav_size);
-        
-        gst_adapter_unmap (demux->adapter);
-        GST_LOG_OBJECT (demux, "Remapping for %d size with %d offset", mapped_size, start_offset);
-        prologue = gst_adapter_map (demux->adapter, mapped_size);
-        if (!prologue) {
-          gst_adapter_flush (demux->adapter, start_offset);
-          goto adapter_map_error;
-        }
-
-        while (mapped_size - start_offset != /*prologue_size +*/ minimum_dhav_size && 
-               (prologue[/*prologue_size +*/ start_offset + 0] != DHAV_prefix[0] ||
-                prologue[/*prologue_size +*/ start_offset + 1] != DHAV_prefix[1] ||
-                prologue[/*prologue_size +*/ start_offset + 2] != DHAV_prefix[2] ||
-                prologue[/*prologue_size +*/ start_offset + 3] != DHAV_prefix[3]))
-          ++start_offset;
-
-        GST_LOG_OBJECT (demux, "searching for prologue DHAV prefix (discarding at least %d) mapped_size %d", start_offset, mapped_size);
-      }
+      skipped = gst_dmss_demux_skip_to_frame (demux);
+      GST_DEBUG ("Packet didn't start at right offset. Skipped %d bytes",
+          (int) skipped);
+      size -= skipped;
+      continue;
     }
-    else
-      GST_LOG_OBJECT (demux, "Prologue DHAV prefix found at %d", start_offset);
 
-    if ((prologue[/*prologue_size +*/ start_offset + 0] != DHAV_prefix[0] ||
-         prologue[/*prologue_size +*/ start_offset + 1] != DHAV_prefix[1] ||
-         prologue[/*prologue_size +*/ start_offset + 2] != DHAV_prefix[2] ||
-         prologue[/*prologue_size +*/ start_offset + 3] != DHAV_prefix[3]))
-      goto prefix_error;
+    GST_LOG_OBJECT (demux, "Prologue DHAV prefix found");
 
-    GST_LOG_OBJECT (demux, "Prologue DHAV prefix found at %d", start_offset);
-
-    prologue += start_offset;
     dhav_packet_type = prologue[/*prologue_size +*/ 4];
-
-    dhav_packet_size =
-        GUINT32_FROM_LE (*(guint32 *) & prologue[/*prologue_size +*/ 12]);
-    dhav_head_size = *(unsigned char *) &prologue[/*prologue_size +*/ 22];
+    dhav_head_size = prologue[/*prologue_size +*/ 22];
     dhav_body_size =
         dhav_packet_size - (dhav_fixed_header_size + dhav_epilogue_size +
         dhav_head_size);
+    frame_epoch = GST_READ_UINT16_LE (&prologue[/*prologue_size +*/ 16]);
+    frame_ts = GST_READ_UINT16_LE (&prologue[/*prologue_size +*/ 20]);
+    frame_time = GST_READ_UINT32_LE (&prologue[16]);
 
-    GST_INFO("byte after head size: %d", (int) *(unsigned char *) &prologue[/*prologue_size +*/ 23]);
-    
-    gst_adapter_unmap (demux->adapter);
-
-    if (start_offset) {
-      GST_DEBUG ("Packet didn't start at right offset. Skipped %d bytes",
-          start_offset);
-      gst_adapter_flush (demux->adapter, start_offset);
-    }
+    GST_INFO("byte after head size: %d", (int) prologue[/*prologue_size +*/ 23]);
 
     GST_DEBUG
         ("DHAV packet (checking if downloaded) type: %.02x DHAV size: %d head size: %d body size: %d",
@@ -527,14 +573,17 @@ gst_dmss_demux_flush (GstDmssDemux * demux)
       if (is_audio)
         GST_INFO ("DHAV audio packet");
 
-      if (!is_audio && (
+      // audio at another rate is just noise
+      if ((is_audio && demux->rate != 1.0) || (!is_audio && (
           dhav_packet_type != (unsigned char) 0xfc &&
           dhav_packet_type != (unsigned char) 0xfd /*&&
-                                                     dhav_packet_type != (unsigned char) 0xf1*/)) {
+                                                     dhav_packet_type != (unsigned char) 0xf1*/))) {
         /* discard packet */
         GST_INFO ("Discarding DHAV packet that is not video frame type: %d", (int)(unsigned int)dhav_packet_type);
-        gst_adapter_flush (demux->adapter, dhav_packet_size/* + prologue_size*/);
-        size = gst_adapter_available (demux->adapter);
+        gst_dmss_assembler_flush (demux->assembler, dhav_packet_size/* + prologue_size*/);
+        size -= dhav_packet_size;
+        demux->salvage_remaining -= MIN (demux->salvage_remaining,
+            dhav_packet_size);
         continue;
       }
 
@@ -543,51 +592,76 @@ gst_dmss_demux_flush (GstDmssDemux * demux)
            (int) size, (int) dhav_packet_size/* + prologue_size*/);
       assert (buffer == NULL);
 
-      buffer = gst_adapter_take_buffer_fast (demux->adapter, dhav_packet_size);
+      gst_dmss_assembler_read (demux->assembler, dhav_packet_size - 8,
+          trailer, sizeof (trailer));
 
-      gst_buffer_map (buffer, &map, GST_MAP_READ);
-
-      if (map.data[/*prologue_size +*/ dhav_packet_size - 8] != DHAV_suffix[0] ||
-          map.data[/*prologue_size +*/ dhav_packet_size - 7] != DHAV_suffix[1] ||
-          map.data[/*prologue_size +*/ dhav_packet_size - 6] != DHAV_suffix[2] ||
-          map.data[/*prologue_size +*/ dhav_packet_size - 5] != DHAV_suffix[3]) {
+      error_msg = NULL;
+      if (memcmp (trailer, DHAV_suffix, 4))
         error_msg = "Packet doesn't end with dhav suffix";
-        goto corrupted_error;
-      }
-
-      if (GUINT32_FROM_LE (*(guint32 *) & map.data[/*prologue_size +*/
-                  dhav_packet_size - 4]) != dhav_packet_size) {
+      else if (GST_READ_UINT32_LE (&trailer[4]) != dhav_packet_size)
         error_msg = "Packet suffixed size doesn't match header packet size";
-        goto corrupted_error;
+
+      // only the bad frame is lost, the ones queued after it still play
+      if (error_msg) {
+        GST_ELEMENT_INFO (demux, RESOURCE, READ, (NULL),
+            ("DHAV packet is corrupted: %s", error_msg));
+        skipped = gst_dmss_demux_skip_to_frame (demux);
+        GST_DEBUG_OBJECT (demux, "Skipped %d bytes of a corrupted packet",
+            (int) skipped);
+        size -= skipped;
+        continue;
       }
 
-      frame_epoch =
-          GUINT16_FROM_LE (*(guint16 *) & prologue[/*prologue_size +*/ 16]);
-      frame_ts = GUINT16_FROM_LE (*(guint16 *) & prologue[/*prologue_size +*/ 20]);
       //uint16_t xx = GUINT16_FROM_LE (*(guint16 *) & prologue[/*prologue_size +*/ 20]);
 
       GST_INFO ("DHAV frame timing info epoch: %d timestamp: %d",
           (int) frame_epoch, (int) frame_ts);
 
-      gst_dmss_demux_parse_extended_header (demux,
-          (gchar *) map.data +
-                                            /*prologue_size +*/
-          dhav_fixed_header_size, dhav_head_size, extended_header);
+      prologue = gst_dmss_assembler_peek (demux->assembler,
+          dhav_fixed_header_size + dhav_head_size);
+      if (!gst_dmss_protocol_parse_dhav_header (prologue,
+              dhav_fixed_header_size + dhav_head_size, &info))
+        GST_LOG_OBJECT (demux, "Extended header tag cut short");
+      // new firmware brings new tags, tell about each one once
+      if (info.unknown_tag && !(demux->unknown_tags[info.unknown_tag / 32] &
+              (1u << (info.unknown_tag % 32)))) {
+        demux->unknown_tags[info.unknown_tag / 32] |=
+            1u << (info.unknown_tag % 32);
+        GST_DEBUG_OBJECT (demux, "Skipping extended header from unknown tag "
+            "%.02x", (unsigned int) info.unknown_tag);
+      }
+
+      // the payload shares the memory it was received in, a frame over
+      // several packets gets a memory of each
+      gst_dmss_assembler_flush (demux->assembler,
+          dhav_fixed_header_size + dhav_head_size);
+      buffer = gst_dmss_assembler_take_buffer (demux->assembler,
+          dhav_body_size);
+      gst_dmss_assembler_flush (demux->assembler, dhav_epilogue_size);
+      size -= dhav_packet_size;
+
+      if (demux->salvage_remaining) {
+        demux->salvage_remaining -= MIN (demux->salvage_remaining,
+            dhav_packet_size);
+        GST_OBJECT_LOCK (demux);
+        ++demux->frames_salvaged;
+        GST_OBJECT_UNLOCK (demux);
+      }
 
       GstClockTime pts;
 
-      pts = gst_dmss_demux_calculate_pts (demux, frame_epoch, frame_ts
-                                          , !is_audio);
+      if (demux->rate != 1.0)
+        pts = gst_dmss_demux_calculate_trick_pts (demux, frame_time, frame_ts);
+      else
+        pts = gst_dmss_demux_calculate_pts (demux, frame_epoch, frame_ts
+                                            , !is_audio);
       GST_INFO ("DHAV frame timing info epoch: %d timestamp: %d pts: %" GST_TIME_FORMAT,
                  (int) frame_epoch, (int) frame_ts, GST_TIME_ARGS(pts));
       
       if (is_audio)
-        gst_dmss_demux_audio_prepare_buffer (demux, buffer, extended_header, pts);
+        gst_dmss_demux_audio_prepare_buffer (demux, buffer, &info, pts);
       else if (!is_audio)
-        gst_dmss_demux_video_prepare_buffer (demux, buffer, extended_header, pts);
-
-      gst_buffer_unmap (buffer, &map);
-      buffer = gst_buffer_make_writable (buffer);
+        gst_dmss_demux_video_prepare_buffer (demux, buffer, &info, pts);
 
       if (dhav_packet_type == (unsigned char) 0xfd)
       {
@@ -605,17 +679,20 @@ gst_dmss_demux_flush (GstDmssDemux * demux)
       /*     GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (buffer)), */
       /*     GST_BUFFER_OFFSET (buffer), GST_BUFFER_OFFSET_END (buffer)); */
 
-      GST_DEBUG ("Resizing buffer to offset %d and size %d",
-          (int) /*prologue_size +*/ dhav_head_size, (int) dhav_body_size);
-      gst_buffer_resize (buffer,
-          /*prologue_size +*/ dhav_head_size +
-          dhav_fixed_header_size, dhav_body_size);
-      GST_DEBUG ("Resized");
+      if (demux->pull_mode) {
+        gst_dmss_demux_push_pending_segment (demux);
+        if (!is_audio)
+          demux->time_segment.position = pts;
+      }
 
       if (is_audio) {
         if (demux->audiosrcpad) {
           /* GST_DEBUG ("pushed audio buffer"); */
           GST_INFO_OBJECT (demux, "pushing audio buffer");
+          if (demux->audio_discont) {
+            GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+            demux->audio_discont = FALSE;
+          }
           gst_pad_push (demux->audiosrcpad, buffer);
           GST_DEBUG_OBJECT (demux, "pushed audio buffer");
           buffer = NULL;
@@ -632,14 +709,20 @@ gst_dmss_demux_flush (GstDmssDemux * demux)
         GstClockTime now = gst_clock_get_time(gst_system_clock_obtain());
         GST_INFO_OBJECT (demux, "pushing video buffer %d diff (time )%dms", ++i, (int)((now - last)/(1000*1000)));
         last = now;
-        if (gst_pad_push (demux->videosrcpad, buffer) != GST_FLOW_OK) {
+        if (demux->video_discont) {
+          GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+          demux->video_discont = FALSE;
+        }
+        if ((ret = gst_pad_push (demux->videosrcpad, buffer)) != GST_FLOW_OK) {
           GST_ERROR_OBJECT (demux, "Error pushing buffer to video pad");
         }
         GST_DEBUG_OBJECT (demux, "pushed video buffer");
         buffer = NULL;
       }
-      
-      size = gst_adapter_available (demux->adapter);
+
+      // a seek in pull mode has to get the streaming thread back
+      if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED)
+        break;
     } else {
       /* demux->waiting_dhav_end = TRUE; */
       GST_DEBUG ("Needs to download more to complete DHAV packet");
@@ -648,24 +731,9 @@ gst_dmss_demux_flush (GstDmssDemux * demux)
     }
   }
 
+  gst_dmss_demux_update_memcpy_rate (demux);
   GST_INFO_OBJECT (demux, "Return from flush");
-  return;
-prefix_error:
-  GST_ELEMENT_INFO (demux, RESOURCE, READ, (NULL),
-      ("DHAV packet doesn't start with the correct bytes"));
-  gst_adapter_unmap (demux->adapter);
-  gst_adapter_clear (demux->adapter);
-  return;
-corrupted_error:
-  GST_ELEMENT_INFO (demux, RESOURCE, READ, (NULL),
-      ("DHAV packet is corrupted: %s", error_msg));
-  gst_object_unref (buffer);
-  gst_buffer_unmap (buffer, &map);
-  gst_adapter_clear (demux->adapter);
-  return;
-adapter_map_error:
-  GST_ELEMENT_ERROR (demux, RESOURCE, READ, (NULL),
-      ("Error mapping buffer with gst_adapter_map"));
+  return ret;
 }
 
 /* initialize the new element
@@ -680,13 +748,32 @@ gst_dmss_demux_init (GstDmssDemux * demux)
   demux->videosrcpad =
       gst_pad_new_from_static_template (&video_template, "video");
   demux->audiosrcpad = NULL;
-  demux->adapter = gst_adapter_new ();
+  demux->assembler = gst_dmss_assembler_new ();
+  demux->memcpy_rate = demux->memcpy_bytes = 0;
+  demux->last_rate_time = GST_CLOCK_TIME_NONE;
+  demux->bytes_skipped = demux->frames_salvaged = 0;
+  demux->salvage_remaining = 0;
+  memset (demux->unknown_tags, 0, sizeof (demux->unknown_tags));
   demux->need_segment = TRUE;
+  demux->video_discont = demux->audio_discont = FALSE;
   demux->segment_seqnum = 0;
   demux->audio_format = GST_DMSS_AUDIO_FORMAT_UNKNOWN;
   demux->video_format = GST_DMSS_VIDEO_FORMAT_UNKNOWN;
   demux->latency = DMSS_DEFAULT_LATENCY;
   demux->pipeline_clock = NULL;
+  demux->dhav_timing = FALSE;
+  demux->rate = 1.0;
+  demux->raw_dhav = demux->input_known = FALSE;
+  demux->pull_mode = FALSE;
+  demux->pull_offset = 0;
+  demux->segment_pending = FALSE;
+  demux->reverse_pts = GST_CLOCK_TIME_NONE;
+  demux->index = NULL;
+  demux->sidecar_index = DMSS_DEFAULT_SIDECAR_INDEX;
+  demux->index_siblings = DMSS_DEFAULT_INDEX_SIBLINGS;
+  demux->sibling_pool = NULL;
+  demux->sibling_paths = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, NULL);
   demux->base_time = 0;
   /* demux->need_resync = TRUE; */
   /* demux->samples = 0; */
@@ -704,6 +791,8 @@ gst_dmss_demux_init (GstDmssDemux * demux)
 
   gst_pad_set_activate_function (demux->sinkpad,
       GST_DEBUG_FUNCPTR (gst_dmss_demux_sink_activate));
+  gst_pad_set_activatemode_function (demux->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_dmss_demux_sink_activate_mode));
 
   gst_pad_set_query_function (demux->sinkpad,
       GST_DEBUG_FUNCPTR (gst_dmss_demux_sink_query));
@@ -718,9 +807,29 @@ gst_dmss_demux_init (GstDmssDemux * demux)
   gst_element_add_pad (GST_ELEMENT (demux), demux->sinkpad);
 }
 
+static void
+gst_dmss_demux_dispose (GObject * object)
+{
+  GstDmssDemux *demux = GST_DMSS_DEMUX (object);
+
+  // files not started yet are left for another run
+  if (demux->sibling_pool)
+    g_thread_pool_free (demux->sibling_pool, TRUE, TRUE);
+  demux->sibling_pool = NULL;
+
+  G_OBJECT_CLASS (parent_class)->dispose (object);
+}
+
 static void
 gst_dmss_demux_finalize (GObject * object)
 {
+  GstDmssDemux *demux = GST_DMSS_DEMUX (object);
+
+  g_hash_table_unref (demux->sibling_paths);
+  gst_dmss_assembler_free (demux->assembler);
+  if (demux->index)
+    gst_dmss_dav_index_free (demux->index);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -737,6 +846,12 @@ gst_dmss_demux_set_property (GObject * object, guint prop_id,
       gst_element_send_event (GST_ELEMENT (demux),
             gst_event_new_latency (demux->latency * GST_MSECOND));
       break;
+  case PROP_SIDECAR_INDEX:
+      demux->sidecar_index = g_value_get_boolean (value);
+      break;
+  case PROP_INDEX_SIBLINGS:
+      demux->index_siblings = g_value_get_boolean (value);
+      break;
   default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -753,6 +868,25 @@ gst_dmss_demux_get_property (GObject * object, guint prop_id,
     case PROP_LATENCY:
       g_value_set_uint (value, demux->latency);
       break;
+    case PROP_SIDECAR_INDEX:
+      g_value_set_boolean (value, demux->sidecar_index);
+      break;
+    case PROP_INDEX_SIBLINGS:
+      g_value_set_boolean (value, demux->index_siblings);
+      break;
+    case PROP_MEMCPY_RATE:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint64 (value, demux->memcpy_rate);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_STATS:
+      GST_OBJECT_LOCK (demux);
+      g_value_take_boxed (value, gst_structure_new ("dmss-demux-stats",
+              "bytes-skipped", G_TYPE_UINT64, demux->bytes_skipped,
+              "frames-salvaged", G_TYPE_UINT64, demux->frames_salvaged,
+              NULL));
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -766,9 +900,21 @@ gst_dmss_demux_change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_READY_TO_PAUSED:
+      // another file may come next, the index goes with the old one
+      demux->raw_dhav = demux->input_known = FALSE;
+      if (demux->index) {
+        gst_dmss_dav_index_free (demux->index);
+        demux->index = NULL;
+      }
+      GST_OBJECT_LOCK (demux);
+      demux->bytes_skipped = demux->frames_salvaged = 0;
+      GST_OBJECT_UNLOCK (demux);
+      memset (demux->unknown_tags, 0, sizeof (demux->unknown_tags));
+      /* fall through */
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
       demux->need_segment = TRUE;
-      gst_adapter_clear (demux->adapter);
+      gst_dmss_assembler_clear (demux->assembler);
+      demux->salvage_remaining = 0;
       break;
     default:
       break;
@@ -798,6 +944,49 @@ gst_dmss_demux_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
   GstDmssDemux *demux = GST_DMSS_DEMUX (parent);
 
   switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_DURATION:
+    {
+      GstFormat format;
+
+      gst_query_parse_duration (query, &format, NULL);
+      if (!demux->pull_mode || format != GST_FORMAT_TIME)
+        return gst_pad_query_default (pad, parent, query);
+
+      if ((ret = demux->index != NULL))
+        gst_query_set_duration (query, GST_FORMAT_TIME,
+            gst_dmss_dav_index_get_duration (demux->index));
+      break;
+    }
+    case GST_QUERY_POSITION:
+    {
+      GstFormat format;
+
+      gst_query_parse_position (query, &format, NULL);
+      if (!demux->pull_mode || format != GST_FORMAT_TIME)
+        return gst_pad_query_default (pad, parent, query);
+
+      gst_query_set_position (query, GST_FORMAT_TIME,
+          demux->time_segment.position);
+      ret = TRUE;
+      break;
+    }
+    case GST_QUERY_SEEKING:
+    {
+      GstFormat format;
+
+      gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
+      if (!demux->pull_mode)
+        return gst_pad_query_default (pad, parent, query);
+
+      if (format == GST_FORMAT_TIME)
+        gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0,
+            demux->index ? gst_dmss_dav_index_get_duration (demux->index) :
+            -1);
+      else
+        gst_query_set_seeking (query, format, FALSE, -1, -1);
+      ret = TRUE;
+      break;
+    }
     case GST_QUERY_LATENCY:
     {
       if ((ret = gst_pad_peer_query (demux->sinkpad, query))) {
@@ -863,14 +1052,490 @@ static GstClock *gst_dmss_demux_provide_clock (GstElement * element)
   return gst_system_clock_obtain ();
 }
 
-/* decide on push or pull based scheduling */
+/* decide on push or pull based scheduling. Only files can be pulled
+ * from, the network source always pushes.
+ */
 static gboolean
 gst_dmss_demux_sink_activate (GstPad * sinkpad, GstObject * parent)
 {
+  GstQuery *query = gst_query_new_scheduling ();
+  gboolean pull_mode = FALSE;
+
+  if (gst_pad_peer_query (sinkpad, query))
+    pull_mode = gst_query_has_scheduling_mode_with_flags (query,
+        GST_PAD_MODE_PULL, GST_SCHEDULING_FLAG_SEEKABLE);
+  gst_query_unref (query);
+
+  if (pull_mode) {
+    GST_DEBUG_OBJECT (sinkpad, "activating pull");
+    return gst_pad_activate_mode (sinkpad, GST_PAD_MODE_PULL, TRUE);
+  }
+
   /* GST_DEBUG_OBJECT (sinkpad, "activating push"); */
   return gst_pad_activate_mode (sinkpad, GST_PAD_MODE_PUSH, TRUE);
 }
 
+static gboolean
+gst_dmss_demux_sink_activate_mode (GstPad * sinkpad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstDmssDemux *demux = GST_DMSS_DEMUX (parent);
+
+  switch (mode) {
+    case GST_PAD_MODE_PUSH:
+      demux->pull_mode = FALSE;
+      return TRUE;
+    case GST_PAD_MODE_PULL:
+      if (!active)
+        return gst_pad_stop_task (sinkpad);
+
+      demux->pull_mode = TRUE;
+      demux->raw_dhav = demux->input_known = TRUE;
+      demux->dhav_timing = TRUE;
+      demux->segment_seqnum = 0;
+      gst_segment_init (&demux->time_segment, GST_FORMAT_TIME);
+      return gst_pad_start_task (sinkpad,
+          (GstTaskFunction) gst_dmss_demux_loop, sinkpad, NULL);
+    default:
+      return FALSE;
+  }
+}
+
+/* Starts reading a .dav file again at a frame with the given timing */
+static void
+gst_dmss_demux_pull_restart (GstDmssDemux * demux, guint64 offset,
+    GstClockTime pts, guint16 frame_ts)
+{
+  gst_dmss_assembler_clear (demux->assembler);
+  demux->salvage_remaining = 0;
+  demux->pull_offset = offset;
+  demux->video_last_ts = demux->audio_last_ts = frame_ts;
+  demux->video_timestamp_window.last_timestamp =
+      demux->audio_timestamp_window.last_timestamp = pts;
+  demux->time_segment.position = pts;
+  demux->need_segment = FALSE;
+  demux->segment_pending = TRUE;
+  demux->video_discont = demux->audio_discont = TRUE;
+}
+
+typedef struct
+{
+  GstDmssDemux *demux;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  guint64 offset;
+  GstFlowReturn ret;
+} GstDmssDemuxScan;
+
+/* Reads for gst_dmss_dav_index_walk out of large pulled chunks, only
+ * pulling again when what is asked for isn't in the current one.
+ */
+static const guint8 *
+gst_dmss_demux_scan_read (guint64 offset, gsize * size, gpointer user_data)
+{
+  GstDmssDemuxScan *scan = user_data;
+
+  if (!scan->buffer || offset < scan->offset
+      || offset + *size > scan->offset + scan->map.size) {
+    if (scan->buffer) {
+      gst_buffer_unmap (scan->buffer, &scan->map);
+      gst_buffer_unref (scan->buffer);
+      scan->buffer = NULL;
+    }
+    if ((scan->ret = gst_pad_pull_range (scan->demux->sinkpad, offset,
+                MAX (*size, DMSS_SCAN_CHUNK_SIZE), &scan->buffer))
+        != GST_FLOW_OK) {
+      scan->buffer = NULL;
+      return NULL;
+    }
+    gst_buffer_map (scan->buffer, &scan->map, GST_MAP_READ);
+    scan->offset = offset;
+    if (scan->map.size < *size)
+      return NULL;
+  }
+
+  *size = scan->offset + scan->map.size - offset;
+  return scan->map.data + (offset - scan->offset);
+}
+
+/* Walks the frames of the whole file once, keeping where every keyframe
+ * is and when it plays. PTS come from the same millisecond counter
+ * differences the frames are stamped with later, so a seek lands exactly
+ * on an indexed keyframe. The walk is the sidecar builder's, so the index
+ * is the same whichever of the two made it.
+ */
+static GstFlowReturn
+gst_dmss_demux_scan (GstDmssDemux * demux, GstDmssDavIndex * index)
+{
+  GstDmssDemuxScan scan = { demux, NULL, };
+
+  scan.ret = GST_FLOW_OK;
+  gst_dmss_dav_index_walk (index, gst_dmss_demux_scan_read, &scan);
+
+  if (scan.buffer) {
+    gst_buffer_unmap (scan.buffer, &scan.map);
+    gst_buffer_unref (scan.buffer);
+  }
+  // the end of the file ends the walk
+  if (scan.ret != GST_FLOW_OK && scan.ret != GST_FLOW_EOS)
+    return scan.ret;
+
+  return GST_FLOW_OK;
+}
+
+/* The local file upstream reads, NULL when it isn't one */
+static gchar *
+gst_dmss_demux_get_filename (GstDmssDemux * demux)
+{
+  GstQuery *query;
+  gchar *uri = NULL, *filename = NULL;
+
+  query = gst_query_new_uri ();
+  if (gst_pad_peer_query (demux->sinkpad, query))
+    gst_query_parse_uri (query, &uri);
+  gst_query_unref (query);
+
+  if (uri) {
+    filename = g_filename_from_uri (uri, NULL, NULL);
+    g_free (uri);
+  }
+
+  return filename;
+}
+
+static void
+gst_dmss_demux_index_siblings_func (gpointer data, gpointer user_data)
+{
+  const gchar *path = data;
+
+  // the path belongs to sibling_paths
+  if (gst_dmss_dav_index_build_file (path))
+    GST_DEBUG ("Built the sidecar index of %s", path);
+}
+
+/* Indexes the other .dav files next to filename that have no sidecar yet,
+ * so opening them later is as quick as this one
+ */
+static void
+gst_dmss_demux_index_siblings (GstDmssDemux * demux, const gchar * filename)
+{
+  GStatBuf stat_buf;
+  GDir *dir;
+  const gchar *name;
+  gchar *dirname, *path, *sidecar;
+  guint queued = 0;
+
+  dirname = g_path_get_dirname (filename);
+  if (!(dir = g_dir_open (dirname, 0, NULL))) {
+    g_free (dirname);
+    return;
+  }
+
+  if (!demux->sibling_pool)
+    demux->sibling_pool =
+        g_thread_pool_new (gst_dmss_demux_index_siblings_func, NULL,
+        g_get_num_processors (), FALSE, NULL);
+
+  while ((name = g_dir_read_name (dir))) {
+    if (!g_str_has_suffix (name, ".dav"))
+      continue;
+
+    path = g_build_filename (dirname, name, NULL);
+    sidecar = gst_dmss_dav_index_sidecar_path (path);
+    // stale sidecars are rebuilt when they are opened
+    if (!strcmp (path, filename) || !g_stat (sidecar, &stat_buf)
+        || g_hash_table_contains (demux->sibling_paths, path)) {
+      g_free (path);
+    } else {
+      g_hash_table_add (demux->sibling_paths, path);
+      g_thread_pool_push (demux->sibling_pool, path, NULL);
+      ++queued;
+    }
+    g_free (sidecar);
+  }
+  g_dir_close (dir);
+  g_free (dirname);
+
+  if (queued)
+    GST_DEBUG_OBJECT (demux, "Indexing %u more files in the background",
+        queued);
+}
+
+/* Gets the keyframe index of the file, from its sidecar when one matches
+ * the file, else by scanning the file and leaving a sidecar for next time
+ */
+static GstFlowReturn
+gst_dmss_demux_load_index (GstDmssDemux * demux)
+{
+  GstFlowReturn ret;
+  GstDmssDavIndex *index;
+  GStatBuf stat_buf;
+  GError *err = NULL;
+  gchar *filename = NULL, *sidecar = NULL;
+  gboolean have_stat = FALSE;
+
+  if (demux->sidecar_index && (filename = gst_dmss_demux_get_filename (demux))) {
+    sidecar = gst_dmss_dav_index_sidecar_path (filename);
+    have_stat = !g_stat (filename, &stat_buf);
+  }
+
+  if (have_stat) {
+    if ((demux->index = gst_dmss_dav_index_load (sidecar, stat_buf.st_size,
+                stat_buf.st_mtime, &err)))
+      goto done;
+    GST_DEBUG_OBJECT (demux, "No sidecar index: %s", err->message);
+    g_clear_error (&err);
+  }
+
+  index = have_stat ? gst_dmss_dav_index_new (stat_buf.st_size,
+      stat_buf.st_mtime) : gst_dmss_dav_index_new (0, 0);
+  if ((ret = gst_dmss_demux_scan (demux, index)) != GST_FLOW_OK) {
+    gst_dmss_dav_index_free (index);
+    g_free (sidecar);
+    g_free (filename);
+    return ret;
+  }
+  demux->index = index;
+
+  if (have_stat && !gst_dmss_dav_index_save (index, sidecar, &err)) {
+    GST_WARNING_OBJECT (demux, "Can't save the index: %s", err->message);
+    g_clear_error (&err);
+  }
+
+done:
+  GST_DEBUG_OBJECT (demux, "Indexed %u keyframes in %" GST_TIME_FORMAT,
+      gst_dmss_dav_index_get_n_keyframes (demux->index),
+      GST_TIME_ARGS (gst_dmss_dav_index_get_duration (demux->index)));
+
+  if (have_stat && demux->index_siblings)
+    gst_dmss_demux_index_siblings (demux, filename);
+  g_free (sidecar);
+  g_free (filename);
+
+  gst_dmss_demux_pull_restart (demux, 0, 0,
+      gst_dmss_dav_index_get_first_frame_ts (demux->index));
+
+  return GST_FLOW_OK;
+}
+
+/* Seeks in a .dav file read in pull mode. Reading restarts at the keyframe
+ * at or before the target so the decoder has what it needs. With KEY_UNIT
+ * the segment starts at that keyframe, otherwise the frames before the
+ * target are decoded but clipped. Negative rates play the keyframes from
+ * the target back, see gst_dmss_demux_pull_keyframe.
+ */
+static gboolean
+gst_dmss_demux_perform_seek (GstDmssDemux * demux, GstEvent * event)
+{
+  GstDmssDavKeyframe keyframe;
+  gboolean have_keyframe;
+  GstSeekType start_type, stop_type;
+  GstSeekFlags flags;
+  GstFormat format;
+  GstSegment segment;
+  GstEvent *flush_event;
+  gboolean flush, update;
+  gint64 start, stop;
+  gdouble rate;
+  guint32 seqnum;
+
+  gst_event_parse_seek (event, &rate, &format, &flags, &start_type, &start,
+      &stop_type, &stop);
+  seqnum = gst_event_get_seqnum (event);
+
+  if (format != GST_FORMAT_TIME || rate == 0) {
+    GST_DEBUG_OBJECT (demux, "Only seeks in time are supported");
+    return FALSE;
+  }
+
+  flush = !!(flags & GST_SEEK_FLAG_FLUSH);
+  if (flush) {
+    flush_event = gst_event_new_flush_start ();
+    gst_event_set_seqnum (flush_event, seqnum);
+    gst_dmss_demux_push_event (demux, flush_event);
+  }
+  gst_pad_pause_task (demux->sinkpad);
+
+  GST_PAD_STREAM_LOCK (demux->sinkpad);
+
+  if (!demux->index && gst_dmss_demux_load_index (demux) != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (demux, "No index to seek with, carrying on");
+    // downstream would stay flushing and the loop paused otherwise
+    if (flush) {
+      flush_event = gst_event_new_flush_stop (FALSE);
+      gst_event_set_seqnum (flush_event, seqnum);
+      gst_dmss_demux_push_event (demux, flush_event);
+    }
+    gst_pad_start_task (demux->sinkpad, (GstTaskFunction) gst_dmss_demux_loop,
+        demux->sinkpad, NULL);
+    GST_PAD_STREAM_UNLOCK (demux->sinkpad);
+    return FALSE;
+  }
+
+  memcpy (&segment, &demux->time_segment, sizeof (segment));
+  if (!GST_CLOCK_TIME_IS_VALID (segment.duration))
+    segment.duration = gst_dmss_dav_index_get_duration (demux->index);
+  gst_segment_do_seek (&segment, rate, format, flags, start_type, start,
+      stop_type, stop, &update);
+
+  have_keyframe = gst_dmss_dav_index_lookup (demux->index, segment.position,
+      &keyframe);
+  if (have_keyframe && (flags & GST_SEEK_FLAG_KEY_UNIT))
+    segment.start = segment.position = segment.time = keyframe.pts;
+
+  GST_DEBUG_OBJECT (demux, "Seeking to %" GST_TIME_FORMAT ", keyframe at %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (segment.position),
+      GST_TIME_ARGS (have_keyframe ? keyframe.pts : 0));
+
+  if (flush) {
+    flush_event = gst_event_new_flush_stop (TRUE);
+    gst_event_set_seqnum (flush_event, seqnum);
+    gst_dmss_demux_push_event (demux, flush_event);
+  }
+
+  memcpy (&demux->time_segment, &segment, sizeof (segment));
+  demux->segment_seqnum = seqnum;
+  if (have_keyframe)
+    gst_dmss_demux_pull_restart (demux, keyframe.offset, keyframe.pts,
+        keyframe.frame_ts);
+  else
+    gst_dmss_demux_pull_restart (demux, 0, 0,
+        gst_dmss_dav_index_get_first_frame_ts (demux->index));
+  demux->time_segment.position = segment.position;
+  demux->reverse_pts = segment.position;
+
+  if (flags & GST_SEEK_FLAG_SEGMENT)
+    gst_element_post_message (GST_ELEMENT (demux),
+        gst_message_new_segment_start (GST_OBJECT (demux), GST_FORMAT_TIME,
+            segment.position));
+
+  gst_pad_start_task (demux->sinkpad, (GstTaskFunction) gst_dmss_demux_loop,
+      demux->sinkpad, NULL);
+
+  GST_PAD_STREAM_UNLOCK (demux->sinkpad);
+
+  return TRUE;
+}
+
+/* Reverse playback of a .dav file. The index is walked back from the seek
+ * target and each keyframe is pushed on its own, flagged DISCONT, the way
+ * devices play recordings in reverse. Delta frames are left out.
+ */
+static GstFlowReturn
+gst_dmss_demux_pull_keyframe (GstDmssDemux * demux)
+{
+  GstFlowReturn ret;
+  GstDmssDavKeyframe keyframe;
+  GstBuffer *buffer = NULL;
+  guint8 header[DHAV_FRAME_HEADER_SIZE];
+  guint32 frame_size = 0;
+
+  if (!GST_CLOCK_TIME_IS_VALID (demux->reverse_pts)
+      || !gst_dmss_dav_index_lookup (demux->index, demux->reverse_pts,
+          &keyframe) || keyframe.pts < demux->time_segment.start)
+    return GST_FLOW_EOS;
+  demux->reverse_pts = keyframe.pts ? keyframe.pts - 1 : GST_CLOCK_TIME_NONE;
+
+  if ((ret = gst_pad_pull_range (demux->sinkpad, keyframe.offset,
+              sizeof (header), &buffer)) != GST_FLOW_OK)
+    return ret;
+  if (gst_buffer_extract (buffer, 0, header, sizeof (header)) ==
+      sizeof (header) && !memcmp (header, DHAV_prefix, 4))
+    frame_size = GST_READ_UINT32_LE (&header[12]);
+  gst_buffer_unref (buffer);
+
+  if (frame_size < DHAV_FRAME_MIN_SIZE
+      || frame_size > GST_DMSS_DHAV_MAX_FRAME_SIZE) {
+    GST_WARNING_OBJECT (demux, "No keyframe at indexed offset %"
+        G_GUINT64_FORMAT, keyframe.offset);
+    return GST_FLOW_OK;
+  }
+
+  if ((ret = gst_pad_pull_range (demux->sinkpad, keyframe.offset,
+              frame_size, &buffer)) != GST_FLOW_OK)
+    return ret;
+
+  // stamped from the index, like a forward seek to it
+  gst_dmss_assembler_clear (demux->assembler);
+  demux->salvage_remaining = 0;
+  demux->video_last_ts = keyframe.frame_ts;
+  demux->video_timestamp_window.last_timestamp = keyframe.pts;
+  demux->video_discont = TRUE;
+  gst_dmss_assembler_push (demux->assembler, buffer);
+
+  return gst_dmss_demux_flush (demux);
+}
+
+/* Pull mode streaming: reads the file in chunks and demuxes them as if
+ * they had been pushed, stopping at the end of the segment.
+ */
+static void
+gst_dmss_demux_loop (GstPad * pad)
+{
+  GstDmssDemux *demux = GST_DMSS_DEMUX (GST_PAD_PARENT (pad));
+  GstFlowReturn ret;
+  GstBuffer *buffer = NULL;
+  GstEvent *event;
+  GstClockTime stop;
+
+  if (!demux->index && (ret = gst_dmss_demux_load_index (demux)) != GST_FLOW_OK)
+    goto pause;
+
+  if (demux->time_segment.rate < 0) {
+    if ((ret = gst_dmss_demux_pull_keyframe (demux)) != GST_FLOW_OK
+        && ret != GST_FLOW_NOT_LINKED)
+      goto pause;
+    return;
+  }
+
+  if ((ret = gst_pad_pull_range (pad, demux->pull_offset,
+              DMSS_PULL_CHUNK_SIZE, &buffer)) != GST_FLOW_OK)
+    goto pause;
+
+  demux->pull_offset += gst_buffer_get_size (buffer);
+  gst_dmss_assembler_push (demux->assembler, buffer);
+
+  if ((ret = gst_dmss_demux_flush (demux)) != GST_FLOW_OK
+      && ret != GST_FLOW_NOT_LINKED)
+    goto pause;
+
+  stop = demux->time_segment.stop;
+  if (GST_CLOCK_TIME_IS_VALID (stop) && demux->time_segment.position > stop) {
+    ret = GST_FLOW_EOS;
+    goto pause;
+  }
+
+  return;
+pause:
+  {
+    GST_DEBUG_OBJECT (demux, "Pausing task, reason %s",
+        gst_flow_get_name (ret));
+    gst_pad_pause_task (pad);
+
+    if (ret == GST_FLOW_EOS) {
+      if (demux->time_segment.flags & GST_SEGMENT_FLAG_SEGMENT) {
+        if (demux->time_segment.rate < 0)
+          stop = demux->time_segment.start;
+        else
+          stop = GST_CLOCK_TIME_IS_VALID (demux->time_segment.stop) ?
+              demux->time_segment.stop : demux->time_segment.position;
+        gst_element_post_message (GST_ELEMENT (demux),
+            gst_message_new_segment_done (GST_OBJECT (demux),
+                GST_FORMAT_TIME, stop));
+        event = gst_event_new_segment_done (GST_FORMAT_TIME, stop);
+      } else {
+        event = gst_event_new_eos ();
+      }
+      if (demux->segment_seqnum)
+        gst_event_set_seqnum (event, demux->segment_seqnum);
+      gst_dmss_demux_push_event (demux, event);
+    } else if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_FLOW_ERROR (demux, ret);
+      gst_dmss_demux_push_event (demux, gst_event_new_eos ());
+    }
+  }
+}
+
 static gboolean
 gst_dmss_demux_handle_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event)
@@ -884,11 +1549,15 @@ gst_dmss_demux_handle_sink_event (GstPad * pad, GstObject * parent,
       const GstSegment *segment;
 
       gst_event_parse_segment (event, &segment);
-      if (segment->format == GST_FORMAT_BYTES) {
-        GST_ERROR_OBJECT (pad, "segment format requested is bytes");
+      // recordings come in TIME, but are stamped from DHAV all the same
+      if (segment->format == GST_FORMAT_BYTES
+          || segment->format == GST_FORMAT_TIME) {
+        GST_DEBUG_OBJECT (pad, "received %s segment",
+            gst_format_get_name (segment->format));
         /* gst_segment_copy_into (segment, &demux->byte_segment); */
         demux->need_segment = TRUE;
         demux->segment_seqnum = gst_event_get_seqnum (event);
+        demux->rate = segment->rate;
 
         gst_event_unref (event);
       } else {
@@ -904,12 +1573,21 @@ gst_dmss_demux_handle_sink_event (GstPad * pad, GstObject * parent,
       gst_dmss_demux_flush (demux);
       /* forward event */
       res = gst_dmss_demux_push_event (demux, event);
-      /* and clear the adapter */
-      gst_adapter_clear (demux->adapter);
+      /* and clear the assembler */
+      gst_dmss_assembler_clear (demux->assembler);
+      demux->salvage_remaining = 0;
       break;
     case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      demux->raw_dhav = gst_structure_has_name (gst_caps_get_structure (caps,
+              0), "video/x-dhav");
+      demux->input_known = TRUE;
       gst_event_unref (event);
       break;
+    }
     default:
       res = gst_dmss_demux_push_event (demux, event);
       break;
@@ -936,7 +1614,8 @@ gst_dmss_demux_add_video_pad (GstDmssDemux * demux, GstCaps * caps, GstClockTime
 
   gst_pad_set_caps (demux->videosrcpad, caps);
 
-  if (!demux->need_segment) {
+  // pull mode pushes the segment of the seek before the first frame
+  if (!demux->need_segment && !demux->pull_mode) {
     /* event = gst_event_new_segment (&demux->time_segment); */
     /* gst_dmss_demux_video_push_event (demux, event); */
     gst_dmss_demux_segment_init (demux, frame_ts);
@@ -978,7 +1657,14 @@ gst_dmss_demux_add_audio_pad (GstDmssDemux * demux, GstCaps * caps, GstClockTime
 
   gst_element_add_pad (GST_ELEMENT (demux), demux->audiosrcpad);
 
-  if (!demux->need_segment) {
+  if (demux->pull_mode) {
+    if (!demux->segment_pending) {
+      event = gst_event_new_segment (&demux->time_segment);
+      if (demux->segment_seqnum)
+        gst_event_set_seqnum (event, demux->segment_seqnum);
+      gst_dmss_demux_audio_push_event (demux, event);
+    }
+  } else if (!demux->need_segment) {
     gst_dmss_demux_segment_init (demux, frame_ts);
     /* event = gst_event_new_segment (&demux->time_segment); */
     /* gst_dmss_demux_audio_push_event (demux, event); */
@@ -995,41 +1681,62 @@ static GstFlowReturn
 gst_dmss_demux_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
 {
   GstDmssDemux *demux = GST_DMSS_DEMUX (parent);
-  GstMapInfo map;
+  guint8 header[8];
   gssize body_size;
   int const prologue_size = 32;
   GstBuffer *outbuf;
 
+  // whatever partial DHAV frame we hold can't be completed anymore
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT)) {
+    GST_DEBUG_OBJECT (demux, "Discont, dropping %" G_GSIZE_FORMAT
+        " pending bytes", gst_dmss_assembler_available (demux->assembler));
+    gst_dmss_assembler_clear (demux->assembler);
+    demux->salvage_remaining = 0;
+    demux->waiting_dhav_end = FALSE;
+    demux->need_segment = TRUE;
+    demux->video_discont = demux->audio_discont = TRUE;
+  }
+
+  // without caps, a file pushed as is starts with a frame
+  if (!demux->input_known) {
+    demux->raw_dhav = gst_buffer_extract (buffer, 0, header, 4) == 4
+        && !memcmp (header, DHAV_prefix, 4);
+    demux->input_known = TRUE;
+  }
+
+  // flushing, EOS or not-linked from downstream has to reach upstream
+  if (demux->raw_dhav) {
+    gst_dmss_assembler_push (demux->assembler, buffer);
+    return gst_dmss_demux_flush (demux);
+  }
+
   if (gst_buffer_get_size(buffer) < prologue_size)
-    return GST_FLOW_OK;  
+    goto discard_buffer;
   
-  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  // extracted rather than mapped, mapping would merge a prologue and a
+  // payload that come in memories of their own, as downloads send them
+  gst_buffer_extract (buffer, 0, header, sizeof (header));
 
-  GST_DEBUG ("buffer received with command %.02x", (unsigned char) map.data[0]);
-  if (((unsigned char *) map.data)[0] == (unsigned char) 0xbc) {
-    body_size = GUINT32_FROM_LE (*(guint32 *) & map.data[4]);
+  GST_DEBUG ("buffer received with command %.02x", header[0]);
+  if (header[0] == 0xbc) {
+    body_size = GST_READ_UINT32_LE (&header[4]);
     GST_DEBUG ("buffer received with DHAV payload size %d", (int) body_size);
 
     if (!body_size)
-      goto discard_mapped_buffer;
-
-    gst_buffer_unmap (buffer, &map);
+      goto discard_buffer;
 
-    outbuf = gst_buffer_make_writable (buffer);
-    gst_buffer_resize (outbuf, prologue_size,
-                       gst_buffer_get_size (outbuf) - prologue_size);
-    gst_adapter_push (demux->adapter, outbuf);
+    // a region rather than a resize, which would keep the emptied memory
+    // of a prologue that comes apart
+    outbuf = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL,
+        prologue_size, gst_buffer_get_size (buffer) - prologue_size);
+    gst_buffer_unref (buffer);
+    gst_dmss_assembler_push (demux->assembler, outbuf);
 
-    gst_dmss_demux_flush (demux);
-
-    return GST_FLOW_OK;
-  } else {
-    gst_buffer_unmap (buffer, &map);
+    return gst_dmss_demux_flush (demux);
   }
 
-  return GST_FLOW_OK;
-discard_mapped_buffer:
-  gst_buffer_unmap (buffer, &map);
+discard_buffer:
+  gst_buffer_unref (buffer);
   return GST_FLOW_OK;
 }
 
@@ -1042,6 +1749,14 @@ gst_dmss_demux_handle_src_event (GstPad * pad, GstObject * parent,
   GstDmssDemux *demux = GST_DMSS_DEMUX (parent);
 
   switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_SEEK:
+      if (!demux->pull_mode) {
+        res = gst_pad_push_event (demux->sinkpad, event);
+        break;
+      }
+      res = gst_dmss_demux_perform_seek (demux, event);
+      gst_event_unref (event);
+      break;
     /* case GST_EVENT_QOS: */
     /* { */
     /*   GstQOSType type; */
@@ -1170,6 +1885,24 @@ static GstClockTime gst_dmss_demux_diff_ts (GstDmssDemux *demux, guint16 frame_e
   }
 }
 
+/* Live sources are stamped against the pipeline clock, anything else
+ * arrives faster than real time and only the DHAV timestamps mean anything.
+ */
+static gboolean
+gst_dmss_demux_upstream_is_live (GstDmssDemux * demux)
+{
+  GstQuery *query = gst_query_new_latency ();
+  gboolean live = TRUE;
+
+  if (gst_pad_peer_query (demux->sinkpad, query))
+    gst_query_parse_latency (query, &live, NULL, NULL);
+  gst_query_unref (query);
+
+  GST_DEBUG_OBJECT (demux, "Upstream is %slive", live ? "" : "not ");
+
+  return live;
+}
+
 static GstClockTime gst_dmss_demux_calculate_pts (GstDmssDemux *demux, guint16 frame_epoch, guint16 frame_ts
                                            , gboolean is_video)
 {
@@ -1177,15 +1910,18 @@ static GstClockTime gst_dmss_demux_calculate_pts (GstDmssDemux *demux, guint16 f
   GstClockTime timestamp/*, send_base_time = demux->send_base_time*/;
   GstClockTime timestamp_recv, timestamp_send/*, latency*//*, delta_latency*/;
   int diff_ts;
-  
-  if (!demux->pipeline_clock)
-    {
-      GST_ERROR_OBJECT (demux, "No pipeline clock!");
-      abort();
-    }
+  struct gst_dmss_demux_timestamp_window *window;
+
+  // without a clock to follow (prerolling a download), go by DHAV alone
+  if (demux->need_segment)
+    demux->dhav_timing = !demux->pipeline_clock
+        || !gst_dmss_demux_upstream_is_live (demux);
+  else if (!demux->pipeline_clock)
+    demux->dhav_timing = TRUE;
 
 /* resync: */
-  current_time = gst_clock_get_time(demux->pipeline_clock);
+  current_time = demux->dhav_timing ? 0 :
+      gst_clock_get_time (demux->pipeline_clock);
 
   if (demux->need_segment)
   {
@@ -1202,6 +1938,13 @@ static GstClockTime gst_dmss_demux_calculate_pts (GstDmssDemux *demux, guint16 f
   // ts are in milliseconds
   diff_ts = gst_dmss_demux_diff_ts (demux, frame_epoch, frame_ts, is_video ? &demux->video_last_ts : &demux->audio_last_ts);
 
+  if (demux->dhav_timing) {
+    window = is_video ? &demux->video_timestamp_window :
+        &demux->audio_timestamp_window;
+    window->last_timestamp += (guint64) diff_ts * GST_MSECOND;
+    return window->last_timestamp;
+  }
+
   gst_dmss_demux_calculate_timestamp_average(demux, is_video ? &demux->video_timestamp_window : &demux->audio_timestamp_window
                                              , diff_ts, current_time, &timestamp);
 
@@ -1234,3 +1977,50 @@ static GstClockTime gst_dmss_demux_calculate_pts (GstDmssDemux *demux, guint16 f
   return timestamp_send;
 }
 
+/* Trick play gets keyframes seconds apart, or going back in time, so the
+ * frame distance comes from the millisecond counter in the direction of
+ * play, or the DHAV wall time once the counter could have wrapped. The
+ * output runs forward at normal speed, with the rate in applied_rate.
+ */
+static GstClockTime
+gst_dmss_demux_calculate_trick_pts (GstDmssDemux * demux, guint32 frame_time,
+    guint16 frame_ts)
+{
+  gint64 time = gst_dmss_protocol_dhav_time (frame_time);
+  GstClockTime timestamp;
+  guint64 diff_s, diff;
+  guint16 diff_ms;
+
+  if (demux->need_segment) {
+    timestamp = (guint16) frame_time;
+    timestamp *= GST_SECOND;
+    timestamp += (((guint64) frame_ts) % 1000) * GST_MSECOND;
+
+    gst_dmss_demux_segment_init (demux, timestamp);
+    demux->trick_pts = timestamp;
+  } else {
+    diff_ms = demux->rate > 0 ? (guint16) (frame_ts - demux->trick_ts) :
+        (guint16) (demux->trick_ts - frame_ts);
+    diff_s = ABS (time - demux->trick_time);
+
+    // the counter wraps every 65 s, and frames a bit out of order look
+    // like a whole wrap ahead
+    if (diff_s > 30)
+      diff = diff_s * 1000;
+    else if (diff_ms > 60000)
+      diff = 0;
+    else
+      diff = diff_ms;
+
+    demux->trick_pts += (GstClockTime) (diff * GST_MSECOND /
+        ABS (demux->rate));
+  }
+
+  demux->trick_time = time;
+  demux->trick_ts = frame_ts;
+
+  GST_LOG_OBJECT (demux, "Trick play frame at %" G_GINT64_FORMAT
+      ", pts %" GST_TIME_FORMAT, time, GST_TIME_ARGS (demux->trick_pts));
+
+  return demux->trick_pts;
+}
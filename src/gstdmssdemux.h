@@ -22,7 +22,6 @@
 #define __GST_DMSS_DEMUX_H__
 
 #include <gst/gst.h>
-#include <gst/base/gstadapter.h>
 
 #include <gio/gio.h>
 
@@ -99,17 +98,58 @@ struct _GstDmssDemux
   GstDmssAudioRate audio_rate;
 
   gboolean need_segment;
+  gboolean video_discont, audio_discont;
   guint32 segment_seqnum;
   GstSegment byte_segment;
   GstSegment time_segment;
 
-  GstAdapter *adapter;
+  /* the received bytes DHAV frames are parsed from */
+  struct _GstDmssAssembler *assembler;
+  /* bytes copied per second by the parser over the last second, protected
+   * by the object lock */
+  guint64 memcpy_rate;
+  guint64 memcpy_bytes;
+  GstClockTime last_rate_time;
+  /* resyncs skip only the corrupted bytes, the counters are protected by
+   * the object lock. salvage_remaining are the bytes queued at the last
+   * resync not parsed yet */
+  guint64 bytes_skipped;
+  guint64 frames_salvaged;
+  gsize salvage_remaining;
+  /* extended header tags already reported for this stream, a bit each */
+  guint32 unknown_tags[8];
   gboolean waiting_dhav_end;
   guint16 video_last_ts, audio_last_ts;
 
   GstClockTime latency; // should not use this anymore, but avg latency or something else
 
   GstClock* pipeline_clock;
+  /* PTS straight from the DHAV timestamps, for sources that aren't live */
+  gboolean dhav_timing;
+  /* rate the source already applied, trick play stamps frames by their
+   * distance in stream time divided by it */
+  gdouble rate;
+  gint64 trick_time;
+  guint16 trick_ts;
+  GstClockTime trick_pts;
+
+  /* raw .dav input, read in pull mode or pushed as video/x-dhav */
+  gboolean raw_dhav;
+  gboolean input_known;
+  gboolean pull_mode;
+  guint64 pull_offset;
+  gboolean segment_pending;
+  /* reverse playback pushes the keyframe at or before this next */
+  GstClockTime reverse_pts;
+  /* keyframes of the whole file, found before the first frame is pushed
+   * or mapped from the sidecar a previous run left next to the file */
+  struct _GstDmssDavIndex *index;
+  gboolean sidecar_index;
+  gboolean index_siblings;
+  /* indexes the sibling files, joined on dispose. Every path ever queued
+   * is kept so a directory pass doesn't queue it twice */
+  GThreadPool *sibling_pool;
+  GHashTable *sibling_paths;
   GstClockTime send_base_time;
   GstClockTime base_time;
   // gboolean need_resync;
@@ -0,0 +1,180 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Looks for the "DHAV" that starts every frame, to resync after garbage.
+ *
+ * Each step compares a vector of bytes against 'D' and the vectors one, two
+ * and three bytes further against 'H', 'A' and 'V', so every position of
+ * the block is tested at once. AVX2 is used when the CPU has it, otherwise
+ * SSE2 on x86-64 and NEON on ARM64, with a scalar loop for the tail and
+ * other targets.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include "gstdmssdhavscan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define DMSS_DHAV_SCAN_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define DMSS_DHAV_SCAN_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define DMSS_DHAV_SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+static gsize
+gst_dmss_dhav_scan_scalar (const guint8 * data, gsize size, gsize i)
+{
+  const guint8 *d;
+
+  while (i + 4 <= size) {
+    if (!(d = memchr (data + i, 'D', size - 3 - i)))
+      break;
+    i = d - data;
+    if (d[1] == 'H' && d[2] == 'A' && d[3] == 'V')
+      return i;
+    ++i;
+  }
+
+  return size;
+}
+
+#ifdef DMSS_DHAV_SCAN_SSE2
+static gsize
+gst_dmss_dhav_scan_sse2 (const guint8 * data, gsize size)
+{
+  const __m128i d = _mm_set1_epi8 ('D');
+  const __m128i h = _mm_set1_epi8 ('H');
+  const __m128i a = _mm_set1_epi8 ('A');
+  const __m128i v = _mm_set1_epi8 ('V');
+  __m128i match;
+  guint mask;
+  gsize i;
+
+  for (i = 0; i + 16 + 3 <= size; i += 16) {
+    match = _mm_and_si128 (
+        _mm_and_si128 (
+            _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data + i)), d),
+            _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data + i + 1)),
+                h)),
+        _mm_and_si128 (
+            _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data + i + 2)),
+                a),
+            _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (data + i + 3)),
+                v)));
+    if ((mask = _mm_movemask_epi8 (match)))
+      return i + __builtin_ctz (mask);
+  }
+
+  return gst_dmss_dhav_scan_scalar (data, size, i);
+}
+#endif
+
+#ifdef DMSS_DHAV_SCAN_AVX2
+__attribute__ ((target ("avx2")))
+static gsize
+gst_dmss_dhav_scan_avx2 (const guint8 * data, gsize size)
+{
+  const __m256i d = _mm256_set1_epi8 ('D');
+  const __m256i h = _mm256_set1_epi8 ('H');
+  const __m256i a = _mm256_set1_epi8 ('A');
+  const __m256i v = _mm256_set1_epi8 ('V');
+  __m256i match;
+  guint mask;
+  gsize i;
+
+  for (i = 0; i + 32 + 3 <= size; i += 32) {
+    match = _mm256_and_si256 (
+        _mm256_and_si256 (
+            _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (data +
+                        i)), d),
+            _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (data +
+                        i + 1)), h)),
+        _mm256_and_si256 (
+            _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (data +
+                        i + 2)), a),
+            _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (data +
+                        i + 3)), v)));
+    if ((mask = _mm256_movemask_epi8 (match)))
+      return i + __builtin_ctz (mask);
+  }
+
+  return i + gst_dmss_dhav_scan_sse2 (data + i, size - i);
+}
+#endif
+
+#ifdef DMSS_DHAV_SCAN_NEON
+static gsize
+gst_dmss_dhav_scan_neon (const guint8 * data, gsize size)
+{
+  const uint8x16_t d = vdupq_n_u8 ('D');
+  const uint8x16_t h = vdupq_n_u8 ('H');
+  const uint8x16_t a = vdupq_n_u8 ('A');
+  const uint8x16_t v = vdupq_n_u8 ('V');
+  uint8x16_t match;
+  guint64 mask;
+  gsize i;
+
+  for (i = 0; i + 16 + 3 <= size; i += 16) {
+    match = vandq_u8 (
+        vandq_u8 (vceqq_u8 (vld1q_u8 (data + i), d),
+            vceqq_u8 (vld1q_u8 (data + i + 1), h)),
+        vandq_u8 (vceqq_u8 (vld1q_u8 (data + i + 2), a),
+            vceqq_u8 (vld1q_u8 (data + i + 3), v)));
+    // four bits per byte, no movemask on NEON
+    mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16
+            (vreinterpretq_u16_u8 (match), 4)), 0);
+    if (mask)
+      return i + (__builtin_ctzll (mask) >> 2);
+  }
+
+  return gst_dmss_dhav_scan_scalar (data, size, i);
+}
+#endif
+
+/* Offset of the first "DHAV" wholly inside data, size when there is none */
+gsize
+gst_dmss_dhav_scan (const guint8 * data, gsize size)
+{
+#if defined(DMSS_DHAV_SCAN_AVX2)
+  static gint has_avx2 = -1;
+
+  if (G_UNLIKELY (has_avx2 < 0))
+    has_avx2 = __builtin_cpu_supports ("avx2");
+  if (has_avx2)
+    return gst_dmss_dhav_scan_avx2 (data, size);
+#endif
+#if defined(DMSS_DHAV_SCAN_SSE2)
+  return gst_dmss_dhav_scan_sse2 (data, size);
+#elif defined(DMSS_DHAV_SCAN_NEON)
+  return gst_dmss_dhav_scan_neon (data, size);
+#else
+  return gst_dmss_dhav_scan_scalar (data, size, 0);
+#endif
+}
@@ -0,0 +1,543 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+/* Downloads a recording range as consecutive segments, one per recorded
+ * file, over several playback streams of one session at once.
+ *
+ * Workers take segments in order, so the earliest unfinished segment is
+ * always being fetched. Each reframes its stream into whole DHAV frames
+ * and queues them per segment; gst_dmss_download_pop drains the segments
+ * one after the other. A segment only keeps the frames stamped inside its
+ * own time range, so nothing is repeated or lost where two meet. Every
+ * worker, the one being output included, stops reading once
+ * DMSS_DOWNLOAD_MAX_QUEUED bytes wait in its segment, which throttles it
+ * through TCP to the pace of the output.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include "gstdmssdownload.h"
+#include "gstdmssdhavscan.h"
+#include "gstdmssprotocol.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+#define DMSS_DOWNLOAD_MAX_QUEUED        (16 * 1024 * 1024)
+#define DMSS_DOWNLOAD_WAIT_US           (100 * 1000)
+#define DMSS_DOWNLOAD_RECEIVE_SIZE      (64 * 1024)
+/* times a segment the device hung up on early is played again */
+#define DMSS_DOWNLOAD_RETRIES           3
+
+/* fixed DHAV header and the "dhav" trailer with the frame size */
+#define DHAV_HEADER_SIZE                24
+#define DHAV_TRAILER_SIZE               8
+
+struct _GstDmssDownloadSegment
+{
+  GstDmssPlaybackParams params;
+  GQueue buffers;
+  gsize queued;
+  gboolean done;
+};
+
+struct _GstDmssDownload
+{
+  GstDmssSession *session;
+  GArray *segments;
+  guint receive_buffer_size;
+
+  GThread **workers;
+  guint n_workers;
+  GCancellable *cancellable;
+
+  /* protects everything below and the segments */
+  GMutex lock;
+  GCond cond;
+  guint next_segment;
+  guint output_segment;
+  GError *error;
+};
+
+static void
+gst_dmss_download_segment_clear (gpointer data)
+{
+  struct _GstDmssDownloadSegment *segment = data;
+
+  g_queue_foreach (&segment->buffers, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&segment->buffers);
+}
+
+/* segments holds the GstDmssPlaybackParams of each segment, in order and
+ * without overlaps.
+ */
+GstDmssDownload *
+gst_dmss_download_new (GstDmssSession * session, const GArray * segments,
+    guint connections, guint receive_buffer_size)
+{
+  GstDmssDownload *download;
+  struct _GstDmssDownloadSegment segment;
+  guint i;
+
+  download = g_slice_new0 (GstDmssDownload);
+  download->session = gst_dmss_session_ref (session);
+  download->receive_buffer_size = receive_buffer_size;
+  download->segments = g_array_sized_new (FALSE, FALSE,
+      sizeof (struct _GstDmssDownloadSegment), segments->len);
+  g_array_set_clear_func (download->segments,
+      gst_dmss_download_segment_clear);
+
+  memset (&segment, 0, sizeof (segment));
+  for (i = 0; i != segments->len; ++i) {
+    segment.params = g_array_index (segments, GstDmssPlaybackParams, i);
+    g_queue_init (&segment.buffers);
+    g_array_append_val (download->segments, segment);
+  }
+
+  download->n_workers = MAX (1, MIN (connections, segments->len));
+  download->workers = g_new0 (GThread *, download->n_workers);
+  download->cancellable = g_cancellable_new ();
+  g_mutex_init (&download->lock);
+  g_cond_init (&download->cond);
+
+  return download;
+}
+
+static void
+gst_dmss_download_fail (GstDmssDownload * download, GError * err)
+{
+  g_mutex_lock (&download->lock);
+  if (!download->error)
+    download->error = err;
+  else
+    g_error_free (err);
+  g_cond_broadcast (&download->cond);
+  g_mutex_unlock (&download->lock);
+}
+
+/* Where a segment got to, so a retry after the device hung up early goes
+ * on after the last frame queued.
+ */
+typedef struct
+{
+  /* wall clock and millisecond counter of the last frame, -1 before one */
+  gint64 time;
+  guint16 frame_ts;
+  /* a retry replays from the second of the last frame, which is dropped
+   * until that frame comes again */
+  gboolean replaying;
+} GstDmssDownloadProgress;
+
+/* Queues the whole DHAV frames at the start of *pending and replaces it
+ * with what is left. The frames are shared with the array rather than
+ * copied, so a new one takes the partial frame after them.
+ * Returns how many bytes the segment has queued now.
+ */
+static gsize
+gst_dmss_download_take_frames (GstDmssDownload * download, guint index,
+    GByteArray ** pending, GstDmssDownloadProgress * progress)
+{
+  struct _GstDmssDownloadSegment *segment;
+  GstBuffer *buffer;
+  GByteArray *rest;
+  guint8 prologue[GST_DMSS_PROTOCOL_HEADER_SIZE] = { 0xbc, 0, };
+  const guint8 *data = (*pending)->data;
+  gsize size = (*pending)->len;
+  guint32 frame_size;
+  guint16 frame_ts;
+  gint64 time;
+  gsize offset = 0, skip, queued;
+  GQueue frames = G_QUEUE_INIT;
+  gsize frames_size = 0;
+  guint dropped = 0, replayed = 0;
+
+  segment = &g_array_index (download->segments,
+      struct _GstDmssDownloadSegment, index);
+
+  while (size - offset >= DHAV_HEADER_SIZE + DHAV_TRAILER_SIZE) {
+    if (memcmp (&data[offset], "DHAV", 4)) {
+      skip = gst_dmss_dhav_scan (&data[offset], size - offset);
+      // a prefix may still start in the last bytes
+      if (skip + 4 > size - offset) {
+        offset = size - 3;
+        break;
+      }
+      offset += skip;
+      continue;
+    }
+
+    frame_size = GST_READ_UINT32_LE (&data[offset + 12]);
+    if (frame_size < DHAV_HEADER_SIZE + DHAV_TRAILER_SIZE + data[offset + 22]
+        || frame_size > GST_DMSS_DHAV_MAX_FRAME_SIZE) {
+      ++offset;
+      continue;
+    }
+    if (size - offset < frame_size)
+      break;
+
+    // like dmssdemux, a frame must end with a trailer repeating its size
+    if (memcmp (&data[offset + frame_size - DHAV_TRAILER_SIZE], "dhav", 4)
+        || GST_READ_UINT32_LE (&data[offset + frame_size - 4]) != frame_size) {
+      GST_DEBUG ("Bad trailer of a frame at %" G_GSIZE_FORMAT " of segment %u",
+          offset, index);
+      ++offset;
+      continue;
+    }
+
+    time = gst_dmss_protocol_dhav_time (GST_READ_UINT32_LE (&data[offset +
+                16]));
+    frame_ts = GST_READ_UINT16_LE (&data[offset + 20]);
+
+    // frames up to the last one queued were already, a replay that never
+    // gets to it leaves a gap from the next second on
+    if (progress->replaying) {
+      if (time < progress->time || (time == progress->time
+              && frame_ts != progress->frame_ts)) {
+        ++replayed;
+        offset += frame_size;
+        continue;
+      }
+      progress->replaying = FALSE;
+      if (time == progress->time) {
+        ++replayed;
+        offset += frame_size;
+        continue;
+      }
+    }
+    progress->time = time;
+    progress->frame_ts = frame_ts;
+
+    // the edges belong to the neighbouring segments
+    if ((index && time < segment->params.start_time)
+        || (index + 1 != download->segments->len
+            && time >= segment->params.end_time)) {
+      ++dropped;
+    } else {
+      // wrapped like the stream packets dmssdemux expects
+      GST_WRITE_UINT32_LE (&prologue[4], frame_size);
+      buffer = gst_buffer_new_allocate (NULL, sizeof (prologue), NULL);
+      gst_buffer_fill (buffer, 0, prologue, sizeof (prologue));
+      gst_buffer_append_memory (buffer,
+          gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, (*pending)->data,
+              size, offset, frame_size, g_byte_array_ref (*pending),
+              (GDestroyNotify) g_byte_array_unref));
+      g_queue_push_tail (&frames, buffer);
+      frames_size += gst_buffer_get_size (buffer);
+    }
+    offset += frame_size;
+  }
+
+  // taken at every packet end, so what is left is less than a packet
+  if (offset) {
+    rest = g_byte_array_sized_new (MAX (size - offset,
+            DMSS_DOWNLOAD_RECEIVE_SIZE));
+    g_byte_array_append (rest, &data[offset], size - offset);
+    g_byte_array_unref (*pending);
+    *pending = rest;
+  }
+
+  if (dropped)
+    GST_DEBUG ("Dropped %u frames outside of segment %u", dropped, index);
+  if (replayed)
+    GST_DEBUG ("Dropped %u replayed frames of segment %u", replayed, index);
+
+  g_mutex_lock (&download->lock);
+  while ((buffer = g_queue_pop_head (&frames)))
+    g_queue_push_tail (&segment->buffers, buffer);
+  segment->queued += frames_size;
+  queued = segment->queued;
+  if (frames_size)
+    g_cond_broadcast (&download->cond);
+  g_mutex_unlock (&download->lock);
+
+  return queued;
+}
+
+/* Waits until the segment is drained enough to read on. The segment being
+ * output waits too, or a slow downstream would let it grow without bound.
+ */
+static gboolean
+gst_dmss_download_wait_room (GstDmssDownload * download, guint index)
+{
+  struct _GstDmssDownloadSegment *segment;
+
+  segment = &g_array_index (download->segments,
+      struct _GstDmssDownloadSegment, index);
+
+  g_mutex_lock (&download->lock);
+  while (segment->queued > DMSS_DOWNLOAD_MAX_QUEUED && !download->error
+      && !g_cancellable_is_cancelled (download->cancellable))
+    g_cond_wait_until (&download->cond, &download->lock,
+        g_get_monotonic_time () + DMSS_DOWNLOAD_WAIT_US);
+  g_mutex_unlock (&download->lock);
+
+  return !g_cancellable_is_cancelled (download->cancellable);
+}
+
+/* Plays params on a stream of its own and queues its frames until the
+ * device hangs up.
+ */
+static gboolean
+gst_dmss_download_play (GstDmssDownload * download, guint index,
+    const GstDmssPlaybackParams * params, GstDmssDownloadProgress * progress,
+    GError ** err)
+{
+  gchar connection_id[GST_DMSS_SESSION_CONNECTION_ID_SIZE];
+  GstDmssParser parser;
+  GstDmssParserEvent event;
+  GByteArray *pending = NULL;
+  GSocket *socket;
+  GError *close_error = NULL;
+  gchar *buffer = NULL;
+  gssize received;
+  gsize offset, consumed, queued = 0;
+  gboolean ret = FALSE;
+
+  if (!(socket = gst_dmss_session_connect_stream_begin (download->session,
+              download->receive_buffer_size, download->cancellable, err)))
+    return FALSE;
+
+  if (!gst_dmss_session_add_object (download->session, connection_id,
+          download->cancellable, err)
+      || !gst_dmss_session_connect_stream_finish (download->session, socket,
+          download->cancellable, err)
+      || !gst_dmss_session_link_stream (download->session, socket,
+          connection_id, download->cancellable, err)
+      || !gst_dmss_session_start_playback (download->session,
+          params, connection_id, download->cancellable, err))
+    goto done;
+
+  gst_dmss_parser_init (&parser, GST_DMSS_PARSER_SHORT_BODY_SIZE);
+  pending = g_byte_array_sized_new (DMSS_DOWNLOAD_RECEIVE_SIZE);
+  buffer = g_malloc (DMSS_DOWNLOAD_RECEIVE_SIZE);
+
+  // the device hangs up once the segment is played, or when it drops us
+  while ((received = g_socket_receive (socket, buffer,
+              DMSS_DOWNLOAD_RECEIVE_SIZE, download->cancellable, err)) > 0) {
+    offset = 0;
+    do {
+      event = gst_dmss_parser_feed (&parser, &buffer[offset],
+          received - offset, &consumed);
+      offset += consumed;
+      if (event == GST_DMSS_PARSER_BODY
+          && (guint8) parser.header[0] == 0xbc)
+        g_byte_array_append (pending, (const guint8 *) parser.body,
+            parser.body_length);
+      else if (event == GST_DMSS_PARSER_PACKET_END)
+        queued = gst_dmss_download_take_frames (download, index, &pending,
+            progress);
+    } while (event != GST_DMSS_PARSER_NEED_DATA);
+
+    if (queued > DMSS_DOWNLOAD_MAX_QUEUED
+        && !gst_dmss_download_wait_room (download, index)) {
+      g_cancellable_set_error_if_cancelled (download->cancellable, err);
+      goto done;
+    }
+  }
+  if (received < 0)
+    goto done;
+
+  if (pending->len)
+    GST_DEBUG ("Segment %u ended with %u bytes of a partial frame", index,
+        pending->len);
+
+  ret = TRUE;
+done:
+  g_free (buffer);
+  if (pending)
+    g_byte_array_unref (pending);
+  g_socket_close (socket, &close_error);
+  g_clear_error (&close_error);
+  g_object_unref (socket);
+
+  return ret;
+}
+
+/* Downloads a segment. A hang-up before the end of the segment is the
+ * device dropping the stream, which is played again from the last frame
+ * a few times before the download fails.
+ */
+static gboolean
+gst_dmss_download_fetch (GstDmssDownload * download, guint index,
+    GError ** err)
+{
+  struct _GstDmssDownloadSegment *segment;
+  GstDmssPlaybackParams params;
+  GstDmssDownloadProgress progress = { -1, 0, FALSE };
+  guint attempt;
+
+  segment = &g_array_index (download->segments,
+      struct _GstDmssDownloadSegment, index);
+  params = segment->params;
+
+  GST_DEBUG ("Downloading segment %u, drive %u cluster %u", index,
+      params.drive_no, params.cluster_no);
+
+  for (attempt = 0;; ++attempt) {
+    if (!gst_dmss_download_play (download, index, &params, &progress, err))
+      return FALSE;
+    if (progress.time >= 0 && gst_dmss_protocol_playback_ended (progress.time,
+            segment->params.end_time, FALSE))
+      break;
+
+    if (attempt == DMSS_DOWNLOAD_RETRIES) {
+      g_set_error (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+          "Stream closed at %" G_GINT64_FORMAT ", before the end of the "
+          "segment at %" G_GINT64_FORMAT, progress.time,
+          segment->params.end_time);
+      return FALSE;
+    }
+
+    GST_DEBUG ("Segment %u closed at %" G_GINT64_FORMAT ", playing it again",
+        index, progress.time);
+    if (progress.time >= 0) {
+      params.start_time = MAX (progress.time, params.start_time);
+      progress.replaying = TRUE;
+    }
+  }
+
+  g_mutex_lock (&download->lock);
+  segment->done = TRUE;
+  g_cond_broadcast (&download->cond);
+  g_mutex_unlock (&download->lock);
+
+  return TRUE;
+}
+
+static gpointer
+gst_dmss_download_worker_func (gpointer user_data)
+{
+  GstDmssDownload *download = user_data;
+  GError *err = NULL;
+  guint index;
+
+  while (TRUE) {
+    g_mutex_lock (&download->lock);
+    if (download->error || download->next_segment == download->segments->len) {
+      g_mutex_unlock (&download->lock);
+      break;
+    }
+    index = download->next_segment++;
+    g_mutex_unlock (&download->lock);
+
+    if (!gst_dmss_download_fetch (download, index, &err)) {
+      g_prefix_error (&err, "Failed to download segment %u: ", index);
+      gst_dmss_download_fail (download, err);
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+gboolean
+gst_dmss_download_start (GstDmssDownload * download, GError ** err)
+{
+  guint i;
+
+  GST_DEBUG ("Downloading %u segments over %u connections",
+      download->segments->len, download->n_workers);
+
+  for (i = 0; i != download->n_workers; ++i)
+    if (!(download->workers[i] = g_thread_try_new ("dmss-download",
+                gst_dmss_download_worker_func, download, err)))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Returns the next frame of the range in order, GST_FLOW_EOS after the
+ * last one.
+ */
+GstFlowReturn
+gst_dmss_download_pop (GstDmssDownload * download, GstBuffer ** outbuf,
+    GCancellable * cancellable, GError ** err)
+{
+  struct _GstDmssDownloadSegment *segment;
+  gsize queued;
+
+  g_mutex_lock (&download->lock);
+  while (TRUE) {
+    if (download->error) {
+      g_propagate_error (err, g_error_copy (download->error));
+      goto error;
+    }
+    if (download->output_segment == download->segments->len) {
+      g_mutex_unlock (&download->lock);
+      return GST_FLOW_EOS;
+    }
+
+    segment = &g_array_index (download->segments,
+        struct _GstDmssDownloadSegment, download->output_segment);
+    if ((*outbuf = g_queue_pop_head (&segment->buffers))) {
+      queued = segment->queued;
+      segment->queued -= gst_buffer_get_size (*outbuf);
+      // its worker may be waiting for room
+      if (queued > DMSS_DOWNLOAD_MAX_QUEUED
+          && segment->queued <= DMSS_DOWNLOAD_MAX_QUEUED)
+        g_cond_broadcast (&download->cond);
+      break;
+    }
+
+    if (segment->done) {
+      GST_DEBUG ("Segment %u fully output", download->output_segment);
+      ++download->output_segment;
+      continue;
+    }
+
+    // cancellation doesn't signal us, so look at it now and then
+    if (g_cancellable_set_error_if_cancelled (cancellable, err))
+      goto error;
+    g_cond_wait_until (&download->cond, &download->lock,
+        g_get_monotonic_time () + DMSS_DOWNLOAD_WAIT_US);
+  }
+  g_mutex_unlock (&download->lock);
+
+  return GST_FLOW_OK;
+error:
+  g_mutex_unlock (&download->lock);
+  return GST_FLOW_ERROR;
+}
+
+void
+gst_dmss_download_free (GstDmssDownload * download)
+{
+  guint i;
+
+  g_cancellable_cancel (download->cancellable);
+  for (i = 0; i != download->n_workers; ++i)
+    if (download->workers[i])
+      g_thread_join (download->workers[i]);
+
+  g_free (download->workers);
+  g_array_unref (download->segments);
+  g_clear_error (&download->error);
+  g_object_unref (download->cancellable);
+  g_mutex_clear (&download->lock);
+  g_cond_clear (&download->cond);
+  gst_dmss_session_unref (download->session);
+  g_slice_free (GstDmssDownload, download);
+}
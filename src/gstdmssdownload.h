@@ -0,0 +1,41 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __GST_DMSS_DOWNLOAD_H__
+#define __GST_DMSS_DOWNLOAD_H__
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include "gstdmsssession.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstDmssDownload GstDmssDownload;
+
+GstDmssDownload *gst_dmss_download_new (GstDmssSession * session,
+    const GArray * segments, guint connections, guint receive_buffer_size);
+gboolean gst_dmss_download_start (GstDmssDownload * download, GError ** err);
+GstFlowReturn gst_dmss_download_pop (GstDmssDownload * download,
+    GstBuffer ** outbuf, GCancellable * cancellable, GError ** err);
+void gst_dmss_download_free (GstDmssDownload * download);
+
+G_END_DECLS
+#endif /* __GST_DMSS_DOWNLOAD_H__ */
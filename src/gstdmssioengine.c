@@ -0,0 +1,525 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Process-wide I/O engine shared by dmsssrc instances in receive-mode=shared.
+ *
+ * Stream sockets are spread over a few threads, each waiting on its own
+ * epoll set. Packets are assembled without blocking and queued per stream,
+ * and the element's create just pops them. When a queue gets too long the
+ * socket is taken out of its epoll set until the element catches up, so a
+ * stalled pipeline pushes back on its camera instead of growing memory.
+ *
+ * Control sockets don't carry enough traffic to deserve epoll; their
+ * keep-alive timers and socket sources are attached to one shared
+ * GMainContext instead of a thread per element.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gstversion.h>
+#if GST_VERSION_MINOR <= 15
+#include <gst/gst-i18n-plugin.h>
+#endif
+#include <gst/gst.h>
+#include "gstdmssioengine.h"
+#include "gstdmssprotocol.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+#define DMSS_IO_ENGINE_MAX_THREADS      4
+#define DMSS_IO_ENGINE_MAX_EVENTS       64
+#define DMSS_IO_ENGINE_READ_BUDGET      (256 * 1024)
+#define DMSS_IO_STREAM_HIGH_WATERMARK   1024
+#define DMSS_IO_STREAM_LOW_WATERMARK    256
+
+typedef struct _GstDmssIoThread GstDmssIoThread;
+
+struct _GstDmssIoStream
+{
+  GstDmssIoThread *thread;
+  GSocket *socket;
+  gint fd;
+
+  /* only touched by the engine thread. Headers are received into header,
+   * bodies straight into the mapped buffer at filled */
+  GstDmssParser parser;
+  gchar header[GST_DMSS_PROTOCOL_HEADER_SIZE];
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize filled;
+
+  /* protected by the engine thread lock */
+  gboolean removed;
+
+  /* protected by lock */
+  GMutex lock;
+  GCond cond;
+  GQueue packets;
+  gboolean paused;
+  gboolean flushing;
+  GError *error;
+
+  gint syscalls;
+};
+
+struct _GstDmssIoThread
+{
+  GThread *thread;
+  gint epoll_fd;
+  gint wakeup_fd;
+  GMutex lock;
+  GSList *removed;
+};
+
+typedef struct
+{
+  GSourceFunc func;
+  gpointer data;
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+} GstDmssIoInvoke;
+
+static struct
+{
+  GstDmssIoThread threads[DMSS_IO_ENGINE_MAX_THREADS];
+  guint n_threads;
+  guint next_thread;
+
+  GMainContext *control_context;
+  GMainLoop *control_loop;
+  GThread *control_thread;
+} engine;
+
+G_LOCK_DEFINE_STATIC (engine);
+
+static gpointer
+gst_dmss_io_engine_control_func (gpointer user_data)
+{
+  g_main_context_push_thread_default (engine.control_context);
+  g_main_loop_run (engine.control_loop);
+  g_main_context_pop_thread_default (engine.control_context);
+
+  return NULL;
+}
+
+GMainContext *
+gst_dmss_io_engine_get_control_context (void)
+{
+  G_LOCK (engine);
+  if (!engine.control_context) {
+    engine.control_context = g_main_context_new ();
+    engine.control_loop = g_main_loop_new (engine.control_context, FALSE);
+    engine.control_thread = g_thread_new ("dmss-control",
+        gst_dmss_io_engine_control_func, NULL);
+  }
+  G_UNLOCK (engine);
+
+  return g_main_context_ref (engine.control_context);
+}
+
+static gboolean
+gst_dmss_io_engine_invoke_cb (gpointer user_data)
+{
+  GstDmssIoInvoke *invoke = user_data;
+
+  invoke->func (invoke->data);
+
+  g_mutex_lock (&invoke->lock);
+  invoke->done = TRUE;
+  g_cond_signal (&invoke->cond);
+  g_mutex_unlock (&invoke->lock);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Runs func in the shared control thread and waits for it, so once this
+ * returns no control callback of the caller can still be running.
+ */
+void
+gst_dmss_io_engine_invoke_control (GSourceFunc func, gpointer data)
+{
+  GstDmssIoInvoke invoke = { func, data, };
+
+  g_return_if_fail (engine.control_context != NULL);
+
+  g_mutex_init (&invoke.lock);
+  g_cond_init (&invoke.cond);
+
+  g_main_context_invoke (engine.control_context,
+      gst_dmss_io_engine_invoke_cb, &invoke);
+
+  g_mutex_lock (&invoke.lock);
+  while (!invoke.done)
+    g_cond_wait (&invoke.cond, &invoke.lock);
+  g_mutex_unlock (&invoke.lock);
+
+  g_mutex_clear (&invoke.lock);
+  g_cond_clear (&invoke.cond);
+}
+
+#ifdef __linux__
+
+static void
+gst_dmss_io_stream_free (gpointer data)
+{
+  GstDmssIoStream *stream = data;
+
+  if (stream->buffer) {
+    gst_buffer_unmap (stream->buffer, &stream->map);
+    gst_buffer_unref (stream->buffer);
+  }
+  g_queue_foreach (&stream->packets, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (&stream->packets);
+  g_clear_error (&stream->error);
+  g_object_unref (stream->socket);
+  g_mutex_clear (&stream->lock);
+  g_cond_clear (&stream->cond);
+  g_slice_free (GstDmssIoStream, stream);
+}
+
+static void
+gst_dmss_io_stream_fail (GstDmssIoStream * stream, GError * err)
+{
+  GST_DEBUG ("Stream socket %d failed: %s", stream->fd, err->message);
+
+  epoll_ctl (stream->thread->epoll_fd, EPOLL_CTL_DEL, stream->fd, NULL);
+
+  g_mutex_lock (&stream->lock);
+  stream->error = err;
+  g_cond_broadcast (&stream->cond);
+  g_mutex_unlock (&stream->lock);
+}
+
+/* returns FALSE when the stream stopped being watched */
+static gboolean
+gst_dmss_io_stream_complete (GstDmssIoStream * stream)
+{
+  gboolean paused;
+
+  gst_buffer_unmap (stream->buffer, &stream->map);
+
+  g_mutex_lock (&stream->lock);
+  g_queue_push_tail (&stream->packets, stream->buffer);
+  g_cond_signal (&stream->cond);
+  if ((paused = stream->packets.length >= DMSS_IO_STREAM_HIGH_WATERMARK)) {
+    GST_DEBUG ("Stream socket %d queue full, pausing", stream->fd);
+    epoll_ctl (stream->thread->epoll_fd, EPOLL_CTL_DEL, stream->fd, NULL);
+    stream->paused = TRUE;
+  }
+  g_mutex_unlock (&stream->lock);
+
+  stream->buffer = NULL;
+
+  return !paused;
+}
+
+/* Runs the parser over what was just received. Receives never ask for
+ * more than the parser wants, so data holds a piece of one packet only.
+ * Returns FALSE when the stream stopped being watched.
+ */
+static gboolean
+gst_dmss_io_stream_feed (GstDmssIoStream * stream, const gchar * data,
+    gsize size)
+{
+  GstDmssParser *parser = &stream->parser;
+  GstDmssParserEvent event;
+  gsize consumed;
+
+  do {
+    event = gst_dmss_parser_feed (parser, data, size, &consumed);
+    data += consumed;
+    size -= consumed;
+
+    switch (event) {
+      case GST_DMSS_PARSER_HEADER:
+        stream->buffer = gst_buffer_new_allocate (NULL,
+            sizeof (parser->header) + parser->body_size, NULL);
+        gst_buffer_map (stream->buffer, &stream->map, GST_MAP_WRITE);
+        memcpy (stream->map.data, parser->header, sizeof (parser->header));
+        stream->filled = sizeof (parser->header);
+        break;
+      case GST_DMSS_PARSER_BODY:
+        // already received in place
+        stream->filled += parser->body_length;
+        break;
+      case GST_DMSS_PARSER_PACKET_END:
+        if (!gst_dmss_io_stream_complete (stream))
+          return FALSE;
+        break;
+      default:
+        break;
+    }
+  } while (event != GST_DMSS_PARSER_NEED_DATA);
+
+  return TRUE;
+}
+
+static void
+gst_dmss_io_stream_read (GstDmssIoStream * stream)
+{
+  GError *err = NULL;
+  gssize received;
+  gsize budget = DMSS_IO_ENGINE_READ_BUDGET;
+  gchar *data;
+
+  while (budget) {
+    g_atomic_int_inc (&stream->syscalls);
+
+    data = stream->buffer ? (gchar *) & stream->map.data[stream->filled] :
+        stream->header;
+    received = g_socket_receive_with_blocking (stream->socket, data,
+        gst_dmss_parser_get_wanted (&stream->parser), FALSE, NULL, &err);
+
+    if (received < 0) {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        g_error_free (err);
+      else
+        gst_dmss_io_stream_fail (stream, err);
+      return;
+    } else if (!received) {
+      gst_dmss_io_stream_fail (stream, g_error_new_literal (G_IO_ERROR,
+              G_IO_ERROR_CONNECTION_CLOSED,
+              "Connection closed by remote peer"));
+      return;
+    }
+
+    budget -= MIN (budget, received);
+
+    if (!gst_dmss_io_stream_feed (stream, data, received))
+      return;
+  }
+}
+
+static gpointer
+gst_dmss_io_engine_thread_func (gpointer user_data)
+{
+  GstDmssIoThread *thread = user_data;
+  struct epoll_event events[DMSS_IO_ENGINE_MAX_EVENTS];
+  GstDmssIoStream *stream;
+  guint64 value;
+  int i, n;
+
+  while (TRUE) {
+    if ((n = epoll_wait (thread->epoll_fd, events, G_N_ELEMENTS (events),
+                -1)) < 0) {
+      if (errno == EINTR)
+        continue;
+      GST_ERROR ("epoll_wait failed: %s", g_strerror (errno));
+      break;
+    }
+
+    g_mutex_lock (&thread->lock);
+    for (i = 0; i != n; ++i) {
+      if (!(stream = events[i].data.ptr)) {
+        if (read (thread->wakeup_fd, &value, sizeof (value)) < 0)
+          GST_LOG ("Spurious engine wakeup");
+        continue;
+      }
+      // events can outlive the removal of their stream by one batch
+      if (!stream->removed)
+        gst_dmss_io_stream_read (stream);
+    }
+
+    g_slist_free_full (thread->removed, gst_dmss_io_stream_free);
+    thread->removed = NULL;
+    g_mutex_unlock (&thread->lock);
+  }
+
+  return NULL;
+}
+
+static gboolean
+gst_dmss_io_engine_ensure_threads (GError ** err)
+{
+  struct epoll_event event = { 0, };
+  GstDmssIoThread *thread;
+  guint n_threads;
+
+  if (engine.n_threads)
+    return TRUE;
+
+  n_threads = CLAMP (g_get_num_processors (), 1, DMSS_IO_ENGINE_MAX_THREADS);
+  for (; engine.n_threads != n_threads; ++engine.n_threads) {
+    thread = &engine.threads[engine.n_threads];
+
+    if ((thread->epoll_fd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+      goto errno_error;
+    if ((thread->wakeup_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+      close (thread->epoll_fd);
+      goto errno_error;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl (thread->epoll_fd, EPOLL_CTL_ADD, thread->wakeup_fd, &event);
+
+    g_mutex_init (&thread->lock);
+    thread->removed = NULL;
+    thread->thread = g_thread_new ("dmss-io", gst_dmss_io_engine_thread_func,
+        thread);
+  }
+
+  GST_DEBUG ("Started I/O engine with %u threads", engine.n_threads);
+  return TRUE;
+errno_error:
+  g_set_error (err, G_IO_ERROR, g_io_error_from_errno (errno),
+      "Failed to create I/O engine thread: %s", g_strerror (errno));
+  // threads already running stay usable
+  return engine.n_threads != 0;
+}
+
+GstDmssIoStream *
+gst_dmss_io_engine_add_stream (GSocket * socket, GError ** err)
+{
+  struct epoll_event event = { 0, };
+  GstDmssIoStream *stream;
+  GstDmssIoThread *thread;
+
+  G_LOCK (engine);
+  if (!gst_dmss_io_engine_ensure_threads (err)) {
+    G_UNLOCK (engine);
+    return NULL;
+  }
+  thread = &engine.threads[engine.next_thread++ % engine.n_threads];
+  G_UNLOCK (engine);
+
+  stream = g_slice_new0 (GstDmssIoStream);
+  stream->thread = thread;
+  stream->socket = g_object_ref (socket);
+  stream->fd = g_socket_get_fd (socket);
+  g_mutex_init (&stream->lock);
+  g_cond_init (&stream->cond);
+  g_queue_init (&stream->packets);
+  gst_dmss_parser_init (&stream->parser, GST_DMSS_PARSER_SHORT_BODY_SIZE);
+
+  event.events = EPOLLIN;
+  event.data.ptr = stream;
+  if (epoll_ctl (thread->epoll_fd, EPOLL_CTL_ADD, stream->fd, &event) < 0) {
+    g_set_error (err, G_IO_ERROR, g_io_error_from_errno (errno),
+        "Failed to watch stream socket: %s", g_strerror (errno));
+    gst_dmss_io_stream_free (stream);
+    return NULL;
+  }
+
+  return stream;
+}
+
+void
+gst_dmss_io_engine_remove_stream (GstDmssIoStream * stream)
+{
+  GstDmssIoThread *thread = stream->thread;
+
+  // fails harmlessly when the stream is paused or failed
+  epoll_ctl (thread->epoll_fd, EPOLL_CTL_DEL, stream->fd, NULL);
+
+  // waits for a batch reading this stream, the thread frees it afterwards
+  g_mutex_lock (&thread->lock);
+  stream->removed = TRUE;
+  thread->removed = g_slist_prepend (thread->removed, stream);
+  g_mutex_unlock (&thread->lock);
+
+  eventfd_write (thread->wakeup_fd, 1);
+}
+
+GstFlowReturn
+gst_dmss_io_stream_pop (GstDmssIoStream * stream, GstBuffer ** buffer,
+    GError ** err)
+{
+  struct epoll_event event = { 0, };
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&stream->lock);
+  while (!stream->flushing && !stream->error
+      && g_queue_is_empty (&stream->packets))
+    g_cond_wait (&stream->cond, &stream->lock);
+
+  if (stream->flushing)
+    ret = GST_FLOW_FLUSHING;
+  else if (!g_queue_is_empty (&stream->packets)) {
+    *buffer = g_queue_pop_head (&stream->packets);
+
+    if (stream->paused
+        && stream->packets.length <= DMSS_IO_STREAM_LOW_WATERMARK) {
+      GST_DEBUG ("Stream socket %d queue drained, resuming", stream->fd);
+      event.events = EPOLLIN;
+      event.data.ptr = stream;
+      epoll_ctl (stream->thread->epoll_fd, EPOLL_CTL_ADD, stream->fd, &event);
+      stream->paused = FALSE;
+    }
+  } else {
+    g_propagate_error (err, g_error_copy (stream->error));
+    ret = GST_FLOW_ERROR;
+  }
+  g_mutex_unlock (&stream->lock);
+
+  return ret;
+}
+
+#else /* !__linux__ */
+
+GstDmssIoStream *
+gst_dmss_io_engine_add_stream (GSocket * socket, GError ** err)
+{
+  g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+      "Shared I/O engine needs epoll");
+  return NULL;
+}
+
+void
+gst_dmss_io_engine_remove_stream (GstDmssIoStream * stream)
+{
+  g_assert_not_reached ();
+}
+
+GstFlowReturn
+gst_dmss_io_stream_pop (GstDmssIoStream * stream, GstBuffer ** buffer,
+    GError ** err)
+{
+  g_assert_not_reached ();
+  return GST_FLOW_ERROR;
+}
+
+#endif /* __linux__ */
+
+void
+gst_dmss_io_stream_set_flushing (GstDmssIoStream * stream, gboolean flushing)
+{
+  g_mutex_lock (&stream->lock);
+  stream->flushing = flushing;
+  g_cond_broadcast (&stream->cond);
+  g_mutex_unlock (&stream->lock);
+}
+
+guint
+gst_dmss_io_stream_take_syscalls (GstDmssIoStream * stream)
+{
+  return g_atomic_int_and ((guint *) & stream->syscalls, 0);
+}
@@ -0,0 +1,45 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_IO_ENGINE_H__
+#define __GST_DMSS_IO_ENGINE_H__
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstDmssIoStream GstDmssIoStream;
+
+GstDmssIoStream *gst_dmss_io_engine_add_stream (GSocket * socket,
+    GError ** err);
+void gst_dmss_io_engine_remove_stream (GstDmssIoStream * stream);
+
+GstFlowReturn gst_dmss_io_stream_pop (GstDmssIoStream * stream,
+    GstBuffer ** buffer, GError ** err);
+void gst_dmss_io_stream_set_flushing (GstDmssIoStream * stream,
+    gboolean flushing);
+guint gst_dmss_io_stream_take_syscalls (GstDmssIoStream * stream);
+
+GMainContext *gst_dmss_io_engine_get_control_context (void);
+void gst_dmss_io_engine_invoke_control (GSourceFunc func, gpointer data);
+
+G_END_DECLS
+#endif /* __GST_DMSS_IO_ENGINE_H__ */
@@ -0,0 +1,834 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-dmssnvrsrc
+ * @title: dmssnvrsrc
+ * @see_also: #dmsssrc
+ *
+ * Receives several channels of one NVR over a single login. Every
+ * requested src_%u pad gets its own stream socket, AddObject and
+ * AckSubChannel, while login and keep-alive happen once on the shared
+ * control connection. The pad index is the default channel.
+ *
+ * ## Example launch line (client):
+ * |[
+ * gst-launch-1.0 dmssnvrsrc name=nvr host=192.168.1.108 user=admin password=admin \
+ *   nvr.src_0 ! dmssdemux ! fakesink  nvr.src_1 ! dmssdemux ! fakesink
+ * ]|
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gstversion.h>
+#if GST_VERSION_MINOR <= 15
+#include <gst/gst-i18n-plugin.h>
+#endif
+#include "gstdmssnvrsrc.h"
+#include "gstdmssprotocol.h"
+#include "gstdmsssession.h"
+#include "gstdmss.h"
+
+#include <stdio.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_STATIC (dmssnvrsrc_debug);
+#define GST_CAT_DEFAULT dmssnvrsrc_debug
+
+#define DMSS_DEFAULT_TIMEOUT            0
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("application/x-dmss"));
+
+enum
+{
+  PROP_0,
+  PROP_HOST,
+  PROP_PORT,
+  PROP_USER,
+  PROP_PASSWORD,
+  PROP_TIMEOUT,
+  PROP_KEEPALIVE_RTT
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_CHANNEL,
+  PROP_PAD_SUBCHANNEL
+};
+
+G_DEFINE_TYPE (GstDmssNvrSrcPad, gst_dmss_nvr_src_pad, GST_TYPE_PAD);
+
+#define gst_dmss_nvr_src_parent_class parent_class
+G_DEFINE_TYPE (GstDmssNvrSrc, gst_dmss_nvr_src, GST_TYPE_ELEMENT);
+
+static void gst_dmss_nvr_src_finalize (GObject * gobject);
+static void gst_dmss_nvr_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_dmss_nvr_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_dmss_nvr_src_change_state (GstElement *
+    element, GstStateChange transition);
+static GstPad *gst_dmss_nvr_src_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_dmss_nvr_src_release_pad (GstElement * element, GstPad * pad);
+static void gst_dmss_nvr_src_pad_loop (GstPad * pad);
+
+static void
+gst_dmss_nvr_src_pad_finalize (GObject * gobject)
+{
+  GstDmssNvrSrcPad *pad = GST_DMSS_NVR_SRC_PAD (gobject);
+
+  g_assert (pad->stream_socket == NULL);
+  g_object_unref (pad->cancellable);
+
+  G_OBJECT_CLASS (gst_dmss_nvr_src_pad_parent_class)->finalize (gobject);
+}
+
+static void
+gst_dmss_nvr_src_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDmssNvrSrcPad *pad = GST_DMSS_NVR_SRC_PAD (object);
+
+  switch (prop_id) {
+    case PROP_PAD_CHANNEL:
+      GST_OBJECT_LOCK (pad);
+      pad->channel = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    case PROP_PAD_SUBCHANNEL:
+      GST_OBJECT_LOCK (pad);
+      pad->subchannel = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_dmss_nvr_src_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDmssNvrSrcPad *pad = GST_DMSS_NVR_SRC_PAD (object);
+
+  switch (prop_id) {
+    case PROP_PAD_CHANNEL:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_uint (value, pad->channel);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    case PROP_PAD_SUBCHANNEL:
+      GST_OBJECT_LOCK (pad);
+      g_value_set_uint (value, pad->subchannel);
+      GST_OBJECT_UNLOCK (pad);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_dmss_nvr_src_pad_class_init (GstDmssNvrSrcPadClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->set_property = gst_dmss_nvr_src_pad_set_property;
+  gobject_class->get_property = gst_dmss_nvr_src_pad_get_property;
+  gobject_class->finalize = gst_dmss_nvr_src_pad_finalize;
+
+  // only read when the pad (re)starts its stream
+  g_object_class_install_property (gobject_class, PROP_PAD_CHANNEL,
+      g_param_spec_uint ("channel", "Channel",
+          "Channel to read, defaults to the pad index", 0,
+          G_MAXUINT, DMSS_DEFAULT_CHANNEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PAD_SUBCHANNEL,
+      g_param_spec_uint ("subchannel", "Subchannel",
+          "Sub-channel to read", 0,
+          G_MAXUINT, DMSS_DEFAULT_SUBCHANNEL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_dmss_nvr_src_pad_init (GstDmssNvrSrcPad * pad)
+{
+  pad->channel = DMSS_DEFAULT_CHANNEL;
+  pad->subchannel = DMSS_DEFAULT_SUBCHANNEL;
+  memset (pad->connection_id, 0, sizeof (pad->connection_id));
+  pad->stream_socket = NULL;
+  pad->cancellable = g_cancellable_new ();
+  pad->need_events = TRUE;
+}
+
+static void
+gst_dmss_nvr_src_class_init (GstDmssNvrSrcClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_dmss_nvr_src_set_property;
+  gobject_class->get_property = gst_dmss_nvr_src_get_property;
+  gobject_class->finalize = gst_dmss_nvr_src_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_HOST,
+      g_param_spec_string ("host", "Host",
+          "The host IP address to the NVR", DMSS_DEFAULT_HOST,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_USER,
+      g_param_spec_string ("user", "User",
+          "Username to authenticate with NVR", DMSS_DEFAULT_USER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PASSWORD,
+      g_param_spec_string ("password", "Password",
+          "Password to authenticate with NVR", DMSS_DEFAULT_PASSWORD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT,
+      g_param_spec_int ("port", "Port", "Port number, default is 37777", 0,
+          DMSS_HIGHEST_PORT, DMSS_DEFAULT_PORT, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class, PROP_TIMEOUT,
+      g_param_spec_uint ("timeout", "timeout",
+          "Value in seconds to timeout a blocking I/O. 0 = No timeout. ", 0,
+          G_MAXUINT, DMSS_DEFAULT_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEEPALIVE_RTT,
+      g_param_spec_uint64 ("keepalive-rtt", "Keep-alive RTT",
+          "Last measured keep-alive round trip time in nanoseconds", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_static_pad_template (gstelement_class,
+      &src_template);
+
+  gst_element_class_set_metadata (gstelement_class,
+      "DMSS NVR client source",
+      "Source for IP Camera",
+      "Receive several channels from an NVR over one login",
+      "Felipe Magno de Almeida <felipe@expertisesolutions.com.br>");
+
+  gstelement_class->change_state = gst_dmss_nvr_src_change_state;
+  gstelement_class->request_new_pad = gst_dmss_nvr_src_request_new_pad;
+  gstelement_class->release_pad = gst_dmss_nvr_src_release_pad;
+
+  GST_DEBUG_CATEGORY_INIT (dmssnvrsrc_debug, "dmssnvrsrc", 0,
+      "DMSS NVR Client Source");
+}
+
+static void
+gst_dmss_nvr_src_init (GstDmssNvrSrc * src)
+{
+  src->port = DMSS_DEFAULT_PORT;
+  src->host = g_strdup (DMSS_DEFAULT_HOST);
+  src->user = g_strdup (DMSS_DEFAULT_USER);
+  src->password = g_strdup (DMSS_DEFAULT_PASSWORD);
+  src->timeout = DMSS_DEFAULT_TIMEOUT;
+  src->session = NULL;
+  src->cancellable = g_cancellable_new ();
+  src->group_id = 0;
+  src->next_pad_index = 0;
+  g_mutex_init (&src->lock);
+  g_cond_init (&src->cond);
+  src->playing = FALSE;
+  src->flushing = TRUE;
+
+  GST_OBJECT_FLAG_SET (src, GST_ELEMENT_FLAG_SOURCE);
+}
+
+static void
+gst_dmss_nvr_src_finalize (GObject * gobject)
+{
+  GstDmssNvrSrc *this = GST_DMSS_NVR_SRC (gobject);
+
+  g_assert (this->session == NULL);
+  g_object_unref (this->cancellable);
+  g_mutex_clear (&this->lock);
+  g_cond_clear (&this->cond);
+  g_free (this->host);
+  g_free (this->user);
+  g_free (this->password);
+
+  G_OBJECT_CLASS (parent_class)->finalize (gobject);
+}
+
+static void
+gst_dmss_nvr_src_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstDmssNvrSrc *src = GST_DMSS_NVR_SRC (object);
+
+  switch (prop_id) {
+    case PROP_HOST:
+      if (!g_value_get_string (value)) {
+        g_warning ("host property cannot be NULL");
+        break;
+      }
+      g_free (src->host);
+      src->host = g_strdup (g_value_get_string (value));
+      break;
+    case PROP_USER:
+      if (!g_value_get_string (value)) {
+        g_warning ("user property cannot be NULL");
+        break;
+      }
+      g_free (src->user);
+      src->user = g_strdup (g_value_get_string (value));
+      break;
+    case PROP_PASSWORD:
+      if (!g_value_get_string (value)) {
+        g_warning ("password property cannot be NULL");
+        break;
+      }
+      g_free (src->password);
+      src->password = g_strdup (g_value_get_string (value));
+      break;
+    case PROP_PORT:
+      src->port = g_value_get_int (value);
+      break;
+    case PROP_TIMEOUT:
+      src->timeout = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_dmss_nvr_src_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstDmssNvrSrc *src = GST_DMSS_NVR_SRC (object);
+
+  switch (prop_id) {
+    case PROP_HOST:
+      g_value_set_string (value, src->host);
+      break;
+    case PROP_USER:
+      g_value_set_string (value, src->user);
+      break;
+    case PROP_PASSWORD:
+      g_value_set_string (value, src->password);
+      break;
+    case PROP_PORT:
+      g_value_set_int (value, src->port);
+      break;
+    case PROP_TIMEOUT:
+      g_value_set_uint (value, src->timeout);
+      break;
+    case PROP_KEEPALIVE_RTT:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint64 (value,
+          src->session ? gst_dmss_session_get_keepalive_rtt (src->session) : 0);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static GstPad *
+gst_dmss_nvr_src_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstDmssNvrSrc *src = GST_DMSS_NVR_SRC (element);
+  GstDmssNvrSrcPad *pad;
+  gchar *pad_name;
+  guint index;
+  gboolean start;
+
+  GST_OBJECT_LOCK (src);
+  if (name && sscanf (name, "src_%u", &index) == 1) {
+    src->next_pad_index = MAX (src->next_pad_index, index + 1);
+  } else {
+    index = src->next_pad_index++;
+  }
+  GST_OBJECT_UNLOCK (src);
+
+  pad_name = g_strdup_printf ("src_%u", index);
+  pad = g_object_new (GST_TYPE_DMSS_NVR_SRC_PAD, "name", pad_name,
+      "direction", GST_PAD_SRC, "template", templ, "channel", index, NULL);
+  g_free (pad_name);
+
+  gst_pad_use_fixed_caps (GST_PAD (pad));
+
+  if (!gst_element_add_pad (element, GST_PAD (pad))) {
+    GST_WARNING_OBJECT (src, "Pad src_%u already exists", index);
+    return NULL;
+  }
+
+  // pads requested while running start right away
+  GST_OBJECT_LOCK (src);
+  start = src->session != NULL;
+  GST_OBJECT_UNLOCK (src);
+  if (start)
+    gst_pad_start_task (GST_PAD (pad),
+        (GstTaskFunction) gst_dmss_nvr_src_pad_loop, pad, NULL);
+
+  return GST_PAD (pad);
+}
+
+static void
+gst_dmss_nvr_src_pad_stop (GstDmssNvrSrc * src, GstDmssNvrSrcPad * pad)
+{
+  GError *error = NULL;
+
+  gst_pad_stop_task (GST_PAD (pad));
+
+  if (pad->stream_socket) {
+    g_socket_close (pad->stream_socket, &error);
+    g_clear_error (&error);
+    g_object_unref (pad->stream_socket);
+  }
+  pad->stream_socket = NULL;
+  pad->need_events = TRUE;
+  g_cancellable_reset (pad->cancellable);
+}
+
+static void
+gst_dmss_nvr_src_release_pad (GstElement * element, GstPad * pad)
+{
+  GstDmssNvrSrc *src = GST_DMSS_NVR_SRC (element);
+
+  GST_DEBUG_OBJECT (src, "Releasing %s:%s", GST_DEBUG_PAD_NAME (pad));
+
+  g_cancellable_cancel (GST_DMSS_NVR_SRC_PAD (pad)->cancellable);
+  g_mutex_lock (&src->lock);
+  g_cond_broadcast (&src->cond);
+  g_mutex_unlock (&src->lock);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_dmss_nvr_src_pad_stop (src, GST_DMSS_NVR_SRC_PAD (pad));
+  gst_element_remove_pad (element, pad);
+}
+
+static gboolean
+gst_dmss_nvr_src_pad_receive_exact (GstDmssNvrSrcPad * pad, gchar * buffer,
+    gsize size, GError ** err)
+{
+  gssize received;
+  gsize offset = 0;
+
+  while (offset != size) {
+    if ((received = g_socket_receive (pad->stream_socket, &buffer[offset],
+                size - offset, pad->cancellable, err)) <= 0) {
+      if (!*err && !received)
+        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+            "Connection closed by remote peer");
+      return FALSE;
+    }
+    offset += received;
+  }
+
+  return TRUE;
+}
+
+/* Receives one packet. Reads ask the parser how much is left of the
+ * header or body, so the body lands straight in the buffer and the next
+ * packet stays in the socket.
+ */
+static gboolean
+gst_dmss_nvr_src_pad_receive (GstDmssNvrSrcPad * pad, GstBuffer ** outbuf,
+    GError ** err)
+{
+  GstDmssParser parser;
+  GstDmssParserEvent event = GST_DMSS_PARSER_NEED_DATA;
+  gchar header[GST_DMSS_PROTOCOL_HEADER_SIZE];
+  GstBuffer *buffer = NULL;
+  GstMapInfo map;
+  gchar *data;
+  gsize size, consumed, filled = 0;
+
+  gst_dmss_parser_init (&parser, GST_DMSS_PARSER_SHORT_BODY_SIZE);
+  while (event != GST_DMSS_PARSER_PACKET_END) {
+    data = buffer ? (gchar *) & map.data[filled] : header;
+    size = gst_dmss_parser_get_wanted (&parser);
+    if (!gst_dmss_nvr_src_pad_receive_exact (pad, data, size, err))
+      goto error;
+
+    do {
+      event = gst_dmss_parser_feed (&parser, data, size, &consumed);
+      data += consumed;
+      size -= consumed;
+
+      if (event == GST_DMSS_PARSER_HEADER) {
+        buffer = gst_buffer_new_allocate (NULL,
+            sizeof (parser.header) + parser.body_size, NULL);
+        gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+        memcpy (map.data, parser.header, sizeof (parser.header));
+        filled = sizeof (parser.header);
+      } else if (event == GST_DMSS_PARSER_BODY) {
+        filled += parser.body_length;
+      }
+    } while (event != GST_DMSS_PARSER_NEED_DATA
+        && event != GST_DMSS_PARSER_PACKET_END);
+  }
+  gst_buffer_unmap (buffer, &map);
+
+  *outbuf = buffer;
+  return TRUE;
+error:
+  if (buffer) {
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+  }
+  return FALSE;
+}
+
+/* Adds this pad's stream object to the shared session */
+static gboolean
+gst_dmss_nvr_src_pad_open (GstDmssNvrSrc * src, GstDmssNvrSrcPad * pad,
+    GError ** err)
+{
+  GstDmssSession *session;
+  GSocket *socket;
+  guint channel, subchannel;
+  gboolean ret = FALSE;
+
+  GST_OBJECT_LOCK (src);
+  session = src->session ? gst_dmss_session_ref (src->session) : NULL;
+  GST_OBJECT_UNLOCK (src);
+  if (!session) {
+    g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED,
+        "No session with the device");
+    return FALSE;
+  }
+
+  GST_OBJECT_LOCK (pad);
+  channel = pad->channel;
+  subchannel = pad->subchannel;
+  GST_OBJECT_UNLOCK (pad);
+
+  if (!(socket = gst_dmss_session_connect_stream_begin (session, 0,
+              pad->cancellable, err))) {
+    g_prefix_error (err, "Connection with stream socket failed: ");
+    goto done;
+  }
+  pad->stream_socket = socket;
+
+  if (!gst_dmss_session_add_object (session, pad->connection_id,
+          pad->cancellable, err)) {
+    g_prefix_error (err, "AddObject failed: ");
+    goto done;
+  }
+
+  if (!gst_dmss_session_connect_stream_finish (session, socket,
+          pad->cancellable, err)) {
+    g_prefix_error (err, "Connection with stream socket failed: ");
+    goto done;
+  }
+
+  if (!gst_dmss_session_link_stream (session, socket, pad->connection_id,
+          pad->cancellable, err)) {
+    g_prefix_error (err, "Authentication in stream socket failed: ");
+    goto done;
+  }
+
+  if (!gst_dmss_session_start_monitor (session, channel, subchannel,
+          pad->connection_id, pad->cancellable, err)) {
+    g_prefix_error (err, "Failed to start stream: ");
+    goto done;
+  }
+
+  GST_DEBUG_OBJECT (pad, "Started channel %u subchannel %u", channel,
+      subchannel);
+  ret = TRUE;
+done:
+  gst_dmss_session_unref (session);
+  return ret;
+}
+
+static void
+gst_dmss_nvr_src_pad_push_events (GstDmssNvrSrc * src, GstDmssNvrSrcPad * pad)
+{
+  GstEvent *event;
+  GstSegment segment;
+  GstCaps *caps;
+  gchar *stream_id;
+
+  stream_id = gst_pad_create_stream_id_printf (GST_PAD (pad),
+      GST_ELEMENT (src), "%u", pad->channel);
+  event = gst_event_new_stream_start (stream_id);
+  gst_event_set_group_id (event, src->group_id);
+  gst_pad_push_event (GST_PAD (pad), event);
+  g_free (stream_id);
+
+  caps = gst_pad_get_pad_template_caps (GST_PAD (pad));
+  gst_pad_push_event (GST_PAD (pad), gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (GST_PAD (pad), gst_event_new_segment (&segment));
+
+  pad->need_events = FALSE;
+}
+
+static void
+gst_dmss_nvr_src_pad_loop (GstPad * gpad)
+{
+  GstDmssNvrSrcPad *pad = GST_DMSS_NVR_SRC_PAD (gpad);
+  GstDmssNvrSrc *src = GST_DMSS_NVR_SRC (GST_PAD_PARENT (gpad));
+  GstBuffer *buffer = NULL;
+  GstFlowReturn ret;
+  GError *err = NULL;
+
+  // live source, nothing is read while paused
+  g_mutex_lock (&src->lock);
+  while (!src->playing && !src->flushing
+      && !g_cancellable_is_cancelled (pad->cancellable))
+    g_cond_wait (&src->cond, &src->lock);
+  if (src->flushing) {
+    g_mutex_unlock (&src->lock);
+    goto flushing;
+  }
+  g_mutex_unlock (&src->lock);
+
+  if (!pad->stream_socket && !gst_dmss_nvr_src_pad_open (src, pad, &err))
+    goto error;
+
+  if (pad->need_events)
+    gst_dmss_nvr_src_pad_push_events (src, pad);
+
+  if (!gst_dmss_nvr_src_pad_receive (pad, &buffer, &err))
+    goto error;
+
+  if ((ret = gst_pad_push (gpad, buffer)) != GST_FLOW_OK)
+    goto push_failed;
+
+  return;
+error:
+  {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      GST_DEBUG_OBJECT (pad, "Cancelled");
+      g_error_free (err);
+      goto flushing;
+    }
+    GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL),
+        ("%s:%s: %s", GST_DEBUG_PAD_NAME (gpad), err->message));
+    g_error_free (err);
+    gst_pad_push_event (gpad, gst_event_new_eos ());
+    gst_pad_pause_task (gpad);
+    return;
+  }
+push_failed:
+  {
+    GST_DEBUG_OBJECT (pad, "Pausing task, reason %s", gst_flow_get_name (ret));
+    if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+      GST_ELEMENT_ERROR (src, STREAM, FAILED, (NULL),
+          ("%s:%s: streaming stopped, reason %s", GST_DEBUG_PAD_NAME (gpad),
+              gst_flow_get_name (ret)));
+      gst_pad_push_event (gpad, gst_event_new_eos ());
+    }
+    gst_pad_pause_task (gpad);
+    return;
+  }
+flushing:
+  {
+    gst_pad_pause_task (gpad);
+    return;
+  }
+}
+
+static GList *
+gst_dmss_nvr_src_get_pads (GstDmssNvrSrc * src)
+{
+  GList *pads;
+
+  GST_OBJECT_LOCK (src);
+  pads = g_list_copy_deep (GST_ELEMENT (src)->srcpads,
+      (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (src);
+
+  return pads;
+}
+
+static gboolean
+gst_dmss_nvr_src_open (GstDmssNvrSrc * src)
+{
+  GResolver *resolver;
+  GList *results;
+  GSocketAddress *saddr;
+  GstDmssSession *session;
+  GError *err = NULL;
+  GList *pads, *l;
+
+  resolver = g_resolver_get_default ();
+  results = g_resolver_lookup_by_name (resolver, src->host, src->cancellable,
+      &err);
+  g_object_unref (resolver);
+  if (!results)
+    goto resolve_failed;
+
+  saddr = g_inet_socket_address_new (results->data, src->port);
+  g_resolver_free_addresses (results);
+
+  session = gst_dmss_session_acquire (src->host, src->port, saddr, src->user,
+      src->password, src->timeout, FALSE, NULL, src->cancellable, &err);
+  g_object_unref (saddr);
+
+  if (!session)
+    goto open_failed;
+
+  GST_DEBUG_OBJECT (src, "Logged in to %s:%d with session %d", src->host,
+      src->port, gst_dmss_session_get_id (session));
+
+  GST_OBJECT_LOCK (src);
+  src->session = session;
+  src->group_id = gst_util_group_id_next ();
+  GST_OBJECT_UNLOCK (src);
+
+  g_mutex_lock (&src->lock);
+  src->flushing = FALSE;
+  g_mutex_unlock (&src->lock);
+
+  pads = gst_dmss_nvr_src_get_pads (src);
+  for (l = pads; l; l = l->next)
+    gst_pad_start_task (GST_PAD (l->data),
+        (GstTaskFunction) gst_dmss_nvr_src_pad_loop, l->data, NULL);
+  g_list_free_full (pads, gst_object_unref);
+
+  return TRUE;
+resolve_failed:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND, (NULL),
+        ("Failed to resolve host '%s': %s", src->host, err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+open_failed:
+  {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED))
+      GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
+          ("Authentication failed, verify your username and password"));
+    else
+      GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
+          ("Failed to open session with host '%s:%d': %s", src->host,
+              src->port, err->message));
+    g_error_free (err);
+    return FALSE;
+  }
+}
+
+/* Unblocks every pad task, they are joined once the pads are inactive */
+static void
+gst_dmss_nvr_src_flush (GstDmssNvrSrc * src)
+{
+  GList *pads, *l;
+
+  g_mutex_lock (&src->lock);
+  src->flushing = TRUE;
+  g_cond_broadcast (&src->cond);
+  g_mutex_unlock (&src->lock);
+
+  pads = gst_dmss_nvr_src_get_pads (src);
+  for (l = pads; l; l = l->next)
+    g_cancellable_cancel (GST_DMSS_NVR_SRC_PAD (l->data)->cancellable);
+  g_list_free_full (pads, gst_object_unref);
+}
+
+static void
+gst_dmss_nvr_src_close (GstDmssNvrSrc * src)
+{
+  GList *pads, *l;
+
+  pads = gst_dmss_nvr_src_get_pads (src);
+  for (l = pads; l; l = l->next)
+    gst_dmss_nvr_src_pad_stop (src, GST_DMSS_NVR_SRC_PAD (l->data));
+  g_list_free_full (pads, gst_object_unref);
+
+  GST_OBJECT_LOCK (src);
+  if (src->session)
+    gst_dmss_session_unref (src->session);
+  src->session = NULL;
+  GST_OBJECT_UNLOCK (src);
+}
+
+static GstStateChangeReturn
+gst_dmss_nvr_src_change_state (GstElement * element, GstStateChange transition)
+{
+  GstDmssNvrSrc *src = GST_DMSS_NVR_SRC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      // tasks wait for PLAYING, so they can start before the pads activate
+      if (!gst_dmss_nvr_src_open (src))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      g_mutex_lock (&src->lock);
+      src->playing = TRUE;
+      g_cond_broadcast (&src->cond);
+      g_mutex_unlock (&src->lock);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_dmss_nvr_src_flush (src);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+      gst_dmss_nvr_src_flush (src);
+      gst_dmss_nvr_src_close (src);
+      g_cancellable_reset (src->cancellable);
+    }
+    return ret;
+  }
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      g_mutex_lock (&src->lock);
+      src->playing = FALSE;
+      g_mutex_unlock (&src->lock);
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_dmss_nvr_src_close (src);
+      g_cancellable_reset (src->cancellable);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
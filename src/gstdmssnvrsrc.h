@@ -0,0 +1,101 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_NVR_SRC_H__
+#define __GST_DMSS_NVR_SRC_H__
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DMSS_NVR_SRC                   \
+  (gst_dmss_nvr_src_get_type())
+#define GST_DMSS_NVR_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DMSS_NVR_SRC,GstDmssNvrSrc))
+#define GST_DMSS_NVR_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_DMSS_NVR_SRC,GstDmssNvrSrcClass))
+#define GST_IS_DMSS_NVR_SRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DMSS_NVR_SRC))
+#define GST_IS_DMSS_NVR_SRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DMSS_NVR_SRC))
+#define GST_TYPE_DMSS_NVR_SRC_PAD               \
+  (gst_dmss_nvr_src_pad_get_type())
+#define GST_DMSS_NVR_SRC_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_DMSS_NVR_SRC_PAD,GstDmssNvrSrcPad))
+typedef struct _GstDmssNvrSrc GstDmssNvrSrc;
+typedef struct _GstDmssNvrSrcClass GstDmssNvrSrcClass;
+typedef struct _GstDmssNvrSrcPad GstDmssNvrSrcPad;
+typedef struct _GstDmssNvrSrcPadClass GstDmssNvrSrcPadClass;
+
+/* One stream of the device, each with its own stream socket and task */
+struct _GstDmssNvrSrcPad
+{
+  GstPad pad;
+
+  /*< private > */
+  guint channel;
+  guint subchannel;
+  gchar connection_id[16];
+
+  GSocket *stream_socket;
+  GCancellable *cancellable;
+  gboolean need_events;
+};
+
+struct _GstDmssNvrSrcPadClass
+{
+  GstPadClass parent_class;
+};
+
+struct _GstDmssNvrSrc
+{
+  GstElement element;
+
+  /*< private > */
+  int port;
+  gchar *host;
+  gchar *user;
+  gchar *password;
+  guint timeout;
+
+  /* shared by every pad, open from PAUSED to READY */
+  struct _GstDmssSession *session;
+  GCancellable *cancellable;
+  guint group_id;
+  guint next_pad_index;
+
+  /* pad tasks only receive while playing */
+  GMutex lock;
+  GCond cond;
+  gboolean playing;
+  gboolean flushing;
+};
+
+struct _GstDmssNvrSrcClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_dmss_nvr_src_get_type (void);
+GType gst_dmss_nvr_src_pad_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_DMSS_NVR_SRC_H__ */
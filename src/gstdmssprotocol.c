@@ -31,6 +31,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "gstdmssprotocol.h"
 
 GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
@@ -91,94 +92,484 @@ gst_dmss_protocol_create_new_packet (char *buffer, int size, const char *fmt,
   return calculated_buffer_size;
 }
 
+void
+gst_dmss_parser_init (GstDmssParser * parser, GstDmssParserFlags flags)
+{
+  parser->flags = flags;
+  gst_dmss_parser_reset (parser);
+}
+
+void
+gst_dmss_parser_reset (GstDmssParser * parser)
+{
+  parser->header_filled = 0;
+  parser->body_size = 0;
+  parser->body_filled = 0;
+  parser->body = NULL;
+  parser->body_length = 0;
+  parser->body_offset = 0;
+  parser->ended = FALSE;
+}
+
+/* Bytes still missing from the current header or body, so blocking
+ * callers can read exactly up to the end of a packet and never into the
+ * next one.
+ */
+gsize
+gst_dmss_parser_get_wanted (GstDmssParser * parser)
+{
+  if (parser->ended)
+    return sizeof (parser->header);
+  if (parser->header_filled != sizeof (parser->header))
+    return sizeof (parser->header) - parser->header_filled;
+  return parser->body_size - parser->body_filled;
+}
+
+/* Consumes at most up to the next event and returns it, *consumed tells
+ * how much of data was used. NEED_DATA means all of data was consumed
+ * without completing anything.
+ */
+GstDmssParserEvent
+gst_dmss_parser_feed (GstDmssParser * parser, const gchar * data, gsize size,
+    gsize * consumed)
+{
+  gsize length;
+
+  *consumed = 0;
+  parser->body = NULL;
+  parser->body_length = 0;
+
+  if (parser->ended)
+    gst_dmss_parser_reset (parser);
+
+  if (parser->header_filled != sizeof (parser->header)) {
+    length = MIN (sizeof (parser->header) - parser->header_filled, size);
+    memcpy (&parser->header[parser->header_filled], data, length);
+    parser->header_filled += length;
+    *consumed = length;
+
+    if (parser->header_filled != sizeof (parser->header))
+      return GST_DMSS_PARSER_NEED_DATA;
+
+    if (parser->flags & GST_DMSS_PARSER_SHORT_BODY_SIZE)
+      parser->body_size = GST_READ_UINT16_LE (&parser->header[4]);
+    else
+      parser->body_size = GST_READ_UINT32_LE (&parser->header[4]);
+    return GST_DMSS_PARSER_HEADER;
+  }
+
+  if (parser->body_filled == parser->body_size) {
+    parser->ended = TRUE;
+    return GST_DMSS_PARSER_PACKET_END;
+  }
+
+  if (!size)
+    return GST_DMSS_PARSER_NEED_DATA;
+
+  length = MIN (parser->body_size - parser->body_filled, size);
+  parser->body = data;
+  parser->body_length = length;
+  parser->body_offset = parser->body_filled;
+  parser->body_filled += length;
+  *consumed = length;
+
+  return GST_DMSS_PARSER_BODY;
+}
+
+/* Blocks until the header of the next packet arrives and returns its body
+ * size, leaving the body in the socket.
+ */
 gssize
 gst_dmss_protocol_receive_packet_no_body (GSocket * socket,
     GCancellable * cancellable, GError ** err, gchar * buffer)
 {
+  GstDmssParser parser;
+  GstDmssParserEvent event;
   gssize size;
-  gssize offset;
-  gssize body_size;
-  static int const buffer_size = 32;
+  gsize consumed;
 
   g_assert (err != NULL);
-  offset = 0;
+  gst_dmss_parser_init (&parser, 0);
   do {
-    if ((size = g_socket_receive (socket, &buffer[offset],
-                buffer_size - offset, cancellable, err)) <= 0) {
+    if ((size = g_socket_receive (socket, buffer,
+                gst_dmss_parser_get_wanted (&parser), cancellable, err)) <= 0) {
       if (!*err && !size)
         g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
             "Read operation timed out");
       goto recv_error;
     }
 
-    offset += size;
+    event = gst_dmss_parser_feed (&parser, buffer, size, &consumed);
   }
-  while (offset != buffer_size);
+  while (event != GST_DMSS_PARSER_HEADER);
 
-  body_size = GUINT32_FROM_LE (*(guint32 *) & buffer[4]);
-  return body_size;             // body size
+  memcpy (buffer, parser.header, sizeof (parser.header));
+  return parser.body_size;      // body size
 recv_error:
   return -1;
 }
 
-int
+/* Receives a whole packet. The first *ext_size bytes of it are stored in
+ * ext_buffer and anything past that is read and dropped, so a short
+ * ext_buffer always holds the header followed by the start of the body.
+ * *ext_size is set to the number of bytes stored and the full packet
+ * size is returned.
+ */
+gssize
 gst_dmss_protocol_receive_packet (GSocket * socket, GCancellable * cancellable,
     GError ** err, gchar * ext_buffer, gssize * ext_size)
 {
-  gssize size, body_size, ring_size;
-  gssize offset;
-  gchar buffer[32];
+  return gst_dmss_protocol_receive_packet_full (socket, 0, cancellable, err,
+      ext_buffer, ext_size);
+}
 
-  offset = 0;
-  do {
-    if ((size = g_socket_receive (socket, &buffer[offset],
-                sizeof (buffer) - offset, cancellable, err)) <= 0) {
-      if (!*err && !size)
-        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      goto recv_error;
-    }
+/* Same as gst_dmss_protocol_receive_packet with parser flags, needed for
+ * packets on the stream socket.
+ */
+gssize
+gst_dmss_protocol_receive_packet_full (GSocket * socket,
+    GstDmssParserFlags flags, GCancellable * cancellable, GError ** err,
+    gchar * ext_buffer, gssize * ext_size)
+{
+  GstDmssParser parser;
+  GstDmssParserEvent event;
+  gssize size, stored;
+  gsize consumed, offset, length;
+  gchar buffer[4096];
 
-    if (offset < *ext_size)
-      memcpy (&ext_buffer[offset], &buffer[offset],
-          *ext_size - offset < size ? *ext_size - offset : size);
+  g_assert (*ext_size >= GST_DMSS_PROTOCOL_HEADER_SIZE);
 
-    offset += size;
-  }
-  while (offset != 32);
-
-  body_size = GUINT32_FROM_LE (*(guint32 *) & buffer[4]);
-
-  GST_DEBUG ("Received packet header with body of size %" G_GSSIZE_FORMAT
-      " and command %.02x", body_size,
-      (unsigned int) (unsigned char) buffer[0]);
-
-  ring_size = *ext_size - 32;
-  offset = 0;
-  while (offset != body_size) {
-    if ((size =
-            g_socket_receive (socket, &ext_buffer[(offset % ring_size) + 32],
-                // if remaining bytes to be read is bigger than
-                // than free space in ring, read only remaining
-                // ring space, otherwise read all that remains
-                (body_size - offset) > ring_size - (offset % ring_size) ?
-                ring_size - (offset % ring_size) :
-                (body_size - offset), cancellable, err)) <= 0) {
-      if (!*err && !size)
-        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      goto recv_error;
-    }
+  gst_dmss_parser_init (&parser, flags);
+  stored = 0;
+  offset = size = 0;
+  while ((event = gst_dmss_parser_feed (&parser, &buffer[offset],
+              size - offset, &consumed)) != GST_DMSS_PARSER_PACKET_END) {
+    offset += consumed;
 
-    offset += size;
+    if (event == GST_DMSS_PARSER_HEADER) {
+      GST_DEBUG ("Received packet header with body of size %" G_GSIZE_FORMAT
+          " and command %.02x", parser.body_size,
+          (unsigned int) (unsigned char) parser.header[0]);
+      memcpy (ext_buffer, parser.header, sizeof (parser.header));
+      stored = sizeof (parser.header);
+    } else if (event == GST_DMSS_PARSER_BODY) {
+      if (stored < *ext_size
+          && stored == sizeof (parser.header) + parser.body_offset) {
+        length = MIN (parser.body_length, *ext_size - stored);
+        memcpy (&ext_buffer[stored], parser.body, length);
+        stored += length;
+      }
+    } else {
+      if ((size = g_socket_receive (socket, buffer,
+                  MIN (sizeof (buffer), gst_dmss_parser_get_wanted (&parser)),
+                  cancellable, err)) <= 0) {
+        if (!*err && !size)
+          g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+              "Read operation timed out");
+        goto recv_error;
+      }
+      offset = 0;
+    }
   }
 
   // null-terminate if there's enough space
-  if (*ext_size > 32 + body_size)
-    ext_buffer[32 + body_size] = 0;
+  if (*ext_size > stored)
+    ext_buffer[stored] = 0;
 
-  GST_DEBUG ("Received packet body\n%s\n", &ext_buffer[32]);
-  return (*ext_size = 32 + body_size);
+  GST_DEBUG ("Received packet body\n%.*s\n",
+      (int) (stored - sizeof (parser.header)), &ext_buffer[32]);
+  *ext_size = stored;
+  return sizeof (parser.header) + parser.body_size;
 recv_error:
   return -1;
 }
+
+/* Just enough JSON for the replies of the 0xf6 calls, which are flat
+ * enough that looking up a member by name is all that is needed.
+ */
+static gsize
+gst_dmss_protocol_json_skip_space (const gchar * json, gsize size)
+{
+  gsize offset = 0;
+
+  while (offset != size && g_ascii_isspace (json[offset]))
+    ++offset;
+
+  return offset;
+}
+
+/* Returns the size of the value starting at json, 0 if it is cut short */
+gsize
+gst_dmss_protocol_json_value_size (const gchar * json, gsize size)
+{
+  gboolean in_string = FALSE;
+  gint depth = 0;
+  gsize offset;
+
+  for (offset = 0; offset != size; ++offset) {
+    if (in_string) {
+      if (json[offset] == '\\')
+        ++offset;
+      else if (json[offset] == '"') {
+        in_string = FALSE;
+        if (!depth)
+          return offset + 1;
+      }
+      continue;
+    }
+
+    switch (json[offset]) {
+      case '"':
+        in_string = TRUE;
+        break;
+      case '{':
+      case '[':
+        ++depth;
+        break;
+      case '}':
+      case ']':
+        if (!depth)
+          return offset;
+        if (!--depth)
+          return offset + 1;
+        break;
+      case ',':
+        if (!depth)
+          return offset;
+        break;
+      default:
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/* Returns the first value of a member called key at any depth */
+const gchar *
+gst_dmss_protocol_json_find (const gchar * json, gsize size,
+    const gchar * key, gsize * value_size)
+{
+  gsize key_size = strlen (key), offset = 0;
+  const gchar *found;
+
+  while ((found = g_strstr_len (&json[offset], size - offset, key))) {
+    offset = found - json + key_size;
+    if (found == json || found[-1] != '"' || offset == size
+        || json[offset] != '"')
+      continue;
+
+    ++offset;
+    offset += gst_dmss_protocol_json_skip_space (&json[offset], size - offset);
+    if (offset == size || json[offset] != ':')
+      continue;
+
+    ++offset;
+    offset += gst_dmss_protocol_json_skip_space (&json[offset], size - offset);
+    if (!(*value_size = gst_dmss_protocol_json_value_size (&json[offset],
+                size - offset)))
+      return NULL;
+
+    return &json[offset];
+  }
+
+  return NULL;
+}
+
+gboolean
+gst_dmss_protocol_json_get_int (const gchar * json, gsize size,
+    const gchar * key, gint64 * value)
+{
+  const gchar *found;
+  gchar number[32];
+  gchar *end;
+  gsize value_size;
+
+  if (!(found = gst_dmss_protocol_json_find (json, size, key, &value_size))
+      || value_size >= sizeof (number))
+    return FALSE;
+
+  memcpy (number, found, value_size);
+  number[value_size] = 0;
+  *value = g_ascii_strtoll (number, &end, 10);
+
+  return end != number;
+}
+
+/* Returns the unescaped string member, NULL when missing or no string */
+gchar *
+gst_dmss_protocol_json_get_string (const gchar * json, gsize size,
+    const gchar * key)
+{
+  const gchar *found;
+  gsize value_size, offset;
+  GString *string;
+
+  if (!(found = gst_dmss_protocol_json_find (json, size, key, &value_size))
+      || value_size < 2 || found[0] != '"')
+    return NULL;
+
+  string = g_string_sized_new (value_size);
+  for (offset = 1; offset != value_size - 1; ++offset) {
+    if (found[offset] == '\\' && offset + 1 != value_size - 1) {
+      ++offset;
+      switch (found[offset]) {
+        case 'n':
+          g_string_append_c (string, '\n');
+          continue;
+        case 'r':
+          g_string_append_c (string, '\r');
+          continue;
+        case 't':
+          g_string_append_c (string, '\t');
+          continue;
+        default:
+          break;
+      }
+    }
+    g_string_append_c (string, found[offset]);
+  }
+
+  return g_string_free (string, FALSE);
+}
+
+/* DHAV frames carry the device's wall clock at offset 16, packed as
+ * year - 2000:6 month:4 day:5 hour:5 minute:6 second:6. Returned as
+ * seconds since the epoch taking it as UTC, like the record index does.
+ */
+gint64
+gst_dmss_protocol_dhav_time (guint32 packed)
+{
+  gint64 year = (packed >> 26) + 2000, days, era, year_of_era, day_of_year;
+  guint month = (packed >> 22) & 0xf, day = (packed >> 17) & 0x1f;
+
+  // days since 1970-01-01 in the proleptic Gregorian calendar
+  year -= month <= 2;
+  era = year / 400;
+  year_of_era = year - era * 400;
+  day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  days = era * 146097 + year_of_era * 365 + year_of_era / 4 -
+      year_of_era / 100 + day_of_year - 719468;
+
+  return days * 86400 + ((packed >> 12) & 0x1f) * 3600 +
+      ((packed >> 6) & 0x3f) * 60 + (packed & 0x3f);
+}
+
+/* Whether a playback whose last frame is at last_time got to end_time,
+ * the start of the range when it plays backwards. Devices hang up there
+ * but also when they drop a client, and frame times have whole seconds
+ * only, so the last frame may be one short of the end.
+ */
+gboolean
+gst_dmss_protocol_playback_ended (gint64 last_time, gint64 end_time,
+    gboolean reverse)
+{
+  if (reverse)
+    return last_time - 1 <= end_time;
+
+  return last_time + 1 >= end_time;
+}
+
+/* resolution in blocks of 8 pixels */
+static void
+gst_dmss_protocol_dhav_tag_blocks (const guint8 * tag, GstDmssDhavInfo * info)
+{
+  info->width = tag[2] * 8;
+  info->height = tag[3] * 8;
+  info->flags |= GST_DMSS_DHAV_INFO_RESOLUTION;
+}
+
+static void
+gst_dmss_protocol_dhav_tag_video (const guint8 * tag, GstDmssDhavInfo * info)
+{
+  info->video_format = tag[2];
+  info->frame_rate = tag[3];
+  info->flags |= GST_DMSS_DHAV_INFO_VIDEO;
+}
+
+static void
+gst_dmss_protocol_dhav_tag_size (const guint8 * tag, GstDmssDhavInfo * info)
+{
+  info->width = GST_READ_UINT16_LE (&tag[4]);
+  info->height = GST_READ_UINT16_LE (&tag[6]);
+  info->flags |= GST_DMSS_DHAV_INFO_RESOLUTION;
+}
+
+static void
+gst_dmss_protocol_dhav_tag_audio (const guint8 * tag, GstDmssDhavInfo * info)
+{
+  info->audio_channels = tag[1];
+  info->audio_format = tag[2];
+  info->audio_rate = tag[3];
+  info->flags |= GST_DMSS_DHAV_INFO_AUDIO;
+}
+
+typedef struct
+{
+  guint8 size;
+  void (*decode) (const guint8 * tag, GstDmssDhavInfo * info);
+} GstDmssDhavTag;
+
+/* Extended header tags by their first byte. A size of 0 is a tag we can't
+ * step over, the rest of the header is skipped then. Tags without a
+ * decoder are known but carry nothing used here.
+ */
+static const GstDmssDhavTag gst_dmss_dhav_tags[256] = {
+  [0x80] = {4, gst_dmss_protocol_dhav_tag_blocks},
+  [0x81] = {4, gst_dmss_protocol_dhav_tag_video},
+  [0x82] = {8, gst_dmss_protocol_dhav_tag_size},
+  [0x83] = {4, gst_dmss_protocol_dhav_tag_audio},
+  [0x84] = {4, NULL},
+  [0x85] = {4, NULL},
+  [0x88] = {8, NULL},
+  [0x8b] = {4, NULL},
+  [0x8c] = {8, gst_dmss_protocol_dhav_tag_audio},
+  [0x91] = {8, NULL},
+  [0x92] = {8, NULL},
+  [0x93] = {8, NULL},
+  [0x94] = {4, NULL},
+  [0x95] = {8, NULL},
+  [0x96] = {4, NULL},
+  [0x9a] = {8, NULL},
+  [0x9b] = {8, NULL},
+  [0xa0] = {4, NULL},
+  [0xb2] = {4, NULL},
+  [0xb3] = {8, NULL},
+  [0xb4] = {4, NULL},
+};
+
+/* Decodes the fixed header and every extended header tag of a DHAV frame
+ * in one pass. header is the frame start, size covers the fixed header
+ * and the extended one. An unknown tag ends the decoding, the rest of the
+ * header is skipped and the tag goes to info->unknown_tag. FALSE only when
+ * the header is cut short, info then has what came before.
+ */
+gboolean
+gst_dmss_protocol_parse_dhav_header (const guint8 * header, gsize size,
+    GstDmssDhavInfo * info)
+{
+  const GstDmssDhavTag *tag;
+  gsize offset = 24;
+
+  memset (info, 0, sizeof (*info));
+  if (size < offset)
+    return FALSE;
+
+  info->time = gst_dmss_protocol_dhav_time (GST_READ_UINT32_LE (&header[16]));
+
+  // zeros pad the tags to the header size
+  while (offset < size && header[offset]) {
+    tag = &gst_dmss_dhav_tags[header[offset]];
+    if (!tag->size) {
+      info->unknown_tag = header[offset];
+      break;
+    }
+    if (offset + tag->size > size)
+      return FALSE;
+    if (tag->decode)
+      tag->decode (&header[offset], info);
+    offset += tag->size;
+  }
+
+  return TRUE;
+}
@@ -23,14 +23,110 @@
 
 #include <gio/gio.h>
 
+#define GST_DMSS_PROTOCOL_HEADER_SIZE 32
+/* larger than any real frame, a header saying more is corrupt */
+#define GST_DMSS_DHAV_MAX_FRAME_SIZE (8 * 1024 * 1024)
+
+typedef enum
+{
+  /* stream packets only use the low 16 bits of the body size */
+  GST_DMSS_PARSER_SHORT_BODY_SIZE = (1 << 0)
+} GstDmssParserFlags;
+
+typedef enum
+{
+  GST_DMSS_PARSER_NEED_DATA,
+  GST_DMSS_PARSER_HEADER,
+  GST_DMSS_PARSER_BODY,
+  GST_DMSS_PARSER_PACKET_END
+} GstDmssParserEvent;
+
+typedef struct _GstDmssParser GstDmssParser;
+
+/* Resumable push parser, never touches a socket. After an event the
+ * public fields describe it until the next call to
+ * gst_dmss_parser_feed:
+ *  HEADER: header and body_size are valid
+ *  BODY: body and body_length point into the fed data, body_offset is
+ *    where that slice starts within the body
+ *  PACKET_END: header and body_size still describe the finished packet
+ */
+struct _GstDmssParser
+{
+  GstDmssParserFlags flags;
+
+  gchar header[GST_DMSS_PROTOCOL_HEADER_SIZE];
+  gsize body_size;
+  const gchar *body;
+  gsize body_length;
+  gsize body_offset;
+
+  /*< private > */
+  gsize header_filled;
+  gsize body_filled;
+  gboolean ended;
+};
+
+void gst_dmss_parser_init (GstDmssParser * parser, GstDmssParserFlags flags);
+void gst_dmss_parser_reset (GstDmssParser * parser);
+GstDmssParserEvent gst_dmss_parser_feed (GstDmssParser * parser,
+    const gchar * data, gsize size, gsize * consumed);
+gsize gst_dmss_parser_get_wanted (GstDmssParser * parser);
+
 int gst_dmss_protocol_create_json_packet (char *buffer, int size,
     guint32 session_id, guint32 id, const char *fmt, ...);
 int gst_dmss_protocol_create_new_packet (char *buffer, int size,
     const char *fmt, ...);
 gssize gst_dmss_protocol_receive_packet_no_body (GSocket * socket,
     GCancellable * cancellable, GError ** err, gchar * buffer);
-int gst_dmss_protocol_receive_packet (GSocket * socket,
+gssize gst_dmss_protocol_receive_packet (GSocket * socket,
     GCancellable * cancellable, GError ** err, gchar * ext_buffer,
     gssize * ext_size);
+gssize gst_dmss_protocol_receive_packet_full (GSocket * socket,
+    GstDmssParserFlags flags, GCancellable * cancellable, GError ** err,
+    gchar * ext_buffer, gssize * ext_size);
+
+gsize gst_dmss_protocol_json_value_size (const gchar * json, gsize size);
+const gchar *gst_dmss_protocol_json_find (const gchar * json, gsize size,
+    const gchar * key, gsize * value_size);
+gboolean gst_dmss_protocol_json_get_int (const gchar * json, gsize size,
+    const gchar * key, gint64 * value);
+gchar *gst_dmss_protocol_json_get_string (const gchar * json, gsize size,
+    const gchar * key);
+
+typedef enum
+{
+  GST_DMSS_DHAV_INFO_VIDEO = (1 << 0),
+  GST_DMSS_DHAV_INFO_RESOLUTION = (1 << 1),
+  GST_DMSS_DHAV_INFO_AUDIO = (1 << 2)
+} GstDmssDhavInfoFlags;
+
+/* What the header of one DHAV frame says. flags tells which of the
+ * extended header fields were there.
+ */
+typedef struct
+{
+  GstDmssDhavInfoFlags flags;
+  /* seconds since the epoch of the packed wall clock */
+  gint64 time;
+  /* video info tag */
+  guint8 video_format;
+  guint8 frame_rate;
+  /* resolution tags, in pixels */
+  guint16 width;
+  guint16 height;
+  /* audio info tags, the rate is the device's index */
+  guint8 audio_channels;
+  guint8 audio_format;
+  guint8 audio_rate;
+  /* first tag that couldn't be stepped over, 0 when there was none */
+  guint8 unknown_tag;
+} GstDmssDhavInfo;
+
+gint64 gst_dmss_protocol_dhav_time (guint32 packed);
+gboolean gst_dmss_protocol_playback_ended (gint64 last_time,
+    gint64 end_time, gboolean reverse);
+gboolean gst_dmss_protocol_parse_dhav_header (const guint8 * header,
+    gsize size, GstDmssDhavInfo * info);
 
 #endif
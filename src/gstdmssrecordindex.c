@@ -0,0 +1,462 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Recordings found with mediaFileFind, per channel.
+ *
+ * Records are kept sorted by start time next to a running maximum of
+ * their end times. The running maximum never decreases, so both ends of
+ * the records overlapping a range are found by binary search and a query
+ * costs O(log n) plus the records returned. Only the time range that was
+ * searched on the device is trusted; anything outside of it is reported
+ * missing so the caller can fetch just that part.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include "gstdmssrecordindex.h"
+#include "gstdmssprotocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+struct _GstDmssRecordChannel
+{
+  GArray *records;
+  GArray *max_end;
+  gboolean searched;
+  gint64 searched_start;
+  gint64 searched_end;
+};
+
+struct _GstDmssRecordIndex
+{
+  GMutex lock;
+  GHashTable *channels;
+};
+
+void
+gst_dmss_record_clear (GstDmssRecord * record)
+{
+  g_free (record->file_path);
+  record->file_path = NULL;
+}
+
+void
+gst_dmss_record_copy_into (const GstDmssRecord * src, GstDmssRecord * dest)
+{
+  *dest = *src;
+  dest->file_path = g_strdup (src->file_path);
+}
+
+/* Parses "YYYY-MM-DD HH:MM:SS". The device works in its local time
+ * without a zone, so it is kept as UTC.
+ */
+gboolean
+gst_dmss_record_index_parse_time (const gchar * string, gint64 * time)
+{
+  GDateTime *date_time;
+  gint year, month, day, hour, minute, second;
+
+  if (!string || sscanf (string, "%d-%d-%d %d:%d:%d", &year, &month, &day,
+          &hour, &minute, &second) != 6)
+    return FALSE;
+
+  if (!(date_time = g_date_time_new_utc (year, month, day, hour, minute,
+              second)))
+    return FALSE;
+
+  *time = g_date_time_to_unix (date_time);
+  g_date_time_unref (date_time);
+
+  return TRUE;
+}
+
+gchar *
+gst_dmss_record_index_format_time (gint64 time)
+{
+  GDateTime *date_time = g_date_time_new_from_unix_utc (time);
+  gchar *formatted;
+
+  formatted = g_date_time_format (date_time, "%Y-%m-%d %H:%M:%S");
+  g_date_time_unref (date_time);
+
+  return formatted;
+}
+
+static gboolean
+gst_dmss_record_index_parse_info (const gchar * json, gsize size,
+    GstDmssRecord * record)
+{
+  gint64 channel, disk, cluster, length;
+  gchar *start_time, *end_time;
+  gboolean ret;
+
+  if (!gst_dmss_protocol_json_get_int (json, size, "Channel", &channel)
+      || !gst_dmss_protocol_json_get_int (json, size, "Disk", &disk)
+      || !gst_dmss_protocol_json_get_int (json, size, "Cluster", &cluster))
+    return FALSE;
+  if (!gst_dmss_protocol_json_get_int (json, size, "Length", &length))
+    length = 0;
+
+  start_time = gst_dmss_protocol_json_get_string (json, size, "StartTime");
+  end_time = gst_dmss_protocol_json_get_string (json, size, "EndTime");
+  ret = gst_dmss_record_index_parse_time (start_time, &record->start_time)
+      && gst_dmss_record_index_parse_time (end_time, &record->end_time);
+  g_free (start_time);
+  g_free (end_time);
+  if (!ret)
+    return FALSE;
+
+  record->channel = channel;
+  record->disk = disk;
+  record->cluster = cluster;
+  record->length = length;
+  record->file_path =
+      gst_dmss_protocol_json_get_string (json, size, "FilePath");
+
+  return TRUE;
+}
+
+/* Appends the infos of a mediaFileFind.findNextFile reply to records and
+ * returns how many the device said it found, -1 if it is no such reply.
+ */
+gint
+gst_dmss_record_index_parse (const gchar * json, gsize size, GArray * records)
+{
+  GstDmssRecord record;
+  const gchar *infos;
+  gsize infos_size, offset, info_size;
+  gint64 found;
+
+  if (!gst_dmss_protocol_json_get_int (json, size, "found", &found))
+    return -1;
+
+  if (!(infos = gst_dmss_protocol_json_find (json, size, "infos",
+              &infos_size)) || infos[0] != '[')
+    return found ? -1 : 0;
+
+  for (offset = 1; offset < infos_size; ++offset) {
+    while (offset != infos_size && (g_ascii_isspace (infos[offset])
+            || infos[offset] == ','))
+      ++offset;
+    if (offset == infos_size || infos[offset] == ']')
+      break;
+
+    if (!(info_size = gst_dmss_protocol_json_value_size (&infos[offset],
+                infos_size - offset)))
+      break;
+
+    if (gst_dmss_record_index_parse_info (&infos[offset], info_size, &record))
+      g_array_append_val (records, record);
+    else
+      GST_WARNING ("Skipping unreadable recording %.*s", (int) info_size,
+          &infos[offset]);
+
+    offset += info_size - 1;
+  }
+
+  return found;
+}
+
+static void
+gst_dmss_record_channel_free (gpointer data)
+{
+  struct _GstDmssRecordChannel *channel = data;
+
+  g_array_unref (channel->records);
+  g_array_unref (channel->max_end);
+  g_slice_free (struct _GstDmssRecordChannel, channel);
+}
+
+GstDmssRecordIndex *
+gst_dmss_record_index_new (void)
+{
+  GstDmssRecordIndex *index = g_slice_new0 (GstDmssRecordIndex);
+
+  g_mutex_init (&index->lock);
+  index->channels = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, gst_dmss_record_channel_free);
+
+  return index;
+}
+
+void
+gst_dmss_record_index_free (GstDmssRecordIndex * index)
+{
+  g_hash_table_unref (index->channels);
+  g_mutex_clear (&index->lock);
+  g_slice_free (GstDmssRecordIndex, index);
+}
+
+static struct _GstDmssRecordChannel *
+gst_dmss_record_index_get_channel (GstDmssRecordIndex * index, guint channel,
+    gboolean create)
+{
+  struct _GstDmssRecordChannel *record_channel;
+
+  record_channel =
+      g_hash_table_lookup (index->channels, GUINT_TO_POINTER (channel));
+  if (record_channel || !create)
+    return record_channel;
+
+  record_channel = g_slice_new0 (struct _GstDmssRecordChannel);
+  record_channel->records = g_array_new (FALSE, FALSE, sizeof (GstDmssRecord));
+  g_array_set_clear_func (record_channel->records,
+      (GDestroyNotify) gst_dmss_record_clear);
+  record_channel->max_end = g_array_new (FALSE, FALSE, sizeof (gint64));
+  g_hash_table_insert (index->channels, GUINT_TO_POINTER (channel),
+      record_channel);
+
+  return record_channel;
+}
+
+/* Index of the first record starting at or after time */
+static guint
+gst_dmss_record_channel_lower_bound (struct _GstDmssRecordChannel *channel,
+    gint64 time)
+{
+  guint low = 0, high = channel->records->len, middle;
+
+  while (low != high) {
+    middle = low + (high - low) / 2;
+    if (g_array_index (channel->records, GstDmssRecord, middle).start_time <
+        time)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+/* Index of the first record whose running end maximum is after time */
+static guint
+gst_dmss_record_channel_first_ending_after (struct _GstDmssRecordChannel
+    *channel, gint64 time)
+{
+  guint low = 0, high = channel->max_end->len, middle;
+
+  while (low != high) {
+    middle = low + (high - low) / 2;
+    if (g_array_index (channel->max_end, gint64, middle) <= time)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+/* Returns in search_start and search_end what has to be searched on the
+ * device before start to end can be answered, FALSE when nothing has.
+ * The last recording is searched again as it may still be growing.
+ */
+gboolean
+gst_dmss_record_index_get_missing (GstDmssRecordIndex * index, guint channel,
+    gint64 start, gint64 end, gint64 * search_start, gint64 * search_end)
+{
+  struct _GstDmssRecordChannel *record_channel;
+  const GstDmssRecord *last;
+  gboolean before, after;
+  gint64 tail;
+
+  g_mutex_lock (&index->lock);
+  record_channel = gst_dmss_record_index_get_channel (index, channel, FALSE);
+
+  if (!record_channel || !record_channel->searched) {
+    *search_start = start;
+    *search_end = end;
+    g_mutex_unlock (&index->lock);
+    return TRUE;
+  }
+
+  before = start < record_channel->searched_start;
+  after = end > record_channel->searched_end;
+
+  tail = record_channel->searched_end;
+  if (record_channel->records->len) {
+    last = &g_array_index (record_channel->records, GstDmssRecord,
+        record_channel->records->len - 1);
+    if (last->end_time >= tail)
+      tail = MIN (tail, last->start_time);
+  }
+
+  // what was searched must stay one range, so gaps are searched too
+  if (before && after) {
+    *search_start = start;
+    *search_end = end;
+  } else if (before) {
+    *search_start = start;
+    *search_end = record_channel->searched_start;
+  } else if (after) {
+    *search_start = tail;
+    *search_end = end;
+  }
+  g_mutex_unlock (&index->lock);
+
+  return before || after;
+}
+
+/* Merges the records found searching search_start to search_end on the
+ * device, taking their file paths. A recording found again replaces the
+ * older copy, which may have ended earlier while it was still recording.
+ */
+void
+gst_dmss_record_index_add (GstDmssRecordIndex * index, guint channel,
+    gint64 search_start, gint64 search_end, GArray * records)
+{
+  struct _GstDmssRecordChannel *record_channel;
+  GstDmssRecord *record, *existing;
+  gint64 max_end = G_MININT64, newest_end = search_start;
+  guint i, j;
+
+  g_mutex_lock (&index->lock);
+  record_channel = gst_dmss_record_index_get_channel (index, channel, TRUE);
+
+  for (i = 0; i != records->len; ++i) {
+    record = &g_array_index (records, GstDmssRecord, i);
+    newest_end = MAX (newest_end, record->end_time);
+
+    j = gst_dmss_record_channel_lower_bound (record_channel,
+        record->start_time);
+    for (existing = NULL; j != record_channel->records->len; ++j) {
+      existing = &g_array_index (record_channel->records, GstDmssRecord, j);
+      if (existing->start_time != record->start_time) {
+        existing = NULL;
+        break;
+      }
+      if (existing->disk == record->disk
+          && existing->cluster == record->cluster)
+        break;
+      existing = NULL;
+    }
+
+    if (existing) {
+      gst_dmss_record_clear (existing);
+      *existing = *record;
+    } else {
+      // after any other recording starting at the same time
+      g_array_insert_val (record_channel->records, j, *record);
+    }
+    record->file_path = NULL;
+  }
+
+  g_array_set_size (record_channel->max_end, record_channel->records->len);
+  for (i = 0; i != record_channel->records->len; ++i) {
+    max_end = MAX (max_end, g_array_index (record_channel->records,
+            GstDmssRecord, i).end_time);
+    g_array_index (record_channel->max_end, gint64, i) = max_end;
+  }
+
+  // nothing can be recorded past the newest recording yet
+  search_end = MIN (search_end, newest_end);
+  if (!record_channel->searched) {
+    record_channel->searched_start = search_start;
+    record_channel->searched_end = search_end;
+    record_channel->searched = TRUE;
+  } else {
+    record_channel->searched_start =
+        MIN (record_channel->searched_start, search_start);
+    record_channel->searched_end =
+        MAX (record_channel->searched_end, search_end);
+  }
+
+  GST_DEBUG ("Channel %u has %u recordings, searched %" G_GINT64_FORMAT
+      " to %" G_GINT64_FORMAT, channel, record_channel->records->len,
+      record_channel->searched_start, record_channel->searched_end);
+  g_mutex_unlock (&index->lock);
+}
+
+/* Copies the latest starting recording that contains time into record,
+ * or else the first one starting after time.
+ */
+gboolean
+gst_dmss_record_index_lookup (GstDmssRecordIndex * index, guint channel,
+    gint64 time, GstDmssRecord * record)
+{
+  struct _GstDmssRecordChannel *record_channel;
+  const GstDmssRecord *found = NULL;
+  guint first, last;
+
+  g_mutex_lock (&index->lock);
+  if (!(record_channel = gst_dmss_record_index_get_channel (index, channel,
+              FALSE)))
+    goto done;
+
+  // records [first, last) may contain time
+  first = gst_dmss_record_channel_first_ending_after (record_channel, time);
+  last = gst_dmss_record_channel_lower_bound (record_channel, time + 1);
+
+  while (last > first && !found) {
+    found = &g_array_index (record_channel->records, GstDmssRecord, --last);
+    if (found->end_time <= time)
+      found = NULL;
+  }
+
+  last = gst_dmss_record_channel_lower_bound (record_channel, time + 1);
+  if (!found && last != record_channel->records->len)
+    found = &g_array_index (record_channel->records, GstDmssRecord, last);
+
+  if (found)
+    gst_dmss_record_copy_into (found, record);
+done:
+  g_mutex_unlock (&index->lock);
+
+  return found != NULL;
+}
+
+/* Returns copies of the recordings overlapping start to end */
+GArray *
+gst_dmss_record_index_query (GstDmssRecordIndex * index, guint channel,
+    gint64 start, gint64 end)
+{
+  struct _GstDmssRecordChannel *record_channel;
+  const GstDmssRecord *record;
+  GstDmssRecord copy;
+  GArray *result;
+  guint first, last;
+
+  result = g_array_new (FALSE, FALSE, sizeof (GstDmssRecord));
+  g_array_set_clear_func (result, (GDestroyNotify) gst_dmss_record_clear);
+
+  g_mutex_lock (&index->lock);
+  if ((record_channel = gst_dmss_record_index_get_channel (index, channel,
+              FALSE))) {
+    first = gst_dmss_record_channel_first_ending_after (record_channel, start);
+    last = gst_dmss_record_channel_lower_bound (record_channel, end);
+
+    for (; first < last; ++first) {
+      record = &g_array_index (record_channel->records, GstDmssRecord, first);
+      if (record->end_time <= start)
+        continue;
+      gst_dmss_record_copy_into (record, &copy);
+      g_array_append_val (result, copy);
+    }
+  }
+  g_mutex_unlock (&index->lock);
+
+  return result;
+}
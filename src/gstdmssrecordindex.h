@@ -0,0 +1,73 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_RECORD_INDEX_H__
+#define __GST_DMSS_RECORD_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Records asked for per mediaFileFind.findNextFile, a full page means
+ * there may be more */
+#define GST_DMSS_RECORD_INDEX_PAGE_SIZE 32
+
+/* One recorded file as mediaFileFind reports it. Times are seconds since
+ * the epoch in the device's local time.
+ */
+typedef struct
+{
+  guint channel;
+  guint disk;
+  guint cluster;
+  gint64 start_time;
+  gint64 end_time;
+  guint64 length;
+  gchar *file_path;
+} GstDmssRecord;
+
+typedef struct _GstDmssRecordIndex GstDmssRecordIndex;
+
+void gst_dmss_record_clear (GstDmssRecord * record);
+void gst_dmss_record_copy_into (const GstDmssRecord * src,
+    GstDmssRecord * dest);
+
+gboolean gst_dmss_record_index_parse_time (const gchar * string,
+    gint64 * time);
+gchar *gst_dmss_record_index_format_time (gint64 time);
+gint gst_dmss_record_index_parse (const gchar * json, gsize size,
+    GArray * records);
+
+GstDmssRecordIndex *gst_dmss_record_index_new (void);
+void gst_dmss_record_index_free (GstDmssRecordIndex * index);
+
+gboolean gst_dmss_record_index_get_missing (GstDmssRecordIndex * index,
+    guint channel, gint64 start, gint64 end, gint64 * search_start,
+    gint64 * search_end);
+void gst_dmss_record_index_add (GstDmssRecordIndex * index, guint channel,
+    gint64 search_start, gint64 search_end, GArray * records);
+
+gboolean gst_dmss_record_index_lookup (GstDmssRecordIndex * index,
+    guint channel, gint64 time, GstDmssRecord * record);
+GArray *gst_dmss_record_index_query (GstDmssRecordIndex * index,
+    guint channel, gint64 start, gint64 end);
+
+G_END_DECLS
+#endif /* __GST_DMSS_RECORD_INDEX_H__ */
@@ -0,0 +1,1297 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* A logged in control connection to a device.
+ *
+ * Once open, a control thread owns the control socket: it sends the 0xa1
+ * keep-alive every DMSS_KEEPALIVE_INTERVAL_MS, measures the time until the
+ * 0xb1 reply and hands 0xf4/0xf6 replies to whoever is waiting in
+ * gst_dmss_session_request. Requests are serialized, so any number of
+ * streams can add objects and start monitors over one session.
+ *
+ * Sessions opened through gst_dmss_session_acquire are also kept in a
+ * process-wide registry keyed on host:port:user, so elements talking to
+ * the same device share a single login. Devices cap concurrent logins.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gstversion.h>
+#if GST_VERSION_MINOR <= 15
+#include <gst/gst-i18n-plugin.h>
+#endif
+#include <gst/gst.h>
+#include <gio/gnetworking.h>
+#include "gstdmsssession.h"
+#include "gstdmssprotocol.h"
+#include "gstdmssioengine.h"
+#include "gstdmssrecordindex.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+#define DMSS_KEEPALIVE_INTERVAL_MS      1000
+#define DMSS_SESSION_WAIT_US            (100 * 1000)
+
+struct _GstDmssSession
+{
+  gint refcount;
+  /* registry key, NULL for sessions that are not shared */
+  gchar *key;
+
+  GSocketAddress *address;
+  gchar *user;
+  gchar *password;
+  guint timeout;
+
+  GSocket *control_socket;
+  gint session_id;
+  GstClock *system_clock;
+
+  /* control thread, owns the control socket while open */
+  GThread *control_thread;
+  GMainContext *control_context;
+  GMainLoop *control_loop;
+  GSource *keepalive_source;
+  GSource *control_source;
+  GstDmssParser control_parser;
+  GByteArray *control_body;
+  gboolean control_collecting;
+  /* 0xf6 replies larger than a packet come in pieces */
+  gsize control_json_size;
+  GstClockTime last_ack_time;
+
+  /* protects sends on the control socket and everything below */
+  GMutex lock;
+  GCond cond;
+  GstClockTime keepalive_rtt;
+  GError *control_error;
+  gboolean waiting;
+  /* TransactionID or JSON id the awaited reply has to carry */
+  guint8 waiting_command;
+  gint64 waiting_id;
+  GByteArray *response;
+
+  /* serializes gst_dmss_session_request */
+  GMutex request_lock;
+
+  /* registered sessions are handed out before they finish opening */
+  gboolean opening;
+  GError *open_error;
+
+  /* id of the last JSON call or TransactionID */
+  gint call_id;
+  GstDmssRecordIndex *record_index;
+};
+
+static GMutex registry_lock;
+static GHashTable *registry;
+
+static void gst_dmss_session_control_thread_stop (GstDmssSession * session);
+static void gst_dmss_session_control_fail (GstDmssSession * session,
+    GError * err);
+
+void
+gst_dmss_session_mark_phase (GstStructure * timings, const gchar * phase,
+    GstClockTime * last)
+{
+  GstClockTime now = gst_util_get_timestamp ();
+
+  GST_DEBUG ("Handshake phase %s took %" GST_TIME_FORMAT, phase,
+      GST_TIME_ARGS (now - *last));
+  if (timings)
+    gst_structure_set (timings, phase, G_TYPE_UINT64, now - *last, NULL);
+  *last = now;
+}
+
+GstDmssSession *
+gst_dmss_session_new (GSocketAddress * address, const gchar * user,
+    const gchar * password, guint timeout)
+{
+  GstDmssSession *session;
+
+  session = g_slice_new0 (GstDmssSession);
+  session->refcount = 1;
+  session->address = g_object_ref (address);
+  session->user = g_strdup (user);
+  session->password = g_strdup (password);
+  session->timeout = timeout;
+  session->system_clock = gst_system_clock_obtain ();
+  session->control_body = g_byte_array_new ();
+  session->last_ack_time = GST_CLOCK_TIME_NONE;
+  g_mutex_init (&session->lock);
+  g_cond_init (&session->cond);
+  g_mutex_init (&session->request_lock);
+  session->record_index = gst_dmss_record_index_new ();
+
+  return session;
+}
+
+GstDmssSession *
+gst_dmss_session_ref (GstDmssSession * session)
+{
+  g_atomic_int_inc (&session->refcount);
+  return session;
+}
+
+void
+gst_dmss_session_unref (GstDmssSession * session)
+{
+  GError *error = NULL;
+
+  if (!g_atomic_int_dec_and_test (&session->refcount))
+    return;
+
+  if (session->key) {
+    g_mutex_lock (&registry_lock);
+    // a replacement may have been registered under the same key already
+    if (g_hash_table_lookup (registry, session->key) == session)
+      g_hash_table_remove (registry, session->key);
+    g_mutex_unlock (&registry_lock);
+    g_free (session->key);
+  }
+
+  gst_dmss_session_control_thread_stop (session);
+
+  if (session->control_socket) {
+    g_socket_close (session->control_socket, &error);
+    g_clear_error (&error);
+    g_object_unref (session->control_socket);
+  }
+
+  g_byte_array_unref (session->control_body);
+  if (session->response)
+    g_byte_array_unref (session->response);
+  g_clear_error (&session->control_error);
+  g_clear_error (&session->open_error);
+  gst_dmss_record_index_free (session->record_index);
+  gst_object_unref (session->system_clock);
+  g_object_unref (session->address);
+  g_free (session->user);
+  g_free (session->password);
+  g_mutex_clear (&session->lock);
+  g_cond_clear (&session->cond);
+  g_mutex_clear (&session->request_lock);
+  g_slice_free (GstDmssSession, session);
+}
+
+gint
+gst_dmss_session_get_id (GstDmssSession * session)
+{
+  return session->session_id;
+}
+
+gboolean
+gst_dmss_session_is_alive (GstDmssSession * session)
+{
+  gboolean alive;
+
+  g_mutex_lock (&session->lock);
+  alive = session->control_thread || session->control_source;
+  alive = alive && !session->control_error;
+  g_mutex_unlock (&session->lock);
+
+  return alive;
+}
+
+GstClockTime
+gst_dmss_session_get_keepalive_rtt (GstDmssSession * session)
+{
+  GstClockTime rtt;
+
+  g_mutex_lock (&session->lock);
+  rtt = session->keepalive_rtt;
+  g_mutex_unlock (&session->lock);
+
+  return rtt;
+}
+
+static gboolean
+gst_dmss_session_login (GstDmssSession * session, GCancellable * cancellable,
+    GError ** err)
+{
+  guint32 const userpass_size =
+      2 + strlen (session->user) + strlen (session->password);
+  gchar login_buffer[32]
+      = {
+    0xa0, 0x00, 0x00, 0x60,
+    (userpass_size & 0x000000FF),
+    (userpass_size & 0x0000FF00) >> 8,
+    (userpass_size & 0x00FF0000) >> 16,
+    (userpass_size & 0xFF000000) >> 24,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0x04, 0x02, 0x03, 0x00, 0x01, 0xa1, 0xaa
+  };
+  static gchar const noop_buffer[32]
+      = {
+    0xa1, 0,
+  };
+  gchar login_separator[2] = { '&', '&' };
+  GOutputVector vectors[4] = {
+    {login_buffer, sizeof (login_buffer)},
+    {session->user, strlen (session->user)},
+    {login_separator, sizeof (login_separator)},
+    {session->password, strlen (session->password)},
+  };
+  gchar prefix_buffer[32];
+  gssize receive_size, sent, expected;
+  int i;
+
+  // header and credentials go out in a single segment
+  for (expected = 0, i = 0; i != G_N_ELEMENTS (vectors); ++i)
+    expected += vectors[i].size;
+  if ((sent = g_socket_send_message (session->control_socket, NULL, vectors,
+              G_N_ELEMENTS (vectors), NULL, 0, 0, cancellable, err)) < 0)
+    return FALSE;
+  if (sent != expected) {
+    g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Short write sending login");
+    return FALSE;
+  }
+
+  GST_DEBUG ("sent authentication info, waiting authentication response");
+
+  receive_size = sizeof (prefix_buffer);
+  if (gst_dmss_protocol_receive_packet (session->control_socket, cancellable,
+          err, prefix_buffer, &receive_size) < 0)
+    return FALSE;
+
+  session->session_id = GST_READ_UINT32_LE (&prefix_buffer[16]);
+
+  if (prefix_buffer[8]) {
+    g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+        "Authentication refused");
+    return FALSE;
+  }
+
+  GST_DEBUG ("authenticated in control socket, session %d",
+      session->session_id);
+
+  // send noop command
+  if (!g_socket_send (session->control_socket, noop_buffer,
+          sizeof (noop_buffer), cancellable, err))
+    return FALSE;
+
+  // wait for response of noop operation
+  do {
+    receive_size = sizeof (prefix_buffer);
+    if (gst_dmss_protocol_receive_packet (session->control_socket,
+            cancellable, err, prefix_buffer, &receive_size) < 0)
+      return FALSE;
+
+    GST_DEBUG ("package received in control socket with command %d",
+        (unsigned int) (unsigned char) prefix_buffer[0]);
+
+  } while ((unsigned char) prefix_buffer[0] != (unsigned char) 0xb1);
+
+  return TRUE;
+}
+
+static gboolean
+gst_dmss_session_keepalive_cb (gpointer user_data)
+{
+  GstDmssSession *session = user_data;
+  GError *err = NULL;
+  static gchar const noop_buffer[32]
+      = {
+    0xa1, 0,
+  };
+
+  g_mutex_lock (&session->lock);
+  if (!g_socket_send (session->control_socket, noop_buffer,
+          sizeof (noop_buffer), NULL, &err)) {
+    g_mutex_unlock (&session->lock);
+    g_prefix_error (&err, "Failed to send keep-alive: ");
+    gst_dmss_session_control_fail (session, err);
+    return G_SOURCE_REMOVE;
+  }
+  g_mutex_unlock (&session->lock);
+
+  GST_LOG ("Sent nope packet for keep-alive");
+  // only time the oldest unanswered keep-alive
+  if (!GST_CLOCK_TIME_IS_VALID (session->last_ack_time))
+    session->last_ack_time = gst_clock_get_time (session->system_clock);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gchar *
+gst_dmss_session_find_value (const gchar * data, gsize size,
+    const gchar * prefix, gsize * value_size)
+{
+  gsize offset = 0, prefix_size = strlen (prefix), end;
+
+  while (size - offset > prefix_size
+      && memcmp (&data[offset], prefix, prefix_size)) {
+    while (size != offset && data[offset] != '\n')
+      ++offset;
+    if (size != offset)
+      ++offset;
+  }
+
+  if (size - offset <= prefix_size)
+    return NULL;
+
+  offset += prefix_size;
+  for (end = offset; end != size && data[end] != '\r'; ++end);
+  *value_size = end - offset;
+
+  return (gchar *) & data[offset];
+}
+
+/* Reads the TransactionID of a 0xf4 or the id of a 0xf6 body */
+static gboolean
+gst_dmss_session_get_reply_id (guint8 command, const gchar * data,
+    gsize size, gint64 * id)
+{
+  gchar number[32];
+  gchar *value, *end;
+  gsize value_size;
+
+  if (command == 0xf6)
+    return gst_dmss_protocol_json_get_int (data, size, "id", id);
+
+  if (!(value = gst_dmss_session_find_value (data, size, "TransactionID:",
+              &value_size)) || value_size >= sizeof (number))
+    return FALSE;
+
+  memcpy (number, value, value_size);
+  number[value_size] = 0;
+  *id = g_ascii_strtoll (number, &end, 10);
+
+  return end != number;
+}
+
+static void
+gst_dmss_session_control_handle_event (GstDmssSession * session,
+    GstDmssParserEvent event)
+{
+  GstDmssParser *parser = &session->control_parser;
+  guint8 command = parser->header[0];
+  GstClockTime rtt;
+  gint64 id = -1;
+  gboolean has_id;
+
+  switch (event) {
+    case GST_DMSS_PARSER_HEADER:
+      if (command == 0xf6 && session->control_json_size) {
+        // next piece of a reply still being collected
+        session->control_collecting = TRUE;
+      } else if (command == 0xf4 || command == 0xf6) {
+        session->control_collecting = TRUE;
+        g_byte_array_set_size (session->control_body, 0);
+        session->control_json_size = command == 0xf4 ? 0 :
+            MAX (GST_READ_UINT32_LE (&parser->header[16]), parser->body_size);
+      } else if (command == 0xb1
+          && GST_CLOCK_TIME_IS_VALID (session->last_ack_time)) {
+        rtt = gst_clock_get_time (session->system_clock) -
+            session->last_ack_time;
+        session->last_ack_time = GST_CLOCK_TIME_NONE;
+
+        GST_LOG ("Keep-alive round trip %" GST_TIME_FORMAT,
+            GST_TIME_ARGS (rtt));
+
+        g_mutex_lock (&session->lock);
+        session->keepalive_rtt = rtt;
+        g_mutex_unlock (&session->lock);
+      } else if (command != 0xb1) {
+        GST_DEBUG ("Discarding control packet with command %.02x",
+            (unsigned int) command);
+      }
+      break;
+    case GST_DMSS_PARSER_BODY:
+      if (session->control_collecting)
+        g_byte_array_append (session->control_body,
+            (const guint8 *) parser->body, parser->body_length);
+      break;
+    case GST_DMSS_PARSER_PACKET_END:
+      if (!session->control_collecting)
+        break;
+      session->control_collecting = FALSE;
+      if (session->control_body->len < session->control_json_size)
+        break;
+      session->control_json_size = 0;
+
+      has_id = gst_dmss_session_get_reply_id (command,
+          (const gchar *) session->control_body->data,
+          session->control_body->len, &id);
+
+      g_mutex_lock (&session->lock);
+      // a reply to a request that timed out must not answer the next one
+      if (session->waiting && command == session->waiting_command
+          && (!has_id || id == session->waiting_id)) {
+        session->response = session->control_body;
+        session->control_body = g_byte_array_new ();
+        session->waiting = FALSE;
+        g_cond_broadcast (&session->cond);
+      } else if (session->waiting) {
+        GST_DEBUG ("Discarding stale reply %.02x with id %" G_GINT64_FORMAT
+            " while waiting for %" G_GINT64_FORMAT, (unsigned int) command,
+            id, session->waiting_id);
+      } else {
+        GST_DEBUG ("Discarding unsolicited reply of %u bytes",
+            session->control_body->len);
+      }
+      g_mutex_unlock (&session->lock);
+      break;
+    default:
+      break;
+  }
+}
+
+static void
+gst_dmss_session_control_fail (GstDmssSession * session, GError * err)
+{
+  GST_WARNING ("Control connection of session %d failed: %s",
+      session->session_id, err->message);
+
+  g_mutex_lock (&session->lock);
+  if (!session->control_error)
+    session->control_error = err;
+  else
+    g_error_free (err);
+  g_cond_broadcast (&session->cond);
+  g_mutex_unlock (&session->lock);
+}
+
+static gboolean
+gst_dmss_session_control_readable_cb (GSocket * socket,
+    GIOCondition condition, gpointer user_data)
+{
+  GstDmssSession *session = user_data;
+  GstDmssParserEvent event;
+  GError *err = NULL;
+  gchar buffer[4096];
+  gssize received;
+  gsize offset, consumed;
+
+  while ((received = g_socket_receive_with_blocking (socket, buffer,
+              sizeof (buffer), FALSE, NULL, &err)) > 0) {
+    offset = 0;
+    do {
+      event = gst_dmss_parser_feed (&session->control_parser,
+          &buffer[offset], received - offset, &consumed);
+      offset += consumed;
+      gst_dmss_session_control_handle_event (session, event);
+    } while (event != GST_DMSS_PARSER_NEED_DATA);
+  }
+
+  if (!received) {
+    gst_dmss_session_control_fail (session,
+        g_error_new_literal (G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+            "Control connection closed by remote peer"));
+    return G_SOURCE_REMOVE;
+  }
+
+  if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+    gst_dmss_session_control_fail (session, err);
+    return G_SOURCE_REMOVE;
+  }
+
+  g_error_free (err);
+  return G_SOURCE_CONTINUE;
+}
+
+static gpointer
+gst_dmss_session_control_thread_func (gpointer user_data)
+{
+  GstDmssSession *session = user_data;
+
+  g_main_context_push_thread_default (session->control_context);
+  g_main_loop_run (session->control_loop);
+  g_main_context_pop_thread_default (session->control_context);
+
+  return NULL;
+}
+
+static gboolean
+gst_dmss_session_control_thread_quit_cb (gpointer user_data)
+{
+  g_main_loop_quit ((GMainLoop *) user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+gst_dmss_session_control_sources_destroy_cb (gpointer user_data)
+{
+  GstDmssSession *session = user_data;
+
+  g_source_destroy (session->keepalive_source);
+  g_source_destroy (session->control_source);
+  return G_SOURCE_REMOVE;
+}
+
+/* With shared_context the sources go to the I/O engine's control context
+ * instead of a thread of our own.
+ */
+static gboolean
+gst_dmss_session_control_thread_start (GstDmssSession * session,
+    gboolean shared_context, GError ** err)
+{
+  g_assert (session->control_thread == NULL);
+  g_assert (session->control_context == NULL);
+
+  if (shared_context)
+    session->control_context = gst_dmss_io_engine_get_control_context ();
+  else {
+    session->control_context = g_main_context_new ();
+    session->control_loop = g_main_loop_new (session->control_context, FALSE);
+  }
+  gst_dmss_parser_init (&session->control_parser, 0);
+  session->last_ack_time = GST_CLOCK_TIME_NONE;
+
+  session->keepalive_source =
+      g_timeout_source_new (DMSS_KEEPALIVE_INTERVAL_MS);
+  g_source_set_callback (session->keepalive_source,
+      gst_dmss_session_keepalive_cb, session, NULL);
+  g_source_attach (session->keepalive_source, session->control_context);
+
+  session->control_source = g_socket_create_source (session->control_socket,
+      G_IO_IN | G_IO_ERR | G_IO_HUP, NULL);
+  g_source_set_callback (session->control_source,
+      (GSourceFunc) gst_dmss_session_control_readable_cb, session, NULL);
+  g_source_attach (session->control_source, session->control_context);
+
+  if (shared_context)
+    return TRUE;
+
+  session->control_thread = g_thread_try_new ("dmss-control",
+      gst_dmss_session_control_thread_func, session, err);
+
+  return session->control_thread != NULL;
+}
+
+static void
+gst_dmss_session_control_thread_stop (GstDmssSession * session)
+{
+  if (session->control_thread) {
+    // the loop may not be running yet, so quit from inside it
+    g_main_context_invoke (session->control_context,
+        gst_dmss_session_control_thread_quit_cb, session->control_loop);
+    g_thread_join (session->control_thread);
+    session->control_thread = NULL;
+    gst_dmss_session_control_sources_destroy_cb (session);
+  } else if (session->control_source && !session->control_loop)
+    // the shared thread may be inside one of our callbacks right now
+    gst_dmss_io_engine_invoke_control
+        (gst_dmss_session_control_sources_destroy_cb, session);
+  else if (session->control_source)
+    // thread creation failed, nothing ever ran the sources
+    gst_dmss_session_control_sources_destroy_cb (session);
+
+  if (session->keepalive_source)
+    g_source_unref (session->keepalive_source);
+  session->keepalive_source = NULL;
+  if (session->control_source)
+    g_source_unref (session->control_source);
+  session->control_source = NULL;
+  if (session->control_loop)
+    g_main_loop_unref (session->control_loop);
+  session->control_loop = NULL;
+  if (session->control_context)
+    g_main_context_unref (session->control_context);
+  session->control_context = NULL;
+}
+
+/* Connects and logs in, then hands the control socket to the control
+ * thread. Adds "connect" and "login" to timings when given.
+ */
+gboolean
+gst_dmss_session_open (GstDmssSession * session, gboolean shared_context,
+    GstStructure * timings, GCancellable * cancellable, GError ** err)
+{
+  GstClockTime last_time = gst_util_get_timestamp ();
+
+  g_assert (session->control_socket == NULL);
+
+  session->control_socket =
+      g_socket_new (g_socket_address_get_family (session->address),
+      G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, err);
+  if (!session->control_socket)
+    return FALSE;
+
+  g_socket_set_timeout (session->control_socket, session->timeout);
+
+  if (!g_socket_connect (session->control_socket, session->address,
+          cancellable, err))
+    return FALSE;
+  gst_dmss_session_mark_phase (timings, "connect", &last_time);
+
+  if (!gst_dmss_session_login (session, cancellable, err))
+    return FALSE;
+  gst_dmss_session_mark_phase (timings, "login", &last_time);
+
+  return gst_dmss_session_control_thread_start (session, shared_context, err);
+}
+
+/* Takes a reference unless the last one is being dropped right now */
+static gboolean
+gst_dmss_session_try_ref (GstDmssSession * session)
+{
+  gint refcount;
+
+  do {
+    refcount = g_atomic_int_get (&session->refcount);
+    if (!refcount)
+      return FALSE;
+  } while (!g_atomic_int_compare_and_exchange (&session->refcount, refcount,
+          refcount + 1));
+
+  return TRUE;
+}
+
+static gboolean
+gst_dmss_session_wait_open (GstDmssSession * session,
+    GCancellable * cancellable, GError ** err)
+{
+  g_mutex_lock (&session->lock);
+  while (session->opening) {
+    if (g_cancellable_set_error_if_cancelled (cancellable, err)) {
+      g_mutex_unlock (&session->lock);
+      return FALSE;
+    }
+    g_cond_wait_until (&session->cond, &session->lock,
+        g_get_monotonic_time () + DMSS_SESSION_WAIT_US);
+  }
+  if (session->open_error) {
+    g_propagate_error (err, g_error_copy (session->open_error));
+    g_mutex_unlock (&session->lock);
+    return FALSE;
+  }
+  g_mutex_unlock (&session->lock);
+
+  return TRUE;
+}
+
+/* Returns the registered session for host:port:user when it is still
+ * alive and was opened with the same password, otherwise opens a new one
+ * and registers it. Whoever opens decides shared_context and gets the
+ * timings.
+ */
+GstDmssSession *
+gst_dmss_session_acquire (const gchar * host, int port,
+    GSocketAddress * address, const gchar * user, const gchar * password,
+    guint timeout, gboolean shared_context, GstStructure * timings,
+    GCancellable * cancellable, GError ** err)
+{
+  GstDmssSession *session;
+  GError *open_error = NULL;
+  gchar *key;
+  gboolean opened;
+
+  key = g_strdup_printf ("%s:%d:%s", host, port, user);
+
+  g_mutex_lock (&registry_lock);
+  if (!registry)
+    registry = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  session = g_hash_table_lookup (registry, key);
+  if (session && !g_strcmp0 (session->password, password)
+      && gst_dmss_session_try_ref (session)) {
+    g_mutex_unlock (&registry_lock);
+    g_free (key);
+
+    if (!gst_dmss_session_wait_open (session, cancellable, err)) {
+      gst_dmss_session_unref (session);
+      return NULL;
+    }
+    if (gst_dmss_session_is_alive (session)) {
+      GST_DEBUG ("Sharing session %d for %s:%d", session->session_id, host,
+          port);
+      return session;
+    }
+
+    // dead control connection, replace it for everyone coming after us
+    GST_DEBUG ("Registered session for %s:%d is gone, logging in again", host,
+        port);
+    gst_dmss_session_unref (session);
+    key = g_strdup_printf ("%s:%d:%s", host, port, user);
+    g_mutex_lock (&registry_lock);
+  }
+
+  session = gst_dmss_session_new (address, user, password, timeout);
+  session->key = g_strdup (key);
+  session->opening = TRUE;
+  g_hash_table_replace (registry, key, session);
+  g_mutex_unlock (&registry_lock);
+
+  opened = gst_dmss_session_open (session, shared_context, timings,
+      cancellable, &open_error);
+
+  g_mutex_lock (&session->lock);
+  session->opening = FALSE;
+  if (!opened)
+    session->open_error = g_error_copy (open_error);
+  g_cond_broadcast (&session->cond);
+  g_mutex_unlock (&session->lock);
+
+  if (!opened) {
+    g_propagate_error (err, open_error);
+    gst_dmss_session_unref (session);
+    return NULL;
+  }
+
+  return session;
+}
+
+/* Sends a request on the control socket and waits for its 0xf4 or 0xf6
+ * reply, whose body is returned in response. Replies are matched on the
+ * TransactionID or JSON id of the request; others are dropped.
+ */
+gboolean
+gst_dmss_session_request (GstDmssSession * session, const gchar * request,
+    gsize size, GByteArray ** response, GCancellable * cancellable,
+    GError ** err)
+{
+  gint64 deadline, end_time;
+
+  deadline = session->timeout ? g_get_monotonic_time () +
+      session->timeout * G_USEC_PER_SEC : G_MAXINT64;
+
+  g_mutex_lock (&session->request_lock);
+  g_mutex_lock (&session->lock);
+
+  if (session->control_error)
+    goto control_error;
+
+  session->waiting = TRUE;
+  session->waiting_command = (guint8) request[0];
+  if (!gst_dmss_session_get_reply_id (session->waiting_command,
+          &request[GST_DMSS_PROTOCOL_HEADER_SIZE],
+          size - GST_DMSS_PROTOCOL_HEADER_SIZE, &session->waiting_id))
+    session->waiting_id = -1;
+  if (!g_socket_send (session->control_socket, request, size, cancellable,
+          err))
+    goto send_error;
+
+  while (session->waiting && !session->control_error) {
+    if (g_cancellable_set_error_if_cancelled (cancellable, err))
+      goto send_error;
+    if (g_get_monotonic_time () >= deadline) {
+      g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+          "Timed out waiting for reply on control socket");
+      goto send_error;
+    }
+    // cancellation doesn't signal us, so look at it now and then
+    end_time = MIN (deadline, g_get_monotonic_time () + DMSS_SESSION_WAIT_US);
+    g_cond_wait_until (&session->cond, &session->lock, end_time);
+  }
+
+  if (session->waiting)
+    goto control_error;
+
+  *response = session->response;
+  session->response = NULL;
+
+  g_mutex_unlock (&session->lock);
+  g_mutex_unlock (&session->request_lock);
+  return TRUE;
+control_error:
+  g_propagate_error (err, g_error_copy (session->control_error));
+send_error:
+  session->waiting = FALSE;
+  g_mutex_unlock (&session->lock);
+  g_mutex_unlock (&session->request_lock);
+  return FALSE;
+}
+
+/* Asks the device for a passive stream connection. connection_id must
+ * hold GST_DMSS_SESSION_CONNECTION_ID_SIZE bytes.
+ */
+gboolean
+gst_dmss_session_add_object (GstDmssSession * session, gchar * connection_id,
+    GCancellable * cancellable, GError ** err)
+{
+  static gchar const add_object_template[] =
+      "TransactionID:%u\r\n"
+      "Method:AddObject\r\n"
+      "ParameterName:Dahua.Device.Network.ControlConnection.Passive\r\n"
+      "ConnectProtocol:0\r\n\r\n";
+  gchar cmd_buffer[32 + sizeof (add_object_template) + 16];
+  GByteArray *response;
+  gchar *value;
+  gsize value_size;
+  guint id;
+  int size;
+
+  id = g_atomic_int_add (&session->call_id, 1) + 1;
+  size = gst_dmss_protocol_create_new_packet (cmd_buffer,
+      sizeof (cmd_buffer) - 1, add_object_template, id);
+
+  if (!gst_dmss_session_request (session, cmd_buffer, size, &response,
+          cancellable, err))
+    return FALSE;
+
+  GST_DEBUG ("Received AddObject response %.*s", response->len,
+      (gchar *) response->data);
+
+  if (!(value = gst_dmss_session_find_value ((const gchar *)
+              response->data, response->len, "FaultCode:", &value_size)) || value_size < 2 || memcmp (value, "OK", 2))
+    goto error_status;
+
+  if (!(value = gst_dmss_session_find_value ((const gchar *)
+              response->data, response->len, "ConnectionID:", &value_size)))
+    goto error_status;
+
+  memset (connection_id, 0, GST_DMSS_SESSION_CONNECTION_ID_SIZE);
+  memcpy (connection_id, value,
+      MIN (value_size, GST_DMSS_SESSION_CONNECTION_ID_SIZE - 1));
+
+  g_byte_array_unref (response);
+  return TRUE;
+error_status:
+  g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_FAILED,
+      "Device refused the stream connection");
+  g_byte_array_unref (response);
+  return FALSE;
+}
+
+gboolean
+gst_dmss_session_start_monitor (GstDmssSession * session, guint channel,
+    guint subchannel, const gchar * connection_id,
+    GCancellable * cancellable, GError ** err)
+{
+  gchar const stream_start_template[] =
+      "TransactionID:%u\r\n"
+      "Method:GetParameterNames\r\n"
+      "ParameterName:Dahua.Device.Network.Monitor.General\r\n"
+      "channel:%d\r\n"
+      "state:1\r\n" "ConnectionID:%s\r\n" "stream:%d\r\n" "\r\n";
+  gchar *new_command_buffer;
+  GByteArray *response;
+  guint id;
+  int size;
+
+  GST_DEBUG ("Starting stream for channel %d and subchannel %d",
+      channel, subchannel);
+
+  id = g_atomic_int_add (&session->call_id, 1) + 1;
+  size = gst_dmss_protocol_create_new_packet (NULL, 0,
+      stream_start_template, id, channel, connection_id, (int) subchannel);
+
+  new_command_buffer = g_malloc (size);
+
+  size = gst_dmss_protocol_create_new_packet (new_command_buffer, size,
+      stream_start_template, id, channel, connection_id, (int) subchannel);
+
+  if (!gst_dmss_session_request (session, new_command_buffer, size,
+          &response, cancellable, err)) {
+    g_free (new_command_buffer);
+    return FALSE;
+  }
+  g_free (new_command_buffer);
+
+  // should check if response is OK
+  GST_DEBUG ("Received monitor response %.*s", response->len,
+      (gchar *) response->data);
+  g_byte_array_unref (response);
+
+  return TRUE;
+}
+
+static gchar *
+gst_dmss_session_format_time (gint64 time)
+{
+  GDateTime *date_time = g_date_time_new_from_unix_utc (time);
+  gchar *formatted;
+
+  formatted = g_strdup_printf ("%d&%d&%d&%d&%d&%d",
+      g_date_time_get_year (date_time), g_date_time_get_month (date_time),
+      g_date_time_get_day_of_month (date_time),
+      g_date_time_get_hour (date_time), g_date_time_get_minute (date_time),
+      g_date_time_get_second (date_time));
+  g_date_time_unref (date_time);
+
+  return formatted;
+}
+
+/* Starts streaming a recording into the object added for connection_id.
+ * The device answers on the control socket like it does for monitors.
+ */
+gboolean
+gst_dmss_session_start_playback (GstDmssSession * session,
+    const GstDmssPlaybackParams * params, const gchar * connection_id,
+    GCancellable * cancellable, GError ** err)
+{
+  gchar const playback_template[] =
+      "TransactionID:%u\r\n"
+      "Method:GetParameterNames\r\n"
+      "ParameterName:Dahua.Device.Network.PlayBack.General\r\n"
+      "channel:%u\r\n"
+      "ConnectionID:%s\r\n"
+      "StartTime:%s\r\n"
+      "EndTime:%s\r\n"
+      "DriveNo:%u\r\n"
+      "ClusterNo:%u\r\n"
+      "Hint:1\r\n"
+      "Type:0\r\n"
+      "IFrames:%u\r\n"
+      "IsTime:1\r\n"
+      "OffLength:%" G_GUINT64_FORMAT "\r\n" "Direction:%u\r\n" "\r\n";
+  gchar *new_command_buffer, *start_time, *end_time;
+  GByteArray *response;
+  gboolean ret;
+  guint id;
+  int size;
+
+  start_time = gst_dmss_session_format_time (params->start_time);
+  end_time = gst_dmss_session_format_time (params->end_time);
+
+  GST_DEBUG ("Starting playback of channel %u from %s to %s at byte %"
+      G_GUINT64_FORMAT, params->channel, start_time, end_time,
+      params->offset);
+
+  // PlayBack counts channels from 1 where Monitor and mediaFileFind use 0
+  id = g_atomic_int_add (&session->call_id, 1) + 1;
+  size = gst_dmss_protocol_create_new_packet (NULL, 0, playback_template, id,
+      params->channel + 1, connection_id, start_time, end_time,
+      params->drive_no, params->cluster_no, params->iframes ? 1 : 0,
+      params->offset, params->reverse ? 1 : 0);
+
+  new_command_buffer = g_malloc (size);
+
+  size = gst_dmss_protocol_create_new_packet (new_command_buffer, size,
+      playback_template, id, params->channel + 1, connection_id, start_time,
+      end_time, params->drive_no, params->cluster_no,
+      params->iframes ? 1 : 0, params->offset, params->reverse ? 1 : 0);
+
+  g_free (start_time);
+  g_free (end_time);
+
+  ret = gst_dmss_session_request (session, new_command_buffer, size,
+      &response, cancellable, err);
+  g_free (new_command_buffer);
+  if (!ret)
+    return FALSE;
+
+  GST_DEBUG ("Received playback response %.*s", response->len,
+      (gchar *) response->data);
+  g_byte_array_unref (response);
+
+  return TRUE;
+}
+
+/* Starts connecting a stream socket without waiting, so the TCP
+ * handshake can run while AddObject is outstanding on the control socket.
+ * A receive_buffer_size other than 0 is set before connecting, so the
+ * window scale offered in the handshake can use it.
+ */
+GSocket *
+gst_dmss_session_connect_stream_begin (GstDmssSession * session,
+    guint receive_buffer_size, GCancellable * cancellable, GError ** err)
+{
+  GError *connect_err = NULL;
+  GSocket *socket;
+
+  socket = g_socket_new (g_socket_address_get_family (session->address),
+      G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, err);
+  if (!socket)
+    return NULL;
+
+  g_socket_set_timeout (socket, session->timeout);
+  g_socket_set_blocking (socket, FALSE);
+
+  // the kernel may clamp it, which is fine
+  if (receive_buffer_size && !g_socket_set_option (socket, SOL_SOCKET,
+          SO_RCVBUF, receive_buffer_size, &connect_err)) {
+    GST_WARNING ("Failed to set receive buffer size: %s",
+        connect_err->message);
+    g_clear_error (&connect_err);
+  }
+
+  if (!g_socket_connect (socket, session->address, cancellable, &connect_err)
+      && !g_error_matches (connect_err, G_IO_ERROR, G_IO_ERROR_PENDING)) {
+    g_propagate_error (err, connect_err);
+    g_object_unref (socket);
+    return NULL;
+  }
+  g_clear_error (&connect_err);
+
+  return socket;
+}
+
+gboolean
+gst_dmss_session_connect_stream_finish (GstDmssSession * session,
+    GSocket * socket, GCancellable * cancellable, GError ** err)
+{
+  // the socket timeout bounds the wait
+  if (!g_socket_condition_timed_wait (socket, G_IO_OUT, -1, cancellable, err)
+      || !g_socket_check_connect_result (socket, err))
+    return FALSE;
+
+  g_socket_set_blocking (socket, TRUE);
+
+  return TRUE;
+}
+
+/* Binds a connected stream socket to the object added for connection_id */
+gboolean
+gst_dmss_session_link_stream (GstDmssSession * session, GSocket * socket,
+    const gchar * connection_id, GCancellable * cancellable, GError ** err)
+{
+  gchar ack_subchannel_template[] =
+      "TransactionID:2\r\n"
+      "Method:GetParameterNames\r\n"
+      "ParameterName:Dahua.Device.Network.ControlConnection.AckSubChannel\r\n"
+      "SessionID:%d\r\n" "ConnectionID:%s\r\n" "\r\n";
+  gchar *new_command_buffer = NULL;
+  gchar extension_recv[255] = { 0, };
+  gssize receive_size;
+  int buffer_size;
+
+  buffer_size = gst_dmss_protocol_create_new_packet (NULL, 0,
+      ack_subchannel_template, session->session_id, connection_id);
+
+  new_command_buffer = g_malloc (buffer_size);
+
+  buffer_size = gst_dmss_protocol_create_new_packet (new_command_buffer,
+      buffer_size, ack_subchannel_template, session->session_id,
+      connection_id);
+
+  GST_DEBUG ("Sending new packet with body\n%.*s\n", buffer_size - 32,
+      new_command_buffer + 32);
+
+  if (!g_socket_send (socket, new_command_buffer, buffer_size, cancellable,
+          err)) {
+    g_free (new_command_buffer);
+    return FALSE;
+  }
+  g_free (new_command_buffer);
+
+  receive_size = sizeof (extension_recv) - 1;
+  if (gst_dmss_protocol_receive_packet_full (socket,
+          GST_DMSS_PARSER_SHORT_BODY_SIZE, cancellable, err, extension_recv,
+          &receive_size) < 0)
+    return FALSE;
+
+  GST_DEBUG ("ack subchannel response %s", &extension_recv[32]);
+
+  return TRUE;
+}
+
+/* Calls a JSON RPC method on the device, object 0 meaning none. params
+ * is a JSON value. A reply carrying an error fails the call.
+ */
+gboolean
+gst_dmss_session_call (GstDmssSession * session, const gchar * method,
+    guint object, const gchar * params, GByteArray ** response,
+    GCancellable * cancellable, GError ** err)
+{
+  static gchar const call_template[] =
+      "{ \"id\" : %u, \"method\" : \"%s\", \"params\" : %s, "
+      "\"session\" : %d }";
+  static gchar const object_call_template[] =
+      "{ \"id\" : %u, \"method\" : \"%s\", \"object\" : %u, "
+      "\"params\" : %s, \"session\" : %d }";
+  gchar *new_command_buffer;
+  const gchar *error;
+  gsize error_size;
+  guint id;
+  int size;
+
+  id = g_atomic_int_add (&session->call_id, 1) + 1;
+
+  if (object)
+    size = gst_dmss_protocol_create_json_packet (NULL, 0,
+        session->session_id, id, object_call_template, id, method, object,
+        params, session->session_id);
+  else
+    size = gst_dmss_protocol_create_json_packet (NULL, 0,
+        session->session_id, id, call_template, id, method, params,
+        session->session_id);
+
+  new_command_buffer = g_malloc (size);
+
+  if (object)
+    size = gst_dmss_protocol_create_json_packet (new_command_buffer, size,
+        session->session_id, id, object_call_template, id, method, object,
+        params, session->session_id);
+  else
+    size = gst_dmss_protocol_create_json_packet (new_command_buffer, size,
+        session->session_id, id, call_template, id, method, params,
+        session->session_id);
+
+  GST_DEBUG ("Calling %.*s", size - 32, new_command_buffer + 32);
+
+  if (!gst_dmss_session_request (session, new_command_buffer, size, response,
+          cancellable, err)) {
+    g_free (new_command_buffer);
+    return FALSE;
+  }
+  g_free (new_command_buffer);
+
+  GST_LOG ("Received %s response %.*s", method, (*response)->len,
+      (gchar *) (*response)->data);
+
+  error = gst_dmss_protocol_json_find ((const gchar *) (*response)->data,
+      (*response)->len, "error", &error_size);
+  if (error && !(error_size == 4 && !memcmp (error, "null", 4))) {
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED, "%s failed: %.*s",
+        method, (int) error_size, error);
+    g_byte_array_unref (*response);
+    *response = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_dmss_session_call_result (GstDmssSession * session, const gchar * method,
+    guint object, const gchar * params, gint64 * result,
+    GCancellable * cancellable, GError ** err)
+{
+  GByteArray *response;
+  const gchar *value;
+  gsize value_size;
+
+  if (!gst_dmss_session_call (session, method, object, params, &response,
+          cancellable, err))
+    return FALSE;
+
+  // booleans come back as true and false
+  value = gst_dmss_protocol_json_find ((const gchar *) response->data,
+      response->len, "result", &value_size);
+  if (value && value_size == 4 && !memcmp (value, "true", 4))
+    *result = 1;
+  else if (value && value_size == 5 && !memcmp (value, "false", 5))
+    *result = 0;
+  else if (!gst_dmss_protocol_json_get_int ((const gchar *) response->data,
+          response->len, "result", result)) {
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "%s returned no result", method);
+    g_byte_array_unref (response);
+    return FALSE;
+  }
+
+  g_byte_array_unref (response);
+  return TRUE;
+}
+
+/* Lists the recordings of channel between start and end into records */
+gboolean
+gst_dmss_session_find_files (GstDmssSession * session, guint channel,
+    gint64 start, gint64 end, GArray * records, GCancellable * cancellable,
+    GError ** err)
+{
+  GByteArray *response;
+  gchar *params, *start_time, *end_time;
+  gint64 object, result;
+  gint found;
+  gboolean ret;
+
+  if (!gst_dmss_session_call_result (session, "mediaFileFind.factory.create",
+          0, "null", &object, cancellable, err))
+    return FALSE;
+  if (!object) {
+    g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_FAILED,
+        "Device did not create a file finder");
+    return FALSE;
+  }
+
+  start_time = gst_dmss_record_index_format_time (start);
+  end_time = gst_dmss_record_index_format_time (end);
+  params = g_strdup_printf ("{ \"condition\" : { \"Channel\" : %u, "
+      "\"StartTime\" : \"%s\", \"EndTime\" : \"%s\", \"Flags\" : [ \"*\" ], "
+      "\"Types\" : [ \"dav\" ], \"VideoStream\" : \"Main\" } }", channel,
+      start_time, end_time);
+  g_free (start_time);
+  g_free (end_time);
+
+  // false means there is nothing recorded in the range
+  ret = gst_dmss_session_call_result (session, "mediaFileFind.findFile",
+      object, params, &result, cancellable, err);
+  g_free (params);
+  if (!ret)
+    goto done;
+
+  params = g_strdup_printf ("{ \"count\" : %d, \"object\" : %" G_GINT64_FORMAT
+      ", \"this\" : %" G_GINT64_FORMAT " }", GST_DMSS_RECORD_INDEX_PAGE_SIZE,
+      object, object);
+  while (result) {
+    if (!(ret = gst_dmss_session_call (session, "mediaFileFind.findNextFile",
+                object, params, &response, cancellable, err)))
+      break;
+
+    found = gst_dmss_record_index_parse ((const gchar *) response->data,
+        response->len, records);
+    g_byte_array_unref (response);
+    if (found < 0) {
+      g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_FAILED,
+          "Unreadable mediaFileFind.findNextFile reply");
+      ret = FALSE;
+      break;
+    }
+    result = found == GST_DMSS_RECORD_INDEX_PAGE_SIZE;
+  }
+  g_free (params);
+
+done:
+  // the device only has a few finders, always give ours back
+  if (gst_dmss_session_call_result (session, "mediaFileFind.close", object,
+          "null", &result, cancellable, NULL))
+    gst_dmss_session_call_result (session, "mediaFileFind.destroy", object,
+        "null", &result, cancellable, NULL);
+
+  GST_DEBUG ("Found %u recordings of channel %u", records->len, channel);
+
+  return ret;
+}
+
+/* Brings the record index up to date for start to end, only asking the
+ * device about what it has not searched yet.
+ */
+gboolean
+gst_dmss_session_refresh_records (GstDmssSession * session, guint channel,
+    gint64 start, gint64 end, GCancellable * cancellable, GError ** err)
+{
+  gint64 search_start, search_end;
+  GArray *records;
+
+  if (!gst_dmss_record_index_get_missing (session->record_index, channel,
+          start, end, &search_start, &search_end))
+    return TRUE;
+
+  records = g_array_new (FALSE, FALSE, sizeof (GstDmssRecord));
+  g_array_set_clear_func (records, (GDestroyNotify) gst_dmss_record_clear);
+
+  if (!gst_dmss_session_find_files (session, channel, search_start,
+          search_end, records, cancellable, err)) {
+    g_array_unref (records);
+    return FALSE;
+  }
+
+  gst_dmss_record_index_add (session->record_index, channel, search_start,
+      search_end, records);
+  g_array_unref (records);
+
+  return TRUE;
+}
+
+GstDmssRecordIndex *
+gst_dmss_session_get_record_index (GstDmssSession * session)
+{
+  return session->record_index;
+}
@@ -0,0 +1,105 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_SESSION_H__
+#define __GST_DMSS_SESSION_H__
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+#include "gstdmssrecordindex.h"
+
+G_BEGIN_DECLS
+
+#define GST_DMSS_SESSION_CONNECTION_ID_SIZE 16
+
+typedef struct _GstDmssSession GstDmssSession;
+
+/* What PlayBack.General streams. Times are seconds since the epoch in
+ * the device's local time, as the device itself reports them. offset is
+ * OffLength, the number of stream bytes from start_time to skip. iframes
+ * leaves out everything but keyframes and reverse streams from end_time
+ * back to start_time.
+ */
+typedef struct
+{
+  guint channel;
+  gint64 start_time;
+  gint64 end_time;
+  guint drive_no;
+  guint cluster_no;
+  guint64 offset;
+  gboolean iframes;
+  gboolean reverse;
+} GstDmssPlaybackParams;
+
+GstDmssSession *gst_dmss_session_new (GSocketAddress * address,
+    const gchar * user, const gchar * password, guint timeout);
+GstDmssSession *gst_dmss_session_ref (GstDmssSession * session);
+void gst_dmss_session_unref (GstDmssSession * session);
+
+GstDmssSession *gst_dmss_session_acquire (const gchar * host, int port,
+    GSocketAddress * address, const gchar * user, const gchar * password,
+    guint timeout, gboolean shared_context, GstStructure * timings,
+    GCancellable * cancellable, GError ** err);
+
+gboolean gst_dmss_session_open (GstDmssSession * session,
+    gboolean shared_context, GstStructure * timings,
+    GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_is_alive (GstDmssSession * session);
+gint gst_dmss_session_get_id (GstDmssSession * session);
+GstClockTime gst_dmss_session_get_keepalive_rtt (GstDmssSession * session);
+
+gboolean gst_dmss_session_request (GstDmssSession * session,
+    const gchar * request, gsize size, GByteArray ** response,
+    GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_add_object (GstDmssSession * session,
+    gchar * connection_id, GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_start_monitor (GstDmssSession * session,
+    guint channel, guint subchannel, const gchar * connection_id,
+    GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_start_playback (GstDmssSession * session,
+    const GstDmssPlaybackParams * params, const gchar * connection_id,
+    GCancellable * cancellable, GError ** err);
+
+gboolean gst_dmss_session_call (GstDmssSession * session,
+    const gchar * method, guint object, const gchar * params,
+    GByteArray ** response, GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_find_files (GstDmssSession * session,
+    guint channel, gint64 start, gint64 end, GArray * records,
+    GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_refresh_records (GstDmssSession * session,
+    guint channel, gint64 start, gint64 end, GCancellable * cancellable,
+    GError ** err);
+GstDmssRecordIndex *gst_dmss_session_get_record_index (GstDmssSession *
+    session);
+
+GSocket *gst_dmss_session_connect_stream_begin (GstDmssSession * session,
+    guint receive_buffer_size, GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_connect_stream_finish (GstDmssSession * session,
+    GSocket * socket, GCancellable * cancellable, GError ** err);
+gboolean gst_dmss_session_link_stream (GstDmssSession * session,
+    GSocket * socket, const gchar * connection_id,
+    GCancellable * cancellable, GError ** err);
+
+void gst_dmss_session_mark_phase (GstStructure * timings,
+    const gchar * phase, GstClockTime * last);
+
+G_END_DECLS
+#endif /* __GST_DMSS_SESSION_H__ */
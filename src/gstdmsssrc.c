@@ -65,6 +65,24 @@ Ukey:
  * gst-launch-1.0 dmsssrc port=37777 host=192.168.1.108 username=admin password=admin ! 
  * ]|
  *
+ * ## Example launch line (recording playback):
+ * |[
+ * gst-launch-1.0 dmsssrc host=192.168.1.108 mode=playback drive-no=9 cluster-no=589005 \
+ *   start-time="2018-09-22 11:29:00" end-time="2018-09-22 12:00:00" ! dmssdemux ! fakesink
+ * ]|
+ *
+ * mode=download fetches the same range as fast as the link allows. The
+ * stream is not live, so dmssdemux stamps it from the DHAV timestamps, and
+ * a "dmss-transfer" element message reports the throughput at the end.
+ * With download-connections above 1 the range is split along the recorded
+ * files, which are fetched over that many streams at once and put back in
+ * order.
+ *
+ * Without drive-no and cluster-no the recording is looked up with
+ * mediaFileFind. The recordings of a range can be listed with a custom
+ * "dmss-recordings" query carrying "start-time" and "end-time" strings,
+ * answered with a "recordings" array of "dmss-recording" structures.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -77,15 +95,44 @@ Ukey:
 #endif
 #include "gstdmsssrc.h"
 #include "gstdmssprotocol.h"
+#include "gstdmssioengine.h"
+#include "gstdmssuring.h"
+#include "gstdmsssession.h"
+#include "gstdmssdownload.h"
+#include "gstdmssdhavscan.h"
 #include "gstdmss.h"
 
-#include <stdio.h>
 #include <string.h>
 
 GST_DEBUG_CATEGORY (dmsssrc_debug);
 #define GST_CAT_DEFAULT dmsssrc_debug
 
 #define DMSS_DEFAULT_TIMEOUT            0
+#define DMSS_DEFAULT_RECEIVE_MODE       GST_DMSS_SRC_RECEIVE_MODE_COPY
+#define DMSS_DEFAULT_RECONNECT_ATTEMPTS 5
+#define DMSS_DEFAULT_RECONNECT_BACKOFF  250
+#define DMSS_DEFAULT_RECONNECT_BACKOFF_MAX 10000
+#define DMSS_DEFAULT_SHARE_SESSION      TRUE
+#define DMSS_DEFAULT_MODE               GST_DMSS_SRC_MODE_LIVE
+#define DMSS_DEFAULT_IFRAMES_RATE       4.0
+
+/* pool receive mode */
+#define DMSS_POOL_DEFAULT_BUFFER_SIZE   (32 + 64 * 1024)
+#define DMSS_POOL_MIN_BUFFERS           4
+#define DMSS_HISTOGRAM_DECAY_SAMPLES    256
+#define DMSS_HISTOGRAM_PERCENTILE       95
+
+/* read-ahead receive mode */
+#define DMSS_DEFAULT_READ_AHEAD_SIZE    (256 * 1024)
+
+/* download mode */
+#define DMSS_DOWNLOAD_RECEIVE_BUFFER_SIZE (4 * 1024 * 1024)
+#define DMSS_DEFAULT_DOWNLOAD_CONNECTIONS 1
+#define DMSS_MAX_DOWNLOAD_CONNECTIONS   16
+
+/* playback mode, seconds of stream time before the end of a file to set
+ * up the next one */
+#define DMSS_PREFETCH_LEAD              30
 
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
@@ -101,9 +148,70 @@ enum
   PROP_PASSWORD,
   PROP_TIMEOUT,
   PROP_CHANNEL,
-  PROP_SUBCHANNEL
+  PROP_SUBCHANNEL,
+  PROP_RECEIVE_MODE,
+  PROP_READ_AHEAD_SIZE,
+  PROP_SYSCALL_RATE,
+  PROP_RECONNECT_ATTEMPTS,
+  PROP_RECONNECT_BACKOFF,
+  PROP_RECONNECT_BACKOFF_MAX,
+  PROP_KEEPALIVE_RTT,
+  PROP_SHARE_SESSION,
+  PROP_MODE,
+  PROP_START_TIME,
+  PROP_END_TIME,
+  PROP_DRIVE_NO,
+  PROP_CLUSTER_NO,
+  PROP_THROUGHPUT,
+  PROP_DOWNLOAD_CONNECTIONS,
+  PROP_IFRAMES_RATE
 };
 
+GType
+gst_dmss_src_receive_mode_get_type (void)
+{
+  static GType receive_mode_type = 0;
+  static const GEnumValue receive_modes[] = {
+    {GST_DMSS_SRC_RECEIVE_MODE_COPY,
+        "Allocate a new buffer for every packet", "copy"},
+    {GST_DMSS_SRC_RECEIVE_MODE_POOL,
+        "Receive straight into buffers of a negotiated pool", "pool"},
+    {GST_DMSS_SRC_RECEIVE_MODE_READ_AHEAD,
+        "Read large chunks and push all complete packets as a list",
+        "read-ahead"},
+    {GST_DMSS_SRC_RECEIVE_MODE_SHARED,
+        "Receive on the process-wide epoll engine threads", "shared"},
+    {GST_DMSS_SRC_RECEIVE_MODE_IO_URING,
+        "Receive into an io_uring buffer ring, falls back to copy",
+        "io-uring"},
+    {0, NULL, NULL},
+  };
+
+  if (!receive_mode_type)
+    receive_mode_type =
+        g_enum_register_static ("GstDmssSrcReceiveMode", receive_modes);
+  return receive_mode_type;
+}
+
+GType
+gst_dmss_src_mode_get_type (void)
+{
+  static GType mode_type = 0;
+  static const GEnumValue modes[] = {
+    {GST_DMSS_SRC_MODE_LIVE, "Live stream of the channel", "live"},
+    {GST_DMSS_SRC_MODE_PLAYBACK,
+        "Recording between start-time and end-time", "playback"},
+    {GST_DMSS_SRC_MODE_DOWNLOAD,
+          "Recording between start-time and end-time, as fast as the link "
+          "allows", "download"},
+    {0, NULL, NULL},
+  };
+
+  if (!mode_type)
+    mode_type = g_enum_register_static ("GstDmssSrcMode", modes);
+  return mode_type;
+}
+
 #define gst_dmss_src_parent_class parent_class
 G_DEFINE_TYPE (GstDmssSrc, gst_dmss_src, GST_TYPE_PUSH_SRC);
 
@@ -113,6 +221,23 @@ static GstFlowReturn gst_dmss_src_create (GstPushSrc * psrc,
     GstBuffer ** outbuf);
 static gboolean gst_dmss_src_stop (GstBaseSrc * bsrc);
 static gboolean gst_dmss_src_start (GstBaseSrc * bsrc);
+static gboolean gst_dmss_src_decide_allocation (GstBaseSrc * bsrc,
+    GstQuery * query);
+static gboolean gst_dmss_src_unlock (GstBaseSrc * bsrc);
+static GstStateChangeReturn gst_dmss_src_change_state (GstElement * element,
+    GstStateChange transition);
+static gboolean gst_dmss_src_unlock_stop (GstBaseSrc * bsrc);
+static gboolean gst_dmss_src_query (GstBaseSrc * bsrc, GstQuery * query);
+static gboolean gst_dmss_src_is_seekable (GstBaseSrc * bsrc);
+static gboolean gst_dmss_src_do_seek (GstBaseSrc * bsrc,
+    GstSegment * segment);
+static void gst_dmss_src_chunk_unref (gpointer data);
+static void gst_dmss_src_close (GstDmssSrc * src);
+static void gst_dmss_src_join_prefetch (GstDmssSrc * src, gboolean cancel);
+static gboolean gst_dmss_src_open (GstDmssSrc * src, GError ** err);
+static struct _GstDmssDownload *gst_dmss_src_new_download (GstDmssSrc * src,
+    GstDmssSession * session, gint64 start, gint64 end, guint connections,
+    GCancellable * cancellable, GError ** err);
 
 static void gst_dmss_src_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
@@ -173,6 +298,101 @@ gst_dmss_src_class_init (GstDmssSrcClass * klass)
           G_MAXUINT, DMSS_DEFAULT_SUBCHANNEL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_RECEIVE_MODE,
+      g_param_spec_enum ("receive-mode", "Receive mode",
+          "How buffers for stream packets are allocated",
+          GST_TYPE_DMSS_SRC_RECEIVE_MODE, DMSS_DEFAULT_RECEIVE_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_READ_AHEAD_SIZE,
+      g_param_spec_uint ("read-ahead-size", "Read ahead size",
+          "Bytes requested from the stream socket at once in read-ahead mode",
+          32, G_MAXUINT, DMSS_DEFAULT_READ_AHEAD_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SYSCALL_RATE,
+      g_param_spec_uint ("syscall-rate", "Syscall rate",
+          "Stream socket receive calls per second", 0, G_MAXUINT, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEEPALIVE_RTT,
+      g_param_spec_uint64 ("keepalive-rtt", "Keep-alive RTT",
+          "Last measured keep-alive round trip time in nanoseconds", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECONNECT_ATTEMPTS,
+      g_param_spec_int ("reconnect-attempts", "Reconnect attempts",
+          "Times to redo the handshake after the connection breaks before "
+          "posting an error, -1 = forever, 0 = never", -1, G_MAXINT,
+          DMSS_DEFAULT_RECONNECT_ATTEMPTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECONNECT_BACKOFF,
+      g_param_spec_uint ("reconnect-backoff", "Reconnect backoff",
+          "Delay in milliseconds before the first reconnect attempt, doubled "
+          "on every further attempt", 0, G_MAXUINT,
+          DMSS_DEFAULT_RECONNECT_BACKOFF,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RECONNECT_BACKOFF_MAX,
+      g_param_spec_uint ("reconnect-backoff-max", "Maximum reconnect backoff",
+          "Upper bound in milliseconds for the delay between reconnect "
+          "attempts", 0, G_MAXINT32, DMSS_DEFAULT_RECONNECT_BACKOFF_MAX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SHARE_SESSION,
+      g_param_spec_boolean ("share-session", "Share session",
+          "Reuse the login of other elements in this process connected to "
+          "the same host, port and user", DMSS_DEFAULT_SHARE_SESSION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MODE,
+      g_param_spec_enum ("mode", "Mode",
+          "Stream live video, play a recording back or download it",
+          GST_TYPE_DMSS_SRC_MODE, DMSS_DEFAULT_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_START_TIME,
+      g_param_spec_string ("start-time", "Start time",
+          "Start of the recording to play back, as \"YYYY-MM-DD HH:MM:SS\" "
+          "in the device's local time", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_END_TIME,
+      g_param_spec_string ("end-time", "End time",
+          "End of the recording to play back, as \"YYYY-MM-DD HH:MM:SS\" "
+          "in the device's local time", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DRIVE_NO,
+      g_param_spec_uint ("drive-no", "Drive number",
+          "Disk holding the recording, as reported by the file search", 0,
+          G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CLUSTER_NO,
+      g_param_spec_uint ("cluster-no", "Cluster number",
+          "Cluster of the recording, as reported by the file search", 0,
+          G_MAXUINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_THROUGHPUT,
+      g_param_spec_uint64 ("throughput", "Throughput",
+          "Bytes per second received from the stream socket over the last "
+          "second", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DOWNLOAD_CONNECTIONS,
+      g_param_spec_uint ("download-connections", "Download connections",
+          "Recorded files downloaded at once in download mode, each over its "
+          "own stream of the session", 1, DMSS_MAX_DOWNLOAD_CONNECTIONS,
+          DMSS_DEFAULT_DOWNLOAD_CONNECTIONS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_IFRAMES_RATE,
+      g_param_spec_double ("iframes-rate", "I-frames rate",
+          "Playback rates this fast or faster, forward or reverse, only "
+          "stream keyframes", 1.0, G_MAXDOUBLE, DMSS_DEFAULT_IFRAMES_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_static_pad_template (gstelement_class, &srctemplate);
 
   gst_element_class_set_metadata (gstelement_class,
@@ -181,8 +401,16 @@ gst_dmss_src_class_init (GstDmssSrcClass * klass)
       "Receive data from IP camera",
       "Felipe Magno de Almeida <felipe@expertisesolutions.com.br>");
 
+  gstelement_class->change_state = gst_dmss_src_change_state;
+
   gstbasesrc_class->start = gst_dmss_src_start;
   gstbasesrc_class->stop = gst_dmss_src_stop;
+  gstbasesrc_class->decide_allocation = gst_dmss_src_decide_allocation;
+  gstbasesrc_class->unlock = gst_dmss_src_unlock;
+  gstbasesrc_class->unlock_stop = gst_dmss_src_unlock_stop;
+  gstbasesrc_class->query = gst_dmss_src_query;
+  gstbasesrc_class->is_seekable = gst_dmss_src_is_seekable;
+  gstbasesrc_class->do_seek = gst_dmss_src_do_seek;
   gstpushsrc_class->create = gst_dmss_src_create;
 
   GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
@@ -201,17 +429,66 @@ gst_dmss_src_init (GstDmssSrc * src)
   src->user = g_strdup (DMSS_DEFAULT_USER);
   src->password = g_strdup (DMSS_DEFAULT_PASSWORD);
   src->timeout = DMSS_DEFAULT_TIMEOUT;
-  src->control_socket = NULL;
+  src->session = NULL;
   src->stream_socket = NULL;
   src->cancellable = g_cancellable_new ();
+  src->prefetch_cancellable = g_cancellable_new ();
   src->channel = 0;
   src->subchannel = 0;
-#if 1
+  src->receive_mode = DMSS_DEFAULT_RECEIVE_MODE;
+  src->pool = NULL;
+  src->pool_buffer_size = 0;
+  memset (src->body_size_histogram, 0, sizeof (src->body_size_histogram));
+  src->body_size_samples = 0;
+  src->read_ahead_size = DMSS_DEFAULT_READ_AHEAD_SIZE;
+  src->chunk = NULL;
+  src->chunk_parsed = src->chunk_filled = 0;
+  src->syscalls = 0;
+  src->syscall_rate = 0;
+  src->last_rate_time = GST_CLOCK_TIME_NONE;
+  src->io_stream = NULL;
+  src->uring = NULL;
+  src->resolve_context = NULL;
+  src->resolve_host = NULL;
+  src->resolve_results = NULL;
+  src->resolve_error = NULL;
+  src->resolve_done = FALSE;
+  src->reconnect_attempts = DMSS_DEFAULT_RECONNECT_ATTEMPTS;
+  src->reconnect_backoff = DMSS_DEFAULT_RECONNECT_BACKOFF;
+  src->reconnect_backoff_max = DMSS_DEFAULT_RECONNECT_BACKOFF_MAX;
+  src->discont = FALSE;
+  src->share_session = DMSS_DEFAULT_SHARE_SESSION;
+  src->mode = DMSS_DEFAULT_MODE;
+  src->start_time = NULL;
+  src->end_time = NULL;
+  src->drive_no = 0;
+  src->cluster_no = 0;
+  src->playback_start = src->playback_end = 0;
+  src->playback_position = 0;
+  src->playback_seek = GST_CLOCK_TIME_NONE;
+  src->playback_rate = src->playback_seek_rate = 1.0;
+  src->iframes_rate = DMSS_DEFAULT_IFRAMES_RATE;
   src->bytes_downloaded = 0;
-#endif
+  src->throughput = 0;
+  src->download_connections = DMSS_DEFAULT_DOWNLOAD_CONNECTIONS;
+  src->download = NULL;
+  src->record_end = src->prefetch_time = 0;
+  src->prefetch = NULL;
+  src->prefetch_thread = NULL;
+  src->prefetched = FALSE;
+  src->total_bytes = 0;
+  src->start_clock_time = GST_CLOCK_TIME_NONE;
+  src->stream_offset = src->frame_start = 0;
+  src->frame_header_filled = 0;
+  src->frame_remaining = 0;
+  src->checkpoint_offset = 0;
+  src->checkpoint_time = 0;
+  src->resume_offset = src->resume_skip = 0;
+  src->resume_check = FALSE;
+  src->offset_resume = TRUE;
+  src->hangup_resumed = FALSE;
 
   src->system_clock = gst_system_clock_obtain ();
-  src->last_ack_time = GST_CLOCK_TIME_NONE;
 
   GST_OBJECT_FLAG_UNSET (src, GST_DMSS_SRC_CONTROL_OPEN);
   gst_base_src_set_live (GST_BASE_SRC (src), TRUE);
@@ -225,18 +502,25 @@ gst_dmss_src_finalize (GObject * gobject)
   if (this->cancellable)
     g_object_unref (this->cancellable);
   this->cancellable = NULL;
-  if (this->control_socket)
-    g_object_unref (this->control_socket);
-  this->control_socket = NULL;
+  if (this->prefetch_cancellable)
+    g_object_unref (this->prefetch_cancellable);
+  this->prefetch_cancellable = NULL;
   if (this->stream_socket)
     g_object_unref (this->stream_socket);
   this->stream_socket = NULL;
+  if (this->pool)
+    gst_object_unref (this->pool);
+  this->pool = NULL;
   g_free (this->host);
   this->host = NULL;
   g_free (this->user);
   this->user = NULL;
   g_free (this->password);
   this->password = NULL;
+  g_free (this->start_time);
+  this->start_time = NULL;
+  g_free (this->end_time);
+  this->end_time = NULL;
 
   G_OBJECT_CLASS (parent_class)->finalize (gobject);
 }
@@ -284,6 +568,53 @@ gst_dmss_src_set_property (GObject * object, guint prop_id,
     case PROP_SUBCHANNEL:
       src->subchannel = g_value_get_uint (value);
       break;
+    case PROP_RECEIVE_MODE:
+      src->receive_mode = g_value_get_enum (value);
+      break;
+    case PROP_READ_AHEAD_SIZE:
+      src->read_ahead_size = g_value_get_uint (value);
+      break;
+    case PROP_RECONNECT_ATTEMPTS:
+      src->reconnect_attempts = g_value_get_int (value);
+      break;
+    case PROP_RECONNECT_BACKOFF:
+      src->reconnect_backoff = g_value_get_uint (value);
+      break;
+    case PROP_RECONNECT_BACKOFF_MAX:
+      src->reconnect_backoff_max = g_value_get_uint (value);
+      break;
+    case PROP_SHARE_SESSION:
+      src->share_session = g_value_get_boolean (value);
+      break;
+    case PROP_MODE:
+      src->mode = g_value_get_enum (value);
+      // a recording is neither live nor addressed in bytes
+      gst_base_src_set_live (GST_BASE_SRC (src),
+          src->mode == GST_DMSS_SRC_MODE_LIVE);
+      gst_base_src_set_format (GST_BASE_SRC (src),
+          src->mode == GST_DMSS_SRC_MODE_LIVE ? GST_FORMAT_BYTES :
+          GST_FORMAT_TIME);
+      break;
+    case PROP_START_TIME:
+      g_free (src->start_time);
+      src->start_time = g_value_dup_string (value);
+      break;
+    case PROP_END_TIME:
+      g_free (src->end_time);
+      src->end_time = g_value_dup_string (value);
+      break;
+    case PROP_DRIVE_NO:
+      src->drive_no = g_value_get_uint (value);
+      break;
+    case PROP_CLUSTER_NO:
+      src->cluster_no = g_value_get_uint (value);
+      break;
+    case PROP_DOWNLOAD_CONNECTIONS:
+      src->download_connections = g_value_get_uint (value);
+      break;
+    case PROP_IFRAMES_RATE:
+      src->iframes_rate = g_value_get_double (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -312,683 +643,1877 @@ gst_dmss_src_get_property (GObject * object, guint prop_id,
     case PROP_TIMEOUT:
       g_value_set_uint (value, src->timeout);
       break;
+    case PROP_RECEIVE_MODE:
+      g_value_set_enum (value, src->receive_mode);
+      break;
+    case PROP_READ_AHEAD_SIZE:
+      g_value_set_uint (value, src->read_ahead_size);
+      break;
+    case PROP_RECONNECT_ATTEMPTS:
+      g_value_set_int (value, src->reconnect_attempts);
+      break;
+    case PROP_RECONNECT_BACKOFF:
+      g_value_set_uint (value, src->reconnect_backoff);
+      break;
+    case PROP_RECONNECT_BACKOFF_MAX:
+      g_value_set_uint (value, src->reconnect_backoff_max);
+      break;
+    case PROP_SHARE_SESSION:
+      g_value_set_boolean (value, src->share_session);
+      break;
+    case PROP_MODE:
+      g_value_set_enum (value, src->mode);
+      break;
+    case PROP_START_TIME:
+      g_value_set_string (value, src->start_time);
+      break;
+    case PROP_END_TIME:
+      g_value_set_string (value, src->end_time);
+      break;
+    case PROP_DRIVE_NO:
+      g_value_set_uint (value, src->drive_no);
+      break;
+    case PROP_CLUSTER_NO:
+      g_value_set_uint (value, src->cluster_no);
+      break;
+    case PROP_SYSCALL_RATE:
+      g_value_set_uint (value, g_atomic_int_get (&src->syscall_rate));
+      break;
+    case PROP_DOWNLOAD_CONNECTIONS:
+      g_value_set_uint (value, src->download_connections);
+      break;
+    case PROP_IFRAMES_RATE:
+      g_value_set_double (value, src->iframes_rate);
+      break;
+    case PROP_THROUGHPUT:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint64 (value, src->throughput);
+      GST_OBJECT_UNLOCK (src);
+      break;
+    case PROP_KEEPALIVE_RTT:
+      GST_OBJECT_LOCK (src);
+      g_value_set_uint64 (value,
+          src->session ? gst_dmss_session_get_keepalive_rtt (src->session) : 0);
+      GST_OBJECT_UNLOCK (src);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
-static gboolean
-gst_dmss_src_stop (GstBaseSrc * bsrc)
+/* Drops the stream connection alone, the session stays logged in */
+static void
+gst_dmss_src_close_stream (GstDmssSrc * src)
 {
-  GstDmssSrc *this = GST_DMSS_SRC (bsrc);
-  GError *error;
-
-  if (this->control_socket) {
-    g_socket_close (this->control_socket, &error);
-    g_object_unref (this->control_socket);
-  }
-  if (this->stream_socket) {
-    g_socket_close (this->stream_socket, &error);
-    g_object_unref (this->stream_socket);
+  GError *error = NULL;
+
+  if (src->io_stream)
+    gst_dmss_io_engine_remove_stream (src->io_stream);
+  src->io_stream = NULL;
+  if (src->uring)
+    gst_dmss_uring_free (src->uring);
+  src->uring = NULL;
+
+  if (src->stream_socket) {
+    g_socket_close (src->stream_socket, &error);
+    g_clear_error (&error);
+    g_object_unref (src->stream_socket);
   }
-  this->control_socket = NULL;
-  this->stream_socket = NULL;
+  src->stream_socket = NULL;
 
-  return TRUE;
+  if (src->chunk)
+    gst_dmss_src_chunk_unref (src->chunk);
+  src->chunk = NULL;
+  src->chunk_parsed = src->chunk_filled = 0;
 }
 
-static GstFlowReturn
-gst_dmss_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
+/* Drops the connection to the device, leaving negotiated state alone */
+static void
+gst_dmss_src_close (GstDmssSrc * src)
 {
-  GstDmssSrc *src;
-  GstFlowReturn ret = GST_FLOW_OK;
-  GError *err = NULL;
-  gssize body_size, size, offset;
-  gchar prologue[32];
-  GstMapInfo map;
-  GstClockTime current_time;
-  static gchar const noop_buffer[32]
-      = {
-    0xa1, 0,
-  };
-
-  src = GST_DMSS_SRC (psrc);
-
-  GST_INFO_OBJECT (src, "Going to read data from stream");
-  
-  current_time = gst_clock_get_time (src->system_clock);
-
-  if (!GST_CLOCK_TIME_IS_VALID (src->last_ack_time) ||
-      current_time - src->last_ack_time > GST_SECOND) {
-    // send no-op packet
-    if (!g_socket_send (src->control_socket, noop_buffer, sizeof (noop_buffer),
-            src->cancellable, &err))
-      goto control_socket_error;
-    GST_LOG_OBJECT (src, "Sent nope packet for keep-alive");
-    src->last_ack_time = current_time;
+  gst_dmss_src_join_prefetch (src, TRUE);
 
-#if 1
-    GST_INFO_OBJECT (src, "Download rate of %d Bps", src->bytes_downloaded);
-    src->bytes_downloaded = 0;
-#endif
-  }
+  // joins the workers, which still use the session
+  if (src->download)
+    gst_dmss_download_free (src->download);
+  src->download = NULL;
+  if (src->prefetch)
+    gst_dmss_download_free (src->prefetch);
+  src->prefetch = NULL;
+  src->prefetched = FALSE;
 
-  GST_INFO_OBJECT (src, " ");
-
-  if (!GST_OBJECT_FLAG_IS_SET (src, GST_DMSS_SRC_CONTROL_OPEN))
-    goto wrong_state;
+  GST_OBJECT_LOCK (src);
+  if (src->session)
+    gst_dmss_session_unref (src->session);
+  src->session = NULL;
+  GST_OBJECT_UNLOCK (src);
 
-  GST_INFO_OBJECT (src, "Receiving data from socket with blocking");
-  if ((body_size =
-          gst_dmss_receive_packet_no_body (src->stream_socket, src->cancellable,
-              &err, prologue)) <= 0) {
-    if (!err && !body_size)
-      g_set_error_literal (&err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
-          "Connection closed by remote peer");
-    GST_ERROR_OBJECT (src, "Error receiving header");
-    g_assert (err != NULL);
-    goto recv_error;
-  }
-  GST_INFO_OBJECT (src, "Received header");
+  gst_dmss_src_close_stream (src);
 
-  g_assert (body_size == GUINT16_FROM_LE (*(guint32 *) & prologue[4]));
+  GST_OBJECT_FLAG_UNSET (src, GST_DMSS_SRC_CONTROL_OPEN);
+}
 
-  //gst_dmss_debug_print_prologue(prologue);
-  GST_INFO_OBJECT (src,
-      "Received prologue packet with command %.02x. body size %d",
-      (unsigned int) (unsigned char) prologue[0], (int) body_size);
+static gboolean
+gst_dmss_src_stop (GstBaseSrc * bsrc)
+{
+  GstDmssSrc *this = GST_DMSS_SRC (bsrc);
 
-#if 1
-  src->bytes_downloaded += sizeof (prologue) + body_size;
-#endif
-  *outbuf = gst_buffer_new_and_alloc (sizeof (prologue) + body_size);
-  gst_buffer_map (*outbuf, &map, GST_MAP_READWRITE);
+  gst_dmss_src_close (this);
 
-  memcpy (map.data, prologue, sizeof (prologue));
+  if (this->pool)
+    gst_object_unref (this->pool);
+  this->pool = NULL;
+  this->pool_buffer_size = 0;
 
-  offset = 0;
-  do {
-    GST_INFO_OBJECT (src, "Receiving data from socket with blocking (2)");
-    if ((size =
-            g_socket_receive (src->stream_socket,
-                (gchar *) & map.data[offset + sizeof (prologue)],
-                body_size - offset, src->cancellable, &err)) <= 0) {
-      GST_ERROR_OBJECT (src, "Error receiving header");
-      if (!err && !size)
-        g_set_error_literal (&err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      g_assert (err != NULL);
-      goto recv_error;
-    }
-    GST_INFO_OBJECT (src, "Received partial body");
-    offset += size;
-  } while (offset != body_size);
+  this->syscalls = 0;
+  this->last_rate_time = GST_CLOCK_TIME_NONE;
+  this->bytes_downloaded = 0;
+  GST_OBJECT_LOCK (this);
+  this->throughput = 0;
+  GST_OBJECT_UNLOCK (this);
 
-  GST_INFO_OBJECT (src, "Received body with %d", (int) offset);
+  return TRUE;
+}
 
-  gst_buffer_unmap (*outbuf, &map);
-  gst_buffer_resize (*outbuf, 0, sizeof (prologue) + body_size);
+static gboolean
+gst_dmss_src_unlock (GstBaseSrc * bsrc)
+{
+  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
 
-  GST_INFO_OBJECT (src,
-      "Returning buffer from _get of size %" G_GSIZE_FORMAT ", ts %"
-      GST_TIME_FORMAT ", dur %" GST_TIME_FORMAT
-      ", offset %" G_GINT64_FORMAT ", offset_end %" G_GINT64_FORMAT
-      ", still available bytes in socket: %d",
-      gst_buffer_get_size (*outbuf),
-      GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (*outbuf)),
-      GST_TIME_ARGS (GST_BUFFER_DURATION (*outbuf)),
-      GST_BUFFER_OFFSET (*outbuf), GST_BUFFER_OFFSET_END (*outbuf),
-      (int) g_socket_get_available_bytes (src->stream_socket));
+  GST_DEBUG_OBJECT (src, "unlock");
+  g_cancellable_cancel (src->cancellable);
+  if (src->io_stream)
+    gst_dmss_io_stream_set_flushing (src->io_stream, TRUE);
 
-  return ret;
-control_socket_error:
-  {
-    GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL),
-        ("failed reading from control socket: %s", err->message));
-    g_object_unref (src->control_socket);
-    if (src->stream_socket)
-      g_object_unref (src->stream_socket);
-    src->control_socket = NULL;
-    src->stream_socket = NULL;
-    return GST_FLOW_ERROR;
-  }
-recv_error:
-  {
-    GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL),
-        ("failed reading from socket: %s", err->message));
-    g_object_unref (src->control_socket);
-    if (src->stream_socket)
-      g_object_unref (src->stream_socket);
-    src->control_socket = NULL;
-    src->stream_socket = NULL;
-    return GST_FLOW_ERROR;
-  }
-wrong_state:
-  {
-    GST_DEBUG_OBJECT (src, "connection closed, cannot read data");
-    g_object_unref (src->control_socket);
-    if (src->stream_socket)
-      g_object_unref (src->stream_socket);
-    src->control_socket = NULL;
-    src->stream_socket = NULL;
-    return GST_FLOW_FLUSHING;
-  }
+  return TRUE;
 }
 
-static int
-gst_dmss_src_new_protocol_find_value_size (gchar * buffer, int buffer_size,
-    GError ** err)
+static gboolean
+gst_dmss_src_unlock_stop (GstBaseSrc * bsrc)
 {
-  int offset = 0;
-  while (offset != buffer_size && buffer[offset] != '\r')
-    ++offset;
+  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
 
-  return offset;
+  GST_DEBUG_OBJECT (src, "unlock_stop");
+  g_cancellable_reset (src->cancellable);
+  if (src->io_stream)
+    gst_dmss_io_stream_set_flushing (src->io_stream, FALSE);
+
+  return TRUE;
 }
 
-static gchar *
-gst_dmss_src_new_protocol_find_prefix (GstDmssSrc * src, gchar * buffer,
-    int buffer_size, gchar * prefix, int prefix_size, GError ** err)
+/* Answers a "dmss-recordings" query with what channel recorded between
+ * its "start-time" and "end-time", asking the device only about the part
+ * that was never searched.
+ */
+static gboolean
+gst_dmss_src_query_recordings (GstDmssSrc * src, GstQuery * query)
 {
-  int offset = 0;
+  GstStructure *structure = gst_query_writable_structure (query);
+  GstDmssSession *session = NULL;
+  GValue recordings = G_VALUE_INIT, value = G_VALUE_INIT;
+  GstDmssRecord *record;
+  GError *err = NULL;
+  GArray *records;
+  gchar *start_time, *end_time;
+  gint64 start, end;
+  guint i;
+
+  if (!gst_dmss_record_index_parse_time (gst_structure_get_string (structure,
+              "start-time"), &start)
+      || !gst_dmss_record_index_parse_time (gst_structure_get_string
+          (structure, "end-time"), &end) || end <= start)
+    return FALSE;
+
+  GST_OBJECT_LOCK (src);
+  if (src->session)
+    session = gst_dmss_session_ref (src->session);
+  GST_OBJECT_UNLOCK (src);
+  if (!session)
+    return FALSE;
 
-  while (buffer_size - offset > prefix_size
-      && memcmp (&buffer[offset], prefix, prefix_size)) {
-    GST_DEBUG_OBJECT (src, "Not found at %s", &buffer[offset]);
-    while (buffer[offset] != '\n' && buffer_size != offset)
-      ++offset;
-    if (buffer_size != offset)
-      ++offset;
+  if (!gst_dmss_session_refresh_records (session, src->channel, start, end,
+          src->cancellable, &err)) {
+    GST_WARNING_OBJECT (src, "Failed to find recordings: %s", err->message);
+    g_error_free (err);
+    gst_dmss_session_unref (session);
+    return FALSE;
   }
 
-  if (buffer_size - offset <= prefix_size)
-    goto error;
+  records = gst_dmss_record_index_query (gst_dmss_session_get_record_index
+      (session), src->channel, start, end);
+  gst_dmss_session_unref (session);
+
+  g_value_init (&recordings, GST_TYPE_ARRAY);
+  for (i = 0; i != records->len; ++i) {
+    record = &g_array_index (records, GstDmssRecord, i);
+    start_time = gst_dmss_record_index_format_time (record->start_time);
+    end_time = gst_dmss_record_index_format_time (record->end_time);
+
+    g_value_init (&value, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&value, gst_structure_new ("dmss-recording",
+            "drive-no", G_TYPE_UINT, record->disk,
+            "cluster-no", G_TYPE_UINT, record->cluster,
+            "start-time", G_TYPE_STRING, start_time,
+            "end-time", G_TYPE_STRING, end_time,
+            "length", G_TYPE_UINT64, record->length,
+            "file-path", G_TYPE_STRING, record->file_path, NULL));
+    gst_value_array_append_and_take_value (&recordings, &value);
+    memset (&value, 0, sizeof (value));
+
+    g_free (start_time);
+    g_free (end_time);
+  }
+  g_array_unref (records);
 
-  offset += prefix_size;
+  gst_structure_take_value (structure, "recordings", &recordings);
 
-  return &buffer[offset];
-error:
-  return NULL;
+  return TRUE;
 }
 
-static int
-gst_dmss_src_new_protocol_link_subchannel (GstDmssSrc * src, GError ** err)
+static gboolean
+gst_dmss_src_query (GstBaseSrc * bsrc, GstQuery * query)
 {
-  gchar ack_subchannel_template[] =
-      "TransactionID:2\r\n"
-      "Method:GetParameterNames\r\n"
-      "ParameterName:Dahua.Device.Network.ControlConnection.AckSubChannel\r\n"
-      "SessionID:%d\r\n" "ConnectionID:%s\r\n" "\r\n";
-  gchar *new_command_buffer = NULL;
-  int buffer_size = 0;
-  gchar extension_recv[255] = { 0, };
-  gint offset, size;
+  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
+  GstClockTime duration;
+  GstFormat format;
 
-  buffer_size = gst_dmss_protocol_create_new_packet (new_command_buffer, 0,
-      ack_subchannel_template, src->session_id, src->connection_id);
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CUSTOM
+      && gst_structure_has_name (gst_query_get_structure (query),
+          "dmss-recordings"))
+    return gst_dmss_src_query_recordings (src, query);
 
-  new_command_buffer = g_malloc (buffer_size + 1);
+  // the range is only known once started
+  if (src->mode == GST_DMSS_SRC_MODE_LIVE
+      || src->playback_end <= src->playback_start)
+    return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
 
-  buffer_size = gst_dmss_protocol_create_new_packet (new_command_buffer,
-      buffer_size, ack_subchannel_template, src->session_id,
-      src->connection_id);
+  duration = (src->playback_end - src->playback_start) * GST_SECOND;
 
-  new_command_buffer[buffer_size] = 0;
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_DURATION:
+      gst_query_parse_duration (query, &format, NULL);
+      if (format != GST_FORMAT_TIME)
+        break;
+      gst_query_set_duration (query, GST_FORMAT_TIME, duration);
+      return TRUE;
+    case GST_QUERY_SEEKING:
+      gst_query_parse_seeking (query, &format, NULL, NULL, NULL);
+      if (format != GST_FORMAT_TIME)
+        break;
+      gst_query_set_seeking (query, GST_FORMAT_TIME, TRUE, 0, duration);
+      return TRUE;
+    default:
+      break;
+  }
 
-  GST_DEBUG_OBJECT (src, " Sending new packet with body\n%s\n",
-      (new_command_buffer + 32));
+  return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
+}
 
-  // send stream start command
-  if (!g_socket_send (src->stream_socket, new_command_buffer,
-          buffer_size, src->cancellable, err))
-    goto error;
+static gboolean
+gst_dmss_src_is_seekable (GstBaseSrc * bsrc)
+{
+  return GST_DMSS_SRC (bsrc)->mode != GST_DMSS_SRC_MODE_LIVE;
+}
 
-  if ((buffer_size =
-          gst_dmss_receive_packet_no_body (src->stream_socket, src->cancellable,
-              err, new_command_buffer)) < 0)
-    goto error;
+/* The device has no seek command, so playback is restarted at the new
+ * position and rate by the next create. Reverse playback starts at the
+ * stop of the segment, or the end of the range without one.
+ */
+static gboolean
+gst_dmss_src_do_seek (GstBaseSrc * bsrc, GstSegment * segment)
+{
+  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
+  GstClockTime duration, position;
 
-  GST_DEBUG_OBJECT (src, "Ack subchannel header response");
+  if (src->mode == GST_DMSS_SRC_MODE_LIVE)
+    return GST_BASE_SRC_CLASS (parent_class)->do_seek (bsrc, segment);
 
-  g_free (new_command_buffer);
+  if (segment->format != GST_FORMAT_TIME)
+    return FALSE;
 
-  offset = 0;
-  do {
-    if ((size = g_socket_receive (src->stream_socket, &extension_recv[offset],
-                buffer_size - offset, src->cancellable, err)) <= 0) {
-      if (!*err && !size)
-        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      goto error;
+  // download mode hands out whole files as fast as they come
+  if (src->mode == GST_DMSS_SRC_MODE_DOWNLOAD && segment->rate != 1.0)
+    return FALSE;
+
+  duration = src->playback_end > src->playback_start ?
+      (src->playback_end - src->playback_start) * GST_SECOND :
+      GST_CLOCK_TIME_NONE;
+
+  if (segment->rate < 0) {
+    position = GST_CLOCK_TIME_IS_VALID (segment->stop) ? segment->stop :
+        duration;
+    if (GST_CLOCK_TIME_IS_VALID (duration))
+      position = MIN (position, duration);
+  } else {
+    position = segment->start;
+    if (GST_CLOCK_TIME_IS_VALID (duration) && position >= duration) {
+      GST_WARNING_OBJECT (src, "Seek to %" GST_TIME_FORMAT
+          " is past the end of the range", GST_TIME_ARGS (position));
+      return FALSE;
     }
+  }
 
-    offset += size;
-  } while (offset != buffer_size);
+  GST_DEBUG_OBJECT (src, "Seeking to %" GST_TIME_FORMAT " at rate %f",
+      GST_TIME_ARGS (position), segment->rate);
 
-  GST_DEBUG_OBJECT (src, "ack subchannel response %s", extension_recv);
+  if (position != src->playback_position
+      || segment->rate != src->playback_rate) {
+    src->playback_seek = position;
+    src->playback_seek_rate = segment->rate;
+  }
 
-  return 0;
-error:
-  return -1;
+  return TRUE;
 }
 
-static int
-gst_dmss_src_add_object (GstDmssSrc * src, GError ** err)
+static gboolean
+gst_dmss_src_receive_exact (GstDmssSrc * src, GSocket * socket,
+    gchar * buffer, gsize size, GError ** err)
 {
-  gchar cmd_buffer[]
-      =
-      "\xf4\x00\x00\x00"
-      "\x76\x00\x00\x00"
-      "\x00\x00\x00\x00"
-      "\x00\x00\x00\x00"
-      "\x00\x00\x00\x00"
-      "\x00\x00\x00\x00"
-      "\x00\x00\x00\x00"
-      "\x00\x00\x00\x00"
-      "TransactionID:1\r\n"
-      "Method:AddObject\r\n"
-      "ParameterName:Dahua.Device.Network.ControlConnection.Passive\r\n"
-      "ConnectProtocol:0\r\n\r\n";
-  gchar extension_recv[255] = { 0, };
-  int buffer_size;
-  gchar error_status[] = "FaultCode:";
-  gchar connection_id_prefix[] = "ConnectionID:";
-  gchar ok_status[] = "OK";
-  int offset;
-  int size;
-  gchar *status_buffer;
-  gchar *connection_id_buffer;
-  int connection_id_value_size;
-
-  if (!g_socket_send (src->control_socket, cmd_buffer,
-          sizeof (cmd_buffer) - 1, src->cancellable, err))
-    goto error;
+  gssize received;
+  gsize offset = 0;
+
+  while (offset != size) {
+    src->syscalls++;
+    if ((received = g_socket_receive (socket, &buffer[offset], size - offset,
+                src->cancellable, err)) <= 0) {
+      if (!*err && !received)
+        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+            "Connection closed by remote peer");
+      return FALSE;
+    }
+    offset += received;
+  }
 
-  GST_DEBUG_OBJECT (src, "Sent add object");
+  return TRUE;
+}
 
-  if ((buffer_size =
-          gst_dmss_receive_packet_no_body (src->control_socket,
-              src->cancellable, err, cmd_buffer)) < 0)
-    goto error;
+/* Pool buffers are sized to hold DMSS_HISTOGRAM_PERCENTILE percent of the
+ * packets seen lately. Bucket i counts bodies smaller than 1 << i.
+ */
+static gsize
+gst_dmss_src_histogram_suggest_size (GstDmssSrc * src)
+{
+  guint i, count = 0, threshold;
 
-  GST_DEBUG_OBJECT (src, "Received header response");
+  if (!src->body_size_samples)
+    return DMSS_POOL_DEFAULT_BUFFER_SIZE;
 
-  if ((unsigned char) cmd_buffer[0] == (unsigned char) 0xf4)
-    GST_DEBUG_OBJECT (src,
-        "Received header response with correct cmd with body size: %d",
-        (int) buffer_size);
+  threshold = (src->body_size_samples * DMSS_HISTOGRAM_PERCENTILE + 99) / 100;
+  for (i = 0; i != GST_DMSS_SRC_HISTOGRAM_BUCKETS - 1; ++i) {
+    count += src->body_size_histogram[i];
+    if (count >= threshold)
+      break;
+  }
 
-  if (buffer_size > sizeof (extension_recv))
-    goto error;
+  return 32 + ((gsize) 1 << i);
+}
 
-  offset = 0;
-  do {
-    if ((size = g_socket_receive (src->control_socket, &extension_recv[offset],
-                buffer_size - offset, src->cancellable, err)) <= 0) {
-      if (!*err && !size)
-        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      goto error;
-    }
-    offset += size;
-  } while (offset != buffer_size);
+static void
+gst_dmss_src_histogram_add (GstDmssSrc * src, gsize body_size)
+{
+  guint i, bucket;
+  gsize suggested;
 
-  GST_DEBUG_OBJECT (src, "Received body of response %s", extension_recv);
+  bucket = MIN (g_bit_storage (body_size), GST_DMSS_SRC_HISTOGRAM_BUCKETS - 1);
+  src->body_size_histogram[bucket]++;
 
-  offset = 0;
-  // search for line with error status
-  status_buffer =
-      gst_dmss_src_new_protocol_find_prefix (src, extension_recv, buffer_size,
-      error_status, sizeof (error_status) - 1, err);
+  if (++src->body_size_samples < DMSS_HISTOGRAM_DECAY_SAMPLES)
+    return;
 
-  GST_DEBUG_OBJECT (src, "Found prefix at %s", status_buffer);
+  // halve every bucket so the histogram follows bitrate changes
+  src->body_size_samples = 0;
+  for (i = 0; i != GST_DMSS_SRC_HISTOGRAM_BUCKETS; ++i) {
+    src->body_size_histogram[i] /= 2;
+    src->body_size_samples += src->body_size_histogram[i];
+  }
 
-  if (!status_buffer
-      || buffer_size - (status_buffer - extension_recv) <
-      sizeof (ok_status) - 1)
-    goto error_status;
+  suggested = gst_dmss_src_histogram_suggest_size (src);
+  if (suggested > src->pool_buffer_size
+      || suggested < src->pool_buffer_size / 4) {
+    GST_DEBUG_OBJECT (src, "Pool buffers of %" G_GSIZE_FORMAT
+        " bytes don't fit packet sizes anymore, renegotiating for %"
+        G_GSIZE_FORMAT, src->pool_buffer_size, suggested);
+    gst_pad_mark_reconfigure (GST_BASE_SRC_PAD (src));
+  }
+}
 
-  if (memcmp (status_buffer, ok_status, sizeof (ok_status) - 1))
-    goto error_status;
+static gboolean
+gst_dmss_src_decide_allocation (GstBaseSrc * bsrc, GstQuery * query)
+{
+  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
+  GstBufferPool *pool;
+  GstStructure *config;
+  GstAllocator *allocator = NULL;
+  GstAllocationParams params;
+  GstCaps *caps;
+  guint size, min, max;
+
+  if (src->receive_mode != GST_DMSS_SRC_RECEIVE_MODE_POOL)
+    return GST_BASE_SRC_CLASS (parent_class)->decide_allocation (bsrc, query);
+
+  size = gst_dmss_src_histogram_suggest_size (src);
+  min = DMSS_POOL_MIN_BUFFERS;
+  max = 0;
+
+  if (gst_query_get_n_allocation_params (query) > 0)
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+  else
+    gst_allocation_params_init (&params);
+
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    guint downstream_min, downstream_max;
+
+    gst_query_parse_nth_allocation_pool (query, 0, NULL, NULL,
+        &downstream_min, &downstream_max);
+    min = MAX (min, downstream_min);
+    max = downstream_max && downstream_max < min ? min : downstream_max;
+  }
 
-  GST_DEBUG_OBJECT (src, "Value is OK");
+  // the socket reads straight into these buffers, so always use a plain
+  // pool of system memory instead of whatever downstream proposed
+  pool = gst_buffer_pool_new ();
+  gst_query_parse_allocation (query, &caps, NULL);
 
-  // search for line with connectionId
-  connection_id_buffer =
-      gst_dmss_src_new_protocol_find_prefix (src, extension_recv, buffer_size,
-      connection_id_prefix, sizeof (connection_id_prefix) - 1, err);
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min, max);
+  gst_buffer_pool_config_set_allocator (config, allocator, &params);
+  if (allocator)
+    gst_object_unref (allocator);
 
-  GST_DEBUG_OBJECT (src, "Found prefix at %s", connection_id_buffer);
+  if (!gst_buffer_pool_set_config (pool, config)) {
+    GST_ERROR_OBJECT (src, "Failed to configure buffer pool");
+    gst_object_unref (pool);
+    return FALSE;
+  }
 
-  if (!connection_id_buffer)
-    goto error_status;
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
 
-  connection_id_value_size =
-      gst_dmss_src_new_protocol_find_value_size (connection_id_buffer,
-      buffer_size - (connection_id_buffer - extension_recv), err);
+  GST_DEBUG_OBJECT (src, "Using pool of %u buffers of %u bytes", min, size);
 
-  memcpy (src->connection_id, connection_id_buffer,
-      connection_id_value_size <
-      sizeof (connection_id_prefix) ? connection_id_value_size :
-      sizeof (connection_id_prefix) - 1);
+  if (src->pool)
+    gst_object_unref (src->pool);
+  src->pool = pool;
+  src->pool_buffer_size = size;
 
-  return sizeof (cmd_buffer);
-error:
-  return -1;
-error_status:
-  return -1;
+  return TRUE;
 }
 
-static gboolean
-gst_dmss_src_start (GstBaseSrc * bsrc)
+static GstFlowReturn
+gst_dmss_src_receive_pooled (GstDmssSrc * src, GstBuffer ** outbuf,
+    GError ** err)
 {
-  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
-  GError *err = NULL;
-  GInetAddress *addr;
-  GSocketAddress *saddr;
-  GResolver *resolver;
-  guint32 const userpass_size = 2 + strlen (src->user) + strlen (src->password);
-  gchar login_buffer[32]
-      = {
-    0xa0, 0x00, 0x00, 0x60,
-    (userpass_size & 0x000000FF),
-    (userpass_size & 0x0000FF00) >> 8,
-    (userpass_size & 0x00FF0000) >> 16,
-    (userpass_size & 0xFF000000) >> 24,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0x04, 0x02, 0x03, 0x00, 0x01, 0xa1, 0xaa
-  };
-  static gchar const noop_buffer[32]
-      = {
-    0xa1, 0,
-  };
-  gchar const stream_start_template[] =
-      "TransactionID:100\r\n"
-      "Method:GetParameterNames\r\n"
-      "ParameterName:Dahua.Device.Network.Monitor.General\r\n"
-      "channel:%d\r\n"
-      "state:1\r\n" "ConnectionID:%s\r\n" "stream:%d\r\n" "\r\n";
-  gchar *new_command_buffer;
-  gchar login_separator[2] = { '&', '&' };
-  gchar prefix_buffer[32];
-  gssize receive_size;
-  gchar login_symbol[4];
-  int size;
-
-  /* look up name if we need to */
-  addr = g_inet_address_new_from_string (src->host);
-  if (!addr) {
-    GList *results;
-
-    resolver = g_resolver_get_default ();
-
-    results =
-        g_resolver_lookup_by_name (resolver, src->host, src->cancellable, &err);
-    if (!results)
-      goto name_resolve;
-    addr = G_INET_ADDRESS (g_object_ref (results->data));
-
-    g_resolver_free_addresses (results);
-    g_object_unref (resolver);
+  GstFlowReturn ret;
+  GstBuffer *buffer, *bigger;
+  GstMapInfo map;
+  gsize body_size;
+
+  if (src->pool) {
+    if ((ret = gst_buffer_pool_acquire_buffer (src->pool, &buffer,
+                NULL)) != GST_FLOW_OK)
+      return ret;
+  } else
+    buffer = gst_buffer_new_allocate (NULL, DMSS_POOL_DEFAULT_BUFFER_SIZE,
+        NULL);
+
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+
+  // prologue goes straight into the pool buffer
+  if (!gst_dmss_src_receive_exact (src, src->stream_socket,
+          (gchar *) map.data, 32, err))
+    goto error;
+
+  body_size = GUINT16_FROM_LE (*(guint16 *) & map.data[4]);
+  gst_dmss_src_histogram_add (src, body_size);
+
+  if (32 + body_size > map.size) {
+    GST_DEBUG_OBJECT (src, "Packet body of %" G_GSIZE_FORMAT
+        " bytes doesn't fit pool buffer of %" G_GSIZE_FORMAT, body_size,
+        map.size);
+    bigger = gst_buffer_new_allocate (NULL, 32 + body_size, NULL);
+    gst_buffer_fill (bigger, 0, map.data, 32);
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+    buffer = bigger;
+    gst_buffer_map (buffer, &map, GST_MAP_WRITE);
   }
-#ifndef GST_DISABLE_GST_DEBUG
-  {
-    gchar *ip = g_inet_address_to_string (addr);
 
-    GST_DEBUG_OBJECT (src, "IP address for host %s is %s", src->host, ip);
-    g_free (ip);
+  if (!gst_dmss_src_receive_exact (src, src->stream_socket,
+          (gchar *) & map.data[32], body_size, err))
+    goto error;
+
+  gst_buffer_unmap (buffer, &map);
+  gst_buffer_set_size (buffer, 32 + body_size);
+
+#if 1
+  src->bytes_downloaded += 32 + body_size;
+#endif
+  *outbuf = buffer;
+  return GST_FLOW_OK;
+error:
+  gst_buffer_unmap (buffer, &map);
+  gst_buffer_unref (buffer);
+  return GST_FLOW_ERROR;
+}
+
+/* Starts following the frames of a new playback request */
+static void
+gst_dmss_src_reset_checkpoints (GstDmssSrc * src)
+{
+  src->stream_offset = src->frame_start = 0;
+  src->frame_header_filled = 0;
+  src->frame_remaining = 0;
+  src->checkpoint_offset = 0;
+  src->checkpoint_time = src->playback_start + src->playback_position /
+      GST_SECOND;
+  src->resume_offset = src->resume_skip = 0;
+  src->resume_check = FALSE;
+  src->hangup_resumed = FALSE;
+}
+
+/* Drops the kept frame header up to the next "DHAV" in it, keeping its
+ * last bytes when there is none as they may begin one.
+ */
+static void
+gst_dmss_src_resync_frames (GstDmssSrc * src)
+{
+  gsize skip;
+
+  skip = 1 + gst_dmss_dhav_scan (&src->frame_header[1],
+      src->frame_header_filled - 1);
+  if (skip == src->frame_header_filled)
+    skip -= 3;
+  memmove (src->frame_header, &src->frame_header[skip],
+      src->frame_header_filled - skip);
+  src->frame_header_filled -= skip;
+  src->frame_start += skip;
+}
+
+/* Follows the DHAV frames in the bytes of a recording. A frame header can
+ * straddle packets, so its first bytes are kept until size and time are
+ * complete, and so are its last ones until the trailer confirms the size.
+ * Only a frame that checks out moves the checkpoint, anything else is
+ * skipped up to the next "DHAV".
+ */
+static void
+gst_dmss_src_track_frames (GstDmssSrc * src, const guint8 * data, gsize size)
+{
+  const gsize header_size = sizeof (src->frame_header);
+  const gsize trailer_size = sizeof (src->frame_trailer);
+  guint32 frame_size;
+  gsize n, skip;
+
+  while (size) {
+    if (src->frame_header_filled < header_size) {
+      if (!src->frame_header_filled) {
+        skip = gst_dmss_dhav_scan (data, size);
+        if (skip == size)
+          skip = size > 3 ? size - 3 : 0;
+        src->stream_offset += skip;
+        data += skip;
+        size -= skip;
+        src->frame_start = src->stream_offset;
+      }
+      n = MIN (size, header_size - src->frame_header_filled);
+      memcpy (&src->frame_header[src->frame_header_filled], data, n);
+      src->frame_header_filled += n;
+      src->stream_offset += n;
+      data += n;
+      size -= n;
+      if (src->frame_header_filled < header_size)
+        break;
+
+      frame_size = GST_READ_UINT32_LE (&src->frame_header[12]);
+      if (memcmp (src->frame_header, "DHAV", 4)
+          || frame_size < 32 || frame_size > GST_DMSS_DHAV_MAX_FRAME_SIZE) {
+        gst_dmss_src_resync_frames (src);
+        continue;
+      }
+      src->frame_remaining = frame_size - header_size;
+    }
+
+    n = MIN (size, src->frame_remaining);
+    // the last bytes of the frame are its trailer
+    if (src->frame_remaining - n < trailer_size) {
+      skip = src->frame_remaining > trailer_size ?
+          src->frame_remaining - trailer_size : 0;
+      memcpy (&src->frame_trailer[trailer_size - (src->frame_remaining -
+                  skip)], &data[skip], n - skip);
+    }
+    src->frame_remaining -= n;
+    src->stream_offset += n;
+    data += n;
+    size -= n;
+
+    if (!src->frame_remaining) {
+      frame_size = GST_READ_UINT32_LE (&src->frame_header[12]);
+      if (!memcmp (src->frame_trailer, "dhav", 4)
+          && GST_READ_UINT32_LE (&src->frame_trailer[4]) == frame_size) {
+        src->checkpoint_offset = src->stream_offset;
+        src->checkpoint_time =
+            gst_dmss_protocol_dhav_time (GST_READ_UINT32_LE
+            (&src->frame_header[16]));
+        src->hangup_resumed = FALSE;
+      } else {
+        GST_LOG_OBJECT (src, "No trailer for the frame at %" G_GUINT64_FORMAT,
+            src->frame_start);
+      }
+      src->frame_header_filled = 0;
+    }
   }
+}
+
+/* Tracks a packet of a recording. After a resume it also drops the bytes
+ * downstream already got, which can leave *buffer NULL, and makes sure
+ * the device really picked up at the checkpoint.
+ */
+static GstFlowReturn
+gst_dmss_src_track_recording (GstDmssSrc * src, GstBuffer ** buffer,
+    GError ** err)
+{
+  GstBuffer *trimmed = NULL;
+  GstMapInfo map;
+  const guint8 *body, *expected;
+  guint8 prologue[32];
+  gsize body_size, expected_size, skip;
+
+  gst_buffer_map (*buffer, &map, GST_MAP_READ);
+  if (map.size <= sizeof (prologue) || map.data[0] != 0xbc) {
+    gst_buffer_unmap (*buffer, &map);
+    return GST_FLOW_OK;
+  }
+  body = &map.data[sizeof (prologue)];
+  body_size = map.size - sizeof (prologue);
+
+  // devices that ignore OffLength start over from StartTime, so the
+  // stream has to begin with the frame that was cut
+  if (src->resume_check) {
+    src->resume_check = FALSE;
+    if (src->frame_start == src->checkpoint_offset
+        && src->frame_header_filled >= 4) {
+      expected = src->frame_header;
+      expected_size = src->frame_header_filled;
+    } else {
+      expected = (const guint8 *) "DHAV";
+      expected_size = 4;
+    }
+    if (memcmp (body, expected, MIN (expected_size, body_size))) {
+      gst_buffer_unmap (*buffer, &map);
+      gst_buffer_unref (*buffer);
+      *buffer = NULL;
+      src->offset_resume = FALSE;
+      g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+          "Device did not resume at the requested offset");
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  skip = MIN (src->resume_skip, body_size);
+  src->resume_skip -= skip;
+  gst_dmss_src_track_frames (src, &body[skip], body_size - skip);
+
+  if (!skip) {
+    gst_buffer_unmap (*buffer, &map);
+    return GST_FLOW_OK;
+  }
+
+  GST_LOG_OBJECT (src, "Dropping %" G_GSIZE_FORMAT " bytes already pushed",
+      skip);
+  if (skip < body_size) {
+    memcpy (prologue, map.data, sizeof (prologue));
+    GST_WRITE_UINT16_LE (&prologue[4], body_size - skip);
+    trimmed = gst_buffer_new_allocate (NULL, map.size - skip, NULL);
+    gst_buffer_fill (trimmed, 0, prologue, sizeof (prologue));
+    gst_buffer_fill (trimmed, sizeof (prologue), &body[skip],
+        body_size - skip);
+  }
+  gst_buffer_unmap (*buffer, &map);
+  gst_buffer_unref (*buffer);
+  *buffer = trimmed;
+
+  return GST_FLOW_OK;
+}
+
+/* Read-ahead chunks are plain refcounted memory blocks. Every packet sliced
+ * out of a chunk is a read-only buffer wrapping its range and holding a
+ * reference, so the chunk goes away with the last packet pushed from it.
+ */
+struct _GstDmssSrcChunk
+{
+  gint refcount;
+  gsize size;
+  guint8 data[1];
+};
+
+static struct _GstDmssSrcChunk *
+gst_dmss_src_chunk_new (gsize size)
+{
+  struct _GstDmssSrcChunk *chunk;
+
+  chunk = g_malloc (G_STRUCT_OFFSET (struct _GstDmssSrcChunk, data) + size);
+  chunk->refcount = 1;
+  chunk->size = size;
+
+  return chunk;
+}
+
+static void
+gst_dmss_src_chunk_unref (gpointer data)
+{
+  struct _GstDmssSrcChunk *chunk = data;
+
+  if (g_atomic_int_dec_and_test (&chunk->refcount))
+    g_free (chunk);
+}
+
+static GstFlowReturn
+gst_dmss_src_receive_read_ahead (GstDmssSrc * src, GstBuffer ** outbuf,
+    GError ** err)
+{
+  struct _GstDmssSrcChunk *chunk, *next;
+  GstBufferList *list = NULL;
+  GstBuffer *buffer;
+  gsize available, packet_size;
+  gssize received;
+
+  while (TRUE) {
+    chunk = src->chunk;
+
+    // slice out every complete packet we already have
+    while (chunk && (available = src->chunk_filled - src->chunk_parsed) >= 32) {
+      packet_size = 32 +
+          GUINT16_FROM_LE (*(guint16 *) & chunk->data[src->chunk_parsed + 4]);
+      if (available < packet_size)
+        break;
+
+      g_atomic_int_inc (&chunk->refcount);
+      buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+          chunk->data, chunk->size, src->chunk_parsed, packet_size, chunk,
+          gst_dmss_src_chunk_unref);
+      src->chunk_parsed += packet_size;
+
+      if (src->mode != GST_DMSS_SRC_MODE_LIVE
+          && gst_dmss_src_track_recording (src, &buffer,
+              err) != GST_FLOW_OK) {
+        if (list)
+          gst_buffer_list_unref (list);
+        return GST_FLOW_ERROR;
+      }
+      if (!buffer)
+        continue;
+
+      if (!list)
+        list = gst_buffer_list_new ();
+      gst_buffer_list_add (list, buffer);
+    }
+
+    if (list)
+      break;
+
+    available = chunk ? src->chunk_filled - src->chunk_parsed : 0;
+    packet_size = available >= 32 ? 32 +
+        GUINT16_FROM_LE (*(guint16 *) & chunk->data[src->chunk_parsed + 4])
+        : 32;
+
+    // start a new chunk when the pending packet can't be completed in this
+    // one, carrying over only its partial bytes
+    if (!chunk || chunk->size - src->chunk_parsed < packet_size) {
+      next = gst_dmss_src_chunk_new (MAX (src->read_ahead_size, packet_size));
+      if (available)
+        memcpy (next->data, &chunk->data[src->chunk_parsed], available);
+      if (chunk)
+        gst_dmss_src_chunk_unref (chunk);
+      src->chunk = chunk = next;
+      src->chunk_parsed = 0;
+      src->chunk_filled = available;
+    }
+
+    src->syscalls++;
+    if ((received = g_socket_receive (src->stream_socket,
+                (gchar *) & chunk->data[src->chunk_filled],
+                chunk->size - src->chunk_filled, src->cancellable, err)) <= 0) {
+      if (!*err && !received)
+        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+            "Connection closed by remote peer");
+      return GST_FLOW_ERROR;
+    }
+
+    GST_LOG_OBJECT (src, "Read ahead %" G_GSSIZE_FORMAT " bytes", received);
+    src->chunk_filled += received;
+#if 1
+    src->bytes_downloaded += received;
 #endif
+  }
 
-  saddr = g_inet_socket_address_new (addr, src->port);
-  g_object_unref (addr);
+  GST_LOG_OBJECT (src, "Submitting list of %u packets",
+      gst_buffer_list_length (list));
+  if (src->discont) {
+    GST_BUFFER_FLAG_SET (gst_buffer_list_get (list, 0),
+        GST_BUFFER_FLAG_DISCONT);
+    src->discont = FALSE;
+  }
+  gst_base_src_submit_buffer_list (GST_BASE_SRC (src), list);
+  *outbuf = NULL;
 
-  /* create receiving client socket */
-  GST_DEBUG_OBJECT (src, "opening receiving control socket to %s:%d",
-      src->host, src->port);
+  return GST_FLOW_OK;
+}
 
-  g_assert (src->control_socket == NULL);
-  g_assert (src->stream_socket == NULL);
+static GstFlowReturn
+gst_dmss_src_receive_shared (GstDmssSrc * src, GstBuffer ** outbuf,
+    GError ** err)
+{
+  GstFlowReturn ret;
 
-  src->control_socket =
-      g_socket_new (g_socket_address_get_family (saddr), G_SOCKET_TYPE_STREAM,
-      G_SOCKET_PROTOCOL_TCP, &err);
-  if (!src->control_socket)
-    goto no_socket;
+  ret = gst_dmss_io_stream_pop (src->io_stream, outbuf, err);
+  src->syscalls += gst_dmss_io_stream_take_syscalls (src->io_stream);
+  if (ret != GST_FLOW_OK)
+    return ret;
 
-  g_socket_set_timeout (src->control_socket, src->timeout);
+  GST_LOG_OBJECT (src, "Popped packet of %" G_GSIZE_FORMAT " bytes",
+      gst_buffer_get_size (*outbuf));
+#if 1
+  src->bytes_downloaded += gst_buffer_get_size (*outbuf);
+#endif
 
-  GST_DEBUG_OBJECT (src, "opened receiving control socket");
+  return GST_FLOW_OK;
+}
 
-  /* connect to server */
-  if (!g_socket_connect (src->control_socket, saddr, src->cancellable, &err))
-    goto connect_failed;
+static GstFlowReturn
+gst_dmss_src_receive_uring (GstDmssSrc * src, GstBuffer ** outbuf,
+    GError ** err)
+{
+  GstFlowReturn ret;
 
-  g_object_unref (saddr);
+  ret = gst_dmss_uring_receive_packet (src->uring, outbuf, err);
+  src->syscalls += gst_dmss_uring_take_syscalls (src->uring);
+  if (ret != GST_FLOW_OK)
+    return ret;
 
-  // go for authentication
-  if (!g_socket_send (src->control_socket, login_buffer, sizeof (login_buffer),
-          src->cancellable, &err))
-    goto login_error;
+  GST_LOG_OBJECT (src, "Received packet of %" G_GSIZE_FORMAT
+      " bytes from io_uring", gst_buffer_get_size (*outbuf));
+#if 1
+  src->bytes_downloaded += gst_buffer_get_size (*outbuf);
+#endif
 
-  if (!g_socket_send (src->control_socket, src->user, strlen (src->user),
-          src->cancellable, &err))
-    goto login_error;
+  return GST_FLOW_OK;
+}
 
-  if (!g_socket_send (src->control_socket, login_separator,
-          sizeof (login_separator), src->cancellable, &err))
-    goto login_error;
+/* Receives the next packet in whatever receive mode is configured */
+static GstFlowReturn
+gst_dmss_src_receive_packet (GstDmssSrc * src, GstBuffer ** outbuf,
+    GError ** err)
+{
+  gssize body_size;
+  gchar prologue[32];
+  GstMapInfo map;
 
-  if (!g_socket_send (src->control_socket, src->password,
-          strlen (src->password), src->cancellable, &err))
-    goto login_error;
+  // io-uring falls back to copy when the ring could not be set up
+  if (src->receive_mode != GST_DMSS_SRC_RECEIVE_MODE_COPY
+      && (src->receive_mode != GST_DMSS_SRC_RECEIVE_MODE_IO_URING
+          || src->uring)) {
+    if (src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_POOL)
+      return gst_dmss_src_receive_pooled (src, outbuf, err);
+    else if (src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_SHARED)
+      return gst_dmss_src_receive_shared (src, outbuf, err);
+    else if (src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_IO_URING)
+      return gst_dmss_src_receive_uring (src, outbuf, err);
+    else
+      return gst_dmss_src_receive_read_ahead (src, outbuf, err);
+  }
 
-  GST_DEBUG_OBJECT (src,
-      "sent authentication info, waiting authentication response");
+  GST_INFO_OBJECT (src, "Receiving data from socket with blocking");
+  if (!gst_dmss_src_receive_exact (src, src->stream_socket, prologue,
+          sizeof (prologue), err)) {
+    GST_ERROR_OBJECT (src, "Error receiving header");
+    return GST_FLOW_ERROR;
+  }
+  GST_INFO_OBJECT (src, "Received header");
 
-  receive_size = sizeof (prefix_buffer);
-  if (gst_dmss_receive_packet (src->control_socket, src->cancellable, &err,
-          prefix_buffer, &receive_size) < 0)
-    goto login_error;
+  body_size = GUINT16_FROM_LE (*(guint16 *) & prologue[4]);
 
-  g_assert (receive_size == sizeof (prefix_buffer));
+  //gst_dmss_debug_print_prologue(prologue);
+  GST_INFO_OBJECT (src,
+      "Received prologue packet with command %.02x. body size %d",
+      (unsigned int) (unsigned char) prologue[0], (int) body_size);
 
-  memcpy (login_symbol, &prefix_buffer[16], sizeof (login_symbol));
-  src->session_id = GUINT32_FROM_LE (*(guint32 *) login_symbol);
+#if 1
+  src->bytes_downloaded += sizeof (prologue) + body_size;
+#endif
+  *outbuf = gst_buffer_new_and_alloc (sizeof (prologue) + body_size);
+  gst_buffer_map (*outbuf, &map, GST_MAP_READWRITE);
 
-  if (prefix_buffer[8])
-    goto authentication_error;
+  memcpy (map.data, prologue, sizeof (prologue));
 
-  GST_DEBUG_OBJECT (src, "authenticated in control socket");
+  GST_INFO_OBJECT (src, "Receiving data from socket with blocking (2)");
+  if (!gst_dmss_src_receive_exact (src, src->stream_socket,
+          (gchar *) & map.data[sizeof (prologue)], body_size, err)) {
+    GST_ERROR_OBJECT (src, "Error receiving body");
+    gst_buffer_unmap (*outbuf, &map);
+    gst_buffer_unref (*outbuf);
+    *outbuf = NULL;
+    return GST_FLOW_ERROR;
+  }
 
-  // send noop command
-  if (!g_socket_send (src->control_socket, noop_buffer, sizeof (noop_buffer),
-          src->cancellable, &err))
-    goto login_error;
+  GST_INFO_OBJECT (src, "Received body with %d", (int) body_size);
 
-  // wait for response of noop operation
-  do {
-    if (gst_dmss_receive_packet (src->control_socket, src->cancellable, &err,
-            prefix_buffer, &receive_size) < 0)
-      goto login_error;
-    g_assert (receive_size == 32);
+  gst_buffer_unmap (*outbuf, &map);
+  gst_buffer_resize (*outbuf, 0, sizeof (prologue) + body_size);
 
-    GST_DEBUG_OBJECT (src, "package received in control socket with command %d",
-        (unsigned int) (unsigned char) prefix_buffer[0]);
+  GST_INFO_OBJECT (src,
+      "Returning buffer from _get of size %" G_GSIZE_FORMAT ", ts %"
+      GST_TIME_FORMAT ", dur %" GST_TIME_FORMAT
+      ", offset %" G_GINT64_FORMAT ", offset_end %" G_GINT64_FORMAT
+      ", still available bytes in socket: %d",
+      gst_buffer_get_size (*outbuf),
+      GST_TIME_ARGS (GST_BUFFER_TIMESTAMP (*outbuf)),
+      GST_TIME_ARGS (GST_BUFFER_DURATION (*outbuf)),
+      GST_BUFFER_OFFSET (*outbuf), GST_BUFFER_OFFSET_END (*outbuf),
+      (int) g_socket_get_available_bytes (src->stream_socket));
 
-  } while ((unsigned char) prefix_buffer[0] != (unsigned char) 0xb1);
+  return GST_FLOW_OK;
+}
 
-  // connect stream socket
-  GST_DEBUG_OBJECT (src, "opening stream receiving client socket to %s:%d",
-      src->host, src->port);
+/* Receives the next packet to push. Read-ahead tracks recordings on its
+ * own and submits lists, leaving *outbuf NULL.
+ */
+static GstFlowReturn
+gst_dmss_src_receive (GstDmssSrc * src, GstBuffer ** outbuf, GError ** err)
+{
+  GstFlowReturn ret;
+  guint8 time[4];
+
+  if (src->download) {
+    if ((ret = gst_dmss_download_pop (src->download, outbuf,
+                src->cancellable, err)) != GST_FLOW_OK)
+      return ret;
+    src->bytes_downloaded += gst_buffer_get_size (*outbuf);
+    // each buffer is a whole frame, its time is where to resume
+    if (src->prefetched && gst_buffer_extract (*outbuf, 32 + 16, time,
+            sizeof (time)) == sizeof (time)) {
+      src->checkpoint_time =
+          gst_dmss_protocol_dhav_time (GST_READ_UINT32_LE (time));
+      src->hangup_resumed = FALSE;
+    }
+    return ret;
+  }
 
-  src->stream_socket =
-      g_socket_new (g_socket_address_get_family (saddr), G_SOCKET_TYPE_STREAM,
-      G_SOCKET_PROTOCOL_TCP, &err);
-  if (!src->stream_socket)
-    goto no_socket;
+  if (src->mode == GST_DMSS_SRC_MODE_LIVE)
+    return gst_dmss_src_receive_packet (src, outbuf, err);
 
-  g_socket_set_timeout (src->stream_socket, src->timeout);
+  while (TRUE) {
+    if ((ret = gst_dmss_src_receive_packet (src, outbuf, err)) != GST_FLOW_OK
+        || !*outbuf)
+      return ret;
+    if ((ret = gst_dmss_src_track_recording (src, outbuf, err)) != GST_FLOW_OK
+        || *outbuf)
+      return ret;
+  }
+}
 
-  GST_DEBUG_OBJECT (src, "opened receiving stream socket");
-  GST_OBJECT_FLAG_SET (src, GST_DMSS_SRC_CONTROL_OPEN);
+/* Sleeps for the backoff of the given attempt unless flushing. The delay
+ * doubles per attempt up to reconnect-backoff-max, and a random half of
+ * it is dropped so cameras behind one NVR don't reconnect in lockstep.
+ */
+static gboolean
+gst_dmss_src_reconnect_wait (GstDmssSrc * src, guint attempt)
+{
+  GPollFD pollfd;
+  guint64 delay;
+  gint timeout;
+
+  delay = (guint64) src->reconnect_backoff << MIN (attempt, 16);
+  // the property stops at G_MAXINT32, so the jitter range and the poll
+  // timeout stay within a gint
+  delay = MIN (delay, src->reconnect_backoff_max);
+  timeout = delay / 2 + g_random_int_range (0, delay / 2 + 1);
+
+  GST_DEBUG_OBJECT (src, "Waiting %d ms before reconnect attempt %u", timeout,
+      attempt + 1);
+
+  if (!g_cancellable_make_pollfd (src->cancellable, &pollfd)) {
+    g_usleep (timeout * G_USEC_PER_SEC / 1000);
+  } else {
+    g_poll (&pollfd, 1, timeout);
+    g_cancellable_release_fd (src->cancellable);
+  }
 
-  if ((size = gst_dmss_src_add_object (src, &err)) < 0)
-    goto login_error;
+  return !g_cancellable_is_cancelled (src->cancellable);
+}
 
-  GST_DEBUG_OBJECT (src, "Added object");
+/* Redoes the handshake after the connection broke. On success a live
+ * downstream gets a fresh segment and the next buffer is flagged DISCONT,
+ * so it drops whatever partial frame it had instead of erroring out.
+ */
+static GstFlowReturn
+gst_dmss_src_reconnect (GstDmssSrc * src, GError ** err)
+{
+  GstSegment segment;
+  guint attempt;
 
-  /* connect to server */
-  if (!g_socket_connect (src->stream_socket, saddr, src->cancellable, &err))
-    goto stream_connect_failed;
+  gst_dmss_src_close (src);
 
-  GST_DEBUG_OBJECT (src, "Stream socket connected");
+  // unsigned so retrying forever can't overflow, compared once known >= 0
+  for (attempt = 0; src->reconnect_attempts < 0
+      || attempt != (guint) src->reconnect_attempts; ++attempt) {
+    g_clear_error (err);
 
-  /* memcpy (&stream_link_buffer[8], login_symbol, sizeof (login_symbol)); */
+    if (!gst_dmss_src_reconnect_wait (src, attempt))
+      return GST_FLOW_FLUSHING;
 
-  if (gst_dmss_src_new_protocol_link_subchannel (src, &err) < 0)
-    goto stream_auth_failed;
+    if (gst_dmss_src_open (src, err))
+      break;
 
-  GST_DEBUG_OBJECT (src,
-      "linked stream socket. Going to start stream for channel %d and subchannel %d",
-      src->channel, src->subchannel);
+    if (g_error_matches (*err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return GST_FLOW_FLUSHING;
+    GST_WARNING_OBJECT (src, "Reconnect attempt %u failed: %s", attempt + 1,
+        (*err)->message);
+  }
 
-  // should check if response is OK
-  {
-    GST_DEBUG_OBJECT (src,
-        "Starting stream for channel %d and subchannel %d using new protocol",
-        src->channel, src->subchannel);
-
-    size = gst_dmss_protocol_create_new_packet (NULL, 0,
-        stream_start_template, src->channel, src->connection_id,
-        (int) src->subchannel);
-
-    new_command_buffer = g_malloc (size);
-
-    size = gst_dmss_protocol_create_new_packet (new_command_buffer, size,
-        stream_start_template, src->channel, src->connection_id,
-        (int) src->subchannel);
-
-    GST_DEBUG_OBJECT (src, "Sending body %s", new_command_buffer + 32);
-
-    // send stream start command
-    if (!g_socket_send (src->control_socket, new_command_buffer,
-            size, src->cancellable, &err))
-      goto login_error;
-
-    //g_free (new_command_buffer);
-
-    GST_DEBUG_OBJECT (src, "Sent start in new protocol");
-
-    {
-      int offset;
-      int buffer_size;
-      gchar extension_recv[255];
-
-      if ((buffer_size =
-              gst_dmss_receive_packet_no_body (src->control_socket,
-                  src->cancellable, &err, new_command_buffer)) < 0)
-        goto login_error;
-
-      GST_DEBUG_OBJECT (src, "Received header %d", (int) buffer_size);
-
-      if ((unsigned char) new_command_buffer[0] == (unsigned char) 0xf4)
-        GST_DEBUG_OBJECT (src,
-            "Received header response with correct cmd with body size: %d",
-            (int) buffer_size);
-      else
-        GST_DEBUG_OBJECT (src,
-            "Received header response with wrong (?) cmd %d with body size: %d",
-            (unsigned int) (unsigned char) new_command_buffer[0],
-            (int) buffer_size);
-
-      if (buffer_size > sizeof (extension_recv))
-        goto login_error;
-
-      offset = 0;
-      do {
-        if ((size =
-                g_socket_receive (src->control_socket, &extension_recv[offset],
-                    buffer_size - offset, src->cancellable, &err)) <= 0) {
-          if (!err && !size)
-            g_set_error_literal (&err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-                "Read operation timed out");
-          goto login_error;
-        }
-
-        offset += size;
-      } while (offset != buffer_size);
-
-      GST_DEBUG_OBJECT (src, "Received body of response %s", extension_recv);
+  if (!GST_OBJECT_FLAG_IS_SET (src, GST_DMSS_SRC_CONTROL_OPEN))
+    return GST_FLOW_ERROR;
+
+  GST_INFO_OBJECT (src, "Reconnected after %u attempts", attempt + 1);
+
+  gst_element_post_message (GST_ELEMENT (src),
+      gst_message_new_element (GST_OBJECT (src),
+          gst_structure_new ("dmss-reconnected", "attempts", G_TYPE_UINT,
+              attempt + 1, NULL)));
+
+  // recordings resume without a gap, see gst_dmss_src_resume
+  if (src->mode != GST_DMSS_SRC_MODE_LIVE)
+    return GST_FLOW_OK;
+
+  GST_OBJECT_LOCK (src);
+  gst_segment_copy_into (&GST_BASE_SRC (src)->segment, &segment);
+  GST_OBJECT_UNLOCK (src);
+  gst_pad_push_event (GST_BASE_SRC_PAD (src), gst_event_new_segment (&segment));
+
+  src->discont = TRUE;
+
+  return GST_FLOW_OK;
+}
+
+/* Reconnects a recording that broke. Playback is requested again with
+ * OffLength at the end of the last complete frame and the bytes pushed
+ * past it are dropped, so downstream sees one continuous stream. Once a
+ * device ignored OffLength, playback restarts at the second of that frame
+ * instead and the stream is flagged DISCONT for the demuxer to resync. So
+ * does a prefetch that took over, its byte offsets are not followed.
+ */
+static GstFlowReturn
+gst_dmss_src_resume (GstDmssSrc * src, GError ** err)
+{
+  GstFlowReturn ret;
+  gint64 time = src->checkpoint_time;
+  gboolean by_offset;
+
+  // OffLength counts the bytes of a normal forward stream
+  by_offset = src->offset_resume && src->playback_rate == 1.0
+      && !src->prefetched;
+  if (by_offset) {
+    src->resume_offset = src->checkpoint_offset;
+    src->resume_skip = src->stream_offset - src->checkpoint_offset;
+    src->resume_check = TRUE;
+  } else {
+    if (time > src->playback_start)
+      src->playback_position = (time - src->playback_start) * GST_SECOND;
+    gst_dmss_src_reset_checkpoints (src);
+  }
+
+  GST_DEBUG_OBJECT (src, "Resuming at byte %" G_GUINT64_FORMAT
+      ", skipping %" G_GUINT64_FORMAT, src->resume_offset, src->resume_skip);
+
+  if ((ret = gst_dmss_src_reconnect (src, err)) != GST_FLOW_OK)
+    return ret;
+
+  if (!by_offset)
+    src->discont = TRUE;
+
+  gst_element_post_message (GST_ELEMENT (src),
+      gst_message_new_element (GST_OBJECT (src),
+          gst_structure_new ("dmss-resumed", "offset", G_TYPE_UINT64,
+              src->resume_offset, "time", G_TYPE_INT64, time, NULL)));
+
+  return GST_FLOW_OK;
+}
+
+/* Posts how long the whole recording took to arrive, to compare the
+ * download mode with other clients.
+ */
+static void
+gst_dmss_src_post_transfer_stats (GstDmssSrc * src, GstClockTime now)
+{
+  GstClockTime duration = now - src->start_clock_time;
+  guint64 bytes = src->total_bytes + src->bytes_downloaded;
+
+  GST_INFO_OBJECT (src, "Received %" G_GUINT64_FORMAT " bytes in %"
+      GST_TIME_FORMAT, bytes, GST_TIME_ARGS (duration));
+
+  gst_element_post_message (GST_ELEMENT (src),
+      gst_message_new_element (GST_OBJECT (src),
+          gst_structure_new ("dmss-transfer", "bytes", G_TYPE_UINT64, bytes,
+              "duration", G_TYPE_UINT64, duration, "throughput",
+              G_TYPE_UINT64, duration ? gst_util_uint64_scale (bytes,
+                  GST_SECOND, duration) : 0, NULL)));
+}
+
+/* Whether the device hung up because the recording was played up to end,
+ * it also does when it drops the client mid-file. A hang-up right after
+ * resuming that brought no frame counts as the end too, the device has
+ * nothing more to send.
+ */
+static gboolean
+gst_dmss_src_played_to (GstDmssSrc * src, gint64 end)
+{
+  if (src->hangup_resumed) {
+    GST_WARNING_OBJECT (src, "No frames since resuming, taking it as the end");
+    return TRUE;
+  }
+
+  return gst_dmss_protocol_playback_ended (src->checkpoint_time, end,
+      src->playback_rate < 0);
+}
+
+typedef struct
+{
+  GstDmssSrc *src;
+  GstDmssSession *session;
+  gint64 start;
+  gint64 end;
+} GstDmssSrcPrefetch;
+
+/* Asks for the records and connects for the next files, which is a round
+ * trip on the control socket and a handshake, so it runs on its own
+ * thread. Returns the download, NULL when it failed.
+ */
+static gpointer
+gst_dmss_src_prefetch_func (gpointer user_data)
+{
+  GstDmssSrcPrefetch *prefetch = user_data;
+  GstDmssSrc *src = prefetch->src;
+  GstDmssDownload *download;
+  GError *err = NULL;
+
+  download = gst_dmss_src_new_download (src, prefetch->session,
+      prefetch->start, prefetch->end, 1, src->prefetch_cancellable, &err);
+  if (!download) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      GST_WARNING_OBJECT (src, "Failed to prefetch the next recording: %s",
+          err->message);
+    g_error_free (err);
+  }
+
+  gst_dmss_session_unref (prefetch->session);
+  g_slice_free (GstDmssSrcPrefetch, prefetch);
+
+  return download;
+}
+
+/* Sets up the files after the one streaming while it still plays, so
+ * the switch at its end doesn't wait for a handshake. The streaming
+ * thread goes on meanwhile, gst_dmss_src_join_prefetch collects it.
+ */
+static void
+gst_dmss_src_start_prefetch (GstDmssSrc * src)
+{
+  GstDmssSrcPrefetch *prefetch;
+  GError *err = NULL;
+
+  src->prefetch_time = 0;
+
+  GST_DEBUG_OBJECT (src, "Prefetching recordings from %" G_GINT64_FORMAT,
+      src->record_end);
+
+  prefetch = g_slice_new (GstDmssSrcPrefetch);
+  prefetch->src = src;
+  prefetch->session = gst_dmss_session_ref (src->session);
+  prefetch->start = src->record_end;
+  prefetch->end = src->playback_end;
+
+  if (!(src->prefetch_thread = g_thread_try_new ("dmss-prefetch",
+              gst_dmss_src_prefetch_func, prefetch, &err))) {
+    GST_WARNING_OBJECT (src, "Failed to prefetch the next recording: %s",
+        err->message);
+    g_error_free (err);
+    gst_dmss_session_unref (prefetch->session);
+    g_slice_free (GstDmssSrcPrefetch, prefetch);
+  }
+}
+
+/* Waits for a prefetch to be set up, the download is kept unless cancel
+ * is set, which stops the prefetch short and drops it instead.
+ */
+static void
+gst_dmss_src_join_prefetch (GstDmssSrc * src, gboolean cancel)
+{
+  GstDmssDownload *download;
+
+  if (!src->prefetch_thread)
+    return;
+
+  if (cancel)
+    g_cancellable_cancel (src->prefetch_cancellable);
+  download = g_thread_join (src->prefetch_thread);
+  src->prefetch_thread = NULL;
+  g_cancellable_reset (src->prefetch_cancellable);
+
+  if (download && cancel) {
+    gst_dmss_download_free (download);
+    download = NULL;
+  }
+  src->prefetch = download;
+}
+
+/* Moves on to the file after the one that just ended. The prefetched
+ * stream takes over when there is one, else playback is requested again
+ * from the end of the file. Either way downstream sees the same segment
+ * go on.
+ */
+static GstFlowReturn
+gst_dmss_src_next_record (GstDmssSrc * src, GError ** err)
+{
+  GST_DEBUG_OBJECT (src, "Recording file ended at %" G_GINT64_FORMAT,
+      src->record_end);
+
+  gst_dmss_src_join_prefetch (src, FALSE);
+
+  src->playback_position = (src->record_end - src->playback_start) *
+      GST_SECOND;
+  gst_dmss_src_reset_checkpoints (src);
+
+  if (src->prefetch) {
+    gst_dmss_src_close_stream (src);
+    src->download = src->prefetch;
+    src->prefetch = NULL;
+    src->prefetched = TRUE;
+    src->record_end = 0;
+    return GST_FLOW_OK;
+  }
+
+  gst_dmss_src_close (src);
+  if (gst_dmss_src_open (src, err))
+    return GST_FLOW_OK;
+
+  // a gap up to the end of the range
+  if (g_error_matches (*err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+    g_clear_error (err);
+    return GST_FLOW_EOS;
+  }
+
+  return GST_FLOW_ERROR;
+}
+
+static GstFlowReturn
+gst_dmss_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
+{
+  GstDmssSrc *src;
+  GstFlowReturn ret = GST_FLOW_OK;
+  GError *err = NULL;
+  GstClockTime current_time;
+  gboolean closed;
+
+  src = GST_DMSS_SRC (psrc);
+
+  GST_INFO_OBJECT (src, "Going to read data from stream");
+  
+  current_time = gst_clock_get_time (src->system_clock);
+
+  // keep-alive is sent by the control thread, only statistics are kept here
+  if (!GST_CLOCK_TIME_IS_VALID (src->last_rate_time) ||
+      current_time - src->last_rate_time > GST_SECOND) {
+    if (GST_CLOCK_TIME_IS_VALID (src->last_rate_time)) {
+      g_atomic_int_set (&src->syscall_rate,
+          gst_util_uint64_scale (src->syscalls, GST_SECOND,
+              current_time - src->last_rate_time));
+      GST_OBJECT_LOCK (src);
+      src->throughput = gst_util_uint64_scale (src->bytes_downloaded,
+          GST_SECOND, current_time - src->last_rate_time);
+      GST_OBJECT_UNLOCK (src);
     }
+    src->syscalls = 0;
+    src->last_rate_time = current_time;
+
+    GST_INFO_OBJECT (src, "Download rate of %" G_GUINT64_FORMAT
+        " Bps, %u receive syscalls/s", src->throughput,
+        (guint) g_atomic_int_get (&src->syscall_rate));
+    src->total_bytes += src->bytes_downloaded;
+    src->bytes_downloaded = 0;
   }
 
-  g_assert (receive_size == 32);
+  GST_INFO_OBJECT (src, " ");
 
-  // should check if response is OK
-  GST_DEBUG_OBJECT (src, "started stream download");
+  if (GST_CLOCK_TIME_IS_VALID (src->playback_seek)) {
+    src->playback_position = src->playback_seek;
+    src->playback_rate = src->playback_seek_rate;
+    src->playback_seek = GST_CLOCK_TIME_NONE;
+    gst_dmss_src_reset_checkpoints (src);
+    gst_dmss_src_close (src);
+    if (!gst_dmss_src_open (src, &err))
+      goto recv_error;
+    src->discont = TRUE;
+  }
 
-  return TRUE;
-stream_connect_failed:
-  {
-    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-        ("Connection with stream socket failed: %s", err->message));
-    gst_dmss_src_stop (GST_BASE_SRC (src));
-    return FALSE;
+  if (!GST_OBJECT_FLAG_IS_SET (src, GST_DMSS_SRC_CONTROL_OPEN))
+    goto wrong_state;
+
+  *outbuf = NULL;
+  ret = gst_dmss_src_receive (src, outbuf, &err);
+
+  while (ret == GST_FLOW_ERROR) {
+    closed = src->mode != GST_DMSS_SRC_MODE_LIVE
+        && g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED);
+
+    // the device hangs up at the end of every file
+    if (closed && !src->download && src->record_end
+        && gst_dmss_src_played_to (src, src->record_end)) {
+      g_clear_error (&err);
+      if ((ret = gst_dmss_src_next_record (src, &err)) != GST_FLOW_OK)
+        break;
+      ret = gst_dmss_src_receive (src, outbuf, &err);
+      continue;
+    }
+
+    // and once the recording is played
+    if (closed && gst_dmss_src_played_to (src, src->playback_rate < 0 ?
+            src->playback_start : src->playback_end)) {
+      GST_DEBUG_OBJECT (src, "Playback finished");
+      g_error_free (err);
+      gst_dmss_src_post_transfer_stats (src,
+          gst_clock_get_time (src->system_clock));
+      return GST_FLOW_EOS;
+    }
+
+    // a range split over several downloads can't be resumed as one stream
+    if (!src->reconnect_attempts || (src->download && !src->prefetched)
+        || g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      break;
+
+    if (src->mode == GST_DMSS_SRC_MODE_LIVE) {
+      GST_WARNING_OBJECT (src, "Stream broke, reconnecting: %s",
+          err->message);
+      ret = gst_dmss_src_reconnect (src, &err);
+    } else {
+      GST_WARNING_OBJECT (src, "Recording broke at %" G_GINT64_FORMAT
+          ", resuming: %s", src->checkpoint_time, err->message);
+      ret = gst_dmss_src_resume (src, &err);
+      src->hangup_resumed = closed;
+    }
+    if (ret != GST_FLOW_OK)
+      break;
+    ret = gst_dmss_src_receive (src, outbuf, &err);
   }
-stream_auth_failed:
-  {
-    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-        ("Authentication in stream socket failed"));
-    gst_dmss_src_stop (GST_BASE_SRC (src));
-    return FALSE;
+
+  if (ret == GST_FLOW_ERROR)
+    goto recv_error;
+
+  if (ret == GST_FLOW_OK && src->prefetch_time
+      && src->checkpoint_time >= src->prefetch_time)
+    gst_dmss_src_start_prefetch (src);
+
+  if (ret == GST_FLOW_EOS) {
+    GST_DEBUG_OBJECT (src, "Download finished");
+    gst_dmss_src_post_transfer_stats (src,
+        gst_clock_get_time (src->system_clock));
   }
-authentication_error:
-  {
-    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-        ("Authentication failed, verify your username and password"));
-    gst_dmss_src_stop (GST_BASE_SRC (src));
-    return FALSE;
+
+  // read-ahead flags the first buffer of its list itself
+  if (ret == GST_FLOW_OK && src->discont && *outbuf) {
+    GST_BUFFER_FLAG_SET (*outbuf, GST_BUFFER_FLAG_DISCONT);
+    src->discont = FALSE;
   }
-login_error:
+
+  return ret;
+recv_error:
   {
-    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-        ("Failed to send data on control socket: %s", err->message));
-    gst_dmss_src_stop (GST_BASE_SRC (src));
-    return FALSE;
+    g_assert (err != NULL);
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      GST_DEBUG_OBJECT (src, "Cancelled reading from socket");
+      g_error_free (err);
+      return GST_FLOW_FLUSHING;
+    }
+    GST_ELEMENT_ERROR (src, RESOURCE, READ, (NULL),
+        ("failed reading from socket: %s", err->message));
+    g_error_free (err);
+    gst_dmss_src_close (src);
+    return GST_FLOW_ERROR;
   }
-no_socket:
+wrong_state:
   {
-    GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-        ("Failed to create socket: %s", err->message));
-    g_object_unref (saddr);
-    gst_dmss_src_stop (GST_BASE_SRC (src));
-    return FALSE;
+    GST_DEBUG_OBJECT (src, "connection closed, cannot read data");
+    gst_dmss_src_close (src);
+    return GST_FLOW_FLUSHING;
+  }
+}
+
+/* Name resolution is started when going to READY so it overlaps with the
+ * rest of the pipeline preroll, start only collects the result. The
+ * lookup callback needs a main context, so it gets a private one that is
+ * iterated only while waiting for it.
+ */
+static void
+gst_dmss_src_resolve_cb (GObject * source, GAsyncResult * result,
+    gpointer user_data)
+{
+  GstDmssSrc *src = GST_DMSS_SRC (user_data);
+
+  src->resolve_results =
+      g_resolver_lookup_by_name_finish (G_RESOLVER (source), result,
+      &src->resolve_error);
+  src->resolve_done = TRUE;
+}
+
+static void
+gst_dmss_src_resolve_begin (GstDmssSrc * src)
+{
+  GInetAddress *addr;
+  GResolver *resolver;
+
+  g_assert (src->resolve_context == NULL);
+
+  // nothing to resolve for literal addresses
+  if ((addr = g_inet_address_new_from_string (src->host))) {
+    g_object_unref (addr);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (src, "Resolving %s in the background", src->host);
+
+  src->resolve_context = g_main_context_new ();
+  src->resolve_host = g_strdup (src->host);
+  src->resolve_done = FALSE;
+
+  resolver = g_resolver_get_default ();
+  g_main_context_push_thread_default (src->resolve_context);
+  g_resolver_lookup_by_name_async (resolver, src->host, src->cancellable,
+      gst_dmss_src_resolve_cb, src);
+  g_main_context_pop_thread_default (src->resolve_context);
+  g_object_unref (resolver);
+}
+
+static void
+gst_dmss_src_resolve_wait (GstDmssSrc * src)
+{
+  g_main_context_push_thread_default (src->resolve_context);
+  while (!src->resolve_done)
+    g_main_context_iteration (src->resolve_context, TRUE);
+  g_main_context_pop_thread_default (src->resolve_context);
+}
+
+static void
+gst_dmss_src_resolve_clear (GstDmssSrc * src)
+{
+  if (!src->resolve_context)
+    return;
+
+  if (!src->resolve_done) {
+    g_cancellable_cancel (src->cancellable);
+    gst_dmss_src_resolve_wait (src);
+    g_cancellable_reset (src->cancellable);
+  }
+
+  if (src->resolve_results)
+    g_resolver_free_addresses (src->resolve_results);
+  src->resolve_results = NULL;
+  g_clear_error (&src->resolve_error);
+  g_main_context_unref (src->resolve_context);
+  src->resolve_context = NULL;
+  g_free (src->resolve_host);
+  src->resolve_host = NULL;
+}
+
+static GInetAddress *
+gst_dmss_src_resolve_finish (GstDmssSrc * src, GError ** err)
+{
+  GInetAddress *addr;
+
+  if ((addr = g_inet_address_new_from_string (src->host)))
+    return addr;
+
+  // host changed since READY, or start is retried after a failure
+  if (src->resolve_context && (g_strcmp0 (src->resolve_host, src->host)
+          || src->resolve_error))
+    gst_dmss_src_resolve_clear (src);
+  if (!src->resolve_context)
+    gst_dmss_src_resolve_begin (src);
+
+  gst_dmss_src_resolve_wait (src);
+
+  if (!src->resolve_results) {
+    g_propagate_error (err, g_error_copy (src->resolve_error));
+    return NULL;
+  }
+
+  return G_INET_ADDRESS (g_object_ref (src->resolve_results->data));
+}
+
+static GstStateChangeReturn
+gst_dmss_src_change_state (GstElement * element, GstStateChange transition)
+{
+  GstDmssSrc *src = GST_DMSS_SRC (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY)
+    gst_dmss_src_resolve_begin (src);
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  if (transition == GST_STATE_CHANGE_READY_TO_NULL
+      || ret == GST_STATE_CHANGE_FAILURE)
+    gst_dmss_src_resolve_clear (src);
+
+  return ret;
+}
+
+/* Splits a range along the recorded files and starts downloading them
+ * the given number at a time.
+ */
+static struct _GstDmssDownload *
+gst_dmss_src_new_download (GstDmssSrc * src, GstDmssSession * session,
+    gint64 start, gint64 end, guint connections, GCancellable * cancellable,
+    GError ** err)
+{
+  GstDmssPlaybackParams params;
+  GstDmssRecord *record;
+  GstDmssDownload *download;
+  GArray *records, *segments;
+  guint i;
+
+  if (!gst_dmss_session_refresh_records (session, src->channel, start, end,
+          cancellable, err))
+    return NULL;
+
+  records = gst_dmss_record_index_query (gst_dmss_session_get_record_index
+      (session), src->channel, start, end);
+  segments = g_array_sized_new (FALSE, FALSE, sizeof (GstDmssPlaybackParams),
+      records->len);
+
+  // overlapping files would play the same frames twice
+  for (i = 0; i != records->len; ++i) {
+    record = &g_array_index (records, GstDmssRecord, i);
+    params.channel = src->channel;
+    params.start_time = MAX (record->start_time, start);
+    params.end_time = MIN (record->end_time, end);
+    params.drive_no = record->disk;
+    params.cluster_no = record->cluster;
+    params.offset = 0;
+    params.iframes = params.reverse = FALSE;
+    if (params.end_time <= params.start_time)
+      continue;
+    g_array_append_val (segments, params);
+    start = params.end_time;
+  }
+  g_array_unref (records);
+
+  if (!segments->len) {
+    g_array_unref (segments);
+    g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+        "Nothing recorded in the requested range");
+    return NULL;
+  }
+
+  download = gst_dmss_download_new (session, segments, connections,
+      DMSS_DOWNLOAD_RECEIVE_BUFFER_SIZE);
+  g_array_unref (segments);
+
+  if (!gst_dmss_download_start (download, err)) {
+    gst_dmss_download_free (download);
+    return NULL;
+  }
+
+  return download;
+}
+
+/* Starts downloading what is left of the range download-connections
+ * files at a time.
+ */
+static gboolean
+gst_dmss_src_start_download (GstDmssSrc * src, GstDmssSession * session,
+    GError ** err)
+{
+  src->download = gst_dmss_src_new_download (src, session,
+      src->playback_start + src->playback_position / GST_SECOND,
+      src->playback_end, src->download_connections, src->cancellable, err);
+
+  return src->download != NULL;
+}
+
+/* Runs the whole handshake. On failure everything opened so far is closed
+ * again and err tells which step failed, so the same code serves start
+ * and reconnect.
+ */
+static gboolean
+gst_dmss_src_open (GstDmssSrc * src, GError ** err)
+{
+  GInetAddress *addr;
+  GSocketAddress *saddr = NULL;
+  GstDmssSession *session;
+  GstStructure *timings;
+  GstClockTime start_time, last_time;
+
+  g_assert (src->session == NULL);
+  g_assert (src->stream_socket == NULL);
+
+  timings = gst_structure_new_empty ("dmss-handshake");
+  start_time = last_time = gst_util_get_timestamp ();
+
+  if (!(addr = gst_dmss_src_resolve_finish (src, err))) {
+    g_prefix_error (err, "Failed to resolve host '%s': ", src->host);
+    goto error;
   }
-name_resolve:
+#ifndef GST_DISABLE_GST_DEBUG
   {
-    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
-      GST_DEBUG_OBJECT (src, "Cancelled name resolval");
-    } else {
-      GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-          ("Failed to resolve host '%s': %s", src->host, err->message));
+    gchar *ip = g_inet_address_to_string (addr);
+
+    GST_DEBUG_OBJECT (src, "IP address for host %s is %s", src->host, ip);
+    g_free (ip);
+  }
+#endif
+  gst_dmss_session_mark_phase (timings, "resolve", &last_time);
+
+  saddr = g_inet_socket_address_new (addr, src->port);
+  g_object_unref (addr);
+
+  GST_DEBUG_OBJECT (src, "opening control session to %s:%d", src->host,
+      src->port);
+
+  if (src->share_session) {
+    session = gst_dmss_session_acquire (src->host, src->port, saddr,
+        src->user, src->password, src->timeout,
+        src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_SHARED, timings,
+        src->cancellable, err);
+  } else {
+    session = gst_dmss_session_new (saddr, src->user, src->password,
+        src->timeout);
+    if (!gst_dmss_session_open (session,
+            src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_SHARED, timings,
+            src->cancellable, err)) {
+      gst_dmss_session_unref (session);
+      session = NULL;
     }
-    g_object_unref (resolver);
-    gst_dmss_src_stop (GST_BASE_SRC (src));
+  }
+  g_clear_object (&saddr);
+
+  if (!session) {
+    if (g_error_matches (*err, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED))
+      g_prefix_error (err,
+          "Authentication failed, verify your username and password: ");
+    else
+      g_prefix_error (err, "Failed to open session with host '%s:%d': ",
+          src->host, src->port);
+    goto error;
+  }
+  last_time = gst_util_get_timestamp ();
+
+  GST_OBJECT_LOCK (src);
+  src->session = session;
+  GST_OBJECT_UNLOCK (src);
+
+  if (src->mode == GST_DMSS_SRC_MODE_DOWNLOAD
+      && src->download_connections > 1) {
+    if (!gst_dmss_src_start_download (src, session, err)) {
+      g_prefix_error (err, "Failed to start download: ");
+      goto error;
+    }
+    GST_OBJECT_FLAG_SET (src, GST_DMSS_SRC_CONTROL_OPEN);
+    gst_dmss_session_mark_phase (timings, "download-start", &last_time);
+    goto started;
+  }
+
+  // downloads arrive faster than a window sized for live video drains
+  if (!(src->stream_socket = gst_dmss_session_connect_stream_begin (session,
+              src->mode == GST_DMSS_SRC_MODE_DOWNLOAD ?
+              DMSS_DOWNLOAD_RECEIVE_BUFFER_SIZE : 0, src->cancellable,
+              err))) {
+    g_prefix_error (err, "Connection with stream socket failed: ");
+    goto error;
+  }
+
+  GST_OBJECT_FLAG_SET (src, GST_DMSS_SRC_CONTROL_OPEN);
+
+  if (!gst_dmss_session_add_object (session, src->connection_id,
+          src->cancellable, err)) {
+    g_prefix_error (err, "AddObject failed: ");
+    goto error;
+  }
+  gst_dmss_session_mark_phase (timings, "add-object", &last_time);
+
+  GST_DEBUG_OBJECT (src, "Added object");
+
+  if (!gst_dmss_session_connect_stream_finish (session, src->stream_socket,
+          src->cancellable, err)) {
+    g_prefix_error (err, "Connection with stream socket failed: ");
+    goto error;
+  }
+  // only what the connect did not overlap with AddObject
+  gst_dmss_session_mark_phase (timings, "stream-connect", &last_time);
+
+  if (!gst_dmss_session_link_stream (session, src->stream_socket,
+          src->connection_id, src->cancellable, err)) {
+    g_prefix_error (err, "Authentication in stream socket failed: ");
+    goto error;
+  }
+  gst_dmss_session_mark_phase (timings, "link-subchannel", &last_time);
+
+  GST_DEBUG_OBJECT (src,
+      "linked stream socket. Going to start stream for channel %d and subchannel %d",
+      src->channel, src->subchannel);
+
+  if (src->mode != GST_DMSS_SRC_MODE_LIVE) {
+    GstDmssPlaybackParams params;
+    gint64 position = src->playback_start + src->playback_position /
+        GST_SECOND;
+
+    params.channel = src->channel;
+    params.reverse = src->playback_rate < 0;
+    params.start_time = params.reverse ? src->playback_start : position;
+    params.end_time = params.reverse ? position : src->playback_end;
+    params.drive_no = src->drive_no;
+    params.cluster_no = src->cluster_no;
+    params.offset = src->resume_offset;
+    // decoders can't play a GOP backwards, so reverse goes by keyframes
+    params.iframes = params.reverse
+        || ABS (src->playback_rate) >= src->iframes_rate;
+    src->record_end = src->prefetch_time = 0;
+
+    if (!params.drive_no && !params.cluster_no) {
+      GstDmssRecord record;
+      gboolean found;
+
+      if (!gst_dmss_session_refresh_records (session, src->channel,
+              params.start_time, params.end_time, src->cancellable, err)) {
+        g_prefix_error (err, "Failed to find recordings: ");
+        goto error;
+      }
+      found = gst_dmss_record_index_lookup (gst_dmss_session_get_record_index
+          (session), src->channel, params.reverse ? params.end_time - 1 :
+          params.start_time, &record);
+      if (found && record.start_time >= params.end_time) {
+        gst_dmss_record_clear (&record);
+        found = FALSE;
+      }
+      if (!found) {
+        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+            "Nothing recorded in the requested range");
+        goto error;
+      }
+
+      GST_DEBUG_OBJECT (src, "Playing recording %s", record.file_path);
+      params.drive_no = record.disk;
+      params.cluster_no = record.cluster;
+      // the device stops at the end of the file, later ones are asked for
+      // separately
+      if (!params.reverse && record.end_time < params.end_time) {
+        src->record_end = record.end_time;
+        if (src->playback_rate == 1.0)
+          src->prefetch_time = record.end_time - DMSS_PREFETCH_LEAD;
+      }
+      gst_dmss_record_clear (&record);
+      gst_dmss_session_mark_phase (timings, "record-lookup", &last_time);
+    }
+
+    if (!gst_dmss_session_start_playback (session, &params,
+            src->connection_id, src->cancellable, err)) {
+      g_prefix_error (err, "Failed to start playback: ");
+      goto error;
+    }
+    gst_dmss_session_mark_phase (timings, "playback-start", &last_time);
+  } else {
+    if (!gst_dmss_session_start_monitor (session, src->channel,
+            src->subchannel, src->connection_id, src->cancellable, err)) {
+      g_prefix_error (err, "Failed to start stream: ");
+      goto error;
+    }
+    gst_dmss_session_mark_phase (timings, "monitor-start", &last_time);
+  }
+
+started:
+  GST_DEBUG_OBJECT (src, "started stream download");
+
+  gst_structure_set (timings, "total", G_TYPE_UINT64, last_time - start_time,
+      NULL);
+  gst_element_post_message (GST_ELEMENT (src),
+      gst_message_new_element (GST_OBJECT (src), timings));
+  timings = NULL;
+
+  // the download workers receive on sockets of their own
+  if (src->download)
+    return TRUE;
+
+  if (src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_SHARED
+      && !(src->io_stream =
+          gst_dmss_io_engine_add_stream (src->stream_socket, err))) {
+    g_prefix_error (err, "Failed to register stream socket with I/O engine: ");
+    goto error;
+  }
+
+  if (src->receive_mode == GST_DMSS_SRC_RECEIVE_MODE_IO_URING
+      && !(src->uring = gst_dmss_uring_new (src->stream_socket,
+              src->cancellable, err))) {
+    GST_WARNING_OBJECT (src, "Falling back to GSocket receive: %s",
+        (*err)->message);
+    g_clear_error (err);
+  }
+
+  return TRUE;
+error:
+  if (timings)
+    gst_structure_free (timings);
+  g_clear_object (&saddr);
+  gst_dmss_src_close (src);
+  return FALSE;
+}
+
+static gboolean
+gst_dmss_src_start (GstBaseSrc * bsrc)
+{
+  GstDmssSrc *src = GST_DMSS_SRC (bsrc);
+  GError *err = NULL;
+
+  src->discont = FALSE;
+  src->total_bytes = 0;
+  src->start_clock_time = gst_clock_get_time (src->system_clock);
+
+  if (src->mode != GST_DMSS_SRC_MODE_LIVE) {
+    if (!gst_dmss_record_index_parse_time (src->start_time,
+            &src->playback_start)
+        || !gst_dmss_record_index_parse_time (src->end_time,
+            &src->playback_end)
+        || src->playback_end <= src->playback_start)
+      goto invalid_range;
+    src->playback_position = 0;
+    src->playback_seek = GST_CLOCK_TIME_NONE;
+    src->playback_rate = src->playback_seek_rate = 1.0;
+    src->offset_resume = TRUE;
+    gst_dmss_src_reset_checkpoints (src);
+  }
+
+  if (!gst_dmss_src_open (src, &err))
+    goto open_failed;
+
+  return TRUE;
+invalid_range:
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS, (NULL),
+        ("Playback needs start-time before end-time, as "
+            "\"YYYY-MM-DD HH:MM:SS\""));
     return FALSE;
   }
-connect_failed:
+open_failed:
   {
     if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
       GST_DEBUG_OBJECT (src, "Cancelled connecting");
-    } else {
+    } else if (g_error_matches (err, G_IO_ERROR,
+            G_IO_ERROR_PERMISSION_DENIED)) {
       GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL),
-          ("Failed to connect to host '%s:%d': %s", src->host, src->port,
+          ("Authentication failed, verify your username and password"));
+    } else {
+      GST_ELEMENT_ERROR (src, RESOURCE, OPEN_READ, (NULL), ("%s",
               err->message));
     }
-    g_object_unref (saddr);
+    g_error_free (err);
     gst_dmss_src_stop (GST_BASE_SRC (src));
     return FALSE;
   }
@@ -1031,55 +2556,11 @@ int
 gst_dmss_receive_packet (GSocket * socket, GCancellable * cancellable,
     GError ** err, gchar * ext_buffer, gssize * ext_size)
 {
-  gssize size, body_size;
-  gssize offset;
-  gchar buffer[32];
-
-  offset = 0;
-  do {
-    if ((size = g_socket_receive (socket, &buffer[offset],
-                sizeof (buffer) - offset, cancellable, err)) <= 0) {
-      if (!*err && !size)
-        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      goto recv_error;
-    }
-
-    if (offset < *ext_size)
-      memcpy (&ext_buffer[offset], &buffer[offset],
-          *ext_size - offset < size ? *ext_size - offset : size);
+  gssize stored = *ext_size;
 
-    offset += size;
-  }
-  while (offset != 32);
-
-  body_size = GUINT32_FROM_LE (*(guint32 *) & buffer[4]);
-
-  offset = 0;
-  while (offset != body_size) {
-    if ((size = g_socket_receive (socket, &buffer[offset % sizeof (buffer)],
-                (body_size - offset) >
-                sizeof (buffer) -
-                (offset %
-                    sizeof (buffer)) ? sizeof (buffer) -
-                (offset % sizeof (buffer)) : (body_size -
-                    offset), cancellable, err)) <= 0) {
-      if (!*err && !size)
-        g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
-            "Read operation timed out");
-      goto recv_error;
-    }
-
-    if (offset + 32 < *ext_size)
-      memcpy (&ext_buffer[offset + 32], &buffer[offset + 32],
-          *ext_size - (offset + 32) < size ? *ext_size - (offset + 32) : size);
-
-    offset += size;
-  }
-
-  return 32 + body_size;
-recv_error:
-  return -1;
+  // callers keep *ext_size as the capacity of ext_buffer
+  return gst_dmss_protocol_receive_packet (socket, cancellable, err,
+      ext_buffer, &stored);
 }
 
 int
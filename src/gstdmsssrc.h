@@ -26,6 +26,8 @@
 
 #include <gio/gio.h>
 
+#include "gstdmssprotocol.h"
+
 G_BEGIN_DECLS
 
 void gst_dmss_debug_print_prologue (gchar * prologue);
@@ -46,9 +48,31 @@ int gst_dmss_receive_packet_ignore (GSocket * socket,
   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_DMSS_SRC))
 #define GST_IS_DMSS_SRC_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_DMSS_SRC))
+#define GST_TYPE_DMSS_SRC_RECEIVE_MODE \
+  (gst_dmss_src_receive_mode_get_type())
+#define GST_TYPE_DMSS_SRC_MODE \
+  (gst_dmss_src_mode_get_type())
 typedef struct _GstDmssSrc GstDmssSrc;
 typedef struct _GstDmssSrcClass GstDmssSrcClass;
 
+typedef enum
+{
+  GST_DMSS_SRC_RECEIVE_MODE_COPY,
+  GST_DMSS_SRC_RECEIVE_MODE_POOL,
+  GST_DMSS_SRC_RECEIVE_MODE_READ_AHEAD,
+  GST_DMSS_SRC_RECEIVE_MODE_SHARED,
+  GST_DMSS_SRC_RECEIVE_MODE_IO_URING
+} GstDmssSrcReceiveMode;
+
+typedef enum
+{
+  GST_DMSS_SRC_MODE_LIVE,
+  GST_DMSS_SRC_MODE_PLAYBACK,
+  GST_DMSS_SRC_MODE_DOWNLOAD
+} GstDmssSrcMode;
+
+#define GST_DMSS_SRC_HISTOGRAM_BUCKETS 24
+
 typedef enum
 {
   GST_DMSS_SRC_CONTROL_OPEN = (GST_BASE_SRC_FLAG_LAST << 0),
@@ -68,19 +92,109 @@ struct _GstDmssSrc
   guint timeout;
   guint channel;
   guint subchannel;
-  gint session_id;
   gchar connection_id[16];
 
-  GSocket *control_socket;
+  /* background name resolution started on NULL_TO_READY */
+  GMainContext *resolve_context;
+  gchar *resolve_host;
+  GList *resolve_results;
+  GError *resolve_error;
+  gboolean resolve_done;
+
+  /* logged in control connection, owns the keep-alive */
+  struct _GstDmssSession *session;
+  gboolean share_session;
+
+  /* playback and download modes, times in seconds of the device's local
+   * time */
+  GstDmssSrcMode mode;
+  gchar *start_time;
+  gchar *end_time;
+  guint drive_no;
+  guint cluster_no;
+  gint64 playback_start;
+  gint64 playback_end;
+  GstClockTime playback_position;
+  GstClockTime playback_seek;
+  /* trick play, reverse playback runs from playback_position back to the
+   * start of the range */
+  gdouble playback_rate;
+  gdouble playback_seek_rate;
+  gdouble iframes_rate;
   GSocket *stream_socket;
   GCancellable *cancellable;
 
+  GstDmssSrcReceiveMode receive_mode;
+
+  /* pool receive mode */
+  GstBufferPool *pool;
+  gsize pool_buffer_size;
+  guint body_size_histogram[GST_DMSS_SRC_HISTOGRAM_BUCKETS];
+  guint body_size_samples;
+
+  /* read-ahead receive mode */
+  guint read_ahead_size;
+  struct _GstDmssSrcChunk *chunk;
+  gsize chunk_parsed;
+  gsize chunk_filled;
+
+  /* shared receive mode */
+  struct _GstDmssIoStream *io_stream;
+
+  /* io-uring receive mode, NULL when falling back to copy */
+  struct _GstDmssUring *uring;
+
+  guint syscalls;
+  gint syscall_rate;
+  GstClockTime last_rate_time;
+
+  /* bytes per second over the last second, protected by the object lock */
+  guint64 throughput;
+  guint64 total_bytes;
+
+  /* download mode over more than one connection */
+  guint download_connections;
+  struct _GstDmssDownload *download;
+
+  /* playback of the files after the one streaming, set up before it ends */
+  gint64 record_end;
+  gint64 prefetch_time;
+  struct _GstDmssDownload *prefetch;
+  /* sets up prefetch off the streaming thread */
+  GThread *prefetch_thread;
+  GCancellable *prefetch_cancellable;
+  /* download is a prefetch that took over, only the time of its frames is
+   * tracked so a break resumes by time */
+  gboolean prefetched;
+  GstClockTime start_clock_time;
+
+  /* resuming a broken recording. Offsets count DHAV bytes since the
+   * StartTime of the request, the checkpoint is the end of the last
+   * complete frame */
+  guint64 stream_offset;
+  guint64 frame_start;
+  guint8 frame_header[20];
+  guint frame_header_filled;
+  guint32 frame_remaining;
+  guint8 frame_trailer[8];
+  guint64 checkpoint_offset;
+  gint64 checkpoint_time;
+  guint64 resume_offset;
+  guint64 resume_skip;
+  gboolean resume_check;
+  gboolean offset_resume;
+  /* resumed after a hang-up and no frame came since */
+  gboolean hangup_resumed;
+
+  /* reconnect */
+  gint reconnect_attempts;
+  guint reconnect_backoff;
+  guint reconnect_backoff_max;
+  gboolean discont;
+
   GArray *queued_buffer;
   GstClock *system_clock;
-  GstClockTime last_ack_time;
-#if 1
-  unsigned int bytes_downloaded;
-#endif
+  guint64 bytes_downloaded;
 };
 
 struct _GstDmssSrcClass
@@ -89,6 +203,8 @@ struct _GstDmssSrcClass
 };
 
 GType gst_dmss_src_get_type (void);
+GType gst_dmss_src_receive_mode_get_type (void);
+GType gst_dmss_src_mode_get_type (void);
 
 G_END_DECLS
 #endif /* __GST_DMSS_SRC_H__ */
@@ -0,0 +1,452 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* io_uring receive backend for the stream socket.
+ *
+ * The kernel picks buffers out of a registered buffer ring and, where
+ * supported, keeps a single multishot receive armed, so a burst of packets
+ * costs one io_uring_enter instead of two receive calls each. While slots
+ * are plentiful packet bodies are not copied out of the ring: every slice
+ * becomes a GstMemory wrapping its ring slot, and the slot goes back to the
+ * kernel once the last memory pointing into it is freed. A single small
+ * buffer held downstream pins a whole slot that way, so once fewer than
+ * DMSS_URING_SLOTS_LOW are free the bodies are copied and the slot is
+ * returned as soon as it is parsed. Headers are always copied.
+ *
+ * Without liburing, or when the kernel lacks buffer rings,
+ * gst_dmss_uring_new fails and dmsssrc keeps using GSocket.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gstversion.h>
+#if GST_VERSION_MINOR <= 15
+#include <gst/gst-i18n-plugin.h>
+#endif
+#include <gst/gst.h>
+#include "gstdmssuring.h"
+#include "gstdmssprotocol.h"
+
+#include <string.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#include <errno.h>
+#include <poll.h>
+#endif
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+#define GST_CAT_DEFAULT dmsssrc_debug
+
+#ifdef HAVE_LIBURING
+
+#define DMSS_URING_ENTRIES              16
+#define DMSS_URING_SLOTS                64
+#define DMSS_URING_SLOT_SIZE            (64 * 1024)
+#define DMSS_URING_SLOTS_LOW            (DMSS_URING_SLOTS / 4)
+#define DMSS_URING_BUFFER_GROUP         0
+#define DMSS_URING_SLOT_WAIT_US         (100 * 1000)
+
+enum
+{
+  DMSS_URING_TAG_RECV = 1,
+  DMSS_URING_TAG_POLL,
+  DMSS_URING_TAG_CANCEL
+};
+
+typedef struct
+{
+  GstDmssUring *uring;
+  guint16 bid;
+  gint refcount;
+} GstDmssUringSlot;
+
+struct _GstDmssUring
+{
+  /* dropped by gst_dmss_uring_free and by every slot returning to the ring */
+  gint refcount;
+
+  struct io_uring ring;
+  struct io_uring_buf_ring *buf_ring;
+  guint8 *slab;
+  GstDmssUringSlot slots[DMSS_URING_SLOTS];
+
+  GSocket *socket;
+  GCancellable *cancellable;
+  gint cancel_fd;
+
+  gboolean multishot;
+  gboolean recv_armed;
+  gboolean poll_armed;
+  GError *error;
+
+  /* protected by lock, slots come back from downstream threads */
+  GMutex lock;
+  GCond cond;
+  guint slots_free;
+
+  GstDmssParser parser;
+  GstBuffer *packet;
+  GQueue ready;
+
+  guint syscalls;
+};
+
+static void
+gst_dmss_uring_unref (GstDmssUring * uring)
+{
+  if (!g_atomic_int_dec_and_test (&uring->refcount))
+    return;
+
+  io_uring_free_buf_ring (&uring->ring, uring->buf_ring, DMSS_URING_SLOTS,
+      DMSS_URING_BUFFER_GROUP);
+  io_uring_queue_exit (&uring->ring);
+  g_free (uring->slab);
+  g_mutex_clear (&uring->lock);
+  g_cond_clear (&uring->cond);
+  g_slice_free (GstDmssUring, uring);
+}
+
+static void
+gst_dmss_uring_slot_recycle (GstDmssUringSlot * slot)
+{
+  GstDmssUring *uring = slot->uring;
+
+  g_mutex_lock (&uring->lock);
+  io_uring_buf_ring_add (uring->buf_ring,
+      uring->slab + slot->bid * DMSS_URING_SLOT_SIZE, DMSS_URING_SLOT_SIZE,
+      slot->bid, io_uring_buf_ring_mask (DMSS_URING_SLOTS), 0);
+  io_uring_buf_ring_advance (uring->buf_ring, 1);
+  uring->slots_free++;
+  g_cond_signal (&uring->cond);
+  g_mutex_unlock (&uring->lock);
+
+  gst_dmss_uring_unref (uring);
+}
+
+static void
+gst_dmss_uring_slot_unref (gpointer data)
+{
+  GstDmssUringSlot *slot = data;
+
+  if (g_atomic_int_dec_and_test (&slot->refcount))
+    gst_dmss_uring_slot_recycle (slot);
+}
+
+/* Splits the bytes the kernel put in a slot into packets. Body slices
+ * keep a reference on the slot instead of being copied.
+ */
+static void
+gst_dmss_uring_parse_slot (GstDmssUring * uring, GstDmssUringSlot * slot,
+    gsize length)
+{
+  GstDmssParser *parser = &uring->parser;
+  GstDmssParserEvent event;
+  guint8 *data = uring->slab + slot->bid * DMSS_URING_SLOT_SIZE;
+  gsize offset = 0, consumed;
+  GstMemory *memory;
+  GstMapInfo map;
+  gboolean copy;
+
+  // the receive itself holds the first reference
+  slot->refcount = 1;
+  g_mutex_lock (&uring->lock);
+  uring->slots_free--;
+  copy = uring->slots_free < DMSS_URING_SLOTS_LOW;
+  g_mutex_unlock (&uring->lock);
+  g_atomic_int_inc (&uring->refcount);
+
+  if (copy)
+    GST_LOG ("Only %u ring slots left, copying bodies out",
+        (guint) uring->slots_free);
+
+  do {
+    event = gst_dmss_parser_feed (parser, (const gchar *) &data[offset],
+        length - offset, &consumed);
+
+    switch (event) {
+      case GST_DMSS_PARSER_HEADER:
+        uring->packet = gst_buffer_new_allocate (NULL,
+            sizeof (parser->header), NULL);
+        gst_buffer_fill (uring->packet, 0, parser->header,
+            sizeof (parser->header));
+        break;
+      case GST_DMSS_PARSER_BODY:
+        if (copy) {
+          memory = gst_allocator_alloc (NULL, parser->body_length, NULL);
+          gst_memory_map (memory, &map, GST_MAP_WRITE);
+          memcpy (map.data, parser->body, parser->body_length);
+          gst_memory_unmap (memory, &map);
+        } else {
+          g_atomic_int_inc (&slot->refcount);
+          memory = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, data,
+              DMSS_URING_SLOT_SIZE, offset, parser->body_length, slot,
+              gst_dmss_uring_slot_unref);
+        }
+        gst_buffer_append_memory (uring->packet, memory);
+        break;
+      case GST_DMSS_PARSER_PACKET_END:
+        g_queue_push_tail (&uring->ready, uring->packet);
+        uring->packet = NULL;
+        break;
+      default:
+        break;
+    }
+    offset += consumed;
+  } while (event != GST_DMSS_PARSER_NEED_DATA);
+
+  gst_dmss_uring_slot_unref (slot);
+}
+
+static void
+gst_dmss_uring_handle_recv (GstDmssUring * uring, struct io_uring_cqe *cqe)
+{
+  if (!(cqe->flags & IORING_CQE_F_MORE))
+    uring->recv_armed = FALSE;
+
+  if (cqe->res > 0) {
+    g_assert (cqe->flags & IORING_CQE_F_BUFFER);
+    gst_dmss_uring_parse_slot (uring,
+        &uring->slots[cqe->flags >> IORING_CQE_BUFFER_SHIFT], cqe->res);
+  } else if (cqe->res == 0) {
+    uring->error = g_error_new_literal (G_IO_ERROR,
+        G_IO_ERROR_CONNECTION_CLOSED, "Connection closed by remote peer");
+  } else if (cqe->res == -ENOBUFS) {
+    GST_DEBUG ("Ran out of ring slots, waiting for downstream");
+  } else if (cqe->res == -EINVAL && uring->multishot) {
+    GST_INFO ("Kernel has no multishot receive, re-arming every packet");
+    uring->multishot = FALSE;
+  } else {
+    uring->error = g_error_new (G_IO_ERROR, g_io_error_from_errno (-cqe->res),
+        "io_uring receive failed: %s", g_strerror (-cqe->res));
+  }
+}
+
+static gboolean
+gst_dmss_uring_wait_slot (GstDmssUring * uring)
+{
+  gint64 end_time;
+
+  g_mutex_lock (&uring->lock);
+  while (!uring->slots_free && !g_cancellable_is_cancelled (uring->cancellable)) {
+    // recycling does not cancel us, so poll the cancellable now and then
+    end_time = g_get_monotonic_time () + DMSS_URING_SLOT_WAIT_US;
+    g_cond_wait_until (&uring->cond, &uring->lock, end_time);
+  }
+  g_mutex_unlock (&uring->lock);
+
+  return !g_cancellable_is_cancelled (uring->cancellable);
+}
+
+static void
+gst_dmss_uring_arm (GstDmssUring * uring)
+{
+  struct io_uring_sqe *sqe;
+  gint fd = g_socket_get_fd (uring->socket);
+
+  if (!uring->recv_armed) {
+    sqe = io_uring_get_sqe (&uring->ring);
+    if (uring->multishot)
+      io_uring_prep_recv_multishot (sqe, fd, NULL, 0, 0);
+    else
+      io_uring_prep_recv (sqe, fd, NULL, DMSS_URING_SLOT_SIZE, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = DMSS_URING_BUFFER_GROUP;
+    io_uring_sqe_set_data64 (sqe, DMSS_URING_TAG_RECV);
+    uring->recv_armed = TRUE;
+  }
+
+  if (!uring->poll_armed && uring->cancel_fd >= 0) {
+    sqe = io_uring_get_sqe (&uring->ring);
+    io_uring_prep_poll_add (sqe, uring->cancel_fd, POLLIN);
+    io_uring_sqe_set_data64 (sqe, DMSS_URING_TAG_POLL);
+    uring->poll_armed = TRUE;
+  }
+}
+
+GstFlowReturn
+gst_dmss_uring_receive_packet (GstDmssUring * uring, GstBuffer ** buffer,
+    GError ** err)
+{
+  struct io_uring_cqe *cqe;
+  unsigned head, seen;
+  int ret;
+
+  while (g_queue_is_empty (&uring->ready)) {
+    if (uring->error) {
+      g_propagate_error (err, g_error_copy (uring->error));
+      return GST_FLOW_ERROR;
+    }
+    if (g_cancellable_is_cancelled (uring->cancellable))
+      return GST_FLOW_FLUSHING;
+
+    if (!uring->recv_armed && !gst_dmss_uring_wait_slot (uring))
+      return GST_FLOW_FLUSHING;
+    gst_dmss_uring_arm (uring);
+
+    g_atomic_int_inc (&uring->syscalls);
+    if ((ret = io_uring_submit_and_wait (&uring->ring, 1)) < 0 && ret != -EINTR) {
+      g_set_error (err, G_IO_ERROR, g_io_error_from_errno (-ret),
+          "io_uring_submit_and_wait failed: %s", g_strerror (-ret));
+      return GST_FLOW_ERROR;
+    }
+
+    seen = 0;
+    io_uring_for_each_cqe (&uring->ring, head, cqe) {
+      switch (io_uring_cqe_get_data64 (cqe)) {
+        case DMSS_URING_TAG_RECV:
+          gst_dmss_uring_handle_recv (uring, cqe);
+          break;
+        case DMSS_URING_TAG_POLL:
+          uring->poll_armed = FALSE;
+          break;
+        default:
+          break;
+      }
+      seen++;
+    }
+    io_uring_cq_advance (&uring->ring, seen);
+  }
+
+  *buffer = g_queue_pop_head (&uring->ready);
+  return GST_FLOW_OK;
+}
+
+GstDmssUring *
+gst_dmss_uring_new (GSocket * socket, GCancellable * cancellable,
+    GError ** err)
+{
+  GstDmssUring *uring;
+  int ret, i;
+
+  uring = g_slice_new0 (GstDmssUring);
+
+  if ((ret = io_uring_queue_init (DMSS_URING_ENTRIES, &uring->ring, 0)) < 0) {
+    g_set_error (err, G_IO_ERROR, g_io_error_from_errno (-ret),
+        "Failed to create io_uring: %s", g_strerror (-ret));
+    g_slice_free (GstDmssUring, uring);
+    return NULL;
+  }
+
+  uring->buf_ring = io_uring_setup_buf_ring (&uring->ring, DMSS_URING_SLOTS,
+      DMSS_URING_BUFFER_GROUP, 0, &ret);
+  if (!uring->buf_ring) {
+    g_set_error (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+        "Kernel has no io_uring buffer rings: %s", g_strerror (-ret));
+    io_uring_queue_exit (&uring->ring);
+    g_slice_free (GstDmssUring, uring);
+    return NULL;
+  }
+
+  uring->slab = g_malloc (DMSS_URING_SLOTS * DMSS_URING_SLOT_SIZE);
+  for (i = 0; i != DMSS_URING_SLOTS; ++i) {
+    uring->slots[i].uring = uring;
+    uring->slots[i].bid = i;
+    io_uring_buf_ring_add (uring->buf_ring,
+        uring->slab + i * DMSS_URING_SLOT_SIZE, DMSS_URING_SLOT_SIZE, i,
+        io_uring_buf_ring_mask (DMSS_URING_SLOTS), i);
+  }
+  io_uring_buf_ring_advance (uring->buf_ring, DMSS_URING_SLOTS);
+  uring->slots_free = DMSS_URING_SLOTS;
+
+  uring->refcount = 1;
+  uring->socket = g_object_ref (socket);
+  uring->cancellable = g_object_ref (cancellable);
+  uring->cancel_fd = g_cancellable_get_fd (cancellable);
+  uring->multishot = TRUE;
+  g_mutex_init (&uring->lock);
+  g_cond_init (&uring->cond);
+  g_queue_init (&uring->ready);
+  gst_dmss_parser_init (&uring->parser, GST_DMSS_PARSER_SHORT_BODY_SIZE);
+
+  GST_DEBUG ("Created io_uring with %d slots of %d bytes", DMSS_URING_SLOTS,
+      DMSS_URING_SLOT_SIZE);
+
+  return uring;
+}
+
+void
+gst_dmss_uring_free (GstDmssUring * uring)
+{
+  struct io_uring_sqe *sqe;
+
+  // the ring outlives us while downstream holds slots, so stop receiving
+  if (uring->recv_armed) {
+    sqe = io_uring_get_sqe (&uring->ring);
+    io_uring_prep_cancel64 (sqe, DMSS_URING_TAG_RECV, 0);
+    io_uring_sqe_set_data64 (sqe, DMSS_URING_TAG_CANCEL);
+    io_uring_submit (&uring->ring);
+  }
+
+  if (uring->packet)
+    gst_buffer_unref (uring->packet);
+  uring->packet = NULL;
+  g_queue_foreach (&uring->ready, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (&uring->ready);
+  g_clear_error (&uring->error);
+  if (uring->cancel_fd >= 0)
+    g_cancellable_release_fd (uring->cancellable);
+  g_object_unref (uring->cancellable);
+  g_object_unref (uring->socket);
+
+  gst_dmss_uring_unref (uring);
+}
+
+guint
+gst_dmss_uring_take_syscalls (GstDmssUring * uring)
+{
+  return g_atomic_int_and ((guint *) & uring->syscalls, 0);
+}
+
+#else /* !HAVE_LIBURING */
+
+GstDmssUring *
+gst_dmss_uring_new (GSocket * socket, GCancellable * cancellable,
+    GError ** err)
+{
+  g_set_error_literal (err, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+      "Built without io_uring support");
+  return NULL;
+}
+
+void
+gst_dmss_uring_free (GstDmssUring * uring)
+{
+  g_assert_not_reached ();
+}
+
+GstFlowReturn
+gst_dmss_uring_receive_packet (GstDmssUring * uring, GstBuffer ** buffer,
+    GError ** err)
+{
+  g_assert_not_reached ();
+  return GST_FLOW_ERROR;
+}
+
+guint
+gst_dmss_uring_take_syscalls (GstDmssUring * uring)
+{
+  g_assert_not_reached ();
+  return 0;
+}
+
+#endif /* HAVE_LIBURING */
@@ -0,0 +1,40 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_DMSS_URING_H__
+#define __GST_DMSS_URING_H__
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GstDmssUring GstDmssUring;
+
+GstDmssUring *gst_dmss_uring_new (GSocket * socket,
+    GCancellable * cancellable, GError ** err);
+void gst_dmss_uring_free (GstDmssUring * uring);
+
+GstFlowReturn gst_dmss_uring_receive_packet (GstDmssUring * uring,
+    GstBuffer ** buffer, GError ** err);
+guint gst_dmss_uring_take_syscalls (GstDmssUring * uring);
+
+G_END_DECLS
+#endif /* __GST_DMSS_URING_H__ */
@@ -30,6 +30,38 @@
 #include <gio/gio.h>
 #include "gstdmsssrc.h"
 #include "gstdmssdemux.h"
+#include "gstdmssnvrsrc.h"
+#include "gstdmssdavsrc.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY_EXTERN (dmsssrc_debug);
+
+static GstStaticCaps dhav_caps = GST_STATIC_CAPS ("video/x-dhav");
+
+/* .dav files are DHAV frames back to back, the first one must end where
+ * its header says with the "dhav" trailer */
+static void
+gst_dmss_dhav_type_find (GstTypeFind * tf, gpointer unused)
+{
+  const guint8 *data;
+  guint32 frame_size;
+
+  if (!(data = gst_type_find_peek (tf, 0, 24)) || memcmp (data, "DHAV", 4))
+    return;
+
+  frame_size = GST_READ_UINT32_LE (&data[12]);
+  if (frame_size < 32)
+    return;
+
+  if ((data = gst_type_find_peek (tf, frame_size - 8, 4))
+      && !memcmp (data, "dhav", 4))
+    gst_type_find_suggest (tf, GST_TYPE_FIND_LIKELY,
+        gst_static_caps_get (&dhav_caps));
+  else
+    gst_type_find_suggest (tf, GST_TYPE_FIND_POSSIBLE,
+        gst_static_caps_get (&dhav_caps));
+}
 
 /* entry point to initialize the plug-in
  * initialize the plug-in itself
@@ -42,6 +74,9 @@ plugin_init (GstPlugin * plugin)
    *
    * exchange the string 'Template plugin' with your description
    */
+  // the session and protocol helpers log here, dmssnvrsrc may use them
+  // before the dmsssrc class is ever initialized
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
 
   if (!gst_element_register (plugin, "dmsssrc", GST_RANK_NONE,
           GST_TYPE_DMSS_SRC))
@@ -49,6 +84,16 @@ plugin_init (GstPlugin * plugin)
   if (!gst_element_register (plugin, "dmssdemux", GST_RANK_NONE,
           GST_TYPE_DMSS_DEMUX))
     return FALSE;
+  if (!gst_element_register (plugin, "dmssnvrsrc", GST_RANK_NONE,
+          GST_TYPE_DMSS_NVR_SRC))
+    return FALSE;
+  if (!gst_element_register (plugin, "dmssdavsrc", GST_RANK_NONE,
+          GST_TYPE_DMSS_DAV_SRC))
+    return FALSE;
+  if (!gst_type_find_register (plugin, "video/x-dhav", GST_RANK_SECONDARY,
+          gst_dmss_dhav_type_find, "dav", gst_static_caps_get (&dhav_caps),
+          NULL, NULL))
+    return FALSE;
 
   return TRUE;
 }
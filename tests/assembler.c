@@ -0,0 +1,236 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Assembler: random pushes, peeks, reads, flushes and takes checked against
+ * a plain byte array, plus which of them copy.
+ */
+
+#include <gst/gst.h>
+#include "gstdmssassembler.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+#define ASSEMBLER_TEST_ROUNDS 20000
+
+/* A buffer of size bytes carrying the stream from position on */
+static GstBuffer *
+make_buffer (GByteArray * stream, gsize position, gsize size)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, size, NULL);
+
+  gst_buffer_fill (buffer, 0, stream->data + position, size);
+  return buffer;
+}
+
+static GByteArray *
+make_stream (gsize size)
+{
+  GByteArray *stream = g_byte_array_sized_new (size);
+  GRand *rand = g_rand_new_with_seed (0x44484156);
+  gsize i;
+
+  g_byte_array_set_size (stream, size);
+  for (i = 0; i != size; ++i)
+    stream->data[i] = g_rand_int (rand);
+  g_rand_free (rand);
+
+  return stream;
+}
+
+static void
+check_buffer (GstBuffer * buffer, const guint8 * expected, gsize size)
+{
+  GstMapInfo map;
+
+  g_assert_cmpuint (gst_buffer_get_size (buffer), ==, size);
+  if (!size)
+    return;
+  g_assert_true (gst_buffer_map (buffer, &map, GST_MAP_READ));
+  g_assert_true (!memcmp (map.data, expected, size));
+  gst_buffer_unmap (buffer, &map);
+}
+
+static void
+test_peek (void)
+{
+  GByteArray *stream = make_stream (300);
+  GstDmssAssembler *assembler = gst_dmss_assembler_new ();
+  const guint8 *data;
+  gsize size;
+
+  g_assert_null (gst_dmss_assembler_peek_contiguous (assembler, &size));
+  g_assert_cmpuint (size, ==, 0);
+
+  gst_dmss_assembler_push (assembler, make_buffer (stream, 0, 100));
+  gst_dmss_assembler_push (assembler, gst_buffer_new ());
+  gst_dmss_assembler_push (assembler, make_buffer (stream, 100, 200));
+  g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==, 300);
+
+  // inside the first chunk, no copy
+  data = gst_dmss_assembler_peek (assembler, 100);
+  g_assert_true (!memcmp (data, stream->data, 100));
+  g_assert_cmpuint (gst_dmss_assembler_take_copied (assembler), ==, 0);
+  data = gst_dmss_assembler_peek_contiguous (assembler, &size);
+  g_assert_cmpuint (size, ==, 100);
+
+  // over the edge, copied into the scratch area
+  data = gst_dmss_assembler_peek (assembler, 150);
+  g_assert_true (!memcmp (data, stream->data, 150));
+  g_assert_cmpuint (gst_dmss_assembler_take_copied (assembler), ==, 150);
+
+  g_assert_null (gst_dmss_assembler_peek (assembler, 301));
+  g_assert_null (gst_dmss_assembler_peek (assembler, 0));
+
+  gst_dmss_assembler_flush (assembler, 120);
+  g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==, 180);
+  data = gst_dmss_assembler_peek_contiguous (assembler, &size);
+  g_assert_cmpuint (size, ==, 180);
+  g_assert_true (!memcmp (data, stream->data + 120, 180));
+
+  gst_dmss_assembler_clear (assembler);
+  g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==, 0);
+
+  gst_dmss_assembler_free (assembler);
+  g_byte_array_unref (stream);
+}
+
+static void
+test_take_buffer (void)
+{
+  GByteArray *stream = make_stream (4096);
+  GstDmssAssembler *assembler = gst_dmss_assembler_new ();
+  GstBuffer *buffer;
+  gsize position = 0;
+  guint i, chunks = gst_buffer_get_max_memory () + 4;
+
+  // one memory per chunk, shared and not copied
+  for (i = 0; i != 3; ++i, position += 10)
+    gst_dmss_assembler_push (assembler, make_buffer (stream, position, 10));
+  buffer = gst_dmss_assembler_take_buffer (assembler, 25);
+  // before mapping, which merges them
+  g_assert_cmpuint (gst_buffer_n_memory (buffer), ==, 3);
+  check_buffer (buffer, stream->data, 25);
+  g_assert_cmpuint (gst_dmss_assembler_take_copied (assembler), ==, 0);
+  gst_buffer_unref (buffer);
+  g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==, 5);
+
+  // more chunks than a buffer holds memories, those get merged
+  for (i = 0; i != chunks; ++i, position += 10)
+    gst_dmss_assembler_push (assembler, make_buffer (stream, position, 10));
+  buffer = gst_dmss_assembler_take_buffer (assembler, 5 + chunks * 10);
+  check_buffer (buffer, stream->data + 25, 5 + chunks * 10);
+  g_assert_cmpuint (gst_dmss_assembler_take_copied (assembler), >, 0);
+  gst_buffer_unref (buffer);
+  g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==, 0);
+
+  gst_dmss_assembler_free (assembler);
+  g_byte_array_unref (stream);
+}
+
+/* Every operation at random against the bytes that should be there */
+static void
+test_random (void)
+{
+  GByteArray *stream = make_stream (4 * 1024 * 1024);
+  GstDmssAssembler *assembler = gst_dmss_assembler_new ();
+  GRand *rand = g_rand_new_with_seed (0x64686176);
+  gsize pushed = 0, consumed = 0, available, size, offset;
+  const guint8 *data;
+  guint8 copy[1024];
+  GstBuffer *buffer;
+  guint round;
+
+  for (round = 0; round != ASSEMBLER_TEST_ROUNDS; ++round) {
+    available = pushed - consumed;
+    g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==,
+        available);
+
+    switch (g_rand_int_range (rand, 0, 8)) {
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+        // more in than out, the ring grows and wraps over many chunks
+        size = g_rand_int_range (rand, 0, 300);
+        size = MIN (size, stream->len - pushed);
+        gst_dmss_assembler_push (assembler, make_buffer (stream, pushed,
+                size));
+        pushed += size;
+        break;
+      case 4:
+        size = g_rand_int_range (rand, 0, 700);
+        data = gst_dmss_assembler_peek (assembler, size);
+        if (!size || size > available) {
+          g_assert_null (data);
+          break;
+        }
+        g_assert_true (!memcmp (data, stream->data + consumed, size));
+        break;
+      case 5:
+        if (!available)
+          break;
+        offset = g_rand_int_range (rand, 0, available);
+        size = g_rand_int_range (rand, 0, sizeof (copy));
+        size = MIN (size, available - offset);
+        gst_dmss_assembler_read (assembler, offset, copy, size);
+        g_assert_true (!memcmp (copy, stream->data + consumed + offset,
+                size));
+        break;
+      case 6:
+        size = g_rand_int_range (rand, 0, 300);
+        size = MIN (size, available);
+        gst_dmss_assembler_flush (assembler, size);
+        consumed += size;
+        break;
+      case 7:
+        size = g_rand_int_range (rand, 0, 600);
+        size = MIN (size, available);
+        buffer = gst_dmss_assembler_take_buffer (assembler, size);
+        check_buffer (buffer, stream->data + consumed, size);
+        gst_buffer_unref (buffer);
+        consumed += size;
+        break;
+    }
+  }
+
+  gst_dmss_assembler_flush (assembler, pushed - consumed);
+  g_assert_cmpuint (gst_dmss_assembler_available (assembler), ==, 0);
+  g_assert_null (gst_dmss_assembler_peek_contiguous (assembler, &size));
+
+  g_rand_free (rand);
+  gst_dmss_assembler_free (assembler);
+  g_byte_array_unref (stream);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  g_test_add_func ("/assembler/peek", test_peek);
+  g_test_add_func ("/assembler/take-buffer", test_take_buffer);
+  g_test_add_func ("/assembler/random", test_random);
+
+  return g_test_run ();
+}
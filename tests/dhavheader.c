@@ -0,0 +1,157 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* DHAV header: the packed time, and the extended header decoded through
+ * the tag table, with known tags skipped, unknown ones ending the walk and
+ * truncated ones failing it.
+ */
+
+#include <gst/gst.h>
+#include "gstdmssprotocol.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+#define DHAV_TIME(year, month, day, hour, minute, second) \
+  ((((year) - 2000u) << 26) | ((month) << 22) | ((day) << 17) | \
+      ((hour) << 12) | ((minute) << 6) | (second))
+
+static void
+test_dhav_time (void)
+{
+  g_assert_cmpint (gst_dmss_protocol_dhav_time (DHAV_TIME (2018u, 9u, 22u,
+              11u, 29u, 0u)), ==, 1537615740);
+  g_assert_cmpint (gst_dmss_protocol_dhav_time (DHAV_TIME (2020u, 2u, 29u,
+              0u, 0u, 0u)), ==, 1582934400);
+  g_assert_cmpint (gst_dmss_protocol_dhav_time (DHAV_TIME (2063u, 12u, 31u,
+              23u, 59u, 59u)), ==, G_GINT64_CONSTANT (2966371199));
+}
+
+/* A fixed DHAV header followed by the given extended header */
+static guint8 *
+make_header (const guint8 * tags, gsize tags_size, gsize * size)
+{
+  guint8 *header = g_malloc0 (24 + tags_size);
+
+  memcpy (header, "DHAV", 4);
+  header[4] = 0xfc;
+  GST_WRITE_UINT32_LE (&header[16], DHAV_TIME (2018u, 9u, 22u, 11u, 29u,
+          0u));
+  header[22] = tags_size;
+  if (tags_size)
+    memcpy (header + 24, tags, tags_size);
+  *size = 24 + tags_size;
+
+  return header;
+}
+
+static void
+test_dhav_header (void)
+{
+  static const guint8 tags[] = {
+    0x80, 0x00, 80, 45,                 /* 640x360 in blocks */
+    0x88, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,     /* known, skipped */
+    0x81, 0x00, 0x02, 25,               /* H.264 at 25 fps */
+    0x83, 0x01, 0x0e, 0x02,             /* mono, G.711A, 8 kHz */
+    0x82, 0x00, 0x00, 0x00, 0x00, 0x05, 0xd0, 0x02,     /* 1280x720 */
+    0x00, 0x00, 0x00, 0x00,             /* padding */
+  };
+  GstDmssDhavInfo info;
+  guint8 *header;
+  gsize size;
+
+  header = make_header (tags, sizeof (tags), &size);
+  g_assert_true (gst_dmss_protocol_parse_dhav_header (header, size, &info));
+  g_assert_cmpint (info.time, ==, 1537615740);
+  g_assert_cmpint (info.flags, ==, GST_DMSS_DHAV_INFO_VIDEO |
+      GST_DMSS_DHAV_INFO_RESOLUTION | GST_DMSS_DHAV_INFO_AUDIO);
+  g_assert_cmpuint (info.video_format, ==, 0x02);
+  g_assert_cmpuint (info.frame_rate, ==, 25);
+  // the later size tag wins over the blocks
+  g_assert_cmpuint (info.width, ==, 1280);
+  g_assert_cmpuint (info.height, ==, 720);
+  g_assert_cmpuint (info.audio_channels, ==, 1);
+  g_assert_cmpuint (info.audio_format, ==, 0x0e);
+  g_assert_cmpuint (info.audio_rate, ==, 0x02);
+  g_assert_cmpuint (info.unknown_tag, ==, 0);
+  g_free (header);
+
+  // no extended header at all
+  header = make_header (NULL, 0, &size);
+  g_assert_true (gst_dmss_protocol_parse_dhav_header (header, size, &info));
+  g_assert_cmpint (info.flags, ==, 0);
+  g_assert_false (gst_dmss_protocol_parse_dhav_header (header, 23, &info));
+  g_free (header);
+}
+
+static void
+test_dhav_header_unknown_tag (void)
+{
+  static const guint8 tags[] = {
+    0x81, 0x00, 0x02, 25,
+    0x99, 0x04, 0x00, 0x00,
+    0x83, 0x01, 0x0e, 0x02,
+  };
+  GstDmssDhavInfo info;
+  guint8 *header;
+  gsize size;
+
+  // what comes after an unknown tag can't be found, the frame is fine
+  header = make_header (tags, sizeof (tags), &size);
+  g_assert_true (gst_dmss_protocol_parse_dhav_header (header, size, &info));
+  g_assert_cmpuint (info.unknown_tag, ==, 0x99);
+  g_assert_cmpint (info.flags, ==, GST_DMSS_DHAV_INFO_VIDEO);
+  g_assert_cmpuint (info.frame_rate, ==, 25);
+  g_free (header);
+}
+
+static void
+test_dhav_header_truncated (void)
+{
+  static const guint8 tags[] = {
+    0x81, 0x00, 0x02, 25,
+    0x82, 0x00, 0x00, 0x00,
+  };
+  GstDmssDhavInfo info;
+  guint8 *header;
+  gsize size;
+
+  // the size tag needs eight bytes, what came before is kept
+  header = make_header (tags, sizeof (tags), &size);
+  g_assert_false (gst_dmss_protocol_parse_dhav_header (header, size, &info));
+  g_assert_cmpint (info.flags, ==, GST_DMSS_DHAV_INFO_VIDEO);
+  g_assert_cmpuint (info.unknown_tag, ==, 0);
+  g_free (header);
+}
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  g_test_add_func ("/dhavheader/time", test_dhav_time);
+  g_test_add_func ("/dhavheader/tags", test_dhav_header);
+  g_test_add_func ("/dhavheader/unknown-tag", test_dhav_header_unknown_tag);
+  g_test_add_func ("/dhavheader/truncated", test_dhav_header_truncated);
+
+  return g_test_run ();
+}
@@ -0,0 +1,154 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Checks each gst_dmss_dhav_scan variant the build has against a naive
+ * search, on random data dense in partial matches, at every alignment and
+ * with matches straddling the end of the buffer.
+ *
+ * The scanner is included rather than linked so the static SSE2, AVX2 and
+ * NEON variants are tested on their own, not only the one dispatched to.
+ */
+
+#include "gstdmssdhavscan.c"
+
+#define DHAVSCAN_TEST_ROUNDS   20000
+#define DHAVSCAN_TEST_MAX_SIZE 4096
+#define DHAVSCAN_TEST_ALIGN    64
+
+typedef gsize (*DhavScanFunc) (const guint8 * data, gsize size);
+
+static gsize
+naive_scan (const guint8 * data, gsize size)
+{
+  gsize i;
+
+  for (i = 0; i + 4 <= size; ++i)
+    if (!memcmp (data + i, "DHAV", 4))
+      return i;
+
+  return size;
+}
+
+static gsize
+scalar_scan (const guint8 * data, gsize size)
+{
+  return gst_dmss_dhav_scan_scalar (data, size, 0);
+}
+
+static void
+check_scan (DhavScanFunc scan)
+{
+  // skewed towards the magic so most blocks hold a partial match
+  static const gchar alphabet[] = "DHAVDHAVDx";
+  guint8 *block = g_malloc (DHAVSCAN_TEST_ALIGN + DHAVSCAN_TEST_MAX_SIZE);
+  GRand *rand = g_rand_new_with_seed (0x44484156);
+  guint8 *data;
+  gsize size, i;
+  guint round;
+
+  for (round = 0; round != DHAVSCAN_TEST_ROUNDS; ++round) {
+    data = block + g_rand_int_range (rand, 0, DHAVSCAN_TEST_ALIGN);
+    size = g_rand_int_range (rand, 0, round % 8 ? 256 :
+        DHAVSCAN_TEST_MAX_SIZE);
+    for (i = 0; i != size; ++i)
+      data[i] = alphabet[g_rand_int_range (rand, 0, sizeof (alphabet) - 1)];
+    // a match cut by the end of the buffer must not be found
+    if (size >= 3 && round % 5 == 0)
+      memcpy (data + size - 3, "DHA", 3);
+
+    g_assert_cmpuint (scan (data, size), ==, naive_scan (data, size));
+  }
+
+  g_rand_free (rand);
+  g_free (block);
+}
+
+static void
+test_edges (void)
+{
+  const guint8 *magic = (const guint8 *) "xxDHAV";
+
+  g_assert_cmpuint (gst_dmss_dhav_scan (magic, 0), ==, 0);
+  g_assert_cmpuint (gst_dmss_dhav_scan (magic, 3), ==, 3);
+  g_assert_cmpuint (gst_dmss_dhav_scan (magic, 5), ==, 5);
+  g_assert_cmpuint (gst_dmss_dhav_scan (magic, 6), ==, 2);
+  g_assert_cmpuint (gst_dmss_dhav_scan (magic + 2, 4), ==, 0);
+}
+
+static void
+test_dispatch (void)
+{
+  check_scan (gst_dmss_dhav_scan);
+}
+
+static void
+test_scalar (void)
+{
+  check_scan (scalar_scan);
+}
+
+#ifdef DMSS_DHAV_SCAN_SSE2
+static void
+test_sse2 (void)
+{
+  check_scan (gst_dmss_dhav_scan_sse2);
+}
+#endif
+
+#ifdef DMSS_DHAV_SCAN_AVX2
+static void
+test_avx2 (void)
+{
+  if (!__builtin_cpu_supports ("avx2")) {
+    g_test_skip ("no AVX2 on this CPU");
+    return;
+  }
+  check_scan (gst_dmss_dhav_scan_avx2);
+}
+#endif
+
+#ifdef DMSS_DHAV_SCAN_NEON
+static void
+test_neon (void)
+{
+  check_scan (gst_dmss_dhav_scan_neon);
+}
+#endif
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/dhavscan/edges", test_edges);
+  g_test_add_func ("/dhavscan/dispatch", test_dispatch);
+  g_test_add_func ("/dhavscan/scalar", test_scalar);
+#ifdef DMSS_DHAV_SCAN_SSE2
+  g_test_add_func ("/dhavscan/sse2", test_sse2);
+#endif
+#ifdef DMSS_DHAV_SCAN_AVX2
+  g_test_add_func ("/dhavscan/avx2", test_avx2);
+#endif
+#ifdef DMSS_DHAV_SCAN_NEON
+  g_test_add_func ("/dhavscan/neon", test_neon);
+#endif
+
+  return g_test_run ();
+}
@@ -0,0 +1,153 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* A device hangs up both once a recording is played and when it drops
+ * the client mid-file. The mock server sends a two second recording and
+ * is made to drop its connection part way, and the last frame received
+ * must tell the two apart.
+ */
+
+#include <gst/gst.h>
+#include "gstdmssprotocol.h"
+#include "gstdmssmock.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+#define FRAME_SIZE      4096
+#define BODY_SIZE       1024
+/* the mock sends 50 frames 40 ms apart */
+#define RECORDING_SECONDS 2
+
+/* Receives from the mock until it hangs up. Returns how many bytes came
+ * and sets the times of the first and last whole frames.
+ */
+static gsize
+receive_recording (GstDmssMock * mock, gint64 * first_time,
+    gint64 * last_time)
+{
+  GSocketClient *client = g_socket_client_new ();
+  GSocketConnection *connection;
+  GInputStream *input;
+  GstDmssParser parser;
+  GByteArray *dhav = g_byte_array_new ();
+  GError *err = NULL;
+  gchar data[4096];
+  gssize size;
+  gsize offset, consumed, received = 0;
+  guint32 frame_size;
+
+  connection = g_socket_client_connect_to_host (client, "127.0.0.1",
+      gst_dmss_mock_get_port (mock), NULL, &err);
+  g_assert_no_error (err);
+  input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+
+  gst_dmss_parser_init (&parser, GST_DMSS_PARSER_SHORT_BODY_SIZE);
+  while ((size = g_input_stream_read (input, data, sizeof (data), NULL,
+              &err)) > 0) {
+    received += size;
+    for (offset = 0; offset != (gsize) size; offset += consumed) {
+      if (gst_dmss_parser_feed (&parser, data + offset, size - offset,
+              &consumed) == GST_DMSS_PARSER_BODY
+          && (guint8) parser.header[0] == 0xbc)
+        g_byte_array_append (dhav, (const guint8 *) parser.body,
+            parser.body_length);
+    }
+  }
+  g_assert_no_error (err);
+  g_assert_cmpint (size, ==, 0);
+
+  *first_time = *last_time = -1;
+  for (offset = 0; offset + 24 <= dhav->len; offset += frame_size) {
+    g_assert_true (!memcmp (&dhav->data[offset], "DHAV", 4));
+    frame_size = GST_READ_UINT32_LE (&dhav->data[offset + 12]);
+    if (offset + frame_size > dhav->len)
+      break;
+    *last_time = gst_dmss_protocol_dhav_time (GST_READ_UINT32_LE
+        (&dhav->data[offset + 16]));
+    if (*first_time < 0)
+      *first_time = *last_time;
+  }
+
+  g_byte_array_unref (dhav);
+  g_object_unref (connection);
+  g_object_unref (client);
+
+  return received;
+}
+
+static void
+test_hangup (void)
+{
+  GstDmssMock *mock;
+  GError *err = NULL;
+  gint64 first_time, last_time, end_time;
+  gsize total;
+
+  mock = gst_dmss_mock_new (0, FRAME_SIZE, BODY_SIZE, 1, &err);
+  g_assert_no_error (err);
+
+  // played to the end
+  total = receive_recording (mock, &first_time, &last_time);
+  end_time = first_time + RECORDING_SECONDS;
+  g_assert_cmpint (last_time, ==, end_time - 1);
+  g_assert_true (gst_dmss_protocol_playback_ended (last_time, end_time,
+          FALSE));
+
+  // dropped in the first second, before the end
+  gst_dmss_mock_set_drop (mock, total / 3);
+  receive_recording (mock, &first_time, &last_time);
+  g_assert_cmpint (last_time, ==, first_time);
+  g_assert_false (gst_dmss_protocol_playback_ended (last_time, end_time,
+          FALSE));
+
+  // dropped in the last second, which frame times can't tell from the end
+  gst_dmss_mock_set_drop (mock, total - FRAME_SIZE - 17);
+  receive_recording (mock, &first_time, &last_time);
+  g_assert_cmpint (last_time, ==, end_time - 1);
+  g_assert_true (gst_dmss_protocol_playback_ended (last_time, end_time,
+          FALSE));
+
+  gst_dmss_mock_free (mock);
+}
+
+static void
+test_reverse (void)
+{
+  // playing backwards ends at the start of the range
+  g_assert_true (gst_dmss_protocol_playback_ended (1000, 1000, TRUE));
+  g_assert_true (gst_dmss_protocol_playback_ended (1001, 1000, TRUE));
+  g_assert_false (gst_dmss_protocol_playback_ended (1002, 1000, TRUE));
+  g_assert_false (gst_dmss_protocol_playback_ended (998, 1000, FALSE));
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  g_test_add_func ("/hangup/mid-file", test_hangup);
+  g_test_add_func ("/hangup/reverse", test_reverse);
+
+  return g_test_run ();
+}
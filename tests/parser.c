@@ -0,0 +1,163 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* DMSS packet parser: packets fed in every split, and the short body size
+ * of stream packets.
+ */
+
+#include <gst/gst.h>
+#include "gstdmssprotocol.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+/* Two packets back to back: 0xbc with a body of body_size, 0xf6 empty */
+static GByteArray *
+make_packets (guint32 body_size)
+{
+  GByteArray *packets = g_byte_array_new ();
+  guint8 header[GST_DMSS_PROTOCOL_HEADER_SIZE] = { 0xbc, };
+  guint32 i;
+  guint8 byte;
+
+  GST_WRITE_UINT32_LE (&header[4], body_size);
+  g_byte_array_append (packets, header, sizeof (header));
+  for (i = 0; i != body_size; ++i) {
+    byte = i * 7;
+    g_byte_array_append (packets, &byte, 1);
+  }
+  memset (header, 0, sizeof (header));
+  header[0] = 0xf6;
+  g_byte_array_append (packets, header, sizeof (header));
+
+  return packets;
+}
+
+/* Feeds data split every step bytes and checks the events come in order
+ * with the body put back together */
+static void
+check_parser_split (GByteArray * packets, guint32 body_size, gsize step)
+{
+  GstDmssParser parser;
+  GstDmssParserEvent event;
+  guint8 *body = g_malloc0 (body_size + 1);
+  gsize offset = 0, length, consumed;
+  guint headers = 0, ends = 0;
+
+  gst_dmss_parser_init (&parser, 0);
+  while (offset != packets->len || !ends || ends != headers) {
+    length = MIN (step, packets->len - offset);
+    if (headers == ends)
+      g_assert_cmpuint (gst_dmss_parser_get_wanted (&parser), <=,
+          GST_DMSS_PROTOCOL_HEADER_SIZE);
+    event = gst_dmss_parser_feed (&parser,
+        (const gchar *) packets->data + offset, length, &consumed);
+    g_assert_cmpuint (consumed, <=, length);
+    offset += consumed;
+
+    switch (event) {
+      case GST_DMSS_PARSER_NEED_DATA:
+        g_assert_cmpuint (consumed, ==, length);
+        g_assert_cmpuint (length, !=, 0);
+        break;
+      case GST_DMSS_PARSER_HEADER:
+        g_assert_cmpuint (headers, ==, ends);
+        ++headers;
+        g_assert_cmpuint (parser.body_size, ==, headers == 1 ? body_size : 0);
+        g_assert_cmpuint (gst_dmss_parser_get_wanted (&parser), ==,
+            parser.body_size);
+        break;
+      case GST_DMSS_PARSER_BODY:
+        g_assert_cmpuint (headers, ==, 1);
+        g_assert_cmpuint (parser.body_length, ==, consumed);
+        g_assert_cmpuint (parser.body_offset + parser.body_length, <=,
+            body_size);
+        memcpy (body + parser.body_offset, parser.body, parser.body_length);
+        break;
+      case GST_DMSS_PARSER_PACKET_END:
+        g_assert_cmpuint (consumed, ==, 0);
+        g_assert_cmpint ((guint8) parser.header[0], ==,
+            headers == 1 ? 0xbc : 0xf6);
+        ++ends;
+        break;
+    }
+  }
+
+  g_assert_cmpuint (headers, ==, 2);
+  g_assert_cmpuint (ends, ==, 2);
+  g_assert_true (!memcmp (body, packets->data + GST_DMSS_PROTOCOL_HEADER_SIZE,
+          body_size));
+  g_free (body);
+}
+
+static void
+test_parser (void)
+{
+  static const gsize steps[] = { 1, 3, 31, 32, 33, 1000, G_MAXSIZE };
+  static const guint32 body_sizes[] = { 0, 1, 100, 70000 };
+  GByteArray *packets;
+  guint i, j;
+
+  for (i = 0; i != G_N_ELEMENTS (body_sizes); ++i) {
+    packets = make_packets (body_sizes[i]);
+    for (j = 0; j != G_N_ELEMENTS (steps); ++j)
+      check_parser_split (packets, body_sizes[i], steps[j]);
+    g_byte_array_unref (packets);
+  }
+}
+
+static void
+test_parser_short_body_size (void)
+{
+  guint8 header[GST_DMSS_PROTOCOL_HEADER_SIZE] = { 0xbc, };
+  GstDmssParser parser;
+  gsize consumed;
+
+  // stream packets carry flags above the 16 bits of the size
+  GST_WRITE_UINT32_LE (&header[4], 0x00010010);
+
+  gst_dmss_parser_init (&parser, GST_DMSS_PARSER_SHORT_BODY_SIZE);
+  g_assert_cmpint (gst_dmss_parser_feed (&parser, (const gchar *) header,
+          sizeof (header), &consumed), ==, GST_DMSS_PARSER_HEADER);
+  g_assert_cmpuint (parser.body_size, ==, 0x10);
+
+  gst_dmss_parser_init (&parser, 0);
+  g_assert_cmpint (gst_dmss_parser_feed (&parser, (const gchar *) header,
+          sizeof (header), &consumed), ==, GST_DMSS_PARSER_HEADER);
+  g_assert_cmpuint (parser.body_size, ==, 0x00010010);
+
+  // reset drops a packet half way
+  gst_dmss_parser_reset (&parser);
+  g_assert_cmpuint (gst_dmss_parser_get_wanted (&parser), ==,
+      GST_DMSS_PROTOCOL_HEADER_SIZE);
+}
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  g_test_add_func ("/parser/split", test_parser);
+  g_test_add_func ("/parser/short-body-size", test_parser_short_body_size);
+
+  return g_test_run ();
+}
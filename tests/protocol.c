@@ -0,0 +1,166 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Protocol helpers: the JSON lookups used on 0xf6 replies */
+
+#include <gst/gst.h>
+#include "gstdmssprotocol.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+static const gchar *
+find (const gchar * json, const gchar * key, gsize * value_size)
+{
+  return gst_dmss_protocol_json_find (json, strlen (json), key, value_size);
+}
+
+static gboolean
+get_int (const gchar * json, const gchar * key, gint64 * value)
+{
+  return gst_dmss_protocol_json_get_int (json, strlen (json), key, value);
+}
+
+static gchar *
+get_string (const gchar * json, const gchar * key)
+{
+  return gst_dmss_protocol_json_get_string (json, strlen (json), key);
+}
+
+static void
+test_json_value_size (void)
+{
+  /* each value followed by what ends it */
+  static const struct
+  {
+    const gchar *json;
+    const gchar *value;
+  } values[] = {
+    {"12, \"b\" : 1", "12"},
+    {"\"a\\\"b\", 1", "\"a\\\"b\""},
+    {"\"a,}\" }", "\"a,}\""},
+    {"{ \"a\" : [ 1, { \"b\" : \"]\" } ] }, 2",
+        "{ \"a\" : [ 1, { \"b\" : \"]\" } ] }"},
+    {"[ 1, [ 2 ] ] }", "[ 1, [ 2 ] ]"},
+    {"true }", "true "},
+  };
+  guint i;
+
+  for (i = 0; i != G_N_ELEMENTS (values); ++i)
+    g_assert_cmpuint (gst_dmss_protocol_json_value_size (values[i].json,
+            strlen (values[i].json)), ==, strlen (values[i].value));
+
+  // cut short
+  g_assert_cmpuint (gst_dmss_protocol_json_value_size ("\"abc", 4), ==, 0);
+  g_assert_cmpuint (gst_dmss_protocol_json_value_size ("{ \"a\" : 1", 9), ==,
+      0);
+}
+
+static void
+test_json_find (void)
+{
+  static const gchar json[] = "{ \"id\" : 12, \"params\" : { \"name\" : "
+      "\"found\", \"note\" : \"\\\"found\\\" : 9\", \"found\"\t:\n 32, "
+      "\"idx\" : 4 }, \"session\" : 5 }";
+  const gchar *value;
+  gsize value_size;
+
+  // a string value or an escaped quote spelling the key is no member
+  value = find (json, "found", &value_size);
+  g_assert_nonnull (value);
+  g_assert_cmpuint (value_size, ==, 2);
+  g_assert_true (!memcmp (value, "32", 2));
+
+  value = find (json, "params", &value_size);
+  g_assert_nonnull (value);
+  g_assert_cmpint (value[0], ==, '{');
+  g_assert_cmpint (value[value_size - 1], ==, '}');
+
+  g_assert_null (find (json, "missing", &value_size));
+  g_assert_null (find (json, "ession", &value_size));
+  // a value running past the end
+  g_assert_null (gst_dmss_protocol_json_find (json, strstr (json,
+              "\"session\"") - json + 14, "session", &value_size));
+}
+
+static void
+test_json_get_int (void)
+{
+  static const gchar json[] = "{ \"id\" : 12, \"idx\" : -4, \"big\" : "
+      "4294967296, \"str\" : \"7\", \"obj\" : { \"id\" : 1 }, \"long\" : "
+      "123456789012345678901234567890123 }";
+  gint64 value;
+
+  g_assert_true (get_int (json, "id", &value));
+  g_assert_cmpint (value, ==, 12);
+  g_assert_true (get_int (json, "idx", &value));
+  g_assert_cmpint (value, ==, -4);
+  g_assert_true (get_int (json, "big", &value));
+  g_assert_cmpint (value, ==, G_GINT64_CONSTANT (4294967296));
+
+  g_assert_false (get_int (json, "str", &value));
+  g_assert_false (get_int (json, "obj", &value));
+  g_assert_false (get_int (json, "long", &value));
+  g_assert_false (get_int (json, "none", &value));
+}
+
+static void
+test_json_get_string (void)
+{
+  static const gchar json[] = "{ \"path\" : \"\\/mnt\\/dvr\\/a.dav\", "
+      "\"quoted\" : \"say \\\"hi\\\"\", \"controls\" : \"a\\tb\\nc\\rd\", "
+      "\"backslash\" : \"c:\\\\dav\", \"empty\" : \"\", \"number\" : 3 }";
+  gchar *value;
+
+  value = get_string (json, "path");
+  g_assert_cmpstr (value, ==, "/mnt/dvr/a.dav");
+  g_free (value);
+  value = get_string (json, "quoted");
+  g_assert_cmpstr (value, ==, "say \"hi\"");
+  g_free (value);
+  value = get_string (json, "controls");
+  g_assert_cmpstr (value, ==, "a\tb\nc\rd");
+  g_free (value);
+  value = get_string (json, "backslash");
+  g_assert_cmpstr (value, ==, "c:\\dav");
+  g_free (value);
+  value = get_string (json, "empty");
+  g_assert_cmpstr (value, ==, "");
+  g_free (value);
+
+  g_assert_null (get_string (json, "number"));
+  g_assert_null (get_string (json, "none"));
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  g_test_add_func ("/protocol/json-value-size", test_json_value_size);
+  g_test_add_func ("/protocol/json-find", test_json_find);
+  g_test_add_func ("/protocol/json-get-int", test_json_get_int);
+  g_test_add_func ("/protocol/json-get-string", test_json_get_string);
+
+  return g_test_run ();
+}
@@ -0,0 +1,343 @@
+/* GStreamer
+ * Copyright (C) <2018> Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *     Author: Felipe Magno de Almeida <felipe@expertisesolutions.com.br>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Record index: parsing mediaFileFind.findNextFile replies page by page,
+ * merging recordings found again while they grow, and what is left to
+ * search on the device.
+ */
+
+#include <gst/gst.h>
+#include "gstdmssrecordindex.h"
+
+#include <string.h>
+
+GST_DEBUG_CATEGORY (dmsssrc_debug);
+
+/* 2018-09-22 11:00:00 */
+#define RECORD_TEST_BASE G_GINT64_CONSTANT (1537614000)
+
+static void
+append_info (GString * reply, guint disk, guint cluster, gint64 start,
+    gint64 end)
+{
+  gchar *start_time = gst_dmss_record_index_format_time (start);
+  gchar *end_time = gst_dmss_record_index_format_time (end);
+
+  if (reply->str[reply->len - 1] == '}')
+    g_string_append (reply, ", ");
+  g_string_append_printf (reply, "{ \"Channel\" : 0, \"Cluster\" : %u, "
+      "\"Disk\" : %u, \"EndTime\" : \"%s\", \"FilePath\" : "
+      "\"\\/mnt\\/dvr\\/%u\\/%u.dav\", \"Length\" : 1048576, "
+      "\"StartTime\" : \"%s\", \"Type\" : \"dav\" }", cluster, disk, end_time,
+      disk, cluster, start_time);
+  g_free (start_time);
+  g_free (end_time);
+}
+
+/* A findNextFile reply with n recordings of ten minutes from first on */
+static gchar *
+make_page (guint first, guint n)
+{
+  GString *reply = g_string_new (NULL);
+  guint i;
+
+  g_string_append_printf (reply, "{ \"id\" : 7, \"params\" : { \"found\" : "
+      "%u, \"infos\" : [ ", n);
+  for (i = first; i != first + n; ++i)
+    append_info (reply, 1, i, RECORD_TEST_BASE + i * 600,
+        RECORD_TEST_BASE + (i + 1) * 600);
+  g_string_append (reply, " ] }, \"result\" : true, \"session\" : 1 }");
+
+  return g_string_free (reply, FALSE);
+}
+
+static GArray *
+records_new (void)
+{
+  GArray *records = g_array_new (FALSE, FALSE, sizeof (GstDmssRecord));
+
+  g_array_set_clear_func (records, (GDestroyNotify) gst_dmss_record_clear);
+  return records;
+}
+
+static void
+records_append (GArray * records, guint disk, guint cluster, gint64 start,
+    gint64 end, const gchar * file_path)
+{
+  GstDmssRecord record = { 0, disk, cluster, start, end, 0,
+    g_strdup (file_path)
+  };
+
+  g_array_append_val (records, record);
+}
+
+static void
+test_parse_time (void)
+{
+  gint64 time;
+  gchar *formatted;
+
+  g_assert_true (gst_dmss_record_index_parse_time ("2018-09-22 11:00:00",
+          &time));
+  g_assert_cmpint (time, ==, RECORD_TEST_BASE);
+  formatted = gst_dmss_record_index_format_time (time);
+  g_assert_cmpstr (formatted, ==, "2018-09-22 11:00:00");
+  g_free (formatted);
+
+  g_assert_false (gst_dmss_record_index_parse_time ("2018-09-22", &time));
+  g_assert_false (gst_dmss_record_index_parse_time ("2018-13-40 11:00:00",
+          &time));
+  g_assert_false (gst_dmss_record_index_parse_time (NULL, &time));
+}
+
+static void
+test_parse (void)
+{
+  static const gchar unreadable[] = "{ \"Channel\" : 0, \"Cluster\" : 9, "
+      "\"StartTime\" : \"2018-09-22 11:00:00\" }";
+  GArray *records = records_new ();
+  GstDmssRecord *record;
+  GString *reply;
+
+  reply = g_string_new ("{ \"params\" : { \"found\" : 3, \"infos\" : [ ");
+  append_info (reply, 2, 17, RECORD_TEST_BASE, RECORD_TEST_BASE + 600);
+  g_string_append_printf (reply, ", %s", unreadable);
+  append_info (reply, 3, 18, RECORD_TEST_BASE + 600, RECORD_TEST_BASE + 900);
+  g_string_append (reply, " ] } }");
+
+  // the one without a disk is skipped, the count is the device's
+  g_assert_cmpint (gst_dmss_record_index_parse (reply->str, reply->len,
+          records), ==, 3);
+  g_assert_cmpuint (records->len, ==, 2);
+
+  record = &g_array_index (records, GstDmssRecord, 0);
+  g_assert_cmpuint (record->disk, ==, 2);
+  g_assert_cmpuint (record->cluster, ==, 17);
+  g_assert_cmpint (record->start_time, ==, RECORD_TEST_BASE);
+  g_assert_cmpint (record->end_time, ==, RECORD_TEST_BASE + 600);
+  g_assert_cmpuint (record->length, ==, 1048576);
+  g_assert_cmpstr (record->file_path, ==, "/mnt/dvr/2/17.dav");
+  record = &g_array_index (records, GstDmssRecord, 1);
+  g_assert_cmpuint (record->cluster, ==, 18);
+  g_assert_cmpint (record->end_time, ==, RECORD_TEST_BASE + 900);
+
+  g_string_free (reply, TRUE);
+  g_array_unref (records);
+}
+
+static void
+test_parse_empty (void)
+{
+  static const gchar none[] = "{ \"params\" : { \"found\" : 0 } }";
+  static const gchar error[] = "{ \"error\" : { \"code\" : 268894209 }, "
+      "\"result\" : false }";
+  static const gchar missing[] = "{ \"params\" : { \"found\" : 2 } }";
+  GArray *records = records_new ();
+
+  g_assert_cmpint (gst_dmss_record_index_parse (none, sizeof (none) - 1,
+          records), ==, 0);
+  g_assert_cmpint (gst_dmss_record_index_parse (error, sizeof (error) - 1,
+          records), ==, -1);
+  g_assert_cmpint (gst_dmss_record_index_parse (missing,
+          sizeof (missing) - 1, records), ==, -1);
+  g_assert_cmpuint (records->len, ==, 0);
+
+  g_array_unref (records);
+}
+
+/* The way gst_dmss_session_find_files pages: ask again while a page comes
+ * back full. Returns the number of pages read.
+ */
+static guint
+read_pages (gchar ** pages, GArray * records)
+{
+  gboolean more = TRUE;
+  gint found;
+  guint n;
+
+  for (n = 0; more && pages[n]; ++n) {
+    found = gst_dmss_record_index_parse (pages[n], strlen (pages[n]),
+        records);
+    g_assert_cmpint (found, >=, 0);
+    more = found == GST_DMSS_RECORD_INDEX_PAGE_SIZE;
+  }
+
+  return n;
+}
+
+static void
+test_paging (void)
+{
+  const guint full = GST_DMSS_RECORD_INDEX_PAGE_SIZE;
+  gchar *pages[5];
+  GArray *records = records_new ();
+  guint i;
+
+  pages[0] = make_page (0, full);
+  pages[1] = make_page (full, full);
+  pages[2] = make_page (2 * full, 5);
+  // never asked for, the page before was short
+  pages[3] = make_page (2 * full + 5, full);
+  pages[4] = NULL;
+
+  g_assert_cmpuint (read_pages (pages, records), ==, 3);
+  g_assert_cmpuint (records->len, ==, 2 * full + 5);
+  for (i = 0; i != records->len; ++i)
+    g_assert_cmpuint (g_array_index (records, GstDmssRecord, i).cluster, ==,
+        i);
+  g_array_set_size (records, 0);
+
+  // exactly a page, the next one comes back empty
+  g_free (pages[1]);
+  pages[1] = make_page (full, 0);
+  g_assert_cmpuint (read_pages (pages, records), ==, 2);
+  g_assert_cmpuint (records->len, ==, full);
+
+  for (i = 0; pages[i]; ++i)
+    g_free (pages[i]);
+  g_array_unref (records);
+}
+
+static void
+test_merge_growing (void)
+{
+  GstDmssRecordIndex *index = gst_dmss_record_index_new ();
+  GArray *records = records_new (), *found;
+  GstDmssRecord record;
+  gint64 search_start, search_end;
+
+  // one recording still going, another disk starting at the same time
+  records_append (records, 1, 10, 1000, 1600, "/a.dav");
+  records_append (records, 2, 20, 1000, 1300, "/b.dav");
+  records_append (records, 1, 11, 400, 1000, "/c.dav");
+  gst_dmss_record_index_add (index, 0, 0, 3600, records);
+  g_array_set_size (records, 0);
+
+  // only searched up to the newest end, the rest is asked for again
+  g_assert_true (gst_dmss_record_index_get_missing (index, 0, 0, 3600,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 1600);
+  g_assert_cmpint (search_end, ==, 3600);
+
+  records_append (records, 1, 10, 1000, 2200, "/a2.dav");
+  gst_dmss_record_index_add (index, 0, search_start, search_end, records);
+
+  found = gst_dmss_record_index_query (index, 0, 0, 3600);
+  g_assert_cmpuint (found->len, ==, 3);
+  g_assert_cmpuint (g_array_index (found, GstDmssRecord, 0).cluster, ==, 11);
+  g_assert_cmpuint (g_array_index (found, GstDmssRecord, 1).cluster, ==, 10);
+  g_assert_cmpint (g_array_index (found, GstDmssRecord, 1).end_time, ==,
+      2200);
+  g_assert_cmpstr (g_array_index (found, GstDmssRecord, 1).file_path, ==,
+      "/a2.dav");
+  g_assert_cmpuint (g_array_index (found, GstDmssRecord, 2).cluster, ==, 20);
+  g_array_unref (found);
+
+  // past the end of the other disk's recording, only the grown one has it
+  g_assert_true (gst_dmss_record_index_lookup (index, 0, 2000, &record));
+  g_assert_cmpuint (record.cluster, ==, 10);
+  gst_dmss_record_clear (&record);
+  found = gst_dmss_record_index_query (index, 0, 1800, 1900);
+  g_assert_cmpuint (found->len, ==, 1);
+  g_array_unref (found);
+
+  // before anything was recorded, the first recording after
+  g_assert_true (gst_dmss_record_index_lookup (index, 0, 100, &record));
+  g_assert_cmpuint (record.cluster, ==, 11);
+  gst_dmss_record_clear (&record);
+  g_assert_false (gst_dmss_record_index_lookup (index, 0, 2200, &record));
+  g_assert_false (gst_dmss_record_index_lookup (index, 1, 1000, &record));
+
+  g_array_unref (records);
+  gst_dmss_record_index_free (index);
+}
+
+static void
+test_missing (void)
+{
+  GstDmssRecordIndex *index = gst_dmss_record_index_new ();
+  GArray *records = records_new ();
+  gint64 search_start, search_end;
+
+  // nothing searched yet
+  g_assert_true (gst_dmss_record_index_get_missing (index, 0, 1500, 3500,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 1500);
+  g_assert_cmpint (search_end, ==, 3500);
+
+  records_append (records, 1, 1, 1000, 2000, NULL);
+  records_append (records, 1, 2, 3000, 4000, NULL);
+  gst_dmss_record_index_add (index, 0, 1000, 5000, records);
+  g_array_set_size (records, 0);
+
+  g_assert_false (gst_dmss_record_index_get_missing (index, 0, 1500, 3500,
+          &search_start, &search_end));
+
+  g_assert_true (gst_dmss_record_index_get_missing (index, 0, 500, 3500,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 500);
+  g_assert_cmpint (search_end, ==, 1000);
+
+  // the last recording reaches the searched end and may still grow
+  g_assert_true (gst_dmss_record_index_get_missing (index, 0, 1500, 6000,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 3000);
+  g_assert_cmpint (search_end, ==, 6000);
+
+  // both sides make one range, the gap included
+  g_assert_true (gst_dmss_record_index_get_missing (index, 0, 500, 6000,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 500);
+  g_assert_cmpint (search_end, ==, 6000);
+
+  // channels are kept apart
+  g_assert_true (gst_dmss_record_index_get_missing (index, 1, 1500, 3500,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 1500);
+
+  // the last one to start ended before an earlier long one
+  records_append (records, 1, 3, 1000, 4000, NULL);
+  records_append (records, 1, 4, 2000, 2500, NULL);
+  gst_dmss_record_index_add (index, 2, 1000, 5000, records);
+  g_assert_true (gst_dmss_record_index_get_missing (index, 2, 1500, 6000,
+          &search_start, &search_end));
+  g_assert_cmpint (search_start, ==, 4000);
+  g_assert_cmpint (search_end, ==, 6000);
+
+  g_array_unref (records);
+  gst_dmss_record_index_free (index);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (dmsssrc_debug, "dmsssrc", 0, "DMSS Client Source");
+
+  g_test_add_func ("/recordindex/parse-time", test_parse_time);
+  g_test_add_func ("/recordindex/parse", test_parse);
+  g_test_add_func ("/recordindex/parse-empty", test_parse_empty);
+  g_test_add_func ("/recordindex/paging", test_paging);
+  g_test_add_func ("/recordindex/merge-growing", test_merge_growing);
+  g_test_add_func ("/recordindex/missing", test_missing);
+
+  return g_test_run ();
+}